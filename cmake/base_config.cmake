@@ -55,6 +55,12 @@ if(WITH_PROFILING)
   message(STATUS "Including profiling library and source files in the local build.")
 endif()
 
+# Add option to store sparse simulator wavefunctions in std::unordered_map rather than the flat hash table
+option(SPARSE_SIM_STD_HASH_MAP OFF)
+if(SPARSE_SIM_STD_HASH_MAP)
+  message(STATUS "Storing sparse simulator wavefunctions in std::unordered_map.")
+endif()
+
 # Project output target namespace
 set(NAMESPACE qristal)
 
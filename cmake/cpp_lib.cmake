@@ -1,5 +1,8 @@
 set(source_files
   # C++ library source files in alphabetical order
+  src/accelerator_pool.cpp
+  src/adjoint_gradients.cpp
+  src/artifact_writer.cpp
   src/backend_utils.cpp
   src/backend.cpp
   src/backends/hardware/qb/options.cpp
@@ -22,12 +25,16 @@ set(source_files
   src/benchmark/workflows/RotationSweep.cpp
   src/benchmark/workflows/SPAMBenchmark.cpp
   src/benchmark/workflows/WorkflowAddins.cpp
+  src/bit_reversal.cpp
   src/circuit_builder.cpp
+  src/compiled_ir_cache.cpp
   src/jensen_shannon.cpp
   src/optimization/vqee/case_generator.cpp
   src/optimization/vqee/vqee_mlpack.cpp
   src/optimization/vqee/vqee_nlopt.cpp
   src/optimization/vqee/vqee.cpp
+  src/packed_results.cpp
+  src/parameter_shift.cpp
   src/passes/circuit_opt_passes.cpp
   src/passes/gate_deferral_pass.cpp
   src/passes/noise_aware_placement_pass.cpp
@@ -36,9 +43,11 @@ set(source_files
   src/pretranspiler.cpp
   src/primitives.cpp
   src/profiler.cpp
+  src/service_locks.cpp
   src/session_getter_setter.cpp
   src/session_parameter_string_constants.cpp
   src/session.cpp
+  src/shot_sampler.cpp
   src/thread_pool.cpp
   src/utils.cpp
 )
@@ -53,6 +62,9 @@ endif()
 
 set(headers
   # C++ and OpenQASM header files in alphabetical order
+  include/qristal/core/accelerator_pool.hpp
+  include/qristal/core/adjoint_gradients.hpp
+  include/qristal/core/artifact_writer.hpp
   include/qristal/core/backend_utils.hpp
   include/qristal/core/backend.hpp
   include/qristal/core/backends/hardware/qb/qdk.hpp
@@ -79,13 +91,17 @@ set(headers
   include/qristal/core/benchmark/workflows/SimpleCircuitExecution.hpp
   include/qristal/core/benchmark/workflows/SPAMBenchmark.hpp
   include/qristal/core/benchmark/workflows/WorkflowAddins.hpp
+  include/qristal/core/bit_reversal.hpp
   include/qristal/core/circuit_builder.hpp
   include/qristal/core/circuit_builders/exponent.hpp
   include/qristal/core/circuit_builders/ry_encoding.hpp
   include/qristal/core/circuit_language.hpp
+  include/qristal/core/compiled_ir_cache.hpp
   include/qristal/core/cmake_variables.hpp
   include/qristal/core/jensen_shannon.hpp
   include/qristal/core/optimization/vqee/vqee.hpp
+  include/qristal/core/packed_results.hpp
+  include/qristal/core/parameter_shift.hpp
   include/qristal/core/passes/base_pass.hpp
   include/qristal/core/passes/circuit_opt_passes.hpp
   include/qristal/core/passes/gate_deferral_pass.hpp
@@ -98,7 +114,9 @@ set(headers
   include/qristal/core/profiler.hpp
   include/qristal/core/qristal.inc
   include/qristal/core/remote_async_accelerator.hpp
+  include/qristal/core/service_locks.hpp
   include/qristal/core/session.hpp
+  include/qristal/core/shot_sampler.hpp
   include/qristal/core/thread_pool.hpp
   include/qristal/core/utils.hpp
   include/qristal/core/wait_until.hpp
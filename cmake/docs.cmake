@@ -29,6 +29,8 @@ set(PUBLIC_HEADERS
   include/qristal/core/backends/hardware/qb/visitor_ACZ.hpp
   include/qristal/core/cudaq/ir_converter.hpp
   include/qristal/core/cudaq/sim_pool.hpp
+  include/qristal/core/noise_model/compiled_noise_model.hpp
+  include/qristal/core/noise_model/kraus_matrix.hpp
   include/qristal/core/noise_model/noise_model.hpp
   include/qristal/core/noise_model/noise_properties.hpp
   include/qristal/core/noise_model/readout_error.hpp
@@ -57,6 +57,21 @@ if(WITH_EXAMPLES)
   add_example(noise_model_custom_parameterized SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/noise_model_custom_parameterized/noise_model_custom_parameterized.cpp)
   add_example(noise_model_custom_channel_qb_gateset SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/noise_model_custom_channel_qb_gateset/noise_model_custom_channel_qb_gateset.cpp)
   add_example(qft SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/qft/qft.cpp)
+  add_example(accelerator_pool_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/accelerator_pool_benchmark/accelerator_pool_benchmark.cpp)
+  add_example(adjoint_gradients_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/adjoint_gradients_benchmark/adjoint_gradients_benchmark.cpp)
+  add_example(bit_reversal_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/bit_reversal_benchmark/bit_reversal_benchmark.cpp)
+  add_example(compiled_ir_cache_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/compiled_ir_cache_benchmark/compiled_ir_cache_benchmark.cpp)
+  add_example(draw_shots_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/draw_shots_benchmark/draw_shots_benchmark.cpp)
+  add_example(lazy_outputs_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/lazy_outputs_benchmark/lazy_outputs_benchmark.cpp)
+  add_example(noise_lookup_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/noise_lookup_benchmark/noise_lookup_benchmark.cpp)
+  add_example(packed_results_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/packed_results_benchmark/packed_results_benchmark.cpp)
+  add_example(run_batch_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/run_batch_benchmark/run_batch_benchmark.cpp)
+  add_example(sparse_dense_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/sparse_dense_benchmark/sparse_dense_benchmark.cpp)
+  add_example(sparse_fusion_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/sparse_fusion_benchmark/sparse_fusion_benchmark.cpp)
+  add_example(sparse_sampling_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/sparse_sampling_benchmark/sparse_sampling_benchmark.cpp)
+  add_example(sparse_threads_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/sparse_threads_benchmark/sparse_threads_benchmark.cpp)
+  add_example(sparse_wavefunction_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/sparse_wavefunction_benchmark/sparse_wavefunction_benchmark.cpp)
+  add_example(thread_pool_benchmark SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/thread_pool_benchmark/thread_pool_benchmark.cpp)
   if (WITH_CUDAQ)
     add_example(benchmark1_qasm SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/benchmark1_qasm/benchmark1_qasm.cpp)
     add_example(benchmark1_cudaq CUDAQ SOURCES ${CMAKE_CURRENT_SOURCE_DIR}/examples/cpp/benchmark1_cudaq/benchmark1_cudaq.cpp)
@@ -1,11 +1,15 @@
 set(source_files
+  src/noise_model/compiled_noise_model.cpp
   src/noise_model/noise_channel.cpp
   src/noise_model/noise_model.cpp
   src/noise_model/default_noise_model.cpp
+  src/noise_model/kraus_matrix.cpp
 )
 
 set(headers
+  include/qristal/core/noise_model/compiled_noise_model.hpp
   include/qristal/core/noise_model/json_complex_convert.hpp
+  include/qristal/core/noise_model/kraus_matrix.hpp
   include/qristal/core/noise_model/noise_channel.hpp
   include/qristal/core/noise_model/noise_model.hpp
   include/qristal/core/noise_model/noise_properties.hpp
@@ -60,6 +60,7 @@ set(test_sources
   tests/misc_cpp/error_mitigation.cpp
   tests/misc_cpp/gateDeferralTester.cpp
   tests/misc_cpp/jensen_shannon.cpp
+  tests/misc_cpp/profilerTester.cpp
   tests/misc_cpp/sessionTester.cpp
   tests/misc_cpp/transpilationTester.cpp
   tests/misc_cpp/XaccInitialisedTests.cpp
@@ -139,11 +139,17 @@ add_xacc_plugin(sparse_simulator
     src/backends/sims/microsoft/sparse-sim/SparseStateVecAccelerator.cpp
   HEADERS
     include/qristal/core/backends/sims/microsoft/sparse-sim/basic_quantum_state.hpp
+    include/qristal/core/backends/sims/microsoft/sparse-sim/flat_wavefunction.hpp
     include/qristal/core/backends/sims/microsoft/sparse-sim/gates.h
     include/qristal/core/backends/sims/microsoft/sparse-sim/quantum_state.hpp
     include/qristal/core/backends/sims/microsoft/sparse-sim/SparseSimulator.h
     include/qristal/core/backends/sims/microsoft/sparse-sim/types.h
+  DEPENDENCIES
+    qristal::core
 )
+if (SPARSE_SIM_STD_HASH_MAP)
+  target_compile_definitions(sparse_simulator PUBLIC SPARSE_SIM_STD_HASH_MAP)
+endif()
 
 # UCSSD quantum chemistry
 add_xacc_plugin(uccsd
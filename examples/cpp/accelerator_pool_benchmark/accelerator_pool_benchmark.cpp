@@ -0,0 +1,59 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/accelerator_pool.hpp>
+#include <qristal/core/circuit_builder.hpp>
+#include <qristal/core/session.hpp>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Time many runs of a small circuit, and print the mean setup time of the accelerator and the mean total time per run
+void time_runs(qristal::session& s, size_t repeats, const std::string& label)
+{
+  auto& pool = qristal::accelerator_pool::get_instance();
+  pool.clear();
+  pool.reset_counters();
+
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < repeats; i++) s.run();
+  const double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  const double setup_ms = pool.new_setup_time_ms() + pool.reused_setup_time_ms();
+
+  std::cout << std::fixed << std::setprecision(4)
+            << label << "mean setup time per run " << setup_ms / repeats << " ms, mean total time per run "
+            << total_ms / repeats << " ms (" << pool.hits() << " accelerators reused)" << std::endl;
+}
+
+int main()
+{
+  constexpr size_t qubits = 2;
+  constexpr size_t repeats = 500;
+
+  // A Bell pair: small enough that setting up the accelerator is a noticeable share of each run
+  qristal::CircuitBuilder circuit;
+  circuit.H(0);
+  circuit.CNOT(0, 1);
+  circuit.MeasureAll(qubits);
+
+  auto& pool = qristal::accelerator_pool::get_instance();
+
+  for (const std::string acc : {"sparse-sim", "qpp"})
+  {
+    qristal::session s;
+    s.acc = acc;
+    s.qn = qubits;
+    s.sn = 100;
+    s.noplacement = true;
+    s.irtarget = circuit.get();
+
+    std::cout << repeats << " runs of a " << qubits << "-qubit circuit on " << acc << std::endl;
+    pool.set_capacity(0);
+    time_runs(s, repeats, "  Accelerator pool disabled: ");
+    pool.set_capacity(16);
+    time_runs(s, repeats, "  Accelerator pool enabled:  ");
+    std::cout << std::endl;
+  }
+}
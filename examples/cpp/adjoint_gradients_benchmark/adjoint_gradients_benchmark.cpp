@@ -0,0 +1,78 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/circuit_builder.hpp>
+#include <qristal/core/session.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Run the session and print the time taken, in milliseconds
+void timed_run(const std::string& label, qristal::session& s)
+{
+  const auto start = std::chrono::steady_clock::now();
+  s.run();
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::cout << std::fixed << std::setprecision(1) << label << ms << " ms" << std::endl;
+}
+
+int main()
+{
+  constexpr size_t qubits = 8;
+  constexpr size_t layers = 3;
+  constexpr size_t shots = 100000;
+
+  // Layers of parametrised RY rotations, each followed by a chain of CNOTs
+  qristal::CircuitBuilder circuit;
+  std::vector<double> parameters;
+  for (size_t l = 0; l < layers; l++)
+  {
+    for (size_t q = 0; q < qubits; q++)
+    {
+      circuit.RY(q, "theta_" + std::to_string(l) + "_" + std::to_string(q));
+      parameters.push_back(0.1 + 0.2 * parameters.size());
+    }
+    for (size_t q = 0; q + 1 < qubits; q++) circuit.CNOT(q, q + 1);
+  }
+  circuit.MeasureAll(qubits);
+
+  qristal::session s;
+  s.acc = "qpp";
+  s.qn = qubits;
+  s.sn = shots;
+  s.seed = 42;
+  s.output_oqm_enabled = false;
+  s.irtarget = circuit.get();
+  s.circuit_parameters = parameters;
+  s.calc_gradients = true;
+
+  std::cout << "Gradients of all " << (1 << qubits) << " bitstring probabilities of a " << qubits << "-qubit circuit "
+            << "with " << parameters.size() << " parameters" << std::endl << std::endl;
+
+  s.gradient_method = "parameter-shift";
+  timed_run("Parameter shift, " + std::to_string(shots) + " shots per shifted circuit: ", s);
+  const std::vector<std::vector<double>> shifted = s.all_bitstring_probability_gradients();
+
+  s.gradient_method = "adjoint";
+  timed_run("Adjoint, exact:                                      ", s);
+  const std::vector<std::vector<double>> exact = s.all_bitstring_probability_gradients();
+
+  double max_difference = 0;
+  for (size_t p = 0; p < exact.size(); p++)
+  {
+    for (size_t i = 0; i < exact[p].size(); i++) max_difference = std::max(max_difference, std::abs(exact[p][i] - shifted[p][i]));
+  }
+  std::cout << std::scientific << std::setprecision(2) << "Largest difference: " << max_difference
+            << " (shot noise is about " << 1 / std::sqrt(shots) << ")" << std::endl << std::endl;
+
+  // The gradients of an observable take a single backward pass, however many parameters there are
+  std::string observable;
+  for (size_t q = 0; q + 1 < qubits; q++) observable += (q ? " + 1.0 Z" : "1.0 Z") + std::to_string(q) + " Z" + std::to_string(q + 1);
+  s.gradient_observable = observable;
+  timed_run("Adjoint gradients of " + observable + ": ", s);
+  std::cout << std::setprecision(6) << "Expectation value: " << s.observable_expectation() << std::endl;
+}
@@ -0,0 +1,63 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/bit_reversal.hpp>
+
+#include <chrono>
+#include <complex>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Reorder a state vector by copying it and building a bit vector for every index, as session::run used to
+void copy_with_bit_vectors(std::vector<std::complex<double>>& state_vec, size_t qubits)
+{
+  std::vector<std::complex<double>> state_vec_tmp = state_vec;
+  for (size_t i = 0; i < state_vec.size(); i++)
+  {
+    std::vector<bool> vb;
+    for (size_t j = 0; j < qubits; j++) vb.emplace_back((i >> j) & 1);
+    size_t index = 0;
+    for (size_t j = 0; j < vb.size(); j++) if (vb[j]) index |= size_t(1) << (vb.size() - j - 1);
+    state_vec_tmp[index] = state_vec.at(i);
+  }
+  state_vec = state_vec_tmp;
+}
+
+// Print the time taken since start, in milliseconds
+void report(const std::string& label, std::chrono::steady_clock::time_point start)
+{
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::cout << std::fixed << std::setprecision(2) << std::setw(12) << ms << " ms  " << label << std::flush;
+}
+
+int main(int argc, char * argv[])
+{
+  // A 30-qubit state vector takes 16 GiB, so the largest size can be lowered on the command line
+  const size_t max_qubits = argc > 1 ? std::stoul(argv[1]) : 30;
+  constexpr size_t max_copy_qubits = 24;
+
+  std::cout << "Reversing the bits of the indices of state vectors" << std::endl << std::endl;
+  for (size_t qubits = 16; qubits <= max_qubits; qubits++)
+  {
+    std::vector<std::complex<double>> state_vec(size_t(1) << qubits);
+    for (size_t i = 0; i < state_vec.size(); i++) state_vec[i] = {double(i), 0.0};
+    std::cout << std::setw(2) << qubits << " qubits: ";
+
+    auto start = std::chrono::steady_clock::now();
+    qristal::bit_reverse_permute(state_vec);
+    report("in place", start);
+
+    // Building bit vectors is too slow to run at every size in reasonable time
+    if (qubits <= max_copy_qubits)
+    {
+      start = std::chrono::steady_clock::now();
+      copy_with_bit_vectors(state_vec, qubits);
+      report("copying with bit vectors", start);
+    }
+    std::cout << std::endl;
+
+    // Reversing twice restores the original order
+    if (state_vec[1].real() != 1.0) std::cout << "Bit reversal failed!" << std::endl;
+  }
+}
@@ -0,0 +1,77 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/compiled_ir_cache.hpp>
+#include <qristal/core/session.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Build a moderately deep OpenQASM circuit, so that compilation takes a noticeable share of each run
+std::string make_circuit(size_t qubits, size_t layers)
+{
+  std::ostringstream circuit;
+  circuit << "__qpu__ void qristal_circuit(qreg q)\n{\n  OPENQASM 2.0;\n  include \"qelib1.inc\";\n";
+  circuit << "  creg c[" << qubits << "];\n";
+  for (size_t l = 0; l < layers; l++)
+  {
+    for (size_t q = 0; q < qubits; q++) circuit << "  rx(" << 0.01 * (l + q + 1) << ") q[" << q << "];\n";
+    for (size_t q = 0; q + 1 < qubits; q++) circuit << "  cx q[" << q << "],q[" << q + 1 << "];\n";
+  }
+  for (size_t q = 0; q < qubits; q++) circuit << "  measure q[" << q << "] -> c[" << q << "];\n";
+  circuit << "}\n";
+  return circuit.str();
+}
+
+// Run the same circuit repeatedly with varying shot counts, and return the median time per run in milliseconds
+double time_runs(qristal::session& s, size_t repeats)
+{
+  std::vector<double> times;
+  for (size_t i = 0; i < repeats; i++)
+  {
+    s.sn = 64 + i % 3;
+    const auto start = std::chrono::steady_clock::now();
+    s.run();
+    times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size()/2];
+}
+
+int main()
+{
+  constexpr size_t qubits = 8;
+  constexpr size_t layers = 40;
+  constexpr size_t repeats = 50;
+
+  qristal::session s;
+  s.acc = "qpp";
+  s.qn = qubits;
+  s.noplacement = true;
+  s.nooptimise = true;
+  s.instring = make_circuit(qubits, layers);
+
+  auto& cache = qristal::compiled_ir_cache::get_instance();
+
+  std::cout << "Repeated runs of a " << qubits << "-qubit, " << layers << "-layer circuit on qpp, "
+            << repeats << " runs each" << std::endl << std::endl;
+
+  // Without the cache
+  cache.set_capacity(0);
+  const double uncached_ms = time_runs(s, repeats);
+
+  // With the cache; the first run fills it
+  cache.set_capacity(256);
+  cache.clear();
+  cache.reset_counters();
+  const double cached_ms = time_runs(s, repeats);
+
+  std::cout << std::fixed << std::setprecision(3)
+            << "Median time per run, cache disabled: " << uncached_ms << " ms" << std::endl
+            << "Median time per run, cache enabled:  " << cached_ms << " ms" << std::endl
+            << "Cache hits: " << cache.hits() << ", misses: " << cache.misses() << std::endl;
+}
@@ -0,0 +1,84 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/circuit_builder.hpp>
+#include <qristal/core/session.hpp>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+// Draw (and remove) a single shot by walking the results map from the start, as session::draw_shot used to
+std::vector<bool> linear_scan_draw(std::map<std::vector<bool>, int>& results, size_t& shots_remaining, std::mt19937& rng)
+{
+  std::uniform_int_distribution<size_t> gen_shot_index(0, shots_remaining - 1);
+  const size_t shot_index = gen_shot_index(rng);
+  size_t sum = 0;
+  std::vector<bool> bitvec;
+  for (auto entry = results.begin(); entry != results.end(); ++entry)
+  {
+    sum += entry->second;
+    if (sum > shot_index)
+    {
+      bitvec = entry->first;
+      if (--(entry->second) == 0) results.erase(entry);
+      break;
+    }
+  }
+  shots_remaining--;
+  return bitvec;
+}
+
+// Print the mean time per shot, in microseconds
+void report(const std::string& label, std::chrono::steady_clock::time_point start, size_t shots)
+{
+  const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  std::cout << std::fixed << std::setprecision(4) << label << us / shots << " us per shot" << std::endl;
+}
+
+int main()
+{
+  constexpr size_t qubits = 12;
+  constexpr size_t shots = 200000;
+  constexpr size_t linear_scan_shots = 10000;
+
+  // Equal superposition, so that every one of the 2^12 outcomes turns up in the results
+  qristal::CircuitBuilder circuit;
+  for (size_t q = 0; q < qubits; q++) circuit.H(q);
+  circuit.MeasureAll(qubits);
+
+  qristal::session s;
+  s.acc = "qpp";
+  s.qn = qubits;
+  s.sn = shots;
+  s.seed = 42;
+  s.output_oqm_enabled = false;
+  s.irtarget = circuit.get();
+  s.run();
+
+  std::cout << "Drawing shots from " << shots << " shots of a " << qubits << "-qubit circuit, with "
+            << s.results().size() << " distinct outcomes" << std::endl << std::endl;
+
+  // Walking the results map is too slow to draw every shot in reasonable time, so only time some of them
+  std::map<std::vector<bool>, int> results = s.results();
+  size_t shots_remaining = shots;
+  std::mt19937 rng(42);
+  size_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < linear_scan_shots; i++) checksum += linear_scan_draw(results, shots_remaining, rng)[0];
+  report("Walking the results map for each shot: ", start, linear_scan_shots);
+
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < shots; i++) checksum += s.draw_shot()[0];
+  report("session::draw_shot:                    ", start, shots);
+
+  // Run again to refill the shots
+  s.run();
+  start = std::chrono::steady_clock::now();
+  for (const auto& shot : s.draw_shots(shots)) checksum += shot[0];
+  report("session::draw_shots:                   ", start, shots);
+
+  if (checksum == 0) std::cout << "No shots measured 1 on qubit 0." << std::endl;
+}
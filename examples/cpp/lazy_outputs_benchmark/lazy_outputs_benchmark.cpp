@@ -0,0 +1,61 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/circuit_builder.hpp>
+#include <qristal/core/session.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Run the circuit repeatedly, optionally reading the transpiled circuit, resource estimates and Z-operator
+// expectation value after each run, and return the median time per run in milliseconds
+double time_runs(qristal::session& s, size_t repeats, bool read_outputs)
+{
+  std::vector<double> times;
+  double checksum = 0;
+  for (size_t i = 0; i < repeats; i++)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    s.run();
+    if (read_outputs)
+    {
+      checksum += s.transpiled_circuit().size();
+      checksum += s.timing_estimates()[0];
+      checksum += s.z_op_expectation();
+    }
+    times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+  if (checksum < 0) std::cout << checksum << std::endl;
+  std::sort(times.begin(), times.end());
+  return times[times.size()/2];
+}
+
+int main()
+{
+  constexpr size_t qubits = 4;
+  constexpr size_t repeats = 200;
+
+  // A small circuit, for which post-processing can easily take longer than simulation
+  qristal::CircuitBuilder circuit;
+  for (size_t q = 0; q < qubits; q++) circuit.H(q);
+  for (size_t q = 0; q + 1 < qubits; q++) circuit.CNOT(q, q + 1);
+  for (size_t q = 0; q < qubits; q++) circuit.RZ(q, 0.1 * (q + 1));
+  circuit.MeasureAll(qubits);
+
+  qristal::session s;
+  s.acc = "qpp";
+  s.qn = qubits;
+  s.sn = 100;
+  s.irtarget = circuit.get();
+
+  std::cout << repeats << " runs of a " << qubits << "-qubit circuit on qpp" << std::endl << std::endl;
+
+  const double unread_ms = time_runs(s, repeats, false);
+  const double read_ms = time_runs(s, repeats, true);
+
+  std::cout << std::fixed << std::setprecision(3)
+            << "Median time per run, outputs never read:           " << unread_ms << " ms" << std::endl
+            << "Median time per run, outputs read after every run: " << read_ms << " ms" << std::endl;
+}
@@ -0,0 +1,98 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/noise_model/compiled_noise_model.hpp>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// A gate of a random circuit, as a simulator sees it
+struct gate
+{
+  std::string name;
+  std::vector<size_t> qubits;
+  size_t index;
+};
+
+// Time a lookup of the noise channels of every gate of a circuit, repeated for a number of trajectories, and
+// return the time in nanoseconds per lookup and the total number of channels found
+template <typename Lookup>
+std::pair<double, size_t> time_lookups(const std::vector<gate>& circuit, size_t trajectories, const Lookup& lookup)
+{
+  size_t found = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t t = 0; t < trajectories; t++)
+  {
+    for (const gate& g : circuit)
+    {
+      const std::vector<qristal::NoiseChannel>* channels = lookup(g);
+      if (channels) found += channels->size();
+    }
+  }
+  const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  return {ns / (circuit.size() * trajectories), found};
+}
+
+int main()
+{
+  constexpr size_t qubits = 32;
+  constexpr size_t gates = 10000;
+  constexpr size_t trajectories = 200;
+
+  // The default noise model, with noise on every single-qubit gate and on CNOTs between every pair of qubits
+  const qristal::NoiseModel noise_model("default", qubits);
+  const auto start = std::chrono::steady_clock::now();
+  const qristal::CompiledNoiseModel compiled(noise_model);
+  const double compile_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  // A random circuit of the basis gates of the model; gate indices are resolved once, as when a circuit is prepared
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> qubit(0, qubits - 1);
+  const std::vector<std::string> names{"u1", "u2", "u3", "cx"};
+  std::vector<gate> circuit;
+  for (size_t i = 0; i < gates; i++)
+  {
+    gate g{names[rng() % names.size()], {qubit(rng)}, 0};
+    if (g.name == "cx")
+    {
+      size_t target;
+      do target = qubit(rng); while (target == g.qubits[0]);
+      g.qubits.push_back(target);
+    }
+    g.index = compiled.gate_index(g.name);
+    circuit.push_back(g);
+  }
+
+  // Look up channels by gate name and operands in the noise model, as the map is laid out
+  const auto& noise_channels = noise_model.get_noise_channels();
+  const auto [map_ns, map_found] = time_lookups(circuit, trajectories, [&](const gate& g)
+  {
+    const auto by_name = noise_channels.find(g.name);
+    if (by_name == noise_channels.end()) return static_cast<const std::vector<qristal::NoiseChannel>*>(nullptr);
+    auto by_qubits = by_name->second.find(g.qubits);
+    if (by_qubits == by_name->second.end()) by_qubits = by_name->second.find({});
+    return by_qubits == by_name->second.end() ? nullptr : &by_qubits->second;
+  });
+
+  // Look up channels by gate index and operands in the compiled model
+  const auto [compiled_ns, compiled_found] = time_lookups(circuit, trajectories, [&](const gate& g)
+  {
+    return compiled.channels(g.index, g.qubits);
+  });
+
+  std::cout << "Noise channel lookups for " << trajectories << " trajectories of a " << gates << "-gate circuit on "
+            << qubits << " qubits, default noise model" << std::endl << std::endl
+            << std::fixed << std::setprecision(1)
+            << "Compiling the noise model: " << compile_ms << " ms" << std::endl
+            << "Noise model lookup:        " << map_ns << " ns per gate" << std::endl
+            << "Compiled model lookup:     " << compiled_ns << " ns per gate" << std::endl
+            << std::setprecision(2) << "Speedup: " << map_ns / compiled_ns << "x" << std::endl;
+  if (map_found != compiled_found)
+  {
+    std::cout << "Error: the lookups found " << map_found << " and " << compiled_found << " channels." << std::endl;
+    return 1;
+  }
+}
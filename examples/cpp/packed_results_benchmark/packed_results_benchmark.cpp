@@ -0,0 +1,96 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/packed_results.hpp>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// Convert backend counts to a map of std::vector<bool>, as session::populate_measure_counts_data used to
+std::map<std::vector<bool>, int> to_results_map(const std::map<std::string, int>& counts, size_t n_bits)
+{
+  std::map<std::vector<bool>, int> results;
+  for (const auto& [bitstring, count] : counts)
+  {
+    std::vector<bool> bitvector(n_bits);
+    for (size_t i = 0; i < n_bits; i++) bitvector.at(n_bits - (i+1)) = (bitstring.at(i) != '0');
+    results[bitvector] = count;
+  }
+  return results;
+}
+
+// Print the time taken since start, in milliseconds
+void report(const std::string& label, std::chrono::steady_clock::time_point start)
+{
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::cout << std::fixed << std::setprecision(1) << label << ms << " ms" << std::endl;
+}
+
+int main()
+{
+  constexpr size_t qubits = 40;
+  constexpr size_t outcomes = 1000000;
+
+  // Two sets of distinct random outcomes, as returned by a backend, sharing about half of their outcomes
+  std::mt19937_64 rng(42);
+  std::map<std::string, int> counts_1, counts_2;
+  while (counts_1.size() < outcomes)
+  {
+    const uint64_t r = rng();
+    std::string bitstring(qubits, '0');
+    for (size_t i = 0; i < qubits; i++) if ((r >> i) & 1) bitstring[i] = '1';
+    counts_1.emplace(bitstring, 1 + r % 7);
+    if (rng() % 2 == 0) counts_2.emplace(bitstring, 1 + r % 5);
+    else
+    {
+      std::string other = bitstring;
+      other[0] = (other[0] == '0' ? '1' : '0');
+      counts_2.emplace(other, 1);
+    }
+  }
+  std::cout << "Results of " << outcomes << " distinct outcomes of " << qubits << " qubits" << std::endl << std::endl;
+
+  long long checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::map<std::vector<bool>, int> map_1 = to_results_map(counts_1, qubits);
+  const std::map<std::vector<bool>, int> map_2 = to_results_map(counts_2, qubits);
+  report("Converting to std::map<std::vector<bool>, int>:      ", start);
+
+  start = std::chrono::steady_clock::now();
+  auto packed_1 = qristal::packed_results::from_bitstrings(counts_1, qubits, false);
+  const auto packed_2 = qristal::packed_results::from_bitstrings(counts_2, qubits, false);
+  report("Converting to qristal::packed_results:               ", start);
+
+  start = std::chrono::steady_clock::now();
+  for (const auto& [bits, count] : map_1) checksum += count * bits[0];
+  report("Iterating over std::map<std::vector<bool>, int>:     ", start);
+
+  start = std::chrono::steady_clock::now();
+  for (const auto& [words, count] : packed_1) checksum -= count * (words[0] >> 63);
+  report("Iterating over qristal::packed_results:              ", start);
+
+  start = std::chrono::steady_clock::now();
+  for (const auto& [bits, count] : map_2) map_1[bits] += count;
+  report("Merging std::map<std::vector<bool>, int>:            ", start);
+
+  start = std::chrono::steady_clock::now();
+  packed_1.merge(packed_2);
+  report("Merging qristal::packed_results:                     ", start);
+
+  start = std::chrono::steady_clock::now();
+  const bool same = (packed_1.to_map() == map_1);
+  report("Converting qristal::packed_results back to std::map: ", start);
+
+  // Each map node holds three pointers and a colour, the key and its heap-allocated bits, and the count
+  constexpr size_t map_node_bytes = 4 * sizeof(void*) + sizeof(std::vector<bool>) + sizeof(uint64_t) + sizeof(int);
+  std::cout << std::endl << "Approximate storage after merging: "
+            << map_1.size() * map_node_bytes / (1 << 20) << " MiB (std::map) versus "
+            << packed_1.size() * (packed_1.words_per_outcome() * sizeof(uint64_t) + sizeof(int)) / (1 << 20)
+            << " MiB (packed)" << std::endl;
+
+  if (not same or checksum != 0) std::cout << "Packed results differ from the map!" << std::endl;
+}
@@ -0,0 +1,60 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/circuit_builder.hpp>
+#include <qristal/core/session.hpp>
+#include <qristal/core/thread_pool.hpp>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+int main()
+{
+  constexpr size_t qubits = 5;
+  constexpr size_t num_circuits = 1000;
+  constexpr size_t layers = 4;
+
+  // Make a set of small random circuits
+  std::mt19937 gen(1234);
+  std::uniform_real_distribution<double> angle(0.0, 3.14159);
+  std::vector<qristal::CircuitBuilder> circuits(num_circuits);
+  for (auto& circuit : circuits)
+  {
+    for (size_t l = 0; l < layers; l++)
+    {
+      for (size_t q = 0; q < qubits; q++) circuit.RY(q, angle(gen));
+      for (size_t q = 0; q + 1 < qubits; q++) circuit.CNOT(q, q + 1);
+    }
+    circuit.MeasureAll(qubits);
+  }
+
+  qristal::session s;
+  s.acc = "qpp";
+  s.qn = qubits;
+  s.sn = 256;
+
+  std::cout << "Running " << num_circuits << " " << qubits << "-qubit circuits on qpp, using "
+            << qristal::thread_pool::get_num_threads() << " threads for run_batch" << std::endl << std::endl;
+
+  // One run() per circuit
+  auto start = std::chrono::steady_clock::now();
+  for (auto& circuit : circuits)
+  {
+    s.irtarget = circuit.get();
+    s.run();
+  }
+  const double loop_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // All circuits in one batch
+  s.irtarget.reset();
+  start = std::chrono::steady_clock::now();
+  std::vector<qristal::session> batch = s.run_batch(circuits);
+  const double batch_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << std::fixed << std::setprecision(3)
+            << "session::run in a loop:  " << loop_s << " s" << std::endl
+            << "session::run_batch:      " << batch_s << " s" << std::endl
+            << "Speedup:                 " << std::setprecision(1) << loop_s / batch_s << "x" << std::endl;
+}
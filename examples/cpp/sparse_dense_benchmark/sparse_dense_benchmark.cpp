@@ -0,0 +1,140 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/backends/sims/microsoft/sparse-sim/SparseSimulator.h>
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::Quantum::SPARSESIMULATOR;
+
+// Quantum Fourier transform of a register, or its inverse
+void qft(SparseSimulator& sim, const std::vector<logical_qubit_id>& reg, bool inverse)
+{
+  const size_t n = reg.size();
+  if (not inverse)
+  {
+    for (size_t q = n; q-- > 0;)
+    {
+      sim.H(reg[q]);
+      for (size_t c = q; c-- > 0;) sim.MCR1({reg[c]}, M_PI / std::pow(2.0, q - c), reg[q]);
+    }
+    for (size_t q = 0; q < n / 2; q++) sim.SWAP(reg[q], reg[n - 1 - q]);
+    return;
+  }
+  for (size_t q = 0; q < n / 2; q++) sim.SWAP(reg[q], reg[n - 1 - q]);
+  for (size_t q = 0; q < n; q++)
+  {
+    for (size_t c = 0; c < q; c++) sim.MCR1({reg[c]}, -M_PI / std::pow(2.0, q - c), reg[q]);
+    sim.H(reg[q]);
+  }
+}
+
+// Simulate a circuit with the wavefunction kept sparse, then allowed to become dense, and print the times taken
+// and the number of conversions between the two
+void compare(const std::string& label, logical_qubit_id qubits, const std::function<void(SparseSimulator&)>& circuit)
+{
+  double ms[2];
+  size_t conversions[2];
+  for (const bool hybrid : {false, true})
+  {
+    const auto start = std::chrono::steady_clock::now();
+    SparseSimulator sim(qubits);
+    sim.set_random_seed(42);
+    if (not hybrid) sim.set_dense_threshold(0);
+    circuit(sim);
+    sim.update_state();
+    ms[hybrid] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    conversions[0] = sim.get_dense_conversions();
+    conversions[1] = sim.get_sparse_conversions();
+  }
+  std::cout << std::left << std::setw(36) << label << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << ms[0] << " ms" << std::setw(10) << ms[1] << " ms" << std::setprecision(2)
+            << std::setw(8) << ms[0] / ms[1] << "x" << std::setw(8) << conversions[0] << std::setw(8)
+            << conversions[1] << std::endl;
+}
+
+int main()
+{
+  std::cout << std::left << std::setw(36) << "Circuit" << std::right << std::setw(13) << "sparse" << std::setw(13)
+            << "hybrid" << std::setw(9) << "speedup" << std::setw(8) << "dense" << std::setw(8) << "sparse"
+            << std::endl;
+
+  // Phase estimation of a phase gate, as in the phase estimation circuit: the evaluation register is put in uniform
+  // superposition, then the inverse QFT concentrates it back onto the single basis state of the exact phase
+  constexpr logical_qubit_id eval_qubits = 18;
+  compare("Phase estimation, " + std::to_string(eval_qubits) + " qubits, 3 times:", eval_qubits + 1,
+          [](SparseSimulator& sim)
+  {
+    std::vector<logical_qubit_id> eval(eval_qubits);
+    std::iota(eval.begin(), eval.end(), 0);
+    sim.X(eval_qubits);
+    for (const double phase : {0.3125, 0.71875, 0.28125})
+    {
+      for (logical_qubit_id q : eval) sim.H(q);
+      for (logical_qubit_id q : eval) sim.MCR1({q}, 2 * M_PI * phase * std::pow(2.0, q), eval_qubits);
+      qft(sim, eval, true);
+      sim.update_state();
+      // Uncompute the estimate, back to the all-zero state
+      qft(sim, eval, false);
+      for (logical_qubit_id q : eval) sim.MCR1({q}, -2 * M_PI * phase * std::pow(2.0, q), eval_qubits);
+      for (logical_qubit_id q : eval) sim.H(q);
+    }
+  });
+
+  // Repeated additions of basis states in the Fourier basis: each addition goes into a dense QFT of the target
+  // register and comes back out to a single basis state
+  constexpr logical_qubit_id bits = 16;
+  compare("QFT adder, " + std::to_string(bits) + "-bit registers, 4 times:", 2 * bits, [](SparseSimulator& sim)
+  {
+    std::vector<logical_qubit_id> a(bits), b(bits);
+    std::iota(a.begin(), a.end(), 0);
+    std::iota(b.begin(), b.end(), bits);
+    for (logical_qubit_id q = 0; q < bits; q += 3) sim.X(a[q]);
+    for (int repeat = 0; repeat < 4; repeat++)
+    {
+      qft(sim, b, false);
+      // Add a to b: bit i of a adds 2^i to b, a phase of 2 pi 2^(i + j) / 2^bits on bit j of the transform
+      for (logical_qubit_id i = 0; i < bits; i++)
+      {
+        for (logical_qubit_id j = 0; i + j < bits; j++)
+        {
+          sim.MCR1({a[i]}, 2 * M_PI * std::pow(2.0, double(i + j) - bits), b[j]);
+        }
+      }
+      qft(sim, b, true);
+      sim.update_state();
+    }
+  });
+
+  // Ripple adder of registers in uniform superposition, from controlled increments built of multi-controlled X, as in
+  // the superposition adder: the wavefunction stays half full throughout
+  constexpr logical_qubit_id sum_bits = 9;
+  compare("Adder of " + std::to_string(sum_bits) + "-bit superpositions:", 2 * sum_bits + 1, [](SparseSimulator& sim)
+  {
+    std::vector<logical_qubit_id> a(sum_bits), b(sum_bits + 1);
+    std::iota(a.begin(), a.end(), 0);
+    std::iota(b.begin(), b.end(), sum_bits);
+    for (logical_qubit_id q = 0; q < sum_bits; q++)
+    {
+      sim.H(a[q]);
+      sim.H(b[q]);
+      sim.R(Gates::Basis::PauliY, 0.1 * q, b[q]);
+    }
+    for (logical_qubit_id i = 0; i < sum_bits; i++)
+    {
+      for (logical_qubit_id j = sum_bits + 1; j-- > i;)
+      {
+        std::vector<logical_qubit_id> controls{a[i]};
+        for (logical_qubit_id k = i; k < j; k++) controls.push_back(b[k]);
+        sim.MCX(controls, b[j]);
+      }
+      sim.R(Gates::Basis::PauliX, 0.2, b[i]);
+    }
+  });
+}
@@ -0,0 +1,90 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/backends/sims/microsoft/sparse-sim/SparseSimulator.h>
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::Quantum::SPARSESIMULATOR;
+
+// Number of qubits, all in superposition
+constexpr logical_qubit_id qubits = 16;
+
+// Number of layers of gates
+constexpr int layers = 4;
+
+// A single-qubit gate on a given qubit
+using gate = std::function<void(SparseSimulator&, logical_qubit_id)>;
+
+// Time layers of gates on a dense state, either letting the simulator fuse and queue them, or applying each gate to
+// the wavefunction as soon as it is queued
+double time_circuit(bool fuse, const std::vector<gate>& gates)
+{
+  SparseSimulator sim(qubits);
+  for (logical_qubit_id q = 0; q < qubits; q++) sim.H(q);
+  sim.update_state();
+  // Applies each gate on its own, if fusion is off
+  auto step = [&]() { if (not fuse) sim.update_state(); };
+  const auto start = std::chrono::steady_clock::now();
+  for (int layer = 0; layer < layers; layer++)
+  {
+    for (logical_qubit_id q = 0; q < qubits; q++)
+    {
+      for (const gate& g : gates)
+      {
+        g(sim, q);
+        step();
+      }
+    }
+    for (logical_qubit_id q = 0; q + 1 < qubits; q++)
+    {
+      sim.MCX({q}, q + 1);
+      step();
+    }
+  }
+  sim.update_state();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void compare(const std::string& label, const std::vector<gate>& gates)
+{
+  const double unfused = time_circuit(false, gates);
+  const double fused = time_circuit(true, gates);
+  std::cout << std::left << std::setw(36) << label << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << unfused << " ms" << std::setw(10) << fused << " ms" << std::setprecision(2)
+            << std::setw(8) << unfused / fused << "x" << std::endl;
+}
+
+int main()
+{
+  std::cout << layers << " layers of gates and CNOTs on " << qubits << " qubits in superposition" << std::endl
+            << std::endl;
+  std::cout << std::left << std::setw(36) << "Single-qubit gates on each qubit" << std::right << std::setw(13)
+            << "each gate" << std::setw(13) << "fused" << std::setw(9) << "speedup" << std::endl;
+
+  // Runs of gates that do not commute with the queued H, Rx and Ry gates are fused into one gate
+  compare("H T H S Rx", {
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.H(q); },
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.T(q); },
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.H(q); },
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.S(q); },
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.R(Gates::Basis::PauliX, 0.4, q); }
+  });
+  compare("Rz Ry Rz Rx", {
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.R(Gates::Basis::PauliZ, 0.3, q); },
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.R(Gates::Basis::PauliY, 0.5, q); },
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.R(Gates::Basis::PauliZ, 0.7, q); },
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.R(Gates::Basis::PauliX, 0.9, q); }
+  });
+  // Phases and permutations are applied in place, all together
+  compare("T S Z X", {
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.T(q); },
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.S(q); },
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.Z(q); },
+    [](SparseSimulator& sim, logical_qubit_id q) { sim.X(q); }
+  });
+}
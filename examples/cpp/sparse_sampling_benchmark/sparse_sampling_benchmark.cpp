@@ -0,0 +1,51 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/backends/sims/microsoft/sparse-sim/SparseSimulator.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::Quantum::SPARSESIMULATOR;
+
+// Print the mean time per shot, in microseconds
+void report(const std::string& label, std::chrono::steady_clock::time_point start, size_t shots)
+{
+  const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  std::cout << std::fixed << std::setprecision(4) << label << us / shots << " us per shot" << std::endl;
+}
+
+int main()
+{
+  constexpr logical_qubit_id qubits = 17;
+  constexpr size_t shots = 1000000;
+  constexpr size_t single_shots = 1000;
+
+  // Rotate every qubit by a different angle, giving 2^17 (about 1e5) nonzero amplitudes of different sizes
+  SparseSimulator sim(qubits);
+  sim.set_random_seed(42);
+  std::vector<logical_qubit_id> measured(qubits);
+  std::iota(measured.begin(), measured.end(), 0);
+  for (logical_qubit_id q = 0; q < qubits; q++) sim.R(Gates::Basis::PauliY, 0.5 + 0.1 * q, q);
+  // Apply the queued rotations before timing anything
+  sim.Sample();
+  std::cout << "Drawing " << shots << " shots from a state with " << (size_t(1) << qubits) << " nonzero amplitudes"
+            << std::endl << std::endl;
+
+  // Walking the wavefunction for every shot is too slow to draw every shot in reasonable time, so only time some
+  std::map<std::string, int> counts;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < single_shots; i++) counts[sim.Sample()]++;
+  report("Walking the wavefunction for each shot:  ", start, single_shots);
+
+  size_t distinct = 0;
+  start = std::chrono::steady_clock::now();
+  for (const auto& [outcome, count] : sim.SampleCounts(shots, measured)) distinct += (count > 0);
+  report("Drawing all shots at once:               ", start, shots);
+
+  std::cout << std::endl << distinct << " distinct outcomes drawn" << std::endl;
+}
@@ -0,0 +1,54 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/backends/sims/microsoft/sparse-sim/SparseSimulator.h>
+#include <qristal/core/thread_pool.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+using namespace Microsoft::Quantum::SPARSESIMULATOR;
+
+// Time one layer of H, Ry, CNOT and controlled Rx gates on every qubit of a dense state, split between n_threads
+double time_layer(logical_qubit_id qubits, size_t n_threads)
+{
+  SparseSimulator sim(qubits);
+  sim.set_num_threads(n_threads);
+  // Fill the wavefunction before timing
+  for (logical_qubit_id q = 0; q < qubits; q++) sim.H(q);
+  sim.R(Gates::Basis::PauliZ, 0.1, 0);
+  const auto start = std::chrono::steady_clock::now();
+  for (logical_qubit_id q = 0; q < qubits; q++)
+  {
+    const logical_qubit_id next = (q + 1) % qubits;
+    sim.H(q);
+    sim.R(Gates::Basis::PauliY, 0.3 + 0.01 * q, q);
+    sim.MCX({q}, next);
+    sim.MCR({next}, Gates::Basis::PauliX, 0.7, q);
+  }
+  // Flush any queued rotations
+  sim.R(Gates::Basis::PauliZ, 0.1, 0);
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+  // Number of qubits, all in superposition; 2^20 amplitudes by default
+  const logical_qubit_id qubits = (argc > 1) ? std::atoi(argv[1]) : 20;
+  std::cout << "One layer of gates on " << qubits << " qubits (" << (size_t(1) << qubits) << " amplitudes), "
+            << std::thread::hardware_concurrency() << " hardware threads" << std::endl << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(12) << "time (s)" << std::setw(10) << "speedup" << std::endl;
+
+  double serial = 0;
+  for (size_t n_threads = 1; n_threads <= 32; n_threads *= 2)
+  {
+    // Give the pool a worker for every shard
+    qristal::thread_pool::set_num_threads(n_threads);
+    const double seconds = time_layer(qubits, n_threads);
+    if (n_threads == 1) serial = seconds;
+    std::cout << std::setw(8) << n_threads << std::fixed << std::setprecision(3) << std::setw(12) << seconds
+              << std::setprecision(2) << std::setw(9) << serial / seconds << "x" << std::endl;
+  }
+}
@@ -0,0 +1,92 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/backends/sims/microsoft/sparse-sim/SparseSimulator.h>
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::Quantum::SPARSESIMULATOR;
+
+// Simulate a circuit, and print the time taken and the number of nonzero amplitudes at the end
+void time_circuit(const std::string& label, logical_qubit_id qubits, const std::function<void(SparseSimulator&)>& circuit)
+{
+  const auto start = std::chrono::steady_clock::now();
+  SparseSimulator sim(qubits);
+  sim.set_random_seed(42);
+  circuit(sim);
+  size_t amplitudes = 0;
+  sim.dump_all([&](const char*, double, double) { amplitudes++; return true; });
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::cout << std::left << std::setw(40) << label << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << ms << " ms, " << amplitudes << " nonzero amplitudes" << std::endl;
+}
+
+int main()
+{
+#ifdef SPARSE_SIM_STD_HASH_MAP
+  std::cout << "Sparse simulator wavefunctions stored in std::unordered_map" << std::endl << std::endl;
+#else
+  std::cout << "Sparse simulator wavefunctions stored in flat_wavefunction" << std::endl << std::endl;
+#endif
+
+  // Preparing and unpreparing a GHZ state on many qubits: never more than two amplitudes, so the cost is in
+  // rebuilding small tables on every gate
+  constexpr logical_qubit_id ghz_qubits = 500;
+  time_circuit("GHZ, " + std::to_string(ghz_qubits) + " qubits, 200 times:", ghz_qubits, [](SparseSimulator& sim)
+  {
+    for (int repeat = 0; repeat < 200; repeat++)
+    {
+      sim.H(0);
+      for (logical_qubit_id q = 0; q + 1 < ghz_qubits; q++) sim.MCX({q}, q + 1);
+      sim.R(Gates::Basis::PauliZ, 0.1, ghz_qubits - 1);
+      for (logical_qubit_id q = ghz_qubits - 1; q > 0; q--) sim.MCX({q - 1}, q);
+      sim.H(0);
+    }
+  });
+
+  // Quantum Fourier transform of a sparse input: 4 basis states in, 2^18 amplitudes out
+  constexpr logical_qubit_id qft_qubits = 18;
+  time_circuit("QFT of a sparse input, " + std::to_string(qft_qubits) + " qubits:", qft_qubits, [](SparseSimulator& sim)
+  {
+    sim.X(3);
+    sim.X(11);
+    sim.H(7);
+    sim.H(15);
+    for (logical_qubit_id q = qft_qubits; q-- > 0;)
+    {
+      sim.H(q);
+      for (logical_qubit_id c = q; c-- > 0;) sim.MCR1({c}, M_PI / std::pow(2.0, q - c), q);
+    }
+    for (logical_qubit_id q = 0; q < qft_qubits / 2; q++) sim.SWAP(q, qft_qubits - 1 - q);
+  });
+
+  // Adder b += a on registers in uniform superposition, from controlled increments built of multi-controlled X
+  constexpr logical_qubit_id bits = 8;
+  time_circuit("Adder of " + std::to_string(bits) + "-bit superpositions:", 2 * bits + 1, [](SparseSimulator& sim)
+  {
+    std::vector<logical_qubit_id> a(bits), b(bits + 1);
+    std::iota(a.begin(), a.end(), 0);
+    std::iota(b.begin(), b.end(), bits);
+    for (logical_qubit_id q = 0; q < bits; q++)
+    {
+      sim.H(a[q]);
+      sim.H(b[q]);
+    }
+    for (logical_qubit_id i = 0; i < bits; i++)
+    {
+      // Add 2^i to b if a_i is 1, flipping the highest bits first so that the carries see the old values
+      for (logical_qubit_id j = bits + 1; j-- > i;)
+      {
+        std::vector<logical_qubit_id> controls{a[i]};
+        for (logical_qubit_id k = i; k < j; k++) controls.push_back(b[k]);
+        sim.MCX(controls, b[j]);
+      }
+    }
+  });
+}
@@ -0,0 +1,100 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/thread_pool.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+// Print the median, 99th percentile and maximum of a set of latencies, in microseconds
+void print_latencies(std::string_view label, std::vector<double> latencies)
+{
+  std::sort(latencies.begin(), latencies.end());
+  std::cout << std::left << std::setw(36) << label << std::right << std::fixed << std::setprecision(1)
+            << "median " << std::setw(9) << latencies[latencies.size()/2] << " us"
+            << "   p99 " << std::setw(9) << latencies[latencies.size()*99/100] << " us"
+            << "   max " << std::setw(9) << latencies.back() << " us" << std::endl;
+}
+
+int main()
+{
+  constexpr int idle_seconds = 2;
+  constexpr size_t num_single_tasks = 2000;
+  constexpr size_t num_burst_tasks = 100000;
+
+  const int threads = qristal::thread_pool::get_num_threads();
+  std::cout << "Threads in pool: " << threads << std::endl << std::endl;
+
+  // 1. Idle CPU use. Make sure the pool has been started, then leave it alone and measure how much CPU time the
+  //    process burns while the main thread sleeps.
+  qristal::thread_pool::submit([]{ return 0; }).get();
+  const std::clock_t cpu_start = std::clock();
+  std::this_thread::sleep_for(std::chrono::seconds(idle_seconds));
+  const double cpu_seconds = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+  std::cout << "Idle pool CPU use over " << idle_seconds << " s of wall time: " << std::setprecision(4)
+            << cpu_seconds << " s of CPU time (" << 100.0 * cpu_seconds / idle_seconds << "% of one core)"
+            << std::endl << std::endl;
+
+  // 2. Submit-to-start latency for single tasks submitted to a sleeping pool, one at a time.
+  std::vector<double> latencies;
+  latencies.reserve(num_single_tasks);
+  for (size_t i = 0; i < num_single_tasks; i++)
+  {
+    const auto submitted = clock_type::now();
+    auto started = qristal::thread_pool::submit([]{ return clock_type::now(); }).get();
+    latencies.push_back(std::chrono::duration<double, std::micro>(started - submitted).count());
+    // Give the workers time to go back to sleep
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  print_latencies("Single task, sleeping pool:", latencies);
+
+  // 3. Submit-to-start latency and throughput for a burst of tiny tasks submitted all at once.
+  std::vector<std::future<clock_type::time_point>> futures;
+  std::vector<clock_type::time_point> submit_times;
+  futures.reserve(num_burst_tasks);
+  submit_times.reserve(num_burst_tasks);
+  const auto burst_start = clock_type::now();
+  for (size_t i = 0; i < num_burst_tasks; i++)
+  {
+    submit_times.push_back(clock_type::now());
+    futures.push_back(qristal::thread_pool::submit([]{ return clock_type::now(); }));
+  }
+  latencies.clear();
+  for (size_t i = 0; i < num_burst_tasks; i++)
+  {
+    latencies.push_back(std::chrono::duration<double, std::micro>(futures[i].get() - submit_times[i]).count());
+  }
+  const double burst_ms = std::chrono::duration<double, std::milli>(clock_type::now() - burst_start).count();
+  print_latencies("Burst of tasks:", latencies);
+  std::cout << "Burst throughput: " << std::setprecision(0) << num_burst_tasks / (burst_ms / 1000.0)
+            << " tasks/s" << std::endl << std::endl;
+
+  // 4. Fanning out a large loop of small work items: one submit (and one future) per item, versus parallel_for.
+  std::vector<double> out(num_burst_tasks);
+  auto work = [&](size_t i) { out[i] = std::sin(0.001 * i); };
+
+  auto start = clock_type::now();
+  std::vector<std::future<bool>> item_futures;
+  item_futures.reserve(num_burst_tasks);
+  for (size_t i = 0; i < num_burst_tasks; i++)
+  {
+    item_futures.push_back(qristal::thread_pool::submit([&work, i] { work(i); return true; }));
+  }
+  for (auto& f : item_futures) f.get();
+  const double submit_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+
+  start = clock_type::now();
+  qristal::thread_pool::parallel_for(0, num_burst_tasks, 0, work);
+  const double parallel_for_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+
+  std::cout << num_burst_tasks << " work items, one submit per item: " << std::setprecision(2) << submit_ms << " ms" << std::endl;
+  std::cout << num_burst_tasks << " work items, parallel_for:        " << parallel_for_ms << " ms" << std::endl;
+}
@@ -0,0 +1,122 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+#pragma once
+
+// STL
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Forward declarations
+namespace xacc { class Accelerator; }
+
+namespace qristal
+{
+
+  /**
+   * @brief A threadsafe, process-wide pool of idle accelerator instances, ready to be handed out to sessions.
+   *
+   * @details Retrieving an accelerator involves a lookup in the XACC service registry (which has to be done under a
+   * process-wide lock), cloning the registered prototype and parsing the accelerator options. This pool keeps
+   * accelerators that have finished running a circuit, keyed by backend name and a hash of the options they were
+   * set up with, so that later runs with the same settings can take one back out instead.
+   *
+   * Only accelerators that are private to the session that retrieved them (i.e. not shared with other callers by
+   * the XACC service registry) should be given to the pool. Setting the capacity to zero disables it.
+   */
+  class accelerator_pool
+  {
+
+    public:
+
+      /// Everything that the setup of an accelerator depends on
+      struct key
+      {
+        /// Backend name
+        std::string backend;
+
+        /// Hash of the options that the accelerator was set up with
+        size_t options_hash;
+
+        /// Equality comparison
+        bool operator==(const key&) const = default;
+      };
+
+      /// Getter for the instance; makes this class a threadsafe singleton
+      static accelerator_pool& get_instance();
+
+      /// Take an idle accelerator set up under a given key out of the pool, or return nullptr if there is none
+      std::shared_ptr<xacc::Accelerator> acquire(const key&);
+
+      /// Give an accelerator back to the pool, once the caller has completely finished with it
+      void release(const key&, std::shared_ptr<xacc::Accelerator>);
+
+      /// Set the maximum number of idle accelerators to keep for each key. Zero disables the pool.
+      void set_capacity(size_t);
+
+      /// Get the maximum number of idle accelerators to keep for each key
+      size_t get_capacity() const;
+
+      /// Get the total number of idle accelerators currently in the pool
+      size_t size() const;
+
+      /// Remove all idle accelerators from the pool
+      void clear();
+
+      /// Number of lookups that found an idle accelerator
+      size_t hits() const;
+
+      /// Number of lookups that did not find an idle accelerator
+      size_t misses() const;
+
+      /// Record the time spent setting up an accelerator for a run, in ms
+      void record_setup_time(bool reused, double ms);
+
+      /// Total time spent setting up accelerators taken from the pool, in ms
+      double reused_setup_time_ms() const;
+
+      /// Total time spent setting up new accelerators, in ms
+      double new_setup_time_ms() const;
+
+      /// Set the hit and miss counters and the setup timers back to zero
+      void reset_counters();
+
+      /// Uncopyable
+      accelerator_pool(const accelerator_pool&) = delete;
+
+      /// Unassignable
+      accelerator_pool& operator=(const accelerator_pool&) = delete;
+
+    private:
+
+      /// Hash function for pool keys
+      struct key_hash
+      {
+        size_t operator()(const key&) const;
+      };
+
+      /// Constructor
+      accelerator_pool() = default;
+
+      /// Idle accelerators, by key
+      std::unordered_map<key, std::vector<std::shared_ptr<xacc::Accelerator>>, key_hash> idle;
+
+      /// Maximum number of idle accelerators to keep for each key
+      size_t capacity = 16;
+
+      /// Hit and miss counters
+      std::atomic<size_t> hit_count = 0;
+      std::atomic<size_t> miss_count = 0;
+
+      /// Setup timers, in ns
+      std::atomic<size_t> reused_setup_ns = 0;
+      std::atomic<size_t> new_setup_ns = 0;
+
+      /// Thread locker for the pool contents
+      mutable std::mutex m;
+
+  };
+
+}
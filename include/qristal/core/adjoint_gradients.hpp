@@ -0,0 +1,126 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+#pragma once
+
+// STL
+#include <array>
+#include <complex>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Forward declarations
+namespace xacc { class CompositeInstruction; }
+
+namespace qristal
+{
+
+  /**
+   * @brief Exact gradients of the outputs of a parametrised circuit, by adjoint differentiation of its state vector.
+   *
+   * @details The circuit is simulated once, without noise, on a dense state vector (the forward pass). The gradient
+   * of the expectation value of an observable with respect to every parameter then takes a single backward pass,
+   * undoing the gates one at a time: O(gates) state updates in all, however many parameters there are. The gradients
+   * of the probabilities of all 2^n bitstrings make up a full Jacobian, so they take one tangent pass per parameter
+   * instead; these are run concurrently on the thread pool.
+   *
+   * Bitstrings are indexed with qubit 0 as the least significant bit. Every qubit must be measured.
+   */
+  class adjoint_gradients
+  {
+
+    public:
+
+      /// A term of a Pauli observable: a coefficient times a product of Pauli operators ('X', 'Y' or 'Z') on qubits
+      struct pauli_term
+      {
+        std::complex<double> coefficient;
+        std::map<size_t, char> paulis;
+      };
+
+      /// @brief Parse a Pauli observable from a string.
+      /// @param observable Sum of Pauli products, in XACC format, e.g. "0.5 Z0 Z1 + 0.2 X0 + 1.0".
+      static std::vector<pauli_term> parse_observable(const std::string& observable);
+
+      /**
+       * @brief Constructor. Runs the forward pass.
+       *
+       * @param circuit Parametrised circuit, with its free parameters passed directly to gates
+       * @param parameters Values of the free parameters, in the order of the circuit's variables
+       * @param n_qubits Number of qubits
+       */
+      adjoint_gradients(std::shared_ptr<xacc::CompositeInstruction> circuit, const std::vector<double>& parameters,
+                        size_t n_qubits);
+
+      /// Probabilities of all bitstrings
+      std::vector<double> probabilities() const;
+
+      /// Gradients of the probabilities of all bitstrings: result[p][k] is the derivative of the probability of
+      /// bitstring k with respect to parameter p
+      std::vector<std::vector<double>> probability_gradients() const;
+
+      /// Expectation value of an observable, and its gradient with respect to every parameter
+      std::pair<double, std::vector<double>> expectation_gradients(const std::vector<pauli_term>& observable) const;
+
+    private:
+
+      using state = std::vector<std::complex<double>>;
+      using matrix = std::array<std::complex<double>, 4>;
+
+      /// A gate, as a 2x2 matrix on a target qubit, optionally controlled by another qubit
+      struct op
+      {
+        /// Matrix of the gate on the target qubit, in row-major order
+        matrix m;
+
+        /// Qubit acted on
+        size_t target;
+
+        /// Control qubit, or -1 for none
+        long control = -1;
+
+        /// Whether the gate swaps the target and control qubits, instead of applying a matrix
+        bool swap = false;
+
+        /// Index of the parameter that the gate depends on, or -1 for none
+        long param = -1;
+
+        /// Generator G of the gate, such that its derivative is -i G U. For a controlled gate, G acts on the target
+        /// when the control is 1, and is zero otherwise.
+        matrix generator;
+      };
+
+      /// Apply a gate to a state
+      void apply(const op& o, state& psi) const;
+
+      /// Apply the inverse of a gate to a state
+      void apply_inverse(const op& o, state& psi) const;
+
+      /// Apply the generator of a gate to a state
+      void apply_generator(const op& o, state& psi) const;
+
+      /// Apply a 2x2 matrix to a state, optionally only where a control qubit is 1, and optionally zeroing the state
+      /// where the control qubit is 0
+      void apply_matrix(const matrix& m, size_t target, long control, bool project_control, state& psi) const;
+
+      /// Apply an observable to a state
+      state apply_observable(const std::vector<pauli_term>& observable, const state& psi) const;
+
+      /// Gates of the circuit, in order
+      std::vector<op> ops;
+
+      /// Number of qubits
+      size_t n_qubits;
+
+      /// Number of parameters
+      size_t n_params;
+
+      /// State after the forward pass
+      state final_state;
+
+      friend class adjoint_circuit_visitor;
+
+  };
+
+}
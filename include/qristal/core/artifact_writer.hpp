@@ -0,0 +1,101 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+#pragma once
+
+// STL
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace qristal
+{
+
+  /**
+   * @brief A threadsafe, process-wide writer of run artifacts (e.g. transpiled circuits) to disk.
+   *
+   * @details Files are written one at a time by a single background thread, in the order they were requested,
+   * so that saving artifacts never holds up the thread that produced them. The contents of each file are given
+   * as a function, which is only called on the background thread; this lets expensive contents (e.g. a circuit
+   * that has yet to be transpiled) be worked out off the hot path too.
+   */
+  class artifact_writer
+  {
+
+    public:
+
+      /// Getter for the instance; makes this class a threadsafe singleton
+      static artifact_writer& get_instance();
+
+      /**
+       * @brief Get a new file path in a directory that no other call (in this process or any other) will return.
+       *
+       * @details The file name is made from the stem, a timestamp, the process ID, a counter and the extension,
+       * e.g. qristal_circuit_1718236912345678901_4242_3.inc.
+       */
+      std::filesystem::path unique_path(const std::filesystem::path& dir, const std::string& stem,
+                                        const std::string& extension);
+
+      /**
+       * @brief Queue a file to be written in the background.
+       *
+       * @details Any missing parent directories are created. Errors in working out the contents or writing the file
+       * are passed on through the returned future.
+       */
+      std::shared_future<void> write(const std::filesystem::path& path, std::function<std::string()> contents);
+
+      /// Wait until all files queued so far have been written
+      void flush();
+
+      /// Destructor; writes any files still queued
+      ~artifact_writer();
+
+      /// Uncopyable
+      artifact_writer(const artifact_writer&) = delete;
+
+      /// Unassignable
+      artifact_writer& operator=(const artifact_writer&) = delete;
+
+    private:
+
+      /// A file waiting to be written
+      struct job
+      {
+        std::filesystem::path path;
+        std::function<std::string()> contents;
+        std::promise<void> done;
+      };
+
+      /// Constructor
+      artifact_writer() = default;
+
+      /// Write queued files until told to stop
+      void work();
+
+      /// Queued files
+      std::deque<job> jobs;
+
+      /// Number of files queued but not yet written
+      size_t pending = 0;
+
+      /// Flag telling the background thread to finish up
+      bool stopping = false;
+
+      /// Counter used to make file names unique
+      std::atomic<size_t> counter = 0;
+
+      /// Background thread; only started when the first file is queued
+      std::thread worker;
+
+      /// Thread locker and signals for the queue
+      std::mutex m;
+      std::condition_variable job_added;
+      std::condition_variable job_finished;
+
+  };
+
+}
@@ -38,6 +38,9 @@ namespace qristal
 
       const std::string& getTranspiledResult() const;
 
+      /// Get the circuit transpiled to QB native gates by the last call to execute, as XACC IR
+      std::shared_ptr<xacc::CompositeInstruction> getTranspiledIR() const;
+
     protected:
 
       /// Number of shots (repeats) over which to collect statistics
@@ -47,8 +50,13 @@ namespace qristal
 
       std::string qpuQasmStr_;
 
+      std::shared_ptr<xacc::CompositeInstruction> transpiledIR_;
+
       bool output_oqm_enabled_ = true;
 
+      /// Keep the transpiled circuit in memory only, rather than also writing it to output_oqm
+      bool output_oqm_in_memory_ = false;
+
       std::string output_oqm = "qristal_circuit.inc";
 
       std::vector<std::pair<int, int>> m_connectivity;
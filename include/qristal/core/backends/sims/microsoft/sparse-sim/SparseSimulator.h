@@ -11,6 +11,7 @@
 #include <iomanip>
 #include <iostream>
 #include <list>
+#include <numeric>
 #include <set>
 
 #include "quantum_state.hpp"
@@ -50,12 +51,15 @@ std::shared_ptr<BasicQuantumState> expand_wfn_helper(std::shared_ptr<BasicQuantu
 // Sparse simulator only stores non-zero coefficients of the quantum state.
 // It has good performance only when the number of non-zero coefficients is low.
 // If the number of non-zero coefficients is low, the number of qubits may be fairly large.
-// Sparse simulator employs std::unordered_map hashtable.
+// Sparse simulator employs a flat open-addressing hash table (flat_wavefunction),
+// or std::unordered_map if built with SPARSE_SIM_STD_HASH_MAP.
 // Keys are basis vectors represented by std::bitset<>.
 // Values are non-zero amplitudes represented by std::complex<real_type>.
 // Zero amplitudes are simply not stored.
-// Hashtable is reallocated and reconstructed on almost every gate.
-// Reallocation is saved for some gates that can be performed in one round.
+// Phase and permutation gates (queued and applied by phase_and_permute), and diagonal
+// and anti-diagonal gates, update the table in place. Gates that can split a basis
+// state in two (e.g. H and general rotations) build a new table.
+// Wavefunctions that become mostly non-zero are switched to a dense array of amplitudes.
 class SparseSimulator
 {
 public:
@@ -78,6 +82,8 @@ public:
 		_queue_H  = std::vector<bool>(num_qubits, 0);
 		_angles_Rx = std::vector<double>(num_qubits, 0.0);
 		_angles_Ry = std::vector<double>(num_qubits, 0.0);
+		_queue_U = std::vector<bool>(num_qubits, 0);
+		_unitaries = std::vector<single_qubit_unitary>(num_qubits);
 
 	}
 
@@ -114,6 +120,51 @@ public:
 		_quantum_state->set_random_seed(seed);
 	}
 
+	// Sets the number of threads that gates on large wavefunctions are split between.
+	// The threads are tasks on the Qristal thread pool, so using more threads than
+	// the pool has only adds overhead.
+	void set_num_threads(size_t num_threads) {
+		_quantum_state->set_num_threads(num_threads);
+	}
+
+	size_t get_num_threads() {
+		return _quantum_state->get_num_threads();
+	}
+
+	// Once this fraction of the basis states of the qubits in use are in superposition,
+	// the wavefunction is stored as a dense array of amplitudes rather than a hash map,
+	// and it goes back to a hash map when fewer than a quarter of that fraction are left.
+	// Zero keeps it sparse.
+	void set_dense_threshold(double dense_threshold) {
+		_quantum_state->set_dense_threshold(dense_threshold);
+	}
+
+	double get_dense_threshold() {
+		return _quantum_state->get_dense_threshold();
+	}
+
+	// Largest number of qubits that a dense wavefunction may span
+	void set_max_dense_qubits(logical_qubit_id max_dense_qubits) {
+		_quantum_state->set_max_dense_qubits(max_dense_qubits);
+	}
+
+	logical_qubit_id get_max_dense_qubits() {
+		return _quantum_state->get_max_dense_qubits();
+	}
+
+	// Number of times the wavefunction has been converted to a dense array, and back
+	size_t get_dense_conversions() {
+		return _quantum_state->get_dense_conversions();
+	}
+
+	size_t get_sparse_conversions() {
+		return _quantum_state->get_sparse_conversions();
+	}
+
+	bool is_dense() {
+		return _quantum_state->is_dense();
+	}
+
 	// Returns the number of qubits currently available
 	// to the simulator, including those already used
 	logical_qubit_id get_num_qubits() {
@@ -138,6 +189,8 @@ public:
 			_queue_H.resize(num_qubits, 0);
 			_angles_Rx.resize(num_qubits, 0.0);
 			_angles_Ry.resize(num_qubits, 0.0);
+			_queue_U.resize(num_qubits, 0);
+			_unitaries.resize(num_qubits);
 		}
 		// The external qubit manager should prevent this, but this checks anyway
 		if (_occupied_qubits[qubit]) {
@@ -174,6 +227,10 @@ public:
 
 
 	void X(logical_qubit_id index) {
+		if (_queue_U[index]) {
+			_fuse(index, {0, 1, 1, 0});
+			return;
+		}
 		// XY = - YX
 		if (_queue_Ry[index]){
 			_angles_Ry[index] *= -1.0;
@@ -196,6 +253,14 @@ public:
 			X(target);
 			return;
 		}
+		// A fused gate on any of the qubits must be applied first
+		_execute_if_fused(controls);
+		_execute_if_fused(target);
+		// Ry on the target causes issues
+		// This is checked first, as executing it also executes any H on the target
+		if (_queue_Ry[target]){
+			_execute_queued_ops(target, OP::Ry);
+		}
 		// Check for anything on the controls
 		if (controls.size() > 1){
 			_execute_if(controls);
@@ -205,10 +270,6 @@ public:
 				_execute_queued_ops(controls, OP::Ry);
 			}
 		}
-		// Ry on the target causes issues
-		if (_queue_Ry[target]){
-			_execute_queued_ops(target, OP::Ry);
-		}
 		// Rx on the target trivially commutes
 
 		// An H on the target flips the operation
@@ -240,6 +301,10 @@ public:
 	}
 
 	void Y(logical_qubit_id index) {
+		if (_queue_U[index]) {
+			_fuse(index, {0, -1i, 1i, 0});
+			return;
+		}
 		// XY = -YX
 		if (_queue_Rx[index]){
 			_angles_Rx[index] *= -1.0;
@@ -255,6 +320,7 @@ public:
 			return;
 		}
 		_execute_if(controls);
+		_execute_if_fused(target);
 		// Commutes with Ry on the target, not Rx
 		if (_queue_Rx[target]){
 			_execute_queued_ops(target, OP::Rx);
@@ -274,6 +340,10 @@ public:
 
 
 	void Z(logical_qubit_id index) {
+		if (_queue_U[index]) {
+			_fuse(index, {1, 0, 0, -1});
+			return;
+		}
 		// ZY = -YZ
 		if (_queue_Ry[index]){
 			_angles_Ry[index] *= -1;
@@ -298,6 +368,8 @@ public:
 			Z(target);
 			return;
 		}
+		_execute_if_fused(controls);
+		_execute_if_fused(target);
 		// If the only thing on the controls is one H, we can switch
 		// this to an MCX. Any Rx or Ry, or more than 1 H, means we
 		// must execute.
@@ -337,9 +409,11 @@ public:
 
 	// Any phase gate
 	void Phase(amplitude const& phase, logical_qubit_id index) {
-		// Rx, Ry, and H do not commute well with arbitrary phase gates
-		if (_queue_Ry[index] || _queue_Rx[index] || _queue_H[index]){
-			_execute_queued_ops(index, OP::Ry);
+		// Rx, Ry, and H do not commute well with arbitrary phase gates,
+		// so the phase is fused with them into a single gate
+		if (_queue_Ry[index] || _queue_Rx[index] || _queue_H[index] || _queue_U[index]){
+			_fuse(index, {1, 0, 0, phase});
+			return;
 		}
 		_queued_operations.push_back(operation(OP::Phase, index, phase));
 	}
@@ -400,16 +474,21 @@ public:
 		if (b == Gates::Basis::PauliI){
 			return;
 		}
+		if (_queue_U[index]){
+			_fuse(index, _rotation_matrix(b, phi));
+			return;
+		}
 
 		// Tries to absorb the rotation into the existing queue,
-		// if it hits a different kind of rotation, the queue executes
+		// if it hits a different kind of rotation, they are fused into one gate
 		if (b == Gates::Basis::PauliY){
 			_queue_Ry[index] = true;
 			_angles_Ry[index] += phi;
 			_set_qubit_to_nonzero(index);
 			return;
 		} else if (_queue_Ry[index]) {
-			_execute_queued_ops(index, OP::Ry);
+			_fuse(index, _rotation_matrix(b, phi));
+			return;
 		}
 
 		if (b == Gates::Basis::PauliX){
@@ -418,15 +497,17 @@ public:
 			_set_qubit_to_nonzero(index);
 			return;
 		} else if (_queue_Rx[index]){
-			_execute_queued_ops(index, OP::Rz);
+			_fuse(index, _rotation_matrix(b, phi));
+			return;
 		}
 
 		// An Rz is just a phase
 		if (b == Gates::Basis::PauliZ){
 			// HRz = RxH, but that's the wrong order for this structure
-			// Thus we must execute the H queue
+			// Thus we fuse it with the H
 			if (_queue_H[index]){
-				_execute_queued_ops(index, OP::H);
+				_fuse(index, _rotation_matrix(b, phi));
+				return;
 			}
 			// Rz(phi) = RI(phi)*R1(-2*phi)
 			// Global phase from RI is ignored
@@ -450,6 +531,7 @@ public:
 		}
 
 		_execute_if(controls);
+		_execute_if_fused(target);
 		// The target can commute with rotations of the same type
 		if (_queue_Ry[target] && b != Gates::Basis::PauliY){
 			_execute_queued_ops(target, OP::Ry);
@@ -507,14 +589,29 @@ public:
 
 
 
+	// Any single-qubit gate, fused with everything queued on the qubit
+	void Unitary(single_qubit_unitary const& matrix, logical_qubit_id index) {
+		_fuse(index, matrix);
+	}
+
+	// Any single-qubit operator, not necessarily unitary (e.g. a Kraus operator)
+	// Applied exactly as given, so unlike Unitary no global factor is dropped
+	void Operator(single_qubit_unitary const& matrix, logical_qubit_id index) {
+		_execute_if(index);
+		_execute_phase_and_permute();
+		_quantum_state->Unitary(matrix, index);
+		_set_qubit_to_nonzero(index);
+	}
+
 	void H(logical_qubit_id index) {
-		// YH = -HY
-		_angles_Ry[index] *= (_queue_Ry[index] ? -1.0 : 1.0);
 		// Commuting with Rx creates a phase, but on the wrong side
-		// So we execute any Rx immediately
-		if (_queue_Rx[index]){
-			_execute_queued_ops(index, OP::Rx);
+		// So we fuse it with any Rx, or with a gate already fused
+		if (_queue_Rx[index] || _queue_U[index]){
+			_fuse(index, {_normalizer_double, _normalizer_double, _normalizer_double, -_normalizer_double});
+			return;
 		}
+		// YH = -HY
+		_angles_Ry[index] *= (_queue_Ry[index] ? -1.0 : 1.0);
 		_queue_H[index] = !_queue_H[index];
 		_set_qubit_to_nonzero(index);
 	}
@@ -526,6 +623,7 @@ public:
 		}
 		// No commutation on controls
 		_execute_if(controls);
+		_execute_if_fused(target);
 		// No Ry or Rx commutation on target
 		if (_queue_Ry[target] || _queue_Rx[target]){
 			_execute_queued_ops(target, OP::Ry);
@@ -536,6 +634,55 @@ public:
 		_set_qubit_to_nonzero(target);
 	}
 
+	// Any single-qubit gate, controlled on all of controls
+	void MCUnitary(std::vector<logical_qubit_id> const& controls, single_qubit_unitary const& matrix, logical_qubit_id target) {
+		if (controls.size() == 0) {
+			Unitary(matrix, target);
+			return;
+		}
+		// Diagonal and anti-diagonal gates become multi-controlled phases,
+		// one on the controls alone and one including the target, and an MCX
+		bool diagonal = std::norm(matrix[1]) <= _fusion_precision && std::norm(matrix[2]) <= _fusion_precision;
+		bool anti_diagonal = std::norm(matrix[0]) <= _fusion_precision && std::norm(matrix[3]) <= _fusion_precision;
+		if (diagonal || anti_diagonal) {
+			amplitude phase_0 = diagonal ? matrix[0] : matrix[2];
+			amplitude phase_1 = diagonal ? matrix[3] : matrix[1];
+			if (std::norm(phase_0 - 1.0) > _fusion_precision) {
+				MCPhase(controls, phase_0, controls[0]);
+			}
+			if (std::norm(phase_1 / phase_0 - 1.0) > _fusion_precision) {
+				MCPhase(controls, phase_1 / phase_0, target);
+			}
+			if (anti_diagonal) {
+				MCX(controls, target);
+			}
+			return;
+		}
+		// No commutation on controls or target
+		_execute_if(controls);
+		_execute_if(target);
+		_execute_phase_and_permute();
+		_quantum_state->MCUnitary(controls, matrix, target);
+		_set_qubit_to_nonzero(target);
+	}
+
+	// Any two-qubit gate, with rows and columns indexed by 2*(bit of index_1) + (bit of index_2)
+	void Unitary(two_qubit_unitary const& matrix, logical_qubit_id index_1, logical_qubit_id index_2) {
+		MCUnitary(std::vector<logical_qubit_id>{}, matrix, index_1, index_2);
+	}
+
+	// Any two-qubit gate, controlled on all of controls
+	void MCUnitary(std::vector<logical_qubit_id> const& controls, two_qubit_unitary const& matrix, logical_qubit_id index_1, logical_qubit_id index_2) {
+		// No commutation on controls or targets
+		_execute_if(controls);
+		_execute_if(index_1);
+		_execute_if(index_2);
+		_execute_phase_and_permute();
+		_quantum_state->MCUnitary(controls, matrix, index_1, index_2);
+		_set_qubit_to_nonzero(index_1);
+		_set_qubit_to_nonzero(index_2);
+	}
+
 
 
 
@@ -550,6 +697,8 @@ public:
 		_queue_Rx.swap(_queue_Rx[index_1],  _queue_Rx[index_2]);
 		std::swap(_angles_Rx[index_1], _angles_Rx[index_2]);
 		_queue_H.swap(_queue_H[index_1],  _queue_H[index_2]);
+		_queue_U.swap(_queue_U[index_1],  _queue_U[index_2]);
+		std::swap(_unitaries[index_1], _unitaries[index_2]);
 		_occupied_qubits.swap(_occupied_qubits[index_1], _occupied_qubits[index_2]);
 		logical_qubit_id shift = index_2 - index_1;
 		_queued_operations.push_back(operation(OP::SWAP, index_1, shift, index_2));
@@ -599,6 +748,7 @@ public:
 	}
 
 	void Assert(std::vector<Gates::Basis> axes, std::vector<logical_qubit_id> const& qubits, bool result) {
+		_execute_if_fused(qubits);
 		// Assertions will not commute well with Rx or Ry
 		for (auto qubit : qubits) {
 			if (_queue_Rx[qubit] || _queue_Ry[qubit])
@@ -645,6 +795,29 @@ public:
 		return _quantum_state->MeasurementProbability(axes, qubits);
 	}
 
+	// Returns the expectation value of a Pauli string, computed directly from the amplitudes
+	double PauliExpectation(std::vector<Gates::Basis> const& axes, std::vector<logical_qubit_id> const& qubits) {
+		return PauliExpectations({{1.0, axes, qubits}})[0];
+	}
+
+	// Returns the expectation value of a weighted sum of Pauli strings, computed directly
+	// from the amplitudes, with no change of basis and no sampling
+	double PauliExpectation(std::vector<pauli_term> const& terms) {
+		const std::vector<double> expectations = PauliExpectations(terms);
+		return std::accumulate(expectations.begin(), expectations.end(), 0.0);
+	}
+
+	// Returns the expectation value of each term of a weighted sum of Pauli strings, times
+	// its coefficient. Terms that flip the same qubits are evaluated in a single pass.
+	std::vector<double> PauliExpectations(std::vector<pauli_term> const& terms) {
+		std::vector<logical_qubit_id> qubits;
+		for (pauli_term const& term : terms) {
+			qubits.insert(qubits.end(), term.qubits.begin(), term.qubits.end());
+		}
+		_execute_queued_ops(qubits, OP::Ry);
+		return _quantum_state->PauliExpectations(terms);
+	}
+
 
 
 	unsigned Measure(std::vector<Gates::Basis> const& axes, std::vector<logical_qubit_id> const& qubits){
@@ -696,6 +869,13 @@ public:
         return samples;
 	}
 
+	// Draws num_samples samples at once, returning how many times each distinct outcome of the given
+	// qubits was drawn, with qubits[i] as bit i % 64 of word i / 64 of each outcome
+	std::vector<std::pair<std::vector<std::uint64_t>, size_t>> SampleCounts(size_t num_samples, std::vector<logical_qubit_id> const& qubits) {
+		_execute_queued_ops();
+		return _quantum_state->SampleCounts(num_samples, qubits);
+	}
+
 	using callback_t = std::function<bool(const char*, double, double)>;
 	using extended_callback_t = std::function<bool(const char*, double, double, void*)>;
 	// Dumps the state of a subspace of particular qubits, if they are not entangled
@@ -742,6 +922,15 @@ private:
 	std::vector<double> _angles_Rx;
 	std::vector<double> _angles_Ry;
 
+	// Single-qubit gates that do not commute with the H, Rx and Ry queues are
+	// fused with them into one 2x2 gate, applied in one pass after them.
+	// Whenever a qubit has a fused gate, its H, Rx and Ry queues are empty.
+	std::vector<bool> _queue_U;
+	std::vector<single_qubit_unitary> _unitaries;
+
+	// Threshold below which an entry of a fused gate is taken to be zero
+	const double _fusion_precision = 1e-11;
+
 	// Store which qubits are non-zero as a bitstring
 	std::vector<bool> _occupied_qubits;
 	logical_qubit_id _max_num_qubits_used = 0;
@@ -780,6 +969,11 @@ private:
 	// The next three functions execute the H, and/or Rx, and/or Ry
 	// queues on a single qubit
 	void _execute_RyRxH_single_qubit(logical_qubit_id const &index){
+		// Two or more queued gates are applied together in one pass
+		if (_queue_H[index] + _queue_Rx[index] + _queue_Ry[index] > 1){
+			_quantum_state->Unitary(_take_queued_matrix(index), index);
+			return;
+		}
 		if (_queue_H[index]){
 			_quantum_state->H(index);
 			_queue_H[index] = false;
@@ -794,6 +988,7 @@ private:
 			_angles_Ry[index] = 0.0;
 			_queue_Ry[index] = false;
 		}
+		_execute_U_single_qubit(index);
 	}
 
 	void _execute_RxH_single_qubit(logical_qubit_id const &index){
@@ -806,6 +1001,7 @@ private:
 			_angles_Rx[index] = 0.0;
 			_queue_Rx[index] = false;
 		}
+		_execute_U_single_qubit(index);
 	}
 
 	void _execute_H_single_qubit(logical_qubit_id const &index){
@@ -813,6 +1009,91 @@ private:
 			_quantum_state->H(index);
 			_queue_H[index] = false;
 		}
+		_execute_U_single_qubit(index);
+	}
+
+	// Applies the fused gate on a qubit, if there is one
+	// Its H, Rx and Ry queues are empty, so this always comes last
+	void _execute_U_single_qubit(logical_qubit_id const &index){
+		if (_queue_U[index]){
+			_quantum_state->Unitary(_unitaries[index], index);
+			_queue_U[index] = false;
+		}
+	}
+
+	// Product of two single-qubit gates: applies b, then a
+	static single_qubit_unitary _multiply(single_qubit_unitary const& a, single_qubit_unitary const& b){
+		return {a[0]*b[0] + a[1]*b[2], a[0]*b[1] + a[1]*b[3],
+		        a[2]*b[0] + a[3]*b[2], a[2]*b[1] + a[3]*b[3]};
+	}
+
+	// Matrix of a rotation, as applied by the quantum state
+	// Z rotations are phases, as in R, so they drop a global phase
+	static single_qubit_unitary _rotation_matrix(Gates::Basis b, double phi){
+		const double c = std::cos(0.5 * phi);
+		const double s = std::sin(0.5 * phi);
+		switch (b){
+			case Gates::Basis::PauliX:
+				return {c, -1i*s, -1i*s, c};
+			case Gates::Basis::PauliY:
+				return {c, -s, s, c};
+			case Gates::Basis::PauliZ:
+				return {1, 0, 0, std::polar(1.0, phi)};
+			default:
+				return {1, 0, 0, 1};
+		}
+	}
+
+	// Removes everything queued on a qubit, other than phase and permutation gates,
+	// and returns it as a single gate
+	single_qubit_unitary _take_queued_matrix(logical_qubit_id index){
+		single_qubit_unitary queued = {1, 0, 0, 1};
+		if (_queue_U[index]){
+			queued = _unitaries[index];
+			_queue_U[index] = false;
+			return queued;
+		}
+		// The queues apply H, then Rx, then Ry
+		if (_queue_H[index]){
+			queued = {_normalizer_double, _normalizer_double, _normalizer_double, -_normalizer_double};
+		}
+		if (_queue_Rx[index]){
+			queued = _multiply(_rotation_matrix(Gates::Basis::PauliX, _angles_Rx[index]), queued);
+		}
+		if (_queue_Ry[index]){
+			queued = _multiply(_rotation_matrix(Gates::Basis::PauliY, _angles_Ry[index]), queued);
+		}
+		_queue_H[index] = false;
+		_queue_Rx[index] = false;
+		_queue_Ry[index] = false;
+		_angles_Rx[index] = 0.0;
+		_angles_Ry[index] = 0.0;
+		return queued;
+	}
+
+	// Fuses a single-qubit gate with everything queued on a qubit
+	// If the result is diagonal or anti-diagonal, it is queued as a phase and
+	// permutation gate (up to a global phase) rather than as a fused gate
+	void _fuse(logical_qubit_id index, single_qubit_unitary const& gate){
+		const single_qubit_unitary fused = _multiply(gate, _take_queued_matrix(index));
+		_set_qubit_to_nonzero(index);
+		if (std::norm(fused[1]) <= _fusion_precision && std::norm(fused[2]) <= _fusion_precision){
+			_queue_phase(fused[3] / fused[0], index);
+		} else if (std::norm(fused[0]) <= _fusion_precision && std::norm(fused[3]) <= _fusion_precision){
+			// [[0, b], [c, 0]] = X diag(c, b)
+			_queue_phase(fused[1] / fused[2], index);
+			_queued_operations.push_back(operation(OP::X, index));
+		} else {
+			_unitaries[index] = fused;
+			_queue_U[index] = true;
+		}
+	}
+
+	// Queues a phase gate, unless it is the identity
+	void _queue_phase(amplitude const& phase, logical_qubit_id index){
+		if (std::norm(phase - 1.0) > _fusion_precision){
+			_queued_operations.push_back(operation(OP::Phase, index, phase));
+		}
 	}
 
 	// Executes all phase and permutation operations, if any exist
@@ -883,7 +1164,7 @@ private:
 	// Executes if there is anything already queued on the qubit target
 	// Used when queuing gates that do not commute well
 	void _execute_if(logical_qubit_id target){
-		if (_queue_Ry[target] || _queue_Rx[target] || _queue_H[target]){
+		if (_queue_Ry[target] || _queue_Rx[target] || _queue_H[target] || _queue_U[target]){
 			_execute_queued_ops(target, OP::Ry);
 		}
 	}
@@ -892,13 +1173,30 @@ private:
 	// Used when queuing gates that do not commute well
 	void _execute_if(std::vector<logical_qubit_id> const &controls) {
 		for (auto control : controls){
-			if (_queue_Ry[control] || _queue_Rx[control] || _queue_H[control]){
+			if (_queue_Ry[control] || _queue_Rx[control] || _queue_H[control] || _queue_U[control]){
 				_execute_queued_ops(controls, OP::Ry);
 				return;
 			}
 		}
 	}
 
+	// Executes if there is a fused gate on the qubit
+	// Used when queuing gates that otherwise commute with the H, Rx and Ry queues
+	void _execute_if_fused(logical_qubit_id target){
+		if (_queue_U[target]){
+			_execute_queued_ops(target, OP::Ry);
+		}
+	}
+
+	void _execute_if_fused(std::vector<logical_qubit_id> const &qubits){
+		for (auto qubit : qubits){
+			if (_queue_U[qubit]){
+				_execute_queued_ops(qubits, OP::Ry);
+				return;
+			}
+		}
+	}
+
 };
 
 } // namespace Microsoft::Quantum::SPARSESIMULATOR
@@ -3,7 +3,9 @@
 
 #pragma once
 
+#include <cstdint>
 #include <list>
+#include <utility>
 
 #include "types.h"
 #include "gates.h"
@@ -29,6 +31,24 @@ public:
 
     virtual void set_load_factor(float new_load_factor) = 0;
 
+    virtual size_t get_num_threads() = 0;
+
+    virtual void set_num_threads(size_t new_num_threads) = 0;
+
+    virtual double get_dense_threshold() = 0;
+
+    virtual void set_dense_threshold(double new_dense_threshold) = 0;
+
+    virtual logical_qubit_id get_max_dense_qubits() = 0;
+
+    virtual void set_max_dense_qubits(logical_qubit_id new_max_dense_qubits) = 0;
+
+    virtual size_t get_dense_conversions() = 0;
+
+    virtual size_t get_sparse_conversions() = 0;
+
+    virtual bool is_dense() = 0;
+
     virtual size_t get_wavefunction_size() = 0;
 
     virtual void PauliCombination(std::vector<Gates::Basis> const&, std::vector<logical_qubit_id> const&, amplitude, amplitude) = 0;
@@ -43,6 +63,7 @@ public:
     virtual void Assert(std::vector<Gates::Basis> const&, std::vector<logical_qubit_id> const&, bool) = 0;
 
     virtual double MeasurementProbability(std::vector<Gates::Basis> const&, std::vector<logical_qubit_id> const&) = 0;
+    virtual std::vector<double> PauliExpectations(std::vector<pauli_term> const&) = 0;
     virtual unsigned Measure(std::vector<Gates::Basis> const&, std::vector<logical_qubit_id> const&) = 0;
 
 
@@ -57,6 +78,10 @@ public:
     virtual void R(Gates::Basis b, double phi, logical_qubit_id index) = 0;
     virtual void MCR (std::vector<logical_qubit_id> const&, Gates::Basis, double, logical_qubit_id) = 0;
 
+    virtual void Unitary(single_qubit_unitary const& matrix, logical_qubit_id index) = 0;
+    virtual void MCUnitary(std::vector<logical_qubit_id> const& controls, single_qubit_unitary const& matrix, logical_qubit_id index) = 0;
+    virtual void MCUnitary(std::vector<logical_qubit_id> const& controls, two_qubit_unitary const& matrix, logical_qubit_id index_1, logical_qubit_id index_2) = 0;
+
     virtual void H(logical_qubit_id index) = 0;
     virtual void MCH(std::vector<logical_qubit_id> const& controls, logical_qubit_id index) = 0;
 
@@ -67,7 +92,9 @@ public:
 
     virtual std::function<double()> get_rng() = 0;
 
-    virtual std::string Sample() const = 0;
+    virtual std::string Sample() = 0;
+
+    virtual std::vector<std::pair<std::vector<std::uint64_t>, size_t>> SampleCounts(size_t num_samples, std::vector<logical_qubit_id> const& qubits) = 0;
 };
 
 } // namespace Microsoft::Quantum::SPARSESIMULATOR
@@ -0,0 +1,249 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+#pragma once
+
+// STL
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace Microsoft::Quantum::SPARSESIMULATOR
+{
+
+  /// Hash of a wavefunction key. Bitset labels are hashed a 64-bit word at a time.
+  template <typename Key>
+  struct flat_wavefunction_hash : std::hash<Key> {};
+
+  template <size_t N>
+  struct flat_wavefunction_hash<std::bitset<N>>
+  {
+    size_t operator()(const std::bitset<N>& label) const
+    {
+      uint64_t words[(sizeof(label) + sizeof(uint64_t) - 1) / sizeof(uint64_t)] = {};
+      std::memcpy(words, &label, sizeof(label));
+      uint64_t h = 0;
+      for (uint64_t w : words) h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+      // Mix the high bits into the low bits, which pick the slot
+      h ^= h >> 33;
+      h *= 0xFF51AFD7ED558CCDull;
+      h ^= h >> 33;
+      return h;
+    }
+  };
+
+  /**
+   * @brief Open-addressing hash table of the amplitudes of a sparse wavefunction, with the same interface as the
+   * parts of std::unordered_map used by the sparse simulator.
+   *
+   * @details Entries are stored contiguously, in the order they were inserted, so the gate kernels iterate over them
+   * as over a plain array. Lookups go through a separate power-of-two index of 64-bit slots, each holding the
+   * position of an entry and the top 32 bits of its hash, probed linearly. Keys are only compared when their tags
+   * match, so a lookup usually touches one slot and one entry. The kernels only ever add entries to a fresh table, so
+   * there is no erase, and thus no tombstones. The index is kept at most half full, or at the maximum load factor if
+   * that is lower.
+   */
+  template <typename Key, typename T, typename Hash = flat_wavefunction_hash<Key>>
+  class flat_wavefunction
+  {
+
+    public:
+
+      using key_type = Key;
+      using mapped_type = T;
+      using value_type = std::pair<Key, T>;
+      using iterator = value_type*;
+      using const_iterator = const value_type*;
+
+      /// Constructor for an empty table
+      flat_wavefunction() = default;
+
+      /// Constructor for an empty table with room for @p n_states entries
+      explicit flat_wavefunction(size_t n_states) { reserve(n_states); }
+
+      /// Make room for @p n_states entries without rehashing
+      void reserve(size_t n_states)
+      {
+        entries.reserve(n_states);
+        const size_t needed = std::bit_ceil(std::max<size_t>(min_slots, size_t(n_states / load) + 1));
+        if (needed > slots.size()) rehash(needed);
+      }
+
+      /// Set the maximum load factor of the index. Linear probing slows down sharply above 1/2, so it is capped there.
+      void max_load_factor(float f) { load = std::min(max_load, std::max(0.125f, f)); }
+
+      /// Maximum load factor of the index
+      float max_load_factor() const { return load; }
+
+      /// Number of slots in the index
+      size_t bucket_count() const { return slots.size(); }
+
+      size_t size() const { return entries.size(); }
+      bool empty() const { return entries.empty(); }
+
+      iterator begin() { return entries.data(); }
+      iterator end() { return entries.data() + entries.size(); }
+      const_iterator begin() const { return entries.data(); }
+      const_iterator end() const { return entries.data() + entries.size(); }
+
+      /// Find the entry with a given key, or end() if there is none
+      iterator find(const Key& key) { return const_cast<iterator>(std::as_const(*this).find(key)); }
+      const_iterator find(const Key& key) const
+      {
+        if (slots.empty()) return end();
+        const uint64_t h = hasher(key);
+        const uint64_t tag = h & tag_mask;
+        for (size_t i = h & (slots.size() - 1);; i = (i + 1) & (slots.size() - 1))
+        {
+          const uint64_t slot = slots[i];
+          if (slot == 0) return end();
+          if ((slot & tag_mask) == tag and entries[(slot & index_mask) - 1].first == key)
+          {
+            return entries.data() + (slot & index_mask) - 1;
+          }
+        }
+      }
+
+      /// Insert an entry constructed from the arguments, unless its key is already present
+      template <typename K, typename... Args>
+      std::pair<iterator, bool> emplace(K&& key_arg, Args&&... args)
+      {
+        Key key(std::forward<K>(key_arg));
+        if (entries.size() + 1 > slots.size() * load) rehash(std::max<size_t>(min_slots, slots.size() * 2));
+        const uint64_t h = hasher(key);
+        const uint64_t tag = h & tag_mask;
+        size_t i = h & (slots.size() - 1);
+        for (;; i = (i + 1) & (slots.size() - 1))
+        {
+          const uint64_t slot = slots[i];
+          if (slot == 0) break;
+          if ((slot & tag_mask) == tag and entries[(slot & index_mask) - 1].first == key)
+          {
+            return {entries.data() + (slot & index_mask) - 1, false};
+          }
+        }
+        if (entries.size() >= index_mask) throw std::length_error("Too many amplitudes for a flat wavefunction.");
+        entries.emplace_back(std::move(key), T(std::forward<Args>(args)...));
+        slots[i] = tag | entries.size();
+        return {entries.data() + entries.size() - 1, true};
+      }
+
+      /// Access the amplitude of a key, inserting a zero amplitude if it is not present
+      T& operator[](const Key& key) { return emplace(key).first->second; }
+
+      /// Hash function of the keys
+      Hash hash_function() const { return hasher; }
+
+      /**
+       * @brief Replace the contents of the table with the entries of several lists, no two of which share a key.
+       *
+       * @details The lists are copied into place, and their entries indexed, by calling for_each(n, f), which must call
+       * f(i) once for every i in [0, n), in any order and possibly concurrently. Each call handles one list, claiming
+       * empty slots of the index with an atomic compare-and-swap, so concurrent calls never touch the same slot.
+       *
+       * @param parts Lists of entries, with distinct keys
+       * @param for_each Function running a function of an index over a range of indices
+       */
+      template <typename ForEach>
+      void assign_distinct(const std::vector<std::vector<value_type>>& parts, ForEach&& for_each)
+      {
+        std::vector<size_t> offsets(parts.size() + 1, 0);
+        for (size_t p = 0; p < parts.size(); p++) offsets[p + 1] = offsets[p] + parts[p].size();
+        const size_t n_states = offsets.back();
+        if (n_states >= index_mask) throw std::length_error("Too many amplitudes for a flat wavefunction.");
+        entries.clear();
+        entries.resize(n_states);
+        slots.assign(std::bit_ceil(std::max<size_t>(min_slots, size_t(n_states / load) + 1)), 0);
+        for_each(parts.size(), [&](size_t p)
+        {
+          std::copy(parts[p].begin(), parts[p].end(), entries.begin() + offsets[p]);
+          index_concurrently(offsets[p], offsets[p + 1]);
+        });
+      }
+
+      /**
+       * @brief Rebuild the index after the keys of the entries have been changed in place, keeping them distinct.
+       *
+       * @details The index is cleared and refilled without being reallocated. The entries are split into @p n_chunks
+       * chunks, which are indexed by calling for_each(n_chunks, f) as for assign_distinct.
+       */
+      template <typename ForEach>
+      void reindex(size_t n_chunks, ForEach&& for_each)
+      {
+        if (n_chunks <= 1)
+        {
+          rehash(slots.size());
+          return;
+        }
+        std::fill(slots.begin(), slots.end(), 0);
+        for_each(n_chunks, [&](size_t c)
+        {
+          index_concurrently(entries.size() * c / n_chunks, entries.size() * (c + 1) / n_chunks);
+        });
+      }
+
+    private:
+
+      /// Rebuild the index with @p n_slots slots
+      void rehash(size_t n_slots)
+      {
+        slots.assign(n_slots, 0);
+        for (size_t e = 0; e < entries.size(); e++)
+        {
+          const uint64_t h = hasher(entries[e].first);
+          size_t i = h & (n_slots - 1);
+          while (slots[i] != 0) i = (i + 1) & (n_slots - 1);
+          slots[i] = (h & tag_mask) | (e + 1);
+        }
+      }
+
+      /// Index the entries in [begin, end), which must not be indexed yet, claiming slots atomically so that other
+      /// ranges can be indexed at the same time
+      void index_concurrently(size_t begin, size_t end)
+      {
+        const size_t slot_mask = slots.size() - 1;
+        for (size_t e = begin; e < end; e++)
+        {
+          const uint64_t h = hasher(entries[e].first);
+          const uint64_t claim = (h & tag_mask) | (e + 1);
+          for (size_t i = h & slot_mask;; i = (i + 1) & slot_mask)
+          {
+            std::atomic_ref<uint64_t> slot(slots[i]);
+            uint64_t empty = 0;
+            if (slot.load(std::memory_order_relaxed) == 0 and
+                slot.compare_exchange_strong(empty, claim, std::memory_order_relaxed)) break;
+          }
+        }
+      }
+
+      /// The top 32 bits of a slot hold the tag of the hash of its key; the bottom 32 bits hold one more than the
+      /// position of its entry, so that an empty slot is zero
+      static constexpr uint64_t tag_mask = 0xFFFFFFFF00000000ull;
+      static constexpr uint64_t index_mask = 0x00000000FFFFFFFFull;
+
+      /// Smallest number of slots in a non-empty index
+      static constexpr size_t min_slots = 8;
+
+      /// Highest maximum load factor allowed
+      static constexpr float max_load = 0.5f;
+
+      /// Entries, in order of insertion
+      std::vector<value_type> entries;
+
+      /// Index of the entries
+      std::vector<uint64_t> slots;
+
+      /// Maximum load factor of the index
+      float load = max_load;
+
+      /// Hash function of the keys
+      [[no_unique_address]] Hash hasher;
+
+  };
+
+}
@@ -254,4 +254,12 @@ namespace Gates
     };
 } // namespace Gates
 
+// A term of a weighted sum of Pauli strings: coefficient times the product of
+// the Pauli operator axes[i] on each qubit qubits[i]
+struct pauli_term {
+    double coefficient;
+    std::vector<Gates::Basis> axes;
+    std::vector<logical_qubit_id> qubits;
+};
+
 } // namespace Microsoft::Quantum::SPARSESIMULATOR
@@ -9,9 +9,18 @@
 #include <cmath>
 #include <functional>
 #include <algorithm>
+#include <bit>
 #include <list>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <numeric>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <qristal/core/thread_pool.hpp>
 
 #include "basic_quantum_state.hpp"
 
@@ -106,6 +115,11 @@ public:
         universal_wavefunction old_qubit_data = old_state->get_universal_wavefunction();
         _qubit_data = wavefunction(old_qubit_data.size());
         _load_factor = old_state->get_load_factor();
+        _num_threads = old_state->get_num_threads();
+        _dense_threshold = old_state->get_dense_threshold();
+        _max_dense_qubits = old_state->get_max_dense_qubits();
+        _dense_conversions = old_state->get_dense_conversions();
+        _sparse_conversions = old_state->get_sparse_conversions();
         _qubit_data.max_load_factor(_load_factor);
         // Writes this into the current wavefunction as qubit_label types
         for (auto current_state = old_qubit_data.begin(); current_state != old_qubit_data.end(); ++current_state) {
@@ -119,6 +133,7 @@ public:
 
     // Outputs all states and amplitudes to the console
     void DumpWavefunction(size_t indent = 0){
+        _make_sparse();
         DumpWavefunction(_qubit_data, indent);
     }
 
@@ -158,9 +173,61 @@ public:
          _load_factor = new_load_factor;
     }
 
+    // Number of threads that gates on large wavefunctions are split between
+    size_t get_num_threads() {
+        return _num_threads;
+    }
+
+    void set_num_threads(size_t new_num_threads) {
+        _num_threads = std::max<size_t>(1, new_num_threads);
+    }
+
+    // Fraction of the 2^n basis states of the n qubits that are not the same in every state
+    // that must be in superposition for the wavefunction to be stored as a dense array of
+    // amplitudes rather than a hash map.
+    // It goes back to the hash map once fewer than a quarter of that fraction are left.
+    // Zero keeps the wavefunction sparse.
+    double get_dense_threshold() {
+        return _dense_threshold;
+    }
+
+    void set_dense_threshold(double new_dense_threshold) {
+        _dense_threshold = std::max(0.0, new_dense_threshold);
+        if (_dense_threshold == 0) {
+            _make_sparse();
+        }
+    }
+
+    // Largest number of qubits that a dense wavefunction may span
+    logical_qubit_id get_max_dense_qubits() {
+        return _max_dense_qubits;
+    }
+
+    void set_max_dense_qubits(logical_qubit_id new_max_dense_qubits) {
+        _max_dense_qubits = std::min<logical_qubit_id>({new_max_dense_qubits, num_qubits, 40});
+        if (_is_dense && _dense_qubits.size() > _max_dense_qubits) {
+            _make_sparse();
+        }
+    }
+
+    // Number of times the wavefunction has been converted to a dense array
+    size_t get_dense_conversions() {
+        return _dense_conversions;
+    }
+
+    // Number of times the wavefunction has been converted back to a hash map
+    size_t get_sparse_conversions() {
+        return _sparse_conversions;
+    }
+
+    // Whether the wavefunction is currently stored as a dense array
+    bool is_dense() {
+        return _is_dense;
+    }
+
     // Returns the number of states in superposition
     size_t get_wavefunction_size() {
-         return _qubit_data.size();
+         return _is_dense ? _dense_nonzeros : _qubit_data.size();
     }
 
 
@@ -168,6 +235,7 @@ public:
     // Applies the operator id_coeff*I + pauli_coeff * P
     // where P is the Pauli operators defined by axes applied to the qubits in qubits.
     void PauliCombination(std::vector<Gates::Basis> const& axes, std::vector<logical_qubit_id> const& qubits, amplitude id_coeff, amplitude pauli_coeff) {
+        _make_sparse();
         // Bit-vectors indexing where gates of each type are applied
         qubit_label XYs = 0;
         qubit_label YZs = 0;
@@ -292,6 +360,7 @@ public:
     // where P is the Pauli operators defined by axes applied to the qubits in qubits.
     // Controlled version
     void MCPauliCombination(std::vector<logical_qubit_id> const& controls, std::vector<Gates::Basis> const& axes, std::vector<logical_qubit_id> const& qubits, amplitude id_coeff, amplitude pauli_coeff) {
+        _make_sparse();
         // Bit-vectors indexing where gates of each type are applied
         qubit_label cmask = _get_mask(controls);
         qubit_label XYs = 0;
@@ -419,6 +488,7 @@ public:
 
 
     unsigned M(logical_qubit_id target) {
+        _make_sparse();
         double zero_probability = 0.0;
         double one_probability = 0.0;
 
@@ -454,6 +524,7 @@ public:
     }
 
     void Reset(logical_qubit_id target) {
+        _make_sparse();
         double zero_probability = 0.0;
         double one_probability = 0.0;
 
@@ -495,8 +566,24 @@ public:
     // Samples a state from the superposition with probably proportion to
     // the amplitude, returning a string of the bits of that state.
     // Unlike measurement, this does not modify the state
-    std::string Sample() const {
+    std::string Sample() {
         double probability = _rng();
+        // A dense wavefunction is sampled in index space, so that it stays dense for later gates
+        if (_is_dense) {
+            uint64_t last = 0;
+            for (uint64_t i = 0; i < _dense.size(); ++i) {
+                double square_amplitude = std::norm(_dense[i]);
+                if (square_amplitude == 0) {
+                    continue;
+                }
+                last = i;
+                probability -= square_amplitude;
+                if (probability <= 0){
+                    return _dense_label(i).to_string();
+                }
+            }
+            return _dense_label(last).to_string();
+        }
         for (auto current_state = (_qubit_data).begin(); current_state != (_qubit_data).end(); ++current_state) {
             double square_amplitude = std::norm(current_state->second);
             probability -= square_amplitude;
@@ -507,7 +594,80 @@ public:
         return _qubit_data.begin()->first.to_string();
     }
 
+    // Draws many samples at once, returning the number of times that each distinct outcome of the given qubits
+    // was drawn. Outcomes are packed into words, with qubits[i] as bit i % 64 of word i / 64.
+    // The cumulative distribution is built once, then walked along a descending sequence of uniform random
+    // numbers, so drawing all the samples takes O(num_samples + nonzero amplitudes) time rather than
+    // O(num_samples * nonzero amplitudes). Like Sample, this does not modify the state: a dense
+    // wavefunction is sampled in index space rather than converted back to the hash table.
+    std::vector<std::pair<std::vector<std::uint64_t>, size_t>> SampleCounts(size_t num_samples, std::vector<logical_qubit_id> const& qubits) {
+        std::vector<std::pair<std::vector<std::uint64_t>, size_t>> counts;
+        if (num_samples == 0) {
+            return counts;
+        }
+        // A dense wavefunction is sampled in index space, so that it stays dense for later gates
+        std::vector<typename wavefunction::const_iterator> states;
+        std::vector<uint64_t> dense_indices;
+        std::vector<double> cdf;
+        double total = 0;
+        if (_is_dense) {
+            dense_indices.reserve(_dense_nonzeros);
+            cdf.reserve(_dense_nonzeros);
+            for (uint64_t i = 0; i < _dense.size(); ++i) {
+                const double square_amplitude = std::norm(_dense[i]);
+                if (square_amplitude == 0) {
+                    continue;
+                }
+                total += square_amplitude;
+                dense_indices.push_back(i);
+                cdf.push_back(total);
+            }
+        } else {
+            states.reserve(_qubit_data.size());
+            cdf.reserve(_qubit_data.size());
+            for (auto current_state = (_qubit_data).begin(); current_state != (_qubit_data).end(); ++current_state) {
+                total += std::norm(current_state->second);
+                states.push_back(current_state);
+                cdf.push_back(total);
+            }
+        }
+        if (cdf.empty()) {
+            return counts;
+        }
+
+        // The largest of n uniform random numbers is distributed as u^(1/n), and the rest are uniform below it,
+        // so the samples can be drawn in descending order without storing or sorting them
+        std::vector<size_t> hits(cdf.size(), 0);
+        size_t k = cdf.size() - 1;
+        double uniform = 1.0;
+        for (size_t n = num_samples; n > 0; --n) {
+            uniform *= std::pow(_rng(), 1.0 / n);
+            const double probability = uniform * total;
+            while (k > 0 && cdf[k - 1] > probability) {
+                --k;
+            }
+            hits[k]++;
+        }
+
+        const size_t num_words = (qubits.size() + 63) / 64;
+        for (size_t i = 0; i < cdf.size(); ++i) {
+            if (hits[i] == 0) {
+                continue;
+            }
+            const qubit_label label = _is_dense ? _dense_label(dense_indices[i]) : states[i]->first;
+            std::vector<std::uint64_t> outcome(num_words, 0);
+            for (size_t j = 0; j < qubits.size(); ++j) {
+                if (label.test(qubits[j])) {
+                    outcome[j / 64] |= std::uint64_t(1) << (j % 64);
+                }
+            }
+            counts.emplace_back(std::move(outcome), hits[i]);
+        }
+        return counts;
+    }
+
     void Assert(std::vector<Gates::Basis> const& axes, std::vector<logical_qubit_id> const& qubits, bool result) {
+        _make_sparse();
         // Bit-vectors indexing where gates of each type are applied
         qubit_label XYs = 0;
         qubit_label YZs = 0;
@@ -570,6 +730,7 @@ public:
     // by decomposing each pair of computational basis states into eigenvectors
     // and adding the coefficients of the respective components
     double MeasurementProbability(std::vector<Gates::Basis> const& axes, std::vector<logical_qubit_id> const& qubits) {
+        _make_sparse();
         // Bit-vectors indexing where gates of each type are applied
         qubit_label XYs = 0;
         qubit_label YZs = 0;
@@ -631,6 +792,90 @@ public:
         return 0.5 - 0.5 * projection.real();
     }
 
+    // Returns the weighted expectation value coefficient * <psi|P|psi> of each term of a sum
+    // of Pauli strings, computed directly from the amplitudes, without changing the state.
+    // A Pauli string is i^y X^x Z^z, where x holds the qubits with an X or Y, z those with
+    // a Y or Z, and y is the number of Ys. It sends |s> to i^y (-1)^|s & z| |s ^ x>, so
+    // <psi|P|psi> = i^y sum_s conj(a_{s ^ x}) (-1)^|s & z| a_s.
+    // Terms are grouped by x, so all the terms that flip the same qubits (e.g. all those
+    // made only of Zs) share a single pass over the wavefunction, in which the partner
+    // s ^ x of each state is looked up once. Passes over large wavefunctions are split
+    // between threads.
+    std::vector<double> PauliExpectations(std::vector<pauli_term> const& terms) {
+        // Masks z and weights (coefficient * i^y) of the terms, grouped by their masks x
+        std::vector<qubit_label> YZs(terms.size(), 0);
+        std::vector<amplitude> weights(terms.size());
+        std::vector<std::pair<qubit_label, std::vector<size_t>>> groups;
+        for (size_t t = 0; t < terms.size(); t++) {
+            qubit_label XYs = 0;
+            weights[t] = terms[t].coefficient;
+            for (size_t i = 0; i < terms[t].axes.size(); i++) {
+                switch (terms[t].axes[i]) {
+                    case Gates::Basis::PauliY:
+                        XYs.flip(terms[t].qubits[i]);
+                        YZs[t].flip(terms[t].qubits[i]);
+                        weights[t] *= amplitude(0, 1);
+                        break;
+                    case Gates::Basis::PauliX:
+                        XYs.flip(terms[t].qubits[i]);
+                        break;
+                    case Gates::Basis::PauliZ:
+                        YZs[t].flip(terms[t].qubits[i]);
+                        break;
+                    case Gates::Basis::PauliI:
+                        break;
+                    default:
+                        throw std::runtime_error("Bad Pauli basis");
+                }
+            }
+            auto group = std::find_if(groups.begin(), groups.end(), [&](auto const& g) { return g.first == XYs; });
+            if (group == groups.end()) {
+                groups.emplace_back(XYs, std::vector<size_t>{});
+                group = groups.end() - 1;
+            }
+            group->second.push_back(t);
+        }
+
+        std::vector<double> expectations(terms.size(), 0.0);
+        for (auto const& [XYs, group] : groups) {
+            std::vector<amplitude> sums;
+            if (_is_dense) {
+                sums = _dense_pauli_sums(XYs, group, YZs, weights);
+            } else {
+                // Adds the contribution of a state to the sum of each term of the group
+                auto add_state = [&](auto const& current_state, amplitude* state_sums) {
+                    amplitude product = std::norm(current_state.second);
+                    if (XYs.any()) {
+                        auto flipped_state = _qubit_data.find(current_state.first ^ XYs);
+                        if (flipped_state == _qubit_data.end()) {
+                            return;
+                        }
+                        product = std::conj(flipped_state->second) * current_state.second;
+                    }
+                    for (size_t k = 0; k < group.size(); k++) {
+                        state_sums[k] += get_parity(current_state.first & YZs[group[k]]) ? -product : product;
+                    }
+                };
+                if constexpr (std::random_access_iterator<decltype(_qubit_data.begin())>) {
+                    auto first = _qubit_data.begin();
+                    sums = _range_sums(_qubit_data.size(), group.size(), [&](size_t i, amplitude* state_sums) {
+                        add_state(first[i], state_sums);
+                    });
+                } else {
+                    sums.assign(group.size(), 0);
+                    for (auto const& current_state : _qubit_data) {
+                        add_state(current_state, sums.data());
+                    }
+                }
+            }
+            // The expectation value of a Hermitian operator is real
+            for (size_t k = 0; k < group.size(); k++) {
+                expectations[group[k]] = (weights[group[k]] * sums[k]).real();
+            }
+        }
+        return expectations;
+    }
+
     unsigned Measure(std::vector<Gates::Basis> const& axes, std::vector<logical_qubit_id> const& qubits){
         // Find a probability to get a specific result
         double probability = MeasurementProbability(axes, qubits);
@@ -646,6 +891,11 @@ public:
 
     // Probe the amplitude of a single basis state
     amplitude probe(qubit_label const& label) {
+        if (_is_dense) {
+            // States beyond the qubits spanned by the dense array are 0
+            // The qubits outside the dense array must match their fixed values
+            return (label & ~_dense_spanned()) == _dense_fixed ? _dense[_dense_index(label)] : amplitude(0.0, 0.0);
+        }
         auto qubit = _qubit_data.find(label);
         // States not in the hash map are assumed to be 0
         if (qubit == _qubit_data.end()) {
@@ -666,6 +916,7 @@ public:
     // This requires it to detect if the subspace is entangled, construct a new 
     // projected wavefunction, then call the `callback` function on each state.
     bool dump_qubits(std::vector<logical_qubit_id> const& qubits, callback_t const& callback) {
+        _make_sparse();
         // Create two wavefunctions
         // check if they are tensor products
         wavefunction dump_wfn;
@@ -685,6 +936,7 @@ public:
 
     // Dumps all the states in superposition via a callback function
     void dump_all(logical_qubit_id max_qubit_id, callback_t const& callback) {
+        _make_sparse();
         _DumpWavefunction_base(_qubit_data, [max_qubit_id, callback](qubit_label label, amplitude val) -> bool {
             return callback(label.to_string().substr(num_qubits-1-max_qubit_id).c_str(), val.real(), val.imag());
         });
@@ -731,12 +983,26 @@ public:
             }
         }
 
-        wavefunction new_qubit_data = make_wavefunction();
-        
-        // Iterates through and applies all operations
-        for (auto current_state = _qubit_data.begin(); current_state != _qubit_data.end(); ++current_state){
-            qubit_label label = current_state->first;
-            amplitude val = current_state->second;
+        // Diagonal gates only change amplitudes; any other gate is a permutation of the labels
+        bool relabel = false;
+        std::vector<logical_qubit_id> targets;
+        for (auto const& op : operation_vector) {
+            if (op.gate_type != OP::Z && op.gate_type != OP::MCZ && op.gate_type != OP::Phase && op.gate_type != OP::MCPhase) {
+                relabel = true;
+                targets.push_back(op.target);
+                if (op.gate_type == OP::SWAP || op.gate_type == OP::MCSWAP) {
+                    targets.push_back(op.target_2);
+                }
+            }
+        }
+        // A dense array is indexed by the bits of the qubits it spans, so the operations
+        // are rewritten in terms of those bits
+        if (_use_dense(targets)) {
+            operation_vector = _dense_operations(operation_vector);
+        }
+
+        // Iterates through and applies all operations, in place
+        _transform_in_place([&](qubit_label& label, amplitude& val) {
             // Iterate through vector of operations and apply each gate
             for (int i=0; i < operation_vector.size(); i++) { 
                 auto &op = operation_vector[i];
@@ -788,21 +1054,22 @@ public:
                         break;
                 }
             }
-            // Insert the new state into the new wavefunction
-            new_qubit_data.emplace(label, val);
-        }
-        _qubit_data = std::move(new_qubit_data);
+        }, relabel);
         operation_vector.clear();
     }
 
     void R(Gates::Basis b, double phi, logical_qubit_id index){
+        if (_use_dense({index})) {
+            _dense_unitary(qubit_label(), _rotation_matrix(b, phi), index);
+            return;
+        }
         // Z rotation can be done in-place
         if (b == Gates::Basis::PauliZ) {
             amplitude exp_0 = std::polar(1.0, -0.5*phi);
             amplitude exp_1 = std::polar(1.0, 0.5*phi);
-            for (auto current_state = (_qubit_data).begin(); current_state != (_qubit_data).end(); ++current_state) {
-                current_state->second *= current_state->first[index] ? exp_1 : exp_0;
-            }
+            _for_each_state([&](auto& current_state) {
+                current_state.second *= current_state.first[index] ? exp_1 : exp_0;
+            });
         }
         else if (b == Gates::Basis::PauliX || b == Gates::Basis::PauliY) {
             amplitude M00 = std::cos(phi / 2.0);
@@ -817,51 +1084,52 @@ public:
             }
 
             amplitude M10 = M01 * (b == Gates::Basis::PauliY ? -1. : 1.);
-            // Holds the amplitude of the new state to make it easier to check if it's non-zero
-            amplitude new_state;
             qubit_label flip(0);
             flip.set(index);
-            wavefunction new_qubit_data = make_wavefunction();
-            for (auto current_state = (_qubit_data).begin(); current_state != (_qubit_data).end(); ++current_state) {
-                auto flipped_state = _qubit_data.find(current_state->first ^ flip);
+            _apply_kernel([&](auto const& current_state, auto& emit) {
+                auto flipped_state = _qubit_data.find(current_state.first ^ flip);
                 if (flipped_state == _qubit_data.end()) { // no matching value
-                    if (current_state->first[index]) {// 1 on that qubit
-                        new_qubit_data.emplace(current_state->first ^ flip, current_state->second * M01);
-                        new_qubit_data.emplace(current_state->first, current_state->second * M00);
+                    if (current_state.first[index]) {// 1 on that qubit
+                        emit(current_state.first ^ flip, current_state.second * M01);
+                        emit(current_state.first, current_state.second * M00);
                     }
                     else {
-                        new_qubit_data.emplace(current_state->first, current_state->second * M00);
-                        new_qubit_data.emplace(current_state->first ^ flip, current_state->second * M10);
+                        emit(current_state.first, current_state.second * M00);
+                        emit(current_state.first ^ flip, current_state.second * M10);
                     }
                 }
                 // Add up the two values, only when reaching the zero value
-                else if (!(current_state->first[index])) {
-                    new_state = current_state->second * M00 + flipped_state->second * M01; // zero state
+                else if (!(current_state.first[index])) {
+                    // Holds the amplitude of the new state to make it easier to check if it's non-zero
+                    amplitude new_state = current_state.second * M00 + flipped_state->second * M01; // zero state
                     if (std::norm(new_state) > _rotation_precision) {
-                        new_qubit_data.emplace(current_state->first, new_state);
+                        emit(current_state.first, new_state);
                     }
-                    new_state = current_state->second * M10 + flipped_state->second * M00; // one state
+                    new_state = current_state.second * M10 + flipped_state->second * M00; // one state
                     if (std::norm(new_state) > _rotation_precision) {
-                        new_qubit_data.emplace(flipped_state->first, new_state);
+                        emit(flipped_state->first, new_state);
                     }
                 }
-            }
-            _qubit_data = std::move(new_qubit_data);
+            }, _qubit_data.size());
         }
     }
 
     // Multi-controlled rotation
     void MCR (std::vector<logical_qubit_id> const& controls, Gates::Basis b, double phi, logical_qubit_id target) {
         qubit_label checks = _get_mask(controls);
+        if (_use_dense({target})) {
+            _dense_unitary(checks, _rotation_matrix(b, phi), target);
+            return;
+        }
         // A Z-rotation can be done without recreating the wavefunction
         if (b == Gates::Basis::PauliZ) {
             amplitude exp_0 = std::polar(1.0, -0.5*phi);
             amplitude exp_1 = std::polar(1.0, 0.5*phi);
-            for (auto current_state = (_qubit_data).begin(); current_state != (_qubit_data).end(); ++current_state) {
-                if ((current_state->first & checks)==checks){
-                    current_state->second *= current_state->first[target] ? exp_1 : exp_0;
+            _for_each_state([&](auto& current_state) {
+                if ((current_state.first & checks)==checks){
+                    current_state.second *= current_state.first[target] ? exp_1 : exp_0;
                 }
-            }
+            });
         }
         // X or Y requires a new wavefunction
         else if (b == Gates::Basis::PauliX || b == Gates::Basis::PauliY) {
@@ -891,114 +1159,224 @@ public:
                 return;
             }
 
-            amplitude new_state;
             qubit_label flip(0);
             flip.set(target);
-            wavefunction new_qubit_data = make_wavefunction();
-            for (auto current_state = (_qubit_data).begin(); current_state != (_qubit_data).end(); ++current_state) {
-                if ((current_state->first & checks)==checks){
-                    auto flipped_state = _qubit_data.find(current_state->first ^ flip);
+            _apply_kernel([&](auto const& current_state, auto& emit) {
+                if ((current_state.first & checks)==checks){
+                    auto flipped_state = _qubit_data.find(current_state.first ^ flip);
                     if (flipped_state == _qubit_data.end()) { // no matching value
-                        if (current_state->first[target]) {// 1 on that qubit
-                            new_qubit_data.emplace(current_state->first ^ flip, current_state->second * M01);
-                            new_qubit_data.emplace(current_state->first, current_state->second * M00);
+                        if (current_state.first[target]) {// 1 on that qubit
+                            emit(current_state.first ^ flip, current_state.second * M01);
+                            emit(current_state.first, current_state.second * M00);
                         }
                         else {
-                            new_qubit_data.emplace(current_state->first, current_state->second * M00);
-                            new_qubit_data.emplace(current_state->first ^ flip, current_state->second * M10);
+                            emit(current_state.first, current_state.second * M00);
+                            emit(current_state.first ^ flip, current_state.second * M10);
                         }
                     }
                     // Add up the two values, only when reaching the zero val
-                    else if (!(current_state->first[target])) {
-                        new_state = current_state->second * M00 + flipped_state->second * M01; // zero state
+                    else if (!(current_state.first[target])) {
+                        amplitude new_state = current_state.second * M00 + flipped_state->second * M01; // zero state
                         if (std::norm(new_state) > _rotation_precision) {
-                            new_qubit_data.emplace(current_state->first, new_state);
+                            emit(current_state.first, new_state);
                         }
-                        new_state = current_state->second * M10 + flipped_state->second * M00; // one state
+                        new_state = current_state.second * M10 + flipped_state->second * M00; // one state
                         if (std::norm(new_state) > _rotation_precision) {
-                            new_qubit_data.emplace(flipped_state->first, new_state);
+                            emit(flipped_state->first, new_state);
                         }
                     }
                 } else {
-                    new_qubit_data.emplace(current_state->first, current_state->second);
+                    emit(current_state.first, current_state.second);
                 }
+            }, _qubit_data.size());
+        }
+    }
+
+    // Arbitrary single-qubit gate
+    void Unitary(single_qubit_unitary const& matrix, logical_qubit_id index){
+        MCUnitary(std::vector<logical_qubit_id>{}, matrix, index);
+    }
+
+    // Multi-controlled arbitrary single-qubit gate
+    // Diagonal and anti-diagonal gates are applied in place
+    void MCUnitary(std::vector<logical_qubit_id> const& controls, single_qubit_unitary const& matrix, logical_qubit_id index){
+        const amplitude M00 = matrix[0], M01 = matrix[1], M10 = matrix[2], M11 = matrix[3];
+        qubit_label checks = _get_mask(controls);
+        if (_use_dense({index})) {
+            _dense_unitary(checks, matrix, index);
+            return;
+        }
+        qubit_label flip(0);
+        flip.set(index);
+        if (std::norm(M01) <= _rotation_precision && std::norm(M10) <= _rotation_precision) {
+            _transform_in_place([&](qubit_label& label, amplitude& val) {
+                if ((label & checks) == checks) {
+                    val *= label[index] ? M11 : M00;
+                }
+            }, false);
+            return;
+        }
+        if (std::norm(M00) <= _rotation_precision && std::norm(M11) <= _rotation_precision) {
+            _transform_in_place([&](qubit_label& label, amplitude& val) {
+                if ((label & checks) == checks) {
+                    val *= label[index] ? M01 : M10;
+                    label ^= flip;
+                }
+            }, true);
+            return;
+        }
+        _apply_kernel([&](auto const& current_state, auto& emit) {
+            if ((current_state.first & checks) != checks) {
+                emit(current_state.first, current_state.second);
+                return;
             }
-            _qubit_data = std::move(new_qubit_data);
+            auto flipped_state = _qubit_data.find(current_state.first ^ flip);
+            if (flipped_state == _qubit_data.end()) { // no matching value
+                if (current_state.first[index]) {// 1 on that qubit
+                    emit(current_state.first ^ flip, current_state.second * M01);
+                    emit(current_state.first, current_state.second * M11);
+                }
+                else {
+                    emit(current_state.first, current_state.second * M00);
+                    emit(current_state.first ^ flip, current_state.second * M10);
+                }
+            }
+            // Add up the two values, only when reaching the zero value
+            else if (!(current_state.first[index])) {
+                amplitude new_state = M00 * current_state.second + M01 * flipped_state->second; // zero state
+                if (std::norm(new_state) > _rotation_precision) {
+                    emit(current_state.first, new_state);
+                }
+                new_state = M10 * current_state.second + M11 * flipped_state->second; // one state
+                if (std::norm(new_state) > _rotation_precision) {
+                    emit(flipped_state->first, new_state);
+                }
+            }
+        }, _qubit_data.size() * 2);
+    }
+
+    // Multi-controlled arbitrary two-qubit gate
+    // The matrix is indexed by 2*(bit of index_1) + (bit of index_2)
+    // The four states that differ only on the two targets are combined by whichever
+    // of them comes first in that order and is present in the wavefunction
+    void MCUnitary(std::vector<logical_qubit_id> const& controls, two_qubit_unitary const& matrix, logical_qubit_id index_1, logical_qubit_id index_2){
+        qubit_label checks = _get_mask(controls);
+        qubit_label targets(0);
+        targets.set(index_1);
+        targets.set(index_2);
+        if (_use_dense({index_1, index_2})) {
+            _dense_unitary(checks, matrix, index_1, index_2);
+            return;
         }
+        _apply_kernel([&](auto const& current_state, auto& emit) {
+            if ((current_state.first & checks) != checks) {
+                emit(current_state.first, current_state.second);
+                return;
+            }
+            const size_t own = 2 * current_state.first[index_1] + current_state.first[index_2];
+            std::array<qubit_label, 4> labels;
+            std::array<amplitude, 4> old_state;
+            for (size_t k = 0; k < 4; ++k) {
+                labels[k] = current_state.first & ~targets;
+                labels[k].set(index_1, k & 2);
+                labels[k].set(index_2, k & 1);
+                if (k == own) {
+                    old_state[k] = current_state.second;
+                    continue;
+                }
+                auto other_state = _qubit_data.find(labels[k]);
+                if (other_state == _qubit_data.end()) {
+                    old_state[k] = 0;
+                } else if (k < own) {
+                    return; // Handled by the other state
+                } else {
+                    old_state[k] = other_state->second;
+                }
+            }
+            for (size_t row = 0; row < 4; ++row) {
+                amplitude new_state = 0;
+                for (size_t k = 0; k < 4; ++k) {
+                    new_state += matrix[4 * row + k] * old_state[k];
+                }
+                if (std::norm(new_state) > _rotation_precision) {
+                    emit(labels[row], new_state);
+                }
+            }
+        }, _qubit_data.size() * 2);
     }
 
     void H(logical_qubit_id index){
-        // Initialize a new wavefunction, which will store the modified state
-        // We initialize with twice as much space as the current one,
-        // as this is the worst case result of an H gate
-        wavefunction new_qubit_data = make_wavefunction(_qubit_data.size() * 2);
+        if (_use_dense({index})) {
+            _dense_unitary(qubit_label(), {_normalizer, _normalizer, _normalizer, -_normalizer}, index);
+            return;
+        }
         // This label makes it easier to find associated labels (where the index is flipped)
         qubit_label flip(0);
         flip.set(index);
-        // The amplitude for the new state
-        amplitude new_state;
-        // Loops over all states in the wavefunction _qubit_data
-        for (auto current_state = (_qubit_data).begin(); current_state != (_qubit_data).end(); ++current_state) {
+        // Builds a new wavefunction from all states in the wavefunction _qubit_data
+        // We initialize it with twice as much space as the current one,
+        // as this is the worst case result of an H gate
+        _apply_kernel([&](auto const& current_state, auto& emit) {
             // An iterator pointing to the state labelled by the flip
-            auto flipped_state = _qubit_data.find(current_state->first ^ flip);
+            auto flipped_state = _qubit_data.find(current_state.first ^ flip);
             // Checks for whether it needs to add amplitudes from matching states
             // or create two new states
             if (flipped_state == _qubit_data.end()) { // no matching value
-                new_qubit_data.emplace(current_state->first & (~flip), current_state->second * _normalizer);
+                emit(current_state.first & (~flip), current_state.second * _normalizer);
                 // Flip the value if the second bit, depending on whether the original had 1 or 0
-                new_qubit_data.emplace(current_state->first | flip, current_state->second * (current_state->first[index] ? -_normalizer : _normalizer));
+                emit(current_state.first | flip, current_state.second * (current_state.first[index] ? -_normalizer : _normalizer));
             }
-            else if (!(current_state->first[index])) {
-                new_state = current_state->second + flipped_state->second; // zero state
+            else if (!(current_state.first[index])) {
+                // The amplitude for the new state
+                amplitude new_state = current_state.second + flipped_state->second; // zero state
                 if (std::norm(new_state) > _rotation_precision) {
-                    new_qubit_data.emplace(current_state->first, new_state * _normalizer);
+                    emit(current_state.first, new_state * _normalizer);
                 }
 
-                new_state = current_state->second - flipped_state->second; // one state
+                new_state = current_state.second - flipped_state->second; // one state
                 if (std::norm(new_state) > _rotation_precision) {
-                    new_qubit_data.emplace(current_state->first | flip, new_state * _normalizer);
+                    emit(current_state.first | flip, new_state * _normalizer);
                 }
             }
-        }
-        // Moves the new data back into the old one (thus destroying
-        // the old data)
-        _qubit_data = std::move(new_qubit_data);
+        }, _qubit_data.size() * 2);
     }
 
     void MCH(std::vector<logical_qubit_id> const& controls, logical_qubit_id index){
-        wavefunction new_qubit_data = make_wavefunction(_qubit_data.size() * 2);
+        qubit_label checks = _get_mask(controls);
+        if (_use_dense({index})) {
+            _dense_unitary(checks, {_normalizer, _normalizer, _normalizer, -_normalizer}, index);
+            return;
+        }
         qubit_label flip(0);
         flip.set(index);
-        amplitude new_state;
-        qubit_label checks = _get_mask(controls);
-        for (auto current_state = (_qubit_data).begin(); current_state != (_qubit_data).end(); ++current_state) {
-            if ((checks & current_state->first) == checks){
-                auto flipped_state = _qubit_data.find(current_state->first ^ flip);
+        _apply_kernel([&](auto const& current_state, auto& emit) {
+            if ((checks & current_state.first) == checks){
+                auto flipped_state = _qubit_data.find(current_state.first ^ flip);
                 if (flipped_state == _qubit_data.end()) { // no matching value
-                    new_qubit_data.emplace(current_state->first & (~flip), current_state->second * _normalizer);
+                    emit(current_state.first & (~flip), current_state.second * _normalizer);
                     // Flip the value if the second bit, depending on whether the original had 1 or 0
-                    new_qubit_data.emplace(current_state->first | flip, current_state->second * (current_state->first[index] ? -_normalizer : _normalizer));
+                    emit(current_state.first | flip, current_state.second * (current_state.first[index] ? -_normalizer : _normalizer));
                 }
-                else if (!(current_state->first[index])) {
-                    new_state = current_state->second + flipped_state->second; // zero state
+                else if (!(current_state.first[index])) {
+                    amplitude new_state = current_state.second + flipped_state->second; // zero state
                     if (std::norm(new_state) > _rotation_precision) {
-                        new_qubit_data.emplace(current_state->first, new_state * _normalizer);
+                        emit(current_state.first, new_state * _normalizer);
                     }
 
-                    new_state = current_state->second - flipped_state->second; // one state
+                    new_state = current_state.second - flipped_state->second; // one state
                     if (std::norm(new_state) > _rotation_precision) {
-                        new_qubit_data.emplace(current_state->first | flip, new_state * _normalizer);
+                        emit(current_state.first | flip, new_state * _normalizer);
                     }
                 }
             } else {
-                new_qubit_data.emplace(current_state->first, current_state->second);
+                emit(current_state.first, current_state.second);
             }
-        }
-        _qubit_data = std::move(new_qubit_data);
+        }, _qubit_data.size() * 2);
     }
 
     // Checks whether a qubit is 0 in all states in the superposition
     bool is_qubit_zero(logical_qubit_id target){
+        _make_sparse();
         for (auto current_state = _qubit_data.begin(); current_state != _qubit_data.end(); ++current_state){
             if (current_state->first[target] && std::norm(current_state->second) > _precision) {
                 return false;
@@ -1011,6 +1389,7 @@ public:
     // result.first is true iff it is classical
     // result.second holds its classical value if result.first == true
     std::pair<bool,bool> is_qubit_classical(logical_qubit_id target){
+        _make_sparse();
         bool value_found = false;
         bool value = false;
         for (auto current_state = _qubit_data.begin(); current_state != _qubit_data.end(); ++current_state){
@@ -1030,6 +1409,7 @@ public:
     // Not intended for computations but as a way to transfer between
     // simulators templated with different numbers of qubits
     universal_wavefunction get_universal_wavefunction() {
+        _make_sparse();
         universal_wavefunction universal_qubit_data = universal_wavefunction(_qubit_data.bucket_count());
         for (auto current_state = _qubit_data.begin(); current_state != _qubit_data.end(); ++current_state) {
             universal_qubit_data.emplace(current_state->first.to_string(), current_state->second);
@@ -1063,6 +1443,547 @@ private:
     // Used when allocating new wavefunctions
     float _load_factor = 0.9375;
 
+    // Number of shards that gates on large wavefunctions are split into,
+    // each handled by a task on the Qristal thread pool
+    size_t _num_threads = 1;
+
+    // Smallest wavefunction worth splitting between threads
+    static constexpr size_t _min_parallel_size = 1 << 14;
+
+    // Dense array of amplitudes, used instead of the hash table while _is_dense is true.
+    // Bit k of an index is the value of qubit _dense_qubits[k]; all other qubits have the
+    // values in _dense_fixed in every state.
+    std::vector<amplitude> _dense;
+    std::vector<amplitude> _dense_scratch;
+    bool _is_dense = false;
+    std::vector<logical_qubit_id> _dense_qubits;
+    qubit_label _dense_fixed;
+
+    // Number of amplitudes of the dense array that are not zero
+    size_t _dense_nonzeros = 0;
+
+    // Fraction of the basis states of the spanned qubits in superposition above which the
+    // wavefunction is stored densely
+    double _dense_threshold = 0.125;
+
+    // Largest number of qubits that a dense array may span
+    logical_qubit_id _max_dense_qubits = std::min<logical_qubit_id>(num_qubits, 26);
+
+    // Smallest wavefunction worth storing densely
+    static constexpr size_t _min_dense_size = 1 << 12;
+
+    // Size of the hash table at which to check again whether to store it densely
+    size_t _next_dense_check = _min_dense_size;
+
+    // Number of conversions to and from a dense array
+    size_t _dense_conversions = 0;
+    size_t _sparse_conversions = 0;
+
+    // Whether gates should be split between threads
+    bool _run_parallel() const {
+        return _num_threads > 1 && _qubit_data.size() >= _min_parallel_size;
+    }
+
+    // Matrix of a rotation about a Pauli axis
+    static single_qubit_unitary _rotation_matrix(Gates::Basis b, double phi) {
+        const double c = std::cos(0.5 * phi);
+        const double s = std::sin(0.5 * phi);
+        switch (b) {
+            case Gates::Basis::PauliX:
+                return {c, -1i*s, -1i*s, c};
+            case Gates::Basis::PauliY:
+                return {c, -s, s, c};
+            case Gates::Basis::PauliZ:
+                return {std::polar(1.0, -0.5*phi), 0, 0, std::polar(1.0, 0.5*phi)};
+            default:
+                throw std::runtime_error("Bad Pauli basis");
+        }
+    }
+
+    // Qubits spanned by the dense array, as a label
+    qubit_label _dense_spanned() const {
+        qubit_label spanned(0);
+        for (logical_qubit_id q : _dense_qubits) {
+            spanned.set(q);
+        }
+        return spanned;
+    }
+
+    // Index in the dense array of a state
+    uint64_t _dense_index(qubit_label const& label) const {
+        uint64_t index = 0;
+        for (size_t k = 0; k < _dense_qubits.size(); ++k) {
+            index |= uint64_t(label[_dense_qubits[k]]) << k;
+        }
+        return index;
+    }
+
+    // State at an index of the dense array
+    qubit_label _dense_label(uint64_t index) const {
+        qubit_label label = _dense_fixed;
+        for (size_t k = 0; k < _dense_qubits.size(); ++k) {
+            label.set(_dense_qubits[k], (index >> k) & 1);
+        }
+        return label;
+    }
+
+    // Bit of the dense index holding a qubit, which must be spanned by the dense array
+    logical_qubit_id _dense_position(logical_qubit_id qubit) const {
+        return logical_qubit_id(std::find(_dense_qubits.begin(), _dense_qubits.end(), qubit) - _dense_qubits.begin());
+    }
+
+    // Turns controls into a mask of bits of the dense index. Controls on qubits outside
+    // the array take their fixed values, so returns false if one of them is 0.
+    bool _dense_controls(qubit_label const& checks, uint64_t& mask) const {
+        if ((checks & ~_dense_spanned() & ~_dense_fixed).any()) {
+            return false;
+        }
+        mask = _dense_index(checks);
+        return true;
+    }
+
+    // Readies the wavefunction for a gate that changes the qubits in targets, and returns
+    // whether the gate should be applied to the dense array.
+    // The dense array spans only the qubits that are not the same in every state, plus any
+    // targets, so classical registers and ancillas cost nothing. A target not spanned yet
+    // doubles the array, unless that makes it too large, in which case it goes back to a
+    // hash map. A hash map becomes a dense array when enough of the basis states of the
+    // qubits it would span are in superposition; finding those qubits takes a pass over
+    // all the states, so this is only checked each time the hash map doubles in size.
+    bool _use_dense(std::initializer_list<logical_qubit_id> targets) {
+        return _use_dense<std::initializer_list<logical_qubit_id>>(targets);
+    }
+
+    template <typename Targets = std::vector<logical_qubit_id>>
+    bool _use_dense(Targets const& targets) {
+        if (_is_dense) {
+            for (logical_qubit_id target : targets) {
+                if (std::find(_dense_qubits.begin(), _dense_qubits.end(), target) != _dense_qubits.end()) {
+                    continue;
+                }
+                if (_dense_qubits.size() >= _max_dense_qubits) {
+                    _make_sparse();
+                    return false;
+                }
+                // The new qubit is the highest bit of the index, so the states
+                // where it is 1 are the upper half of the array
+                const size_t size = _dense.size();
+                _dense.resize(2 * size, 0);
+                if (_dense_fixed[target]) {
+                    std::copy(_dense.begin(), _dense.begin() + size, _dense.begin() + size);
+                    std::fill(_dense.begin(), _dense.begin() + size, 0);
+                    _dense_fixed.reset(target);
+                }
+                _dense_qubits.push_back(target);
+            }
+            return true;
+        }
+        if (_dense_threshold <= 0 || _qubit_data.size() < _next_dense_check) {
+            return false;
+        }
+        _next_dense_check = 2 * _qubit_data.size();
+        const qubit_label first = _qubit_data.begin()->first;
+        qubit_label spanned(0);
+        for (auto current_state = _qubit_data.begin(); current_state != _qubit_data.end(); ++current_state) {
+            spanned |= current_state->first ^ first;
+        }
+        for (logical_qubit_id target : targets) {
+            spanned.set(target);
+        }
+        const size_t width = spanned.count();
+        if (width > _max_dense_qubits || _qubit_data.size() < _dense_threshold * std::ldexp(1.0, width)) {
+            return false;
+        }
+        _dense_qubits.clear();
+        for (logical_qubit_id q = 0; q < num_qubits && _dense_qubits.size() < width; ++q) {
+            if (spanned[q]) {
+                _dense_qubits.push_back(q);
+            }
+        }
+        _dense_fixed = first & ~spanned;
+        _dense.assign(size_t(1) << width, 0);
+        for (auto current_state = _qubit_data.begin(); current_state != _qubit_data.end(); ++current_state) {
+            _dense[_dense_index(current_state->first)] = current_state->second;
+        }
+        _dense_nonzeros = _qubit_data.size();
+        _qubit_data = make_wavefunction(0);
+        _is_dense = true;
+        _dense_conversions++;
+        return true;
+    }
+
+    // Turns a dense array back into a hash map, dropping amplitudes too small to keep
+    void _make_sparse() {
+        if (!_is_dense) {
+            return;
+        }
+        wavefunction new_qubit_data = make_wavefunction(_dense_nonzeros);
+        for (size_t i = 0; i < _dense.size(); ++i) {
+            if (std::norm(_dense[i]) > _rotation_precision) {
+                new_qubit_data.emplace(_dense_label(i), _dense[i]);
+            }
+        }
+        _qubit_data = std::move(new_qubit_data);
+        _dense = std::vector<amplitude>();
+        _dense_scratch = std::vector<amplitude>();
+        _dense_qubits.clear();
+        _is_dense = false;
+        _sparse_conversions++;
+        _next_dense_check = std::max(_min_dense_size, 2 * _qubit_data.size());
+    }
+
+    // Rewrites phase and permutation operations in terms of the bits of the dense index.
+    // Diagonal gates become multi-controlled ones on all their qubits, so that those outside
+    // the array can be dropped from the controls, or the gate dropped, by their fixed values.
+    std::vector<internal_operation> _dense_operations(std::vector<internal_operation> const& operations) const {
+        std::vector<internal_operation> dense_operations;
+        dense_operations.reserve(operations.size());
+        for (auto const& op : operations) {
+            qubit_label controls = op.controls;
+            if (op.gate_type == OP::Z || op.gate_type == OP::Phase) {
+                controls = qubit_label().set(op.target);
+            } else if (op.gate_type != OP::MCX && op.gate_type != OP::MCY && op.gate_type != OP::MCZ &&
+                       op.gate_type != OP::MCPhase && op.gate_type != OP::MCSWAP) {
+                controls.reset();
+            }
+            uint64_t mask;
+            if (!_dense_controls(controls, mask)) {
+                continue;
+            }
+            const qubit_label dense_controls(mask);
+            switch (op.gate_type) {
+                case OP::X:
+                case OP::Y:
+                    dense_operations.push_back(internal_operation(op.gate_type, _dense_position(op.target)));
+                    break;
+                case OP::MCX:
+                case OP::MCY:
+                    dense_operations.push_back(internal_operation(op.gate_type, _dense_position(op.target), dense_controls));
+                    break;
+                case OP::Z:
+                case OP::MCZ:
+                    dense_operations.push_back(internal_operation(OP::MCZ, 0, dense_controls));
+                    break;
+                case OP::Phase:
+                case OP::MCPhase:
+                    dense_operations.push_back(internal_operation(OP::MCPhase, 0, dense_controls, op.phase));
+                    break;
+                case OP::SWAP:
+                    dense_operations.push_back(internal_operation(op.gate_type, _dense_position(op.target), _dense_position(op.target_2)));
+                    break;
+                case OP::MCSWAP:
+                    dense_operations.push_back(internal_operation(op.gate_type, _dense_position(op.target), dense_controls, _dense_position(op.target_2)));
+                    break;
+                default:
+                    throw std::runtime_error("Unsupported operation");
+            }
+        }
+        return dense_operations;
+    }
+
+    // Records the number of nonzero amplitudes left by a gate on the dense array, and goes back to
+    // a hash map if there are few enough
+    void _update_dense_nonzeros(size_t nonzeros) {
+        _dense_nonzeros = nonzeros;
+        if (nonzeros < 0.25 * _dense_threshold * _dense.size()) {
+            _make_sparse();
+        }
+    }
+
+    // Calls f(i) for every i in [0, n), split between threads for large arrays, and returns the
+    // sum of the results
+    template <typename Function>
+    size_t _dense_sum(size_t n, Function&& f) {
+        const size_t n_chunks = (_num_threads > 1 && n >= _min_parallel_size) ? _num_threads : 1;
+        std::vector<size_t> sums(n_chunks, 0);
+        auto run = [&](size_t chunk) {
+            size_t sum = 0;
+            for (size_t i = n * chunk / n_chunks; i < n * (chunk + 1) / n_chunks; ++i) {
+                sum += f(i);
+            }
+            sums[chunk] = sum;
+        };
+        if (n_chunks == 1) {
+            run(0);
+        } else {
+            qristal::thread_pool::parallel_for(0, n_chunks, 1, run);
+        }
+        return std::accumulate(sums.begin(), sums.end(), size_t(0));
+    }
+
+    // Calls f(i, sums) for every i in [0, n), split between threads for large ranges, where
+    // f adds to an array of width sums, and returns the totals of those sums
+    template <typename Function>
+    std::vector<amplitude> _range_sums(size_t n, size_t width, Function&& f) {
+        const size_t n_chunks = (_num_threads > 1 && n >= _min_parallel_size) ? _num_threads : 1;
+        std::vector<amplitude> sums(n_chunks * width, 0);
+        auto run = [&](size_t chunk) {
+            std::vector<amplitude> chunk_sums(width, 0);
+            for (size_t i = n * chunk / n_chunks; i < n * (chunk + 1) / n_chunks; ++i) {
+                f(i, chunk_sums.data());
+            }
+            std::copy(chunk_sums.begin(), chunk_sums.end(), sums.begin() + chunk * width);
+        };
+        if (n_chunks == 1) {
+            run(0);
+        } else {
+            qristal::thread_pool::parallel_for(0, n_chunks, 1, run);
+        }
+        for (size_t chunk = 1; chunk < n_chunks; ++chunk) {
+            for (size_t k = 0; k < width; ++k) {
+                sums[k] += sums[chunk * width + k];
+            }
+        }
+        sums.resize(width);
+        return sums;
+    }
+
+    // Inserts a zero bit into an index at a given position
+    static uint64_t _insert_zero(uint64_t i, logical_qubit_id position) {
+        const uint64_t low = (uint64_t(1) << position) - 1;
+        return ((i & ~low) << 1) | (i & low);
+    }
+
+    // Applies a single-qubit gate to the dense array, on the states whose labels contain checks
+    void _dense_unitary(qubit_label const& checks, single_qubit_unitary const& matrix, logical_qubit_id qubit) {
+        uint64_t controls;
+        if (!_dense_controls(checks, controls)) {
+            return;
+        }
+        const logical_qubit_id index = _dense_position(qubit);
+        const uint64_t flip = uint64_t(1) << index;
+        const amplitude M00 = matrix[0], M01 = matrix[1], M10 = matrix[2], M11 = matrix[3];
+        _update_dense_nonzeros(_dense_sum(_dense.size() / 2, [&](uint64_t i) -> size_t {
+            const uint64_t i0 = _insert_zero(i, index);
+            amplitude& a0 = _dense[i0];
+            amplitude& a1 = _dense[i0 | flip];
+            if ((i0 & controls) == controls) {
+                const amplitude old_0 = a0;
+                a0 = M00 * old_0 + M01 * a1;
+                a1 = M10 * old_0 + M11 * a1;
+            }
+            return (std::norm(a0) > _rotation_precision) + (std::norm(a1) > _rotation_precision);
+        }));
+    }
+
+    // Applies a two-qubit gate to the dense array, on the states whose labels contain checks
+    void _dense_unitary(qubit_label const& checks, two_qubit_unitary const& matrix, logical_qubit_id qubit_1, logical_qubit_id qubit_2) {
+        uint64_t controls;
+        if (!_dense_controls(checks, controls)) {
+            return;
+        }
+        const logical_qubit_id index_1 = _dense_position(qubit_1);
+        const logical_qubit_id index_2 = _dense_position(qubit_2);
+        const uint64_t flip_1 = uint64_t(1) << index_1;
+        const uint64_t flip_2 = uint64_t(1) << index_2;
+        _update_dense_nonzeros(_dense_sum(_dense.size() / 4, [&](uint64_t i) -> size_t {
+            const uint64_t base = _insert_zero(_insert_zero(i, std::min(index_1, index_2)), std::max(index_1, index_2));
+            const uint64_t indices[4] = {base, base | flip_2, base | flip_1, base | flip_1 | flip_2};
+            size_t nonzeros = 0;
+            if ((base & controls) == controls) {
+                amplitude old_state[4];
+                for (size_t k = 0; k < 4; ++k) {
+                    old_state[k] = _dense[indices[k]];
+                }
+                for (size_t row = 0; row < 4; ++row) {
+                    amplitude new_state = 0;
+                    for (size_t k = 0; k < 4; ++k) {
+                        new_state += matrix[4 * row + k] * old_state[k];
+                    }
+                    _dense[indices[row]] = new_state;
+                }
+            }
+            for (size_t k = 0; k < 4; ++k) {
+                nonzeros += std::norm(_dense[indices[k]]) > _rotation_precision;
+            }
+            return nonzeros;
+        }));
+    }
+
+    // Dense version of the pass of PauliExpectations over the states, for the terms of a group
+    // flipping the qubits in XYs. Flipping a qubit outside the array gives a state that is not
+    // there, and a Z on one gives the sign of its fixed value.
+    std::vector<amplitude> _dense_pauli_sums(qubit_label const& XYs, std::vector<size_t> const& group, std::vector<qubit_label> const& YZs, std::vector<amplitude> const& weights) {
+        if ((XYs & ~_dense_spanned()).any()) {
+            return std::vector<amplitude>(group.size(), 0);
+        }
+        const uint64_t flip = _dense_index(XYs);
+        std::vector<uint64_t> masks;
+        for (size_t t : group) {
+            masks.push_back(_dense_index(YZs[t]));
+        }
+        std::vector<amplitude> sums = _range_sums(_dense.size(), group.size(), [&](uint64_t i, amplitude* state_sums) {
+            const amplitude product = std::conj(_dense[i ^ flip]) * _dense[i];
+            for (size_t k = 0; k < masks.size(); k++) {
+                state_sums[k] += (std::popcount(i & masks[k]) & 1) ? -product : product;
+            }
+        });
+        for (size_t k = 0; k < group.size(); k++) {
+            if (get_parity(YZs[group[k]] & _dense_fixed)) {
+                sums[k] = -sums[k];
+            }
+        }
+        return sums;
+    }
+
+    // Dense version of _transform_in_place, where the labels passed to f are indices of the
+    // dense array. Relabelled amplitudes are written to a scratch array, which then becomes
+    // the dense array.
+    template <typename Function>
+    void _dense_transform_in_place(Function& f, bool relabel) {
+        if (relabel) {
+            _dense_scratch.assign(_dense.size(), 0);
+        }
+        _update_dense_nonzeros(_dense_sum(_dense.size(), [&](uint64_t i) -> size_t {
+            if (_dense[i] == amplitude(0)) {
+                return 0;
+            }
+            qubit_label label(i);
+            amplitude val = _dense[i];
+            f(label, val);
+            (relabel ? _dense_scratch[label.to_ullong()] : _dense[i]) = val;
+            return std::norm(val) > _rotation_precision;
+        }));
+        if (relabel) {
+            _dense.swap(_dense_scratch);
+        }
+    }
+
+    // Calls f on every state of the wavefunction, in place
+    // States are split between threads when the table can be indexed directly
+    template <typename Function>
+    void _for_each_state(Function&& f) {
+        _make_sparse();
+        if constexpr (std::random_access_iterator<decltype(_qubit_data.begin())>) {
+            if (_run_parallel()) {
+                const size_t size = _qubit_data.size();
+                const size_t n_chunks = _num_threads;
+                qristal::thread_pool::parallel_for(0, n_chunks, 1, [&](size_t chunk) {
+                    auto first = _qubit_data.begin();
+                    for (size_t i = size * chunk / n_chunks; i < size * (chunk + 1) / n_chunks; ++i) {
+                        f(first[i]);
+                    }
+                });
+                return;
+            }
+        }
+        for (auto current_state = _qubit_data.begin(); current_state != _qubit_data.end(); ++current_state) {
+            f(*current_state);
+        }
+    }
+
+    // Calls f(label, val) on every state, changing its label and amplitude in place
+    // If relabel is true, f may change labels, as long as they stay distinct, and the
+    // wavefunction is then re-indexed without allocating a new table
+    template <typename Function>
+    void _transform_in_place(Function&& f, bool relabel) {
+        if (_is_dense) {
+            _dense_transform_in_place(f, relabel);
+            return;
+        }
+        if constexpr (std::is_same_v<wavefunction, flat_wavefunction<qubit_label, amplitude>>) {
+            _for_each_state([&](auto& current_state) { f(current_state.first, current_state.second); });
+            if (relabel) {
+                const size_t n_chunks = _run_parallel() ? _num_threads : 1;
+                _qubit_data.reindex(n_chunks, [](size_t n, auto&& g) { qristal::thread_pool::parallel_for(0, n, 1, g); });
+            }
+        } else if (!relabel) {
+            for (auto current_state = _qubit_data.begin(); current_state != _qubit_data.end(); ++current_state) {
+                qubit_label label = current_state->first;
+                f(label, current_state->second);
+            }
+        } else {
+            // Keys of a std::unordered_map are const, so the nodes are taken out, changed and put back
+            std::vector<typename wavefunction::node_type> nodes;
+            nodes.reserve(_qubit_data.size());
+            while (!_qubit_data.empty()) {
+                nodes.push_back(_qubit_data.extract(_qubit_data.begin()));
+            }
+            for (auto& node : nodes) {
+                f(node.key(), node.mapped());
+                _qubit_data.insert(std::move(node));
+            }
+        }
+    }
+
+    // Replaces the wavefunction by a new one, built by calling kernel(state, emit) on each state,
+    // where emit(label, val) adds a state to the new wavefunction
+    // No label may be emitted twice, so the order in which states are handled does not matter
+    // new_size is the expected size of the new wavefunction
+    template <typename Kernel>
+    void _apply_kernel(Kernel&& kernel, size_t new_size) {
+        _make_sparse();
+        if (_run_parallel()) {
+            _apply_kernel_sharded(kernel);
+            return;
+        }
+        wavefunction new_qubit_data = make_wavefunction(new_size);
+        auto emit = [&new_qubit_data](qubit_label const& label, amplitude val) {
+            new_qubit_data.emplace(label, val);
+        };
+        for (auto current_state = _qubit_data.begin(); current_state != _qubit_data.end(); ++current_state) {
+            kernel(*current_state, emit);
+        }
+        // Moves the new data back into the old one (thus destroying
+        // the old data)
+        _qubit_data = std::move(new_qubit_data);
+    }
+
+    // Multithreaded version of _apply_kernel
+    // The states are split into one chunk per thread, and each thread sorts the states it
+    // emits into shards by the hash of their labels. The shards are then turned into
+    // tables in parallel: for a flat_wavefunction, they are copied into place and indexed
+    // concurrently; for a std::unordered_map, each shard is built into its own table and
+    // the tables are spliced together.
+    template <typename Kernel>
+    void _apply_kernel_sharded(Kernel& kernel) {
+        using state = std::pair<qubit_label, amplitude>;
+        const size_t n_threads = _num_threads;
+        const size_t size = _qubit_data.size();
+        const auto hash = _qubit_data.hash_function();
+
+        // Random access to the states, whatever the table
+        std::vector<decltype(&*_qubit_data.begin())> states;
+        states.reserve(size);
+        for (auto current_state = _qubit_data.begin(); current_state != _qubit_data.end(); ++current_state) {
+            states.push_back(&*current_state);
+        }
+
+        // shards[s*n_threads + t] holds the states emitted by thread t into shard s
+        std::vector<std::vector<state>> shards(n_threads * n_threads);
+        qristal::thread_pool::parallel_for(0, n_threads, 1, [&](size_t t) {
+            auto emit = [&](qubit_label const& label, amplitude val) {
+                // The shard is picked by the high bits of the hash, as tables use the low bits
+                const size_t s = ((uint64_t(hash(label)) >> 32) * n_threads) >> 32;
+                shards[s*n_threads + t].emplace_back(label, val);
+            };
+            for (size_t i = size * t / n_threads; i < size * (t + 1) / n_threads; ++i) {
+                kernel(*states[i], emit);
+            }
+        });
+        states = {};
+
+        auto for_each = [](size_t n, auto&& f) { qristal::thread_pool::parallel_for(0, n, 1, f); };
+        if constexpr (std::is_same_v<wavefunction, flat_wavefunction<qubit_label, amplitude>>) {
+            _qubit_data.assign_distinct(shards, for_each);
+        } else {
+            std::vector<wavefunction> tables(n_threads);
+            for_each(n_threads, [&](size_t s) {
+                size_t shard_size = 0;
+                for (size_t t = 0; t < n_threads; ++t) shard_size += shards[s*n_threads + t].size();
+                tables[s] = make_wavefunction(shard_size);
+                for (size_t t = 0; t < n_threads; ++t) {
+                    for (auto const& [label, val] : shards[s*n_threads + t]) tables[s].emplace(label, val);
+                    shards[s*n_threads + t] = {};
+                }
+            });
+            size_t new_size = 0;
+            for (auto const& table : tables) new_size += table.size();
+            _qubit_data = make_wavefunction(new_size);
+            for (auto& table : tables) _qubit_data.merge(table);
+        }
+    }
+
     // Makes a wavefunction that is preallocated to the right size
     // and has the correct load factor
     wavefunction make_wavefunction() {
@@ -3,10 +3,14 @@
 
 #pragma once
 
+#include <array>
 #include <vector>
 #include <complex>
 #include <unordered_map>
 #include <bitset>
+#include <string>
+
+#include "flat_wavefunction.hpp"
 
 namespace Microsoft::Quantum::SPARSESIMULATOR
 {
@@ -21,15 +25,29 @@ using real_type = double;
 
 using amplitude = std::complex<real_type>;
 
+// Single-qubit gate as a 2x2 matrix, in row-major order
+using single_qubit_unitary = std::array<amplitude, 4>;
+
+// Two-qubit gate as a 4x4 matrix, in row-major order
+using two_qubit_unitary = std::array<amplitude, 16>;
+
 template <size_t num_qubits>
 using qubit_label_type = std::bitset<num_qubits>;
 
-// Wavefunctions are hash maps of some key (std::bitset or a string)
+// Wavefunctions are hash maps of some key (std::bitset or a string).
+// They are open-addressing flat_wavefunction tables, unless the build selects
+// std::unordered_map with SPARSE_SIM_STD_HASH_MAP.
+#ifdef SPARSE_SIM_STD_HASH_MAP
 template <typename key>
 using abstract_wavefunction = std::unordered_map<key, amplitude>;
+#else
+template <typename key>
+using abstract_wavefunction = flat_wavefunction<key, amplitude>;
+#endif
 
 // Wavefunctions with strings as keys are "universal" in that they do not depend
-// on the total number of qubits
-using universal_wavefunction = abstract_wavefunction<std::string>;
+// on the total number of qubits. They are only used to move a state between
+// simulators of different sizes, so they are always std::unordered_maps.
+using universal_wavefunction = std::unordered_map<std::string, amplitude>;
 
 } // namespace Microsoft::Quantum::SPARSESIMULATOR
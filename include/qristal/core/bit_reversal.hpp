@@ -0,0 +1,33 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+#pragma once
+
+// STL
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace qristal
+{
+
+  /// Reverse the order of the lowest @p n_bits bits of @p index
+  size_t reverse_bits(size_t index, size_t n_bits);
+
+  /**
+   * @brief Permute a vector of 2^n elements in place, moving the element at every index i to the index with the
+   * bits of i in reverse order.
+   *
+   * @details This converts state vectors and probabilities between orderings with qubit 0 as the least significant
+   * bit and as the most significant bit. Splitting each index into its lowest b bits, middle bits and highest b bits,
+   * the elements with the same middle bits form a tile of 2^b runs of 2^b contiguous elements, and reversing the bits
+   * swaps every tile with the tile of the reversed middle bits, transposing both. Each run fills about a cache line,
+   * so both tiles stay in cache while they are swapped. Pairs of tiles are swapped concurrently on the thread pool.
+   * No memory is allocated.
+   *
+   * @throws std::invalid_argument if the size of the vector is not a power of two.
+   */
+  void bit_reverse_permute(std::vector<std::complex<double>>& v);
+
+  /// @copydoc bit_reverse_permute(std::vector<std::complex<double>>&)
+  void bit_reverse_permute(std::vector<double>& v);
+
+}
@@ -0,0 +1,134 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+#pragma once
+
+#include <qristal/core/circuit_language.hpp>
+
+// STL
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// Forward declarations
+namespace xacc { class CompositeInstruction; }
+
+namespace qristal
+{
+
+  /**
+   * @brief A threadsafe, process-wide, size-bounded cache of circuits compiled from source strings.
+   *
+   * @details Compiling a circuit string involves wrapping it into a kernel, running the pre-transpilation regexes
+   * over it and calling the staq/xasm/quil compiler, all of which is repeated from scratch every time the same
+   * source is resubmitted (e.g. with a different shot count or noise model). This cache maps everything that the
+   * compiled IR depends on to the IR itself, so that repeat compilations can be skipped. The cache owns its copy of
+   * each circuit and only ever hands out clones, so callers are free to transform the circuits they receive.
+   *
+   * When the cache is full, the least recently used circuit is evicted. Setting the capacity to zero disables it.
+   */
+  class compiled_ir_cache
+  {
+
+    public:
+
+      /// Everything that the IR compiled from a circuit string depends on
+      struct key
+      {
+        /// Circuit source, before any wrapping or pre-transpilation
+        std::string source;
+
+        /// Number of qubits
+        size_t num_qubits;
+
+        /// Language of the circuit source
+        circuit_language language;
+
+        /// Contents of the QB custom include file inserted into OpenQASM sources
+        std::string include_qb;
+
+        /// Names and contents of the files included by an OpenQASM source (other than qelib1.inc), as resolved by the
+        /// compiler
+        std::string includes;
+
+        /// Whether the source is pre-transpiled for the aer simulator
+        bool aer_pretranspile;
+
+        /// Equality comparison
+        bool operator==(const key&) const = default;
+      };
+
+      /// Getter for the instance; makes this class a threadsafe singleton
+      static compiled_ir_cache& get_instance();
+
+      /// Return a clone of the circuit cached under a given key, or nullptr if there is none
+      std::shared_ptr<xacc::CompositeInstruction> get(const key&);
+
+      /// Store a clone of a circuit under a given key, evicting the least recently used circuit if the cache is full
+      void put(const key&, const std::shared_ptr<xacc::CompositeInstruction>&);
+
+      /// Set the maximum number of circuits to keep in the cache. Zero disables the cache.
+      void set_capacity(size_t);
+
+      /// Get the maximum number of circuits to keep in the cache
+      size_t get_capacity() const;
+
+      /// Get the number of circuits currently in the cache
+      size_t size() const;
+
+      /// Remove all circuits from the cache
+      void clear();
+
+      /// Number of lookups that found a cached circuit
+      size_t hits() const;
+
+      /// Number of lookups that did not find a cached circuit
+      size_t misses() const;
+
+      /// Set the hit and miss counters back to zero
+      void reset_counters();
+
+      /// Uncopyable
+      compiled_ir_cache(const compiled_ir_cache&) = delete;
+
+      /// Unassignable
+      compiled_ir_cache& operator=(const compiled_ir_cache&) = delete;
+
+    private:
+
+      /// Hash function for cache keys
+      struct key_hash
+      {
+        size_t operator()(const key&) const;
+      };
+
+      /// Cached circuits, most recently used first
+      using entry_list = std::list<std::pair<key, std::shared_ptr<xacc::CompositeInstruction>>>;
+
+      /// Constructor
+      compiled_ir_cache() = default;
+
+      /// Drop least recently used circuits until the cache fits within its capacity. The caller must hold m.
+      void trim();
+
+      /// Cached circuits, most recently used first
+      entry_list entries;
+
+      /// Index into the list of cached circuits
+      std::unordered_map<key, entry_list::iterator, key_hash> index;
+
+      /// Maximum number of circuits to keep in the cache
+      size_t capacity = 256;
+
+      /// Hit and miss counters
+      std::atomic<size_t> hit_count = 0;
+      std::atomic<size_t> miss_count = 0;
+
+      /// Thread locker for the cache contents
+      mutable std::mutex m;
+
+  };
+
+}
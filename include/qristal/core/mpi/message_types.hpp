@@ -9,6 +9,7 @@ enum class MessageTags : int32_t {
   COUNTS = 102,
   PROBABILITIES = 103,
   PROBABILITY_GRADIENTS = 104,
-  SHOT_COUNT = 105
+  SHOT_COUNT = 105,
+  SPARSE_INDICES = 106
 };
 }
@@ -23,7 +23,8 @@ namespace {
 const std::unordered_map<std::type_index, MPI_Datatype> MPI_TYPE_MAP = {
     {typeid(char), MPI_CHAR},       {typeid(int16_t), MPI_INT16_T},
     {typeid(int32_t), MPI_INT32_T}, {typeid(uint32_t), MPI_UINT32_T},
-    {typeid(int64_t), MPI_INT64_T}, {typeid(float), MPI_FLOAT},
+    {typeid(int64_t), MPI_INT64_T}, {typeid(uint64_t), MPI_UINT64_T},
+    {typeid(float), MPI_FLOAT},
     {typeid(double), MPI_DOUBLE}};
 
 } // namespace
@@ -69,6 +69,15 @@ concept MapUpdateCallback =
  */
 std::vector<ResultsType> pack_results_map(const ResultsMap &results_map);
 
+/**
+ * @brief Pack packed results for sending over MPI, in the same format as
+ * pack_results_map(), so that they can be unpacked with unpack_results_map()
+ *
+ * @param results Packed results from a session object
+ * @return std::vector<ResultsType> The results in MPI format
+ */
+std::vector<ResultsType> pack_results(const Results &results);
+
 /**
  * @brief Unpacks a data stream previously packed with pack_results_map()
  *
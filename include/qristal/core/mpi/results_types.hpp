@@ -1,5 +1,7 @@
 #pragma once
 
+#include <qristal/core/packed_results.hpp>
+
 #include <cstdint>
 #include <map>
 #include <vector>
@@ -14,10 +16,16 @@ using Qubits = std::vector<bool>;
 
 using ResultsMap = std::map<Qubits, Count>;
 
+using Results = qristal::packed_results;
+
 using Probability = double;
 
 using OutProbabilities = std::vector<Probability>;
 
 using OutProbabilityGradients = std::vector<std::vector<Probability>>;
 
+using BitstringIndex = uint64_t;
+
+using SparseIndices = std::vector<BitstringIndex>;
+
 } // namespace qristal
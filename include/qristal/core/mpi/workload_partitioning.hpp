@@ -40,7 +40,7 @@ int32_t shots_for_mpi_process(int32_t total_processes, int32_t total_shots,
  * Optional as not all session instances calculate this output.
  */
 void send_results_to_supervisor(
-    MpiManager &mpi_manager, ResultsMap &results,
+    MpiManager &mpi_manager, Results &results,
     std::optional<std::reference_wrapper<ResultsMap>> results_native,
     std::optional<std::span<Count>> out_counts,
     std::optional<std::span<Probability>> out_probs,
@@ -65,13 +65,65 @@ void send_results_to_supervisor(
  * session instances calculate this output.
  * @param out_prob_gradients The out prob gradients for the calculation.
  * Optional as not all session instances calculate this output.
+ * @return std::vector<int32_t> The number of shots run by each process,
+ * indexed by MPI process ID
  */
-void collect_results_from_mpi_processes(
+std::vector<int32_t> collect_results_from_mpi_processes(
     MpiManager &mpi_manager, int32_t total_shots_requested,
-    int32_t supervisor_shot_count, ResultsMap &results,
+    int32_t supervisor_shot_count, Results &results,
     std::optional<std::reference_wrapper<ResultsMap>> results_native,
     std::optional<std::span<Count>> out_counts,
     std::optional<std::span<Probability>> out_probs,
     std::optional<std::reference_wrapper<OutProbabilityGradients>>
         out_prob_gradients);
+
+/**
+ * @brief Sends sparse outputs to the supervisor MPI process from an MPI worker
+ * process
+ * @note This function is designed to be called from worker processes only,
+ * after send_results_to_supervisor()
+ *
+ * @param mpi_manager The process's MPI manager
+ * @param indices The sorted bitstring indices that the other outputs are
+ * given for
+ * @param out_counts The out counts of the bitstrings in indices
+ * @param out_probs The out probs of the bitstrings in indices. Optional as not
+ * all session instances calculate this output.
+ * @param out_prob_gradients The out prob gradients of the bitstrings in
+ * indices. Optional as not all session instances calculate this output.
+ */
+void send_sparse_outputs_to_supervisor(
+    MpiManager &mpi_manager, SparseIndices &indices, std::span<Count> out_counts,
+    std::optional<std::span<Probability>> out_probs,
+    std::optional<std::reference_wrapper<OutProbabilityGradients>>
+        out_prob_gradients);
+
+/**
+ * @brief Receives sparse outputs from all MPI worker processes and merges them
+ * with the supervisor process's sparse outputs, by bitstring index. The merged
+ * indices are the sorted union of the indices of all processes, and the other
+ * outputs are combined in the same way as in
+ * collect_results_from_mpi_processes().
+ * @note This function is designed to be called from the supervisor process
+ * only, after collect_results_from_mpi_processes()
+ *
+ * @param mpi_manager The process's MPI manager
+ * @param total_shots_requested The total shot count for the session
+ * @param shot_counts The number of shots run by each process, as returned by
+ * collect_results_from_mpi_processes()
+ * @param indices The sorted bitstring indices of the supervisor's outputs,
+ * replaced by the merged indices
+ * @param out_counts The out counts of the bitstrings in indices
+ * @param out_probs The out probs of the bitstrings in indices. Optional as not
+ * all session instances calculate this output.
+ * @param out_prob_gradients The out prob gradients of the bitstrings in
+ * indices. Optional as not all session instances calculate this output.
+ */
+void collect_sparse_outputs_from_mpi_processes(
+    MpiManager &mpi_manager, int32_t total_shots_requested,
+    std::span<const int32_t> shot_counts, SparseIndices &indices,
+    OutCounts &out_counts,
+    std::optional<std::reference_wrapper<OutProbabilities>> out_probs,
+    std::optional<std::reference_wrapper<OutProbabilityGradients>>
+        out_prob_gradients);
 }
@@ -0,0 +1,123 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <qristal/core/noise_model/noise_model.hpp>
+
+namespace qristal
+{
+
+    /**
+     * @brief Compiled, immutable view of the gate noise and readout errors of a NoiseModel
+     *
+     * Looking up the channels of a gate in a NoiseModel hashes the gate name and compares vectors of
+     * operands in a tree. A compiled model resolves gate names to indices once, and holds the channels
+     * of each gate in a flat table indexed by its operands, so lookups by gate index need neither.
+     * It never changes once built, so it can be shared between threads without locking.
+     */
+    class CompiledNoiseModel
+    {
+
+      public:
+
+        /**
+         * @brief Gates of the QObj basis gate sets, which have fixed indices
+         * Other gates of a noise model are given the indices that follow these.
+         */
+        enum class Gate : size_t
+        {
+            id, u1, u2, u3, rx, ry, rz, x, y, z, h, s, sdg, t, tdg, cx, cz, cp, swap, count
+        };
+
+        /// Index returned by gate_index for gates unknown to the model
+        static constexpr size_t no_gate = static_cast<size_t>(-1);
+
+        CompiledNoiseModel() = default;
+
+        /**
+         * @brief Compile a noise model
+         *
+         * @param noise_model Noise model to compile; later changes to it are not reflected
+         */
+        explicit CompiledNoiseModel(const NoiseModel &noise_model);
+
+        /**
+         * @brief Get the index of a gate
+         *
+         * @param gate_name Name of the gate in the noise model
+         * @return Index of the gate, or no_gate if it is neither a QObj basis gate nor a gate with noise in the model
+         */
+        size_t gate_index(std::string_view gate_name) const;
+
+        /**
+         * @brief Get the noise channels of a gate
+         *
+         * @param gate Index of the gate
+         * @param qubits Qubit operands of the gate
+         * @return Channels for these operands, or else those for any operands, or nullptr if there are none
+         */
+        const std::vector<NoiseChannel>* channels(size_t gate, std::span<const size_t> qubits) const;
+
+        /// @brief Get the noise channels of a QObj basis gate
+        const std::vector<NoiseChannel>* channels(Gate gate, std::span<const size_t> qubits) const
+        {
+            return channels(static_cast<size_t>(gate), qubits);
+        }
+
+        /**
+         * @brief Get the readout error of a qubit
+         *
+         * @param qubit Qubit index
+         * @return Readout error, with both probabilities zero if the qubit has none
+         */
+        const ReadoutError& readout_error(size_t qubit) const;
+
+        /// @brief Whether any qubit has a readout error
+        bool has_readout_errors() const { return !m_readout_errors.empty(); }
+
+        /// @brief Number of qubits spanned by the tables: one more than the highest qubit index in the model
+        size_t nb_qubits() const { return m_nb_qubits; }
+
+      private:
+
+        /// @brief Where the channels of one gate are found
+        struct GateTable
+        {
+            /// Number of operands (one or two) indexing the flat table of the gate, or 0 if it has none
+            size_t arity = 0;
+            /// Offset of the gate's flat table in m_index
+            size_t offset = 0;
+            /// Channels for any operands, or -1
+            int32_t uniform = -1;
+            /// Channels for operands of any other number
+            std::map<std::vector<size_t>, int32_t> others;
+        };
+
+        /// @brief Number of qubits spanned by the tables
+        size_t m_nb_qubits = 0;
+
+        /// @brief Indices of gates by name
+        std::unordered_map<std::string, size_t> m_gate_indices;
+
+        /// @brief Tables of the gates, by gate index
+        std::vector<GateTable> m_gates;
+
+        /// @brief Flat tables of all gates: for operands q_1 ... q_k, the index of their channels in
+        /// m_channels is found at offset + (...(q_1 * nb_qubits + q_2) ...) * nb_qubits + q_k, or -1 if none
+        std::vector<int32_t> m_index;
+
+        /// @brief Channels of every gate and operands
+        std::vector<std::vector<NoiseChannel>> m_channels;
+
+        /// @brief Readout errors by qubit, empty if there are none
+        std::vector<ReadoutError> m_readout_errors;
+    };
+}
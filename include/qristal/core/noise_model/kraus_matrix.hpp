@@ -0,0 +1,187 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <complex>
+#include <initializer_list>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <nlohmann/json.hpp>
+
+namespace qristal
+{
+
+    /**
+     * @brief Square complex matrix, stored contiguously in row-major order
+     *
+     * Matrices of one or two qubits (2x2 and 4x4), as most Kraus operators are, are stored inline without any heap
+     * allocation, and larger ones (e.g., Choi or process matrices) in a single heap block. The elements can be used
+     * in place as an Eigen matrix through an Eigen::Map, of fixed size for one and two qubits. Rows can also be
+     * indexed as in the nested std::vector that used to hold these matrices, i.e., mat[row][col].
+     */
+    class KrausMatrix
+    {
+
+      public:
+
+        using Scalar = std::complex<double>;
+
+        /// Iterator over the rows of a matrix, each viewed as a span
+        template <typename T>
+        class RowIterator
+        {
+          public:
+            using value_type = std::span<T>;
+            using difference_type = std::ptrdiff_t;
+
+            RowIterator() = default;
+            RowIterator(T *row, size_t dim) : m_row(row), m_dim(dim) {}
+
+            std::span<T> operator*() const { return {m_row, m_dim}; }
+            RowIterator &operator++() { m_row += m_dim; return *this; }
+            RowIterator operator++(int) { RowIterator prev = *this; ++*this; return prev; }
+            bool operator==(const RowIterator &other) const { return m_row == other.m_row; }
+
+          private:
+            T *m_row = nullptr;
+            size_t m_dim = 0;
+        };
+
+        /// Row-major Eigen matrix with the layout of the elements
+        using EigenMatrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+        /// Fixed-size row-major Eigen matrix with the layout of the elements
+        template <int Dim>
+        using FixedEigenMatrix = Eigen::Matrix<Scalar, Dim, Dim, Eigen::RowMajor>;
+
+        /// Largest dimension stored inline
+        static constexpr size_t max_inline_dim = 4;
+
+        KrausMatrix() = default;
+
+        /**
+         * @brief Construct a zero matrix
+         *
+         * @param dim Number of rows and columns
+         */
+        explicit KrausMatrix(size_t dim) : m_dim(dim)
+        {
+            if (m_dim > max_inline_dim) m_heap.resize(m_dim * m_dim);
+        }
+
+        /**
+         * @brief Construct a matrix from its rows, e.g., KrausMatrix{{0.0, 1.0}, {1.0, 0.0}}
+         *
+         * Throws if the matrix is not square.
+         */
+        KrausMatrix(std::initializer_list<std::initializer_list<Scalar>> rows);
+
+        /**
+         * @brief Construct a matrix from a nested std::vector of its rows
+         *
+         * Throws if the matrix is not square.
+         */
+        KrausMatrix(const std::vector<std::vector<Scalar>> &rows);
+
+        /**
+         * @brief Construct a matrix from an Eigen matrix or expression
+         *
+         * Throws if the matrix is not square.
+         */
+        template <typename Derived>
+        explicit KrausMatrix(const Eigen::MatrixBase<Derived> &mat) : KrausMatrix(static_cast<size_t>(mat.rows()))
+        {
+            if (mat.rows() != mat.cols()) throw std::invalid_argument("Kraus matrices must be square.");
+            eigen() = mat;
+        }
+
+        /// @brief Number of rows (and columns)
+        size_t dim() const { return m_dim; }
+
+        /// @brief Number of rows, as for the nested std::vector
+        size_t size() const { return m_dim; }
+
+        /// @brief Whether the matrix has no elements
+        bool empty() const { return m_dim == 0; }
+
+        /// @brief Elements in row-major order
+        Scalar *data() { return m_dim > max_inline_dim ? m_heap.data() : m_inline.data(); }
+        const Scalar *data() const { return m_dim > max_inline_dim ? m_heap.data() : m_inline.data(); }
+
+        /// @brief Element at a row and column
+        Scalar &operator()(size_t row, size_t col) { return data()[row * m_dim + col]; }
+        const Scalar &operator()(size_t row, size_t col) const { return data()[row * m_dim + col]; }
+
+        /// @brief View of a row
+        std::span<Scalar> operator[](size_t row) { return {data() + row * m_dim, m_dim}; }
+        std::span<const Scalar> operator[](size_t row) const { return {data() + row * m_dim, m_dim}; }
+
+        /// @brief View of a row, checking that it exists
+        std::span<Scalar> at(size_t row) { check_row(row); return (*this)[row]; }
+        std::span<const Scalar> at(size_t row) const { check_row(row); return (*this)[row]; }
+
+        /// @brief Iterators over the rows, as for the nested std::vector
+        RowIterator<Scalar> begin() { return {data(), m_dim}; }
+        RowIterator<Scalar> end() { return {data() + m_dim * m_dim, m_dim}; }
+        RowIterator<const Scalar> begin() const { return {data(), m_dim}; }
+        RowIterator<const Scalar> end() const { return {data() + m_dim * m_dim, m_dim}; }
+
+        /// @brief Zero-copy Eigen view of the matrix
+        Eigen::Map<EigenMatrix> eigen() { return {data(), Eigen::Index(m_dim), Eigen::Index(m_dim)}; }
+        Eigen::Map<const EigenMatrix> eigen() const { return {data(), Eigen::Index(m_dim), Eigen::Index(m_dim)}; }
+
+        /// @brief Zero-copy fixed-size Eigen view of the matrix, which must have dimension Dim (e.g., 2 or 4)
+        template <int Dim>
+        Eigen::Map<FixedEigenMatrix<Dim>> fixed()
+        {
+            static_assert(Dim > 1 && Dim <= int(max_inline_dim));
+            check_dim(Dim);
+            return Eigen::Map<FixedEigenMatrix<Dim>>(data());
+        }
+        template <int Dim>
+        Eigen::Map<const FixedEigenMatrix<Dim>> fixed() const
+        {
+            static_assert(Dim > 1 && Dim <= int(max_inline_dim));
+            check_dim(Dim);
+            return Eigen::Map<const FixedEigenMatrix<Dim>>(data());
+        }
+
+        /// @brief Copy of the matrix as a nested std::vector of its rows
+        std::vector<std::vector<Scalar>> to_nested() const;
+
+        /// @brief Whether two matrices have the same dimension and elements
+        bool operator==(const KrausMatrix &other) const;
+
+      private:
+
+        void check_row(size_t row) const
+        {
+            if (row >= m_dim) throw std::out_of_range("Kraus matrix row out of range.");
+        }
+
+        void check_dim(size_t dim) const
+        {
+            if (dim != m_dim) throw std::invalid_argument("Kraus matrix has a different dimension.");
+        }
+
+        /// @brief Number of rows and columns
+        size_t m_dim = 0;
+
+        /// @brief Elements of matrices of up to max_inline_dim rows
+        std::array<Scalar, max_inline_dim * max_inline_dim> m_inline{};
+
+        /// @brief Elements of larger matrices
+        std::vector<Scalar> m_heap;
+    };
+
+    /// @brief Convert a Kraus matrix to JSON, as a list of rows of [real, imag] pairs
+    void to_json(nlohmann::json &js, const KrausMatrix &mat);
+
+    /// @brief Convert JSON, as a list of rows of complex numbers, to a Kraus matrix
+    void from_json(const nlohmann::json &js, KrausMatrix &mat);
+}
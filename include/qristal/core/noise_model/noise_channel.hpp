@@ -13,11 +13,13 @@
 #include <algorithm>
 #include <set>
 
+#include <qristal/core/noise_model/kraus_matrix.hpp>
+
 namespace qristal
 {
     struct KrausOperator
     {
-        using Matrix = std::vector<std::vector<std::complex<double>>>;
+        using Matrix = KrausMatrix;
 
         /**
          * @brief Kraus matrix
@@ -77,16 +79,16 @@ namespace qristal
      */
     Eigen::MatrixXcd process_to_choi(const Eigen::MatrixXcd& process_matrix);
     /**
-     * @brief Convert an STL-based process matrix to its STL-based Choi matrix representation.
+     * @brief Convert a KrausMatrix-based process matrix to its KrausMatrix-based Choi matrix representation.
      * 
      * Arguments: 
-     * @param process_matrix the STL-based (std::vector<std::vector<T>>) process matrix in the 
+     * @param process_matrix the KrausMatrix-based process matrix in the 
      * standard Pauli basis ordered from II..I, II..X, ... ZZ..Y, ZZ..Z
      *
      * @return Choi matrix in the computational basis ordered in ascending bit string order 
      * (|0..0><0..0|, |0..0><0..1|, ..., |1..1><1..0|, |1..1><1..1|)
      * 
-     * @details This function may be used to convert arbitrary STL-based quantum process 
+     * @details This function may be used to convert arbitrary KrausMatrix-based quantum process 
      * matrices to their Choi representation by delegating the transformation to the Eigen-based 
      * implementation.
      */
@@ -107,15 +109,15 @@ namespace qristal
      */
     Eigen::MatrixXcd process_to_superoperator(const Eigen::MatrixXcd& process_matrix);
     /**
-     * @brief Convert an STL-based process matrix to its STL-based superoperator matrix representation.
+     * @brief Convert a KrausMatrix-based process matrix to its KrausMatrix-based superoperator matrix representation.
      * 
      * Arguments: 
-     * @param process_matrix the STL-based (std::vector<std::vector<T>>) process matrix in the 
+     * @param process_matrix the KrausMatrix-based process matrix in the 
      * standard Pauli basis ordered from II..I, II..X, ... ZZ..Y, ZZ..Z
      *
-     * @return std::vector<std::vector<T>> superoperator matrix representation.
+     * @return KrausMatrix-based superoperator matrix representation.
      * 
-     * @details This function transforms arbitrary STL-based process matrices to their superoperator 
+     * @details This function transforms arbitrary KrausMatrix-based process matrices to their superoperator 
      * representation by delegating the transformation to the Eigen-based implementation.
      */
     KrausOperator::Matrix process_to_superoperator(const KrausOperator::Matrix& process_matrix);
@@ -135,15 +137,15 @@ namespace qristal
     std::vector<Eigen::MatrixXcd> process_to_kraus(const Eigen::MatrixXcd& process_matrix);
 
     /**
-     * @brief Convert an STL-based process matrix to a NoiseChannel of Kraus matrices.
+     * @brief Convert a KrausMatrix-based process matrix to a NoiseChannel of Kraus matrices.
      * 
      * Arguments: 
-     * @param process_matrix the STL-based process matrix of the quantum process.
+     * @param process_matrix the KrausMatrix-based process matrix of the quantum process.
      *
      * @return NoiseChannel a noise channel containing all complex Kraus operator matrices.
      * 
-     * @details This function transforms arbitrary STL-based process matrices to a NoiseChannel 
-     * object by (i) converting the STL-based process matrix to an Eigen matrix, (ii) calling 
+     * @details This function transforms arbitrary KrausMatrix-based process matrices to a NoiseChannel 
+     * object by (i) converting the KrausMatrix-based process matrix to an Eigen matrix, (ii) calling 
      * process_to_kraus(const Eigen::MatrixXcd&), and (iii) calling eigen_to_noisechannel.
      */
     NoiseChannel process_to_kraus(const KrausOperator::Matrix& process_matrix);
@@ -166,15 +168,15 @@ namespace qristal
     Eigen::MatrixXcd choi_to_superoperator(const Eigen::MatrixXcd& choi_matrix);
 
     /**
-     * @brief Convert an STL-based Choi matrix to its STL-based superoperator matrix representation.
+     * @brief Convert a KrausMatrix-based Choi matrix to its KrausMatrix-based superoperator matrix representation.
      * 
      * Arguments: 
-     * @param choi_matrix the STL-based (std::vector<std::vector<T>>) Choi matrix in the computational basis 
+     * @param choi_matrix the KrausMatrix-based Choi matrix in the computational basis 
      * in ascending bit string order (|0..0><0..0|, |0..0><0..1|, ..., |1..1><1..0|, |1..1><1..1|).
      *
-     * @return std::vector<std::vector<T>> superoperator matrix representation.
+     * @return KrausMatrix-based superoperator matrix representation.
      * 
-     * @details This function transforms arbitrary STL-based Choi matrices to their superoperator 
+     * @details This function transforms arbitrary KrausMatrix-based Choi matrices to their superoperator 
      * representation by delegating the transformation to the Eigen-based implementation.
      */
     KrausOperator::Matrix choi_to_superoperator(const KrausOperator::Matrix& choi_matrix);
@@ -195,14 +197,14 @@ namespace qristal
     std::vector<Eigen::MatrixXcd> choi_to_kraus(const Eigen::MatrixXcd& choi_matrix);
 
     /**
-     * @brief Convert an STL-based Choi matrix to a NoiseChannel of Kraus matrices.
+     * @brief Convert a KrausMatrix-based Choi matrix to a NoiseChannel of Kraus matrices.
      * 
      * Arguments: 
-     * @param choi_matrix the STL-based Choi matrix of the quantum process.
+     * @param choi_matrix the KrausMatrix-based Choi matrix of the quantum process.
      *
      * @return NoiseChannel the noise channel containing all complex Kraus operator matrices.
      * 
-     * @details This function will convert the STL-based Choi matrix to a complex-valued 
+     * @details This function will convert the KrausMatrix-based Choi matrix to a complex-valued 
      * Eigen matrix and delegate the conversion to choi_to_kraus(const Eigen::MatrixXcd&).
      */
     NoiseChannel choi_to_kraus(const KrausOperator::Matrix& choi_matrix);
@@ -225,15 +227,15 @@ namespace qristal
     Eigen::MatrixXcd superoperator_to_choi(const Eigen::MatrixXcd& superop);
 
     /**
-     * @brief Convert an STL-based superoperator matrix to its STL-based Choi matrix representation.
+     * @brief Convert a KrausMatrix-based superoperator matrix to its KrausMatrix-based Choi matrix representation.
      * 
      * Arguments: 
-     * @param superop the STL-based (std::vector<std::vector<T>>) superoperator matrix representation
+     * @param superop the KrausMatrix-based superoperator matrix representation
      * of the quantum process.
      *
-     * @return std::vector<std::vector<T>> Choi matrix representation.
+     * @return KrausMatrix-based Choi matrix representation.
      * 
-     * @details This function transforms arbitrary STL-based superoperator matrices to their Choi 
+     * @details This function transforms arbitrary KrausMatrix-based superoperator matrices to their Choi 
      * representation by delegating the transformation to the Eigen-based implementation.
      */
     KrausOperator::Matrix superoperator_to_choi(const KrausOperator::Matrix& superop);
@@ -255,15 +257,15 @@ namespace qristal
     std::vector<Eigen::MatrixXcd> superoperator_to_kraus(const Eigen::MatrixXcd& superop);
 
     /**
-     * @brief Convert an STL-based superoperator matrix to a NoiseChannel of Kraus matrices.
+     * @brief Convert a KrausMatrix-based superoperator matrix to a NoiseChannel of Kraus matrices.
      * 
      * Arguments: 
-     * @param superop the STL-based (std::vector<std::vector<T>>) superoperator matrix representation
+     * @param superop the KrausMatrix-based superoperator matrix representation
      * of the quantum process.
      *
      * @return NoiseChannel the noise channel containing all complex Kraus operator matrices.
      * 
-     * @details This function will convert the STL-based superoperator matrix to a complex-valued 
+     * @details This function will convert the KrausMatrix-based superoperator matrix to a complex-valued 
      * Eigen matrix and delegate the conversion to superoperator_to_kraus(const Eigen::MatrixXcd&).
      */
     NoiseChannel superoperator_to_kraus(const KrausOperator::Matrix& superop);
@@ -281,12 +283,12 @@ namespace qristal
     Eigen::MatrixXcd kraus_to_choi(const std::vector<Eigen::MatrixXcd> &kraus_mats);
 
     /**
-     * @brief Convert a noise channel (list of STL-based Kraus operator matrices) into their Choi matrix representation.
+     * @brief Convert a noise channel (list of KrausMatrix-based Kraus operator matrices) into their Choi matrix representation.
      * 
      * Arguments: 
-     * @param noise_channel the noise channel composed of STL-based Kraus matrices.
+     * @param noise_channel the noise channel composed of KrausMatrix-based Kraus matrices.
      *
-     * @return KrausOperator::Matrix the STL-based Choi matrix representation.
+     * @return KrausOperator::Matrix the KrausMatrix-based Choi matrix representation.
      */
     KrausOperator::Matrix kraus_to_choi(const NoiseChannel& noise_channel);
 
@@ -302,13 +304,13 @@ namespace qristal
     Eigen::MatrixXcd kraus_to_superoperator(const std::vector<Eigen::MatrixXcd> &kraus_mats);
 
     /**
-     * @brief Convert a noise channel (list of STL-based Kraus operator matrices) into their STL-based superoperator
+     * @brief Convert a noise channel (list of KrausMatrix-based Kraus operator matrices) into their KrausMatrix-based superoperator
      *  matrix representation.
      * 
      * Arguments: 
-     * @param noise_channel the noise channel composed of STL-based Kraus matrices.
+     * @param noise_channel the noise channel composed of KrausMatrix-based Kraus matrices.
      *
-     * @return KrausOperator::Matrix the STL-based superoperator matrix representation.
+     * @return KrausOperator::Matrix the KrausMatrix-based superoperator matrix representation.
      */
     KrausOperator::Matrix kraus_to_superoperator(const NoiseChannel& noise_channel);
 
@@ -0,0 +1,165 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+#pragma once
+
+// STL
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace qristal
+{
+
+  /**
+   * @brief Measurement counts of distinct outcomes, with each outcome packed into fixed-width 64-bit words.
+   *
+   * @details Outcomes are kept in a flat, sorted array of words, with their counts in a matching array, rather than
+   * as std::vector<bool> keys in the nodes of a std::map. Bit i of an outcome is stored in word i/64, starting from
+   * the most significant bit, so that sorting the words sorts the outcomes in the same (lexicographic) order as a
+   * std::map<std::vector<bool>, int>. Counts can be converted directly from the bitstrings returned by backends,
+   * merged in linear time, and converted to a std::map for compatibility.
+   */
+  class packed_results
+  {
+
+    public:
+
+      /// A single measurement outcome, unpacked
+      using outcome = std::vector<bool>;
+
+      /// A single entry of the results: the packed outcome and its count
+      struct entry
+      {
+        std::span<const uint64_t> words;
+        int count;
+
+        /// Unpack the outcome
+        outcome bits(size_t n_bits) const;
+      };
+
+      /// Iterator over the entries of the results, in order of their outcomes
+      class const_iterator
+      {
+        public:
+          const_iterator(const packed_results* results, size_t index) : results(results), index(index) {}
+          entry operator*() const { return {results->words(index), results->counts_[index]}; }
+          const_iterator& operator++() { index++; return *this; }
+          bool operator==(const const_iterator&) const = default;
+        private:
+          const packed_results* results;
+          size_t index;
+      };
+
+      /// Constructor for empty results, taking their number of bits from the first outcome added
+      packed_results() = default;
+
+      /// Constructor for empty results with outcomes of @p n_bits bits
+      explicit packed_results(size_t n_bits);
+
+      /// Constructor converting from a map of counts
+      explicit packed_results(const std::map<outcome, int>& counts);
+
+      /**
+       * @brief Convert from a map of counts with bitstring keys, as returned by a backend.
+       *
+       * @param counts Map from bitstrings of '0' and '1' characters to counts
+       * @param n_bits Number of bits in each bitstring
+       * @param qubit0_left Whether qubit 0 is the leftmost character of each bitstring, rather than the rightmost
+       */
+      template <typename CountMapT>
+      static packed_results from_bitstrings(const CountMapT& counts, size_t n_bits, bool qubit0_left)
+      {
+        packed_results r(n_bits);
+        r.keys.assign(counts.size() * r.n_words, 0);
+        r.counts_.reserve(counts.size());
+        uint64_t* key = r.keys.data();
+        for (const auto& [bitstring, count] : counts)
+        {
+          // Branch-free, as the bits of distinct outcomes are unpredictable
+          for (size_t i = 0; i < n_bits; i++)
+          {
+            const uint64_t bit = (bitstring.at(qubit0_left ? i : n_bits - 1 - i) != '0');
+            key[i / 64] |= bit << (63 - i % 64);
+          }
+          r.counts_.push_back(count);
+          key += r.n_words;
+        }
+        r.sort_and_combine();
+        return r;
+      }
+
+      /// Number of bits in each outcome
+      size_t bits() const { return n_bits; }
+
+      /// Number of 64-bit words that each outcome is packed into
+      size_t words_per_outcome() const { return n_words; }
+
+      /// Number of distinct outcomes
+      size_t size() const { return counts_.size(); }
+
+      /// Whether there are no outcomes
+      bool empty() const { return counts_.empty(); }
+
+      /// Remove all outcomes, keeping the number of bits
+      void clear();
+
+      /// Packed words of the i-th outcome, in order of outcomes
+      std::span<const uint64_t> words(size_t i) const { return {keys.data() + i * n_words, n_words}; }
+
+      /// Unpacked i-th outcome, in order of outcomes
+      outcome outcome_at(size_t i) const { return entry{words(i), counts_[i]}.bits(n_bits); }
+
+      /// Counts of all outcomes, in order of outcomes
+      std::span<const int> counts() const { return counts_; }
+
+      /// Count of an outcome, or zero if it was not measured
+      int count(const outcome& o) const;
+
+      /// Total count of all outcomes
+      long long total() const;
+
+      /// Add @p count to the count of an outcome. Adding outcomes in increasing order takes constant time each.
+      void add(const outcome& o, int count);
+
+      /// Add the counts of other results to these, in linear time. Both must have the same number of bits.
+      void merge(const packed_results& other);
+
+      /// Convert to a map of counts
+      std::map<outcome, int> to_map() const;
+
+      /// Iterators over the entries, in order of outcomes
+      const_iterator begin() const { return {this, 0}; }
+      const_iterator end() const { return {this, size()}; }
+
+      bool operator==(const packed_results&) const = default;
+
+    private:
+
+      /// Pack an outcome into words
+      std::vector<uint64_t> pack(const outcome& o) const;
+
+      /// Sort the outcomes, and combine the counts of any repeated outcomes
+      void sort_and_combine();
+
+      /// Index of the first outcome not less than the given packed outcome
+      size_t lower_bound(std::span<const uint64_t> key) const;
+
+      /// Set the number of bits of empty results, or check it against that of non-empty results
+      void check_bits(size_t bits);
+
+      /// Number of bits in each outcome
+      size_t n_bits = 0;
+
+      /// Number of words in each outcome
+      size_t n_words = 0;
+
+      /// Packed outcomes, n_words words each, in increasing order
+      std::vector<uint64_t> keys;
+
+      /// Counts of the outcomes
+      std::vector<int> counts_;
+
+  };
+
+}
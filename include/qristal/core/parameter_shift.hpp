@@ -0,0 +1,51 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+#pragma once
+
+// STL
+#include <memory>
+#include <vector>
+
+// Forward declarations
+namespace xacc { class CompositeInstruction; }
+
+/**
+ * @brief General parameter-shift rules for the gradients of circuit outputs with respect to circuit parameters.
+ *
+ * @details The output probabilities of a circuit are trigonometric polynomials in each parameter, with frequencies
+ * set by the gates that the parameter appears in. A single rotation gate gives the frequency 1, so that the familiar
+ * two-term rule (shifts of +/- pi/2) is exact. A parameter that appears in several gates, or in a controlled rotation
+ * or controlled block, has several frequencies, and then needs the general rule with 2R terms for R frequencies
+ * (Wierichs et al., Quantum 6, 677 (2022)).
+ */
+namespace qristal::parameter_shift
+{
+
+  /// A single term of a shift rule: the derivative at x is the sum over all terms of coefficient * f(x + shift)
+  struct term
+  {
+    double shift;
+    double coefficient;
+  };
+
+  /// The frequencies of a circuit output with respect to a parameter: all multiples of base_frequency up to
+  /// max_multiple * base_frequency
+  struct spectrum
+  {
+    double base_frequency = 1.0;
+    size_t max_multiple = 0;
+  };
+
+  /// Get the shift rule for a parameter with the given spectrum. A parameter with no frequencies gets no terms.
+  std::vector<term> rule(const spectrum&);
+
+  /**
+   * @brief Work out the spectrum of each free parameter of a parametrised circuit, in the order of its variables.
+   *
+   * @details Each parameter must be passed to gates directly, rather than in an expression; std::invalid_argument
+   * is thrown for any named gate parameter that is not a free parameter of the circuit. Controlled rotations (CRZ)
+   * and any gates inside controlled-unitary (C-U) blocks give the frequencies 1/2 and 1; all other parametrised gates
+   * are taken to give the frequency 1.
+   */
+  std::vector<spectrum> spectra(std::shared_ptr<xacc::CompositeInstruction> circuit);
+
+}
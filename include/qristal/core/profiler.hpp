@@ -4,6 +4,8 @@
 #include <memory>
 #include <unordered_map>
 #include <map>
+#include <string>
+#include <vector>
 
 // Forward declaration
 namespace xacc { class CompositeInstruction; }
@@ -14,9 +16,40 @@ namespace qristal {
   *  Class: Profiler
   *  Profiles the time (in ms) for 1 shot of a given CompositeInstruction.
   *  The caller is responsible for scaling to the number-of-shots by passing this to the constructor.
+  *
+  *  The gates of the circuit are arranged into a dependency DAG (each gate depends on the previous gate on each of
+  *  its qubits) and scheduled both as soon as possible (ASAP) and as late as possible (ALAP), giving the critical
+  *  path through the circuit and the time each qubit spends idle.
   */
   class Profiler {
 
+    public:
+
+      /// A gate in the circuit, with its dependencies and its place in the ASAP and ALAP schedules
+      struct scheduled_gate
+      {
+        /// Gate name
+        std::string name;
+
+        /// Qubits that the gate acts on
+        std::vector<size_t> qubits;
+
+        /// Indices (in the schedule) of the gates that must finish before this one can start
+        std::vector<size_t> predecessors;
+
+        /// Gate duration (in milliseconds)
+        double duration_ms = 0;
+
+        /// Earliest possible start time (in milliseconds)
+        double asap_start_ms = 0;
+
+        /// Latest start time that does not delay the end of the circuit (in milliseconds)
+        double alap_start_ms = 0;
+
+        /// Time by which the gate can be delayed without delaying the end of the circuit (in milliseconds)
+        double slack_ms() const { return alap_start_ms - asap_start_ms; }
+      };
+
     protected:
       /// IR representation of the circuit for profiling
       std::shared_ptr<xacc::CompositeInstruction> placed_circuit_;
@@ -29,10 +62,16 @@ namespace qristal {
       std::unordered_map<int, int> count_1q_gates_on_q_;
       /// Map from qubit index to two-qubit gates on that qubit wire.
       std::unordered_map<int, int> count_2q_gates_on_q_;
-      /// Qubit that has the largest gate depth (total of 1 qubit- and 2 qubit-gates).
-      int largestdepth_q_;
       /// Number of qubits in the circuit.
       size_t n_qubits_;
+      /// Gates of the circuit in program order, excluding measurements
+      std::vector<scheduled_gate> schedule_;
+      /// Indices (in the schedule) of the gates on the critical path, in order
+      std::vector<size_t> critical_path_;
+      /// Total gate time along the critical path (in milliseconds)
+      double critical_path_time_ms_ = 0;
+      /// Map from qubit index to the total time that qubit spends in gates
+      std::map<int, double> busy_time_on_q_;
 
       // Timing data
       /// Single-qubit gate time (in milliseconds)
@@ -50,7 +89,8 @@ namespace qristal {
       bool debug_;
 
     public:
-      /// @brief Constructor (from an OpenQASM string)
+      /// @brief Constructor (from an OpenQASM string). Prefer the IR constructor where the IR is at hand, as this
+      /// one has to compile the string first.
       /// @param target_circuit
       /// @param n_qubits
       /// @param gate_1q_time_ms
@@ -110,16 +150,33 @@ namespace qristal {
       /// @return
       int get_count_2q_gates_on_q(const int iq);
 
-      /// @brief Get Id of the qubit having the most number of gates (largest depth)
+      /// @brief Get Id of the qubit that spends the most time in gates (largest depth)
       /// @return
       int get_largestdepth_q();
 
+      /// @brief Get the gates of the circuit (excluding measurements) in program order, with their dependencies and
+      /// ASAP and ALAP start times
+      const std::vector<scheduled_gate>& get_schedule() const;
+
+      /// @brief Get the critical path through the circuit
+      /// @return Indices (in the schedule) of the gates on the critical path, in order
+      const std::vector<size_t>& get_critical_path() const;
+
+      /// @brief Get the total gate time along the critical path, i.e. the shortest possible gate execution time
+      /// @return Time in milliseconds
+      double get_critical_path_time_ms() const;
+
+      /// @brief Get the time that each qubit spends idle between the start of the circuit and the end of the
+      /// critical path, i.e. not taking part in any gate
+      /// @return Keys: qubit indices; values: idle time in milliseconds
+      std::map<int,double> get_idle_time_on_q() const;
+
       // Index keys to retrieve profiling results (returned as a (int -> double) map)
       /// Index key for total time
       const int KEY_TOTAL_TIME = 0;
       /// Index key for initialisation time
       const int KEY_INITIALISATION_TIME = 1;
-      /// Index key for total gate time on the qubit having the max gate depth
+      /// Index key for total gate time along the critical path
       const int KEY_MAX_DEPTH_GATE_TIME = 2;
       /// Index key for readout time
       const int KEY_READOUT_TIME = 3;
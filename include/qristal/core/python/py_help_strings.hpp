@@ -169,6 +169,13 @@ namespace qristal {
         Setting this True enables circuit timing and resource estimation.
     )";
 
+    const char* output_oqm_dir = R"(
+        output_oqm_dir:
+
+        Directory in which to save the transpiled circuit of each run. If empty (the default), the transpiled circuit is only kept in memory.
+        Otherwise, each run's transpiled circuit is written in the background to a new, uniquely named file in this directory.
+    )";
+
     const char* qn = R"(
         qn:
 
@@ -357,12 +364,58 @@ namespace qristal {
         The entry y_i is the output probability of ith bitstring, indexed in the same manner as the all_bitstring_counts. Explicitly, the index i corresponding to a specific bitstring can be obtained by calling bitstring_index(bitstring), with bitstring given as a list of bit values.
     )";
 
+    const char* sparse_bitstring_indices = R"(
+        sparse_bitstring_indices:
+
+        After calling session.run() with `sparse_outputs` and `calc_all_bitstring_counts` set True, the sorted indices of the bitstrings that were measured, as given by the function bitstring_index.
+        The other sparse outputs hold the values for the same bitstrings, in the same order.
+    )";
+
+    const char* sparse_bitstring_counts = R"(
+        sparse_bitstring_counts:
+
+        After calling session.run() with `sparse_outputs` and `calc_all_bitstring_counts` set True, the counts of the bitstrings in sparse_bitstring_indices.
+    )";
+
+    const char* sparse_bitstring_probabilities = R"(
+        sparse_bitstring_probabilities:
+
+        After calling session.run() with `sparse_outputs` and `calc_gradients` set True, the probabilities of the bitstrings in sparse_bitstring_indices.
+    )";
+
+    const char* sparse_bitstring_probability_gradients = R"(
+        sparse_bitstring_probability_gradients:
+
+        After calling session.run() with `sparse_outputs` and `calc_gradients` set True, the probability Jacobian of the bitstrings in sparse_bitstring_indices, with one row per runtime parameter.
+        Bitstrings that were only measured in the shifted runs used to calculate the gradients are included in sparse_bitstring_indices, with zero counts.
+    )";
+
+    const char* observable_expectation = R"(
+        observable_expectation:
+
+        The exact expectation value of gradient_observable for the noiseless circuit, after calling session.run() with `calc_gradients` set True, `gradient_method` set to "adjoint" and `gradient_observable` set.
+    )";
+
+    const char* observable_gradients = R"(
+        observable_gradients:
+
+        The exact gradients of the expectation value of gradient_observable with respect to the runtime parameters, after calling session.run() with `calc_gradients` set True, `gradient_method` set to "adjoint" and `gradient_observable` set.
+        The entry i corresponds to the ith parameter in the parameter list (i.e. the parameters ordered by their first appearance in the circuit.)
+    )";
+
     const char* transpiled_circuit = R"(
         transpiled_circuit:
 
         Retrieve the transpiled version of the executed circuit after calling session.run().
     )";
 
+    const char* output_oqm_file = R"(
+        output_oqm_file:
+
+        Retrieve the path of the file to which the transpiled circuit was saved after calling session.run(), waiting for it to be written if necessary.
+        Empty if output_oqm_dir was not set.
+    )";
+
     const char* qobj = R"(
         qobj:
 
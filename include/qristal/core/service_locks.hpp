@@ -0,0 +1,62 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+#pragma once
+
+// STL
+#include <memory>
+#include <mutex>
+#include <string>
+
+// XACC
+#include <Identifiable.hpp>
+
+// Forward declarations
+namespace xacc { class Accelerator; }
+
+namespace qristal
+{
+
+  /**
+   * @brief Thread lockers for XACC services that cannot be used from several threads at once.
+   *
+   * @details The XACC service registry hands out a fresh clone of a cloneable (xacc::Cloneable) service to every
+   * caller, so such services can be used freely from any thread. A non-cloneable service (e.g. the staq compiler)
+   * is a single instance shared by the whole process, so threads must take turns to use it. These functions provide
+   * one thread locker per shared instance, so that only users of the same instance ever wait for each other.
+   *
+   * Accelerators need slightly different treatment, as XACC initialises them during the registry lookup itself, so
+   * a shared accelerator must be locked before it is even retrieved. Accelerators are therefore locked by backend
+   * name, and each backend is treated as shared until an instance retrieved from XACC proves that it is cloneable.
+   * Some backends (e.g. TNQVM, which drives the process-wide ExaTN runtime) are never safe to use concurrently, even
+   * through separate instances.
+   */
+  namespace service_locks
+  {
+
+    /// Get the thread locker dedicated to a shared service instance
+    std::mutex& get_instance_mutex(const void* instance);
+
+    /// Lock the thread locker dedicated to an XACC service instance, unless the instance is private to the caller.
+    /// Returns an empty lock in the latter case.
+    template <class Service>
+    std::unique_lock<std::mutex> lock_if_shared(const std::shared_ptr<Service>& service)
+    {
+      if (std::dynamic_pointer_cast<xacc::Cloneable<Service>>(service)) return {};
+      return std::unique_lock(get_instance_mutex(service.get()));
+    }
+
+    /// Lock the thread locker of an accelerator backend, unless the backend is known to hand out private instances
+    /// that can run concurrently. Returns an empty lock in the latter case.
+    std::unique_lock<std::mutex> lock_backend(const std::string& backend);
+
+    /// Check an accelerator instance retrieved from XACC, and remember if its backend hands out private instances.
+    /// Pass constructed = true for instances constructed directly rather than retrieved from the service registry.
+    /// Returns true if the instance is private, and so can be used without holding the backend's lock.
+    bool register_backend_instance(const std::string& backend, const std::shared_ptr<xacc::Accelerator>& instance,
+                                   bool constructed = false);
+
+    /// Lock the XACC service registry, for looking up and initialising services
+    std::unique_lock<std::mutex> lock_registry();
+
+  }
+
+}
@@ -1,11 +1,15 @@
 // Copyright (c) Quantum Brilliance Pty Ltd
 #pragma once
 
+#include <qristal/core/accelerator_pool.hpp>
 #include <qristal/core/circuit_language.hpp>
 #include <qristal/core/cmake_variables.hpp>
+#include <qristal/core/compiled_ir_cache.hpp>
 #include <qristal/core/noise_model/noise_model.hpp>
+#include <qristal/core/packed_results.hpp>
 #include <qristal/core/passes/base_pass.hpp>
 #include <qristal/core/remote_async_accelerator.hpp>
+#include <qristal/core/shot_sampler.hpp>
 #include <qristal/core/utils.hpp>
 
 // MPI
@@ -22,9 +26,12 @@
 // STL
 #include <cmath>
 #include <complex>
+#include <cstdint>
 #include <functional>
+#include <future>
 #include <map>
 #include <mutex>
+#include <optional>
 #include <string>
 #include <type_traits>
 #include <unordered_map>
@@ -36,8 +43,9 @@
 
 
 // Forward declarations
+namespace xacc { class AcceleratorBuffer; class CompositeInstruction; }
 namespace xacc::quantum { class qdk; }
-namespace qristal { class backend; }
+namespace qristal { class backend; class CircuitBuilder; }
 
 namespace qristal
 {
@@ -62,11 +70,8 @@ namespace qristal
       bool all_bitstring_counts_ordered_by_MSB_ = false;
       YAML::Node remote_backend_database_;
 
-      /// A mutex to lock access to non-threadsafe operations.
-      static std::mutex shared_mutex;
-
-      /// The number of shots remaining to be drawn from \ref results_ using \ref draw_shot
-      size_t shots_remaining_;
+      /// Sampler for drawing shots from \ref results_ using \ref draw_shot and \ref draw_shots; set up on the first draw
+      std::optional<shot_sampler> shot_sampler_;
 
       /// The number of shots to be run on the current process (differs from \ref sn if running with multiple MPI processes).
       size_t sn_this_process;
@@ -75,12 +80,13 @@ namespace qristal
 
       /**
        * @brief The results of a Quantum calculation.
-       * The map value (count) is the number of times the map key (Qubit states
-       * with the same bit indexation as the quantum processor registers) was
+       * The count of each outcome (Qubit states with the same bit indexation as
+       * the quantum processor registers) is the number of times that it was
        * measured after all shots were run.
        *
-       * @note The Qubit states are represented as a vector of booleans for the
-       * reasons outlined below:
+       * @note The Qubit states are packed into fixed-width words, with bit i of
+       * each word array corresponding to qubit i, and unpack to vectors of
+       * booleans (as returned by @ref results()) for the reasons outlined below:
        * - High qubit counts can quickly exhaust all possible values able to
        *   be encoded by even a 64-bit integer, causing integer overflow.
        * - Values are agnostic with respect to both endianness and ordering
@@ -96,7 +102,39 @@ namespace qristal
        *     integer must be chosen.
        *
        */
-      std::map<std::vector<bool>, int> results_;
+      packed_results results_;
+
+      /// Compatibility view of @ref results_ as a map, rebuilt in place the first time that results() is called after they change
+      struct results_map_view
+      {
+        std::map<std::vector<bool>, int> map;
+        bool stale = false;
+        mutable std::mutex m;
+
+        results_map_view() = default;
+        results_map_view(const results_map_view& other)
+        {
+          std::lock_guard lock(other.m);
+          map = other.map;
+          stale = other.stale;
+        }
+        results_map_view& operator=(const results_map_view& other)
+        {
+          if (this == &other) return *this;
+          std::scoped_lock lock(m, other.m);
+          map = other.map;
+          stale = other.stale;
+          return *this;
+        }
+      };
+      mutable results_map_view results_map_;
+
+      /// Mark the compatibility view of the results as out of date after they have changed
+      void results_changed()
+      {
+        std::lock_guard lock(results_map_.m);
+        results_map_.stale = true;
+      }
 
       /**
        * @brief Provides counts for every possible combination of qubit
@@ -156,18 +194,114 @@ namespace qristal
        */
       std::vector<std::vector<double>> all_bitstring_probability_gradients_;
 
-      std::string transpiled_circuit_;
+      /// Expectation value of @ref gradient_observable, exact for the noiseless circuit. Requires @ref calc_gradients
+      /// to be set to true, @ref gradient_method to be "adjoint" and @ref gradient_observable to be set.
+      double observable_expectation_ = 0;
+
+      /// Gradients of the expectation value of @ref gradient_observable with respect to the circuit parameters, in the
+      /// same order as @ref circuit_parameters. Requires the same settings as @ref observable_expectation_.
+      std::vector<double> observable_gradients_;
+
+      /**
+       * @brief Sorted indices of the bitstrings that were measured, when @ref sparse_outputs is set.
+       *
+       * @details Indices are given by @ref bitstring_index, and @ref sparse_bitstring_counts_,
+       * @ref sparse_bitstring_probabilities_ and each row of @ref sparse_bitstring_probability_gradients_ hold the
+       * values for the same bitstrings, in the same order. Bitstrings that were only measured in the shifted runs
+       * used to calculate gradients are included, with zero counts.
+       */
+      std::vector<uint64_t> sparse_bitstring_indices_;
+
+      /// Counts of the bitstrings in @ref sparse_bitstring_indices_. Requires @ref calc_all_bitstring_counts.
+      std::vector<int> sparse_bitstring_counts_;
+
+      /// Probabilities of the bitstrings in @ref sparse_bitstring_indices_. Requires @ref calc_gradients.
+      std::vector<double> sparse_bitstring_probabilities_;
+
+      /// Gradients of the probabilities of the bitstrings in @ref sparse_bitstring_indices_ with respect to the
+      /// circuit parameters, one row per parameter. Requires @ref calc_gradients.
+      std::vector<std::vector<double>> sparse_bitstring_probability_gradients_;
+
       std::string qobj_;
       std::string qbjson_;
       bool acc_outputs_qbit0_left_;
-      std::map<int,int> one_qubit_gate_depths_;
-      std::map<int,int> two_qubit_gate_depths_;
-      std::map<int,double> timing_estimates_;
-      double z_op_expectation_;
+
+      /**
+       * @brief Outputs of a run that are only worked out the first time that they are asked for.
+       *
+       * @details Transpiling the circuit to QB native gates, profiling it and calculating the Z-operator expectation
+       * value can easily take longer than simulating a small circuit, and are often not needed at all. So run()
+       * just keeps hold of what they need, and the getters work them out on first access and memoise them. Copies
+       * of a session share the same deferred outputs, so these are only ever worked out once per run.
+       */
+      struct deferred_outputs
+      {
+        /// Copy of the circuit that was executed, taken when the run finished, or nullptr if transpilation is disabled
+        std::shared_ptr<xacc::CompositeInstruction> circuit;
+
+        /// Transpiler to QB native gates, or nullptr if transpilation and resource estimation are disabled
+        std::shared_ptr<qristal::backend> transpiler;
+
+        /// Buffer holding the measurement results, or nullptr if the Z-operator expectation value is not available
+        std::shared_ptr<xacc::AcceleratorBuffer> buffer;
+
+        /// Number of qubits
+        size_t num_qubits = 0;
+
+        /// Total number of shots
+        size_t shots = 0;
+
+        /// Walltime, in ms, for the simulator to execute the circuit
+        double simulator_time_ms = 0;
+
+        /// Whether to print debug information
+        bool debug = false;
+
+        /// Circuit transpiled to QB native gates, as an OpenQASM string
+        std::string transpiled_circuit;
+
+        /// Numbers of one- and two-qubit gates applied to each qubit
+        std::map<int,int> one_qubit_gate_depths;
+        std::map<int,int> two_qubit_gate_depths;
+
+        /// Estimated circuit execution times on hardware
+        std::map<int,double> timing_estimates;
+
+        /// Expected value in the Z basis
+        double z_op_expectation = 0;
+
+        /// File to which the transpiled circuit is being saved in the background, or empty if it is not being saved
+        std::string output_oqm_file;
+
+        /// Completion of the background save of the transpiled circuit
+        std::shared_future<void> output_oqm_written;
+
+        /// Flags marking the outputs that have been worked out
+        std::once_flag profiled;
+        std::once_flag z_op_calculated;
+
+        /// Transpile the circuit to QB native gates and profile it
+        void profile();
+
+        /// Calculate the Z-operator expectation value
+        void calculate_z_op_expectation();
+      };
+
+      /// Deferred outputs of the last run
+      std::shared_ptr<deferred_outputs> deferred_outputs_;
+
+      /// Get the deferred outputs of the last run, after transpiling and profiling the circuit if not yet done
+      const deferred_outputs& profiled_outputs() const;
+
+      /// Get the sampler for drawing shots from the results of the last run, setting it up if not yet done
+      shot_sampler& get_shot_sampler();
 
       /// The XACC accelerator in use
       std::shared_ptr<xacc::Accelerator> qpu_ = nullptr;
 
+      /// Accelerator pool key for qpu_, if qpu_ is private to this session and so can be reused by others afterwards
+      std::optional<accelerator_pool::key> qpu_pool_key_;
+
       /// State vector from qpp or aer
       std::shared_ptr<std::vector<std::complex<double>>> state_vec_;
 
@@ -231,6 +365,8 @@ namespace qristal
       static const std::unordered_set<std::string_view> VALID_MEASURE_SAMPLING_OPTIONS;
       /// Valid singular value decomposition type options
       static const std::unordered_set<std::string_view> VALID_SVD_TYPE_OPTIONS;
+      /// Valid gradient methods
+      static const std::unordered_set<std::string_view> VALID_GRADIENT_METHODS;
       /// @}
 
       #ifdef USE_MPI
@@ -301,9 +437,10 @@ namespace qristal
       //           CMakeFiles/ReadTheDocsHtmlBuild.dir/all] Error 2
       //      gmake: *** [Makefile:166: all] Error 2
       /// @cond DOXYGEN_SHOULD_SKIP_THIS
-      using ResultsMapQubitsType = decltype(results_)::key_type;
-      using ResultsMapCountType = decltype(results_)::mapped_type;
-      using ResultsMapType = decltype(results_);
+      using ResultsMapQubitsType = decltype(results_map_view::map)::key_type;
+      using ResultsMapCountType = decltype(results_map_view::map)::mapped_type;
+      using ResultsMapType = decltype(results_map_view::map);
+      using PackedResultsType = decltype(results_);
       using NativeResultsMapType = decltype(results_native_);
       using CountType = decltype(all_bitstring_counts_)::value_type;
       using OutCountsType = decltype(all_bitstring_counts_);
@@ -311,6 +448,8 @@ namespace qristal
       using OutProbabilitiesType = decltype(all_bitstring_probabilities_);
       using ProbabilityGradientType = decltype(all_bitstring_probability_gradients_)::value_type::value_type;
       using OutProbabilityGradientsType = decltype(all_bitstring_probability_gradients_);
+      using BitstringIndexType = decltype(sparse_bitstring_indices_)::value_type;
+      using SparseIndicesType = decltype(sparse_bitstring_indices_);
       /// @endcond
 
       /**
@@ -370,9 +509,40 @@ namespace qristal
       /// Whether or not gradients will be calculated for parametrized circuits.
       bool calc_gradients = false;
 
+      /**
+       * @brief Method used to calculate gradients.
+       *
+       * @details "parameter-shift" runs shifted copies of the circuit on the chosen backend, and works out the
+       * gradients from their measured counts. "adjoint" works out exact gradients from a single noiseless simulation of
+       * the state vector, with one backward pass for the gradients of @ref gradient_observable, or one tangent pass per
+       * parameter for the gradients of all bitstring probabilities. It only supports local simulators without noise.
+       */
+      std::string gradient_method = "parameter-shift";
+
+      /**
+       * @brief Pauli observable whose expectation value is differentiated, in XACC format (e.g. "0.5 Z0 Z1 + 0.2 X0").
+       *
+       * @details Only used with @ref gradient_method = "adjoint". If set, the gradients of the expectation value of
+       * the observable are returned by observable_gradients() in place of all_bitstring_probability_gradients(), which
+       * is left empty. Qubits are numbered as in the circuit.
+       */
+      std::string gradient_observable;
+
       /// Whether or not a non-compact output counts vector will be calculated.
       bool calc_all_bitstring_counts = false;
 
+      /**
+       * @brief Whether to store the outputs indexed by bitstring sparsely.
+       *
+       * @details If set, only the bitstrings that were measured are kept, as sorted 64-bit indices with matching
+       * arrays of counts, probabilities and probability gradients, returned by sparse_bitstring_indices(),
+       * sparse_bitstring_counts(), sparse_bitstring_probabilities() and sparse_bitstring_probability_gradients().
+       * The dense all_bitstring_* outputs, which hold a value for every one of the 2^qn bitstrings, are then not
+       * calculated. Use this for sampling runs on many qubits, which only ever measure a tiny fraction of all
+       * bitstrings.
+       */
+      bool sparse_outputs = false;
+
       /// @brief The path to the remote backend database yaml file.
       /// The path to a YAML file with configuration data for remote backends (including hardware).
       std::string remote_backend_database_path = QRISTAL_DIR + "/remote_backends.yaml";
@@ -426,6 +596,16 @@ namespace qristal
        /// Enable output transpilation and resource estimation
       bool output_oqm_enabled = true;
 
+      /**
+       * @brief Directory in which to save the transpiled circuit of each run.
+       *
+       * @details By default (empty), the transpiled circuit is only kept in memory. Otherwise, after each run the
+       * circuit is transpiled and written in the background to a new, uniquely named OpenQASM file in this directory
+       * (see output_oqm_file()), so concurrent sessions never overwrite each other's files and run() never waits
+       * for the filesystem. Has no effect unless output_oqm_enabled is set.
+       */
+      std::string output_oqm_dir;
+
       /// Disable timing estimation
       bool notiming = false;
 
@@ -515,10 +695,21 @@ namespace qristal
       /**
        * @brief Get the output measurement counts as a map
        *
+       * @details The map is rebuilt in place from the packed results the first time that it is asked for after a
+       * run, so references to it remain valid across runs. A reference held across a run shows the new results once
+       * results() has been called again.
+       *
        * @return Measurement counts map
        */
       const std::map<std::vector<bool>,int>& results() const;
 
+      /**
+       * @brief Get the output measurement counts, packed
+       *
+       * @return Measurement counts of the distinct outcomes, in the same order as results()
+       */
+      const packed_results& results_packed() const;
+
       /**
        * @brief Get the native output measurement counts as a map
        *
@@ -557,13 +748,69 @@ namespace qristal
        */
       const std::vector<std::vector<double>>& all_bitstring_probability_gradients() const;
 
+      /**
+       * @brief Get the expectation value of the gradient observable
+       *
+       * @return Exact expectation value of gradient_observable for the noiseless circuit
+       */
+      double observable_expectation() const;
+
+      /**
+       * @brief Get the gradients of the expectation value of the gradient observable
+       *
+       * @return Gradients of the expectation value of gradient_observable w.r.t. runtime parameters
+       */
+      const std::vector<double>& observable_gradients() const;
+
+      /**
+       * @brief Get the sorted indices of the measured bitstrings, when outputs are stored sparsely
+       *
+       * @return Indices of the bitstrings with entries in the other sparse outputs
+       */
+      const std::vector<uint64_t>& sparse_bitstring_indices() const;
+
+      /**
+       * @brief Get the output measurement counts, when outputs are stored sparsely
+       *
+       * @return Measurement counts of the bitstrings in sparse_bitstring_indices()
+       */
+      const std::vector<int>& sparse_bitstring_counts() const;
+
+      /**
+       * @brief Get the output probabilities, when outputs are stored sparsely
+       *
+       * @return Measurement probabilities of the bitstrings in sparse_bitstring_indices()
+       */
+      const std::vector<double>& sparse_bitstring_probabilities() const;
+
+      /**
+       * @brief Get the output probability gradients, when outputs are stored sparsely
+       *
+       * @return Table of probability jacobians w.r.t. runtime parameters, with one row per parameter and one column
+       * per bitstring in sparse_bitstring_indices()
+       */
+      const std::vector<std::vector<double>>& sparse_bitstring_probability_gradients() const;
+
       /**
        * @brief Get the output transpiled circuit
        *
+       * @details The circuit is transpiled and profiled the first time that this or any of the resource estimates
+       * (gate depths and timing estimates) is asked for after a run, and the results are kept for later calls.
+       *
        * @return Output transpiled circuit as an OpenQASM string.
        */
       std::string transpiled_circuit() const;
 
+      /**
+       * @brief Get the file to which the transpiled circuit of the last run was saved
+       *
+       * @details Waits for the file to be written if it is still being written in the background, and passes on any
+       * error in transpiling the circuit or writing the file.
+       *
+       * @return Path to the file, or an empty string if output_oqm_dir was not set for the last run.
+       */
+      std::string output_oqm_file() const;
+
       /**
        * @brief Get the output Aer QObj JSON string
        *
@@ -608,6 +855,8 @@ namespace qristal
       /**
        * @brief Get the output expected value in the Z basis, from the shot counts observed.
        *
+       * @details This is calculated the first time that it is asked for after a run.
+       *
        * @return Expected value in the Z basis
        */
       double z_op_expectation() const;
@@ -641,6 +890,31 @@ namespace qristal
       /// Otherwise, returns null if this function completes the run locally.
       std::shared_ptr<async_job_handle> run();
 
+      /**
+       * @brief Run many circuits with the same settings as this session, sharing as much setup as possible.
+       *
+       * @details The run configuration is validated and the backend options collected once for the whole batch.
+       * Accelerator instances are reused from circuit to circuit through the accelerator pool. Each circuit is compiled,
+       * placed, optimised, executed and post-processed on the thread pool, with as many circuits in flight as
+       * there are threads in the pool. Execution on accelerator instances that cannot be used concurrently is
+       * serialised, as in run(). Hardware, AWS Braket and multi-process MPI runs fall back to calling run() on each
+       * circuit in turn.
+       *
+       * @param circuits The circuits to run.
+       * @return One session per circuit, in the same order as @p circuits, holding the results of that circuit.
+       * Each is a copy of this session with its input circuit replaced.
+       */
+      std::vector<session> run_batch(const std::vector<CircuitBuilder>& circuits);
+
+      /**
+       * @brief Run many circuits given as source strings (in @ref input_language) with the same settings as this
+       * session, sharing as much setup as possible. See run_batch(const std::vector<CircuitBuilder>&).
+       *
+       * @param sources The circuit sources to run.
+       * @return One session per circuit, in the same order as @p sources, holding the results of that circuit.
+       */
+      std::vector<session> run_batch(const std::vector<std::string>& sources);
+
       /// Cancel any in-flight asynchronous execution of run()
       void cancel_run();
 
@@ -649,12 +923,26 @@ namespace qristal
        * counts vector, corresponding to a bitstring.
        *
        * @param bitvec The bit-vector to be converted to the vector index
+       * @throws std::out_of_range if the bitstring has more than 64 bits
        */
       size_t bitstring_index(const std::vector<bool> &bitvec);
 
-      /// Randomly draw (and remove) a single shot from the results map
+      /**
+       * @brief Randomly draw a single shot from the results of the last run, without replacement
+       *
+       * @details Shots are drawn from a stream set up from \ref results on the first draw after each run, and
+       * seeded from \ref seed, so draws are reproducible for a fixed seed. Drawing shots does not change \ref results.
+       * Throws std::out_of_range if all shots have already been drawn.
+       */
       std::vector<bool> draw_shot();
 
+      /**
+       * @brief Randomly draw @p n shots from the results of the last run, without replacement
+       *
+       * @details As for \ref draw_shot. Throws std::out_of_range (and draws nothing) if fewer than @p n shots remain.
+       */
+      std::vector<std::vector<bool>> draw_shots(size_t n);
+
     private:
 
       std::string random_circuit(const size_t n_q, const size_t depth);
@@ -672,16 +960,48 @@ namespace qristal
                               std::shared_ptr<xacc::AcceleratorBuffer> buffer_b, double runtime_ms,
                               std::shared_ptr<qristal::backend> qb_transpiler);
 
+      /// @brief Finish post-processing the results of a run: calculate gradients, correct for SPAM errors and combine
+      /// the results of MPI processes.
+      /// @details None of this needs the accelerator, so it is done after the accelerator has been released.
+      void finish_run_result();
+
       /// @brief Util method to compile input source string into IR
       ///
       /// This method is thread-safe, thus can be used to compile multiple source strings in parallel.
       std::shared_ptr<xacc::CompositeInstruction> compile_input(const std::string& in_source_string, int in_num_qubits, circuit_language in_source_type);
 
+      /// @brief Compile (if necessary), place and optimise the input circuit, ready for execution.
+      /// @param input_origin The origin of the input circuit.
+      /// @param backend_instance The Qristal backend, used for placement.
+      /// @return The circuit to execute.
+      std::shared_ptr<xacc::CompositeInstruction> prepare_circuit(circuit_origin input_origin,
+                                                                  std::shared_ptr<qristal::backend> backend_instance);
+
+      /// @brief Place and optimise a circuit that has already been compiled and had its parameters bound.
+      /// @param citarget The circuit, which is modified in place.
+      /// @param backend_instance The Qristal backend, used for placement.
+      void place_and_optimise(std::shared_ptr<xacc::CompositeInstruction> citarget,
+                              std::shared_ptr<qristal::backend> backend_instance);
+
+      /// @brief Run a batch of circuits; the common implementation of the public run_batch overloads.
+      /// @param n_circuits The number of circuits in the batch.
+      /// @param set_input Function that sets the input circuit of the session for the i-th circuit.
+      /// @return One session per circuit, holding the results of that circuit.
+      std::vector<session> run_batch(size_t n_circuits, const std::function<void(session&, size_t)>& set_input);
+
       /// @brief Retrieve the target circuit string.
       /// This will involve loading a file, generating a random circuit string, etc, depending on the value of \p input_origin.
       /// @param input_origin The origin of the input circuit.
+      /// @param cache_key The compiled IR cache key of the circuit, if any, whose source and include_qb contents are
+      /// used instead of reading the input and include files again.
       /// @return The target circuit as a std::string.
-      std::string get_target_circuit_qasm_string(circuit_origin input_origin);
+      std::string get_target_circuit_qasm_string(circuit_origin input_origin,
+                                                 const std::optional<compiled_ir_cache::key>& cache_key = std::nullopt);
+
+      /// @brief Work out the key under which the IR compiled from the target circuit string is stored in the compiled IR cache.
+      /// @param input_origin The origin of the input circuit.
+      /// @return The cache key, or std::nullopt if the circuit should not be cached (e.g. random circuits).
+      std::optional<compiled_ir_cache::key> get_compiled_ir_cache_key(circuit_origin input_origin);
 
       /// Wrap raw OpenQASM string in a QB Kernel:
       /// - Move qreg to a kernel argument
@@ -692,22 +1012,40 @@ namespace qristal
       /// @return A xacc::HeterogeneousMap containing the settings for the backend in use.
       xacc::HeterogeneousMap configure_backend(const YAML::Node& rbdb);
 
-      /// Get the simulator
+      /// @brief Get the simulator, from the accelerator pool if an idle one with the same settings is available.
+      /// @details Sets @ref qpu_pool_key_ if the returned accelerator is private to this session.
       std::shared_ptr<xacc::Accelerator> get_sim_qpu(bool execute_on_hardware);
 
+      /// @brief Retrieve and configure the accelerator for this run, storing it in @ref qpu_.
+      /// @return A lock on the accelerator's backend. This is held if the accelerator instance is shared with other
+      /// sessions and so must not be used concurrently, and empty otherwise.
+      std::unique_lock<std::mutex> acquire_sim_qpu(bool execute_on_hardware, const xacc::HeterogeneousMap& mqbacc);
+
+      /// Give @ref qpu_ back to the accelerator pool for reuse, if it is private to this session
+      void release_sim_qpu();
+
       /// @brief Calculate the gradients for the parametrized quantum task.
       /// This will calculate the gradients of the probabilities of all possible output bitstrings
-      /// of the circuit, with respect to each circuit parameter. The session does this by creating
-      /// two new session objects and using them to compute the gradients using the "parameter-shift"
-      /// rule, where the circuit is run again using slightly shifted parameters.
+      /// of the circuit, with respect to each circuit parameter, using the general "parameter-shift"
+      /// rule for each parameter (see parameter_shift.hpp). All the shifted parameter values are bound
+      /// to the same compiled circuit, and the shifted circuits are run concurrently on the thread pool,
+      /// without transpiling or profiling them.
       void run_gradients();
 
+      /// @brief Calculate exact gradients by adjoint differentiation of the noiseless state vector (see
+      /// adjoint_gradients.hpp), either of the probabilities of all possible output bitstrings or of the
+      /// expectation value of gradient_observable.
+      void run_adjoint_gradients();
+
       /// Execute the circuit on a simulator
       void execute_on_simulator(
           std::shared_ptr<xacc::Accelerator> acc,
           std::shared_ptr<xacc::AcceleratorBuffer> buffer_b,
           std::shared_ptr<xacc::CompositeInstruction>& circuit);
 
+      /// Save the results to the sparse bitstring counts, sorted by bitstring index
+      void populate_sparse_counts();
+
       /// Populate a given counts map with results from QPU execution.
       /// Templated measure_counts_map to support different type of map-like data.
       template <typename CountMapT>
@@ -724,20 +1062,15 @@ namespace qristal
           throw std::logic_error("Not enough qubits! Set qn to at least " + std::to_string(qbits_meas));
         }
 
-        // Convert count map keys from strings with assumed endianness and directionality to std::vector<bool>, and save results
-        results_.clear();
-        for (const auto& [bitstring, count] : measure_counts_map) {
-          std::vector<bool> bitvector(qbits_meas);
-          for (int i = 0; i < qbits_meas; i++) {
-            int j = acc_outputs_qbit0_left_ ? i : qbits_meas - (i+1);
-            bitvector.at(j) = (bitstring.at(i) != '0');
-          }
-          results_[bitvector] = count;
-        }
+        // Pack count map keys from strings with assumed endianness and directionality, and save results
+        results_ = packed_results::from_bitstrings(measure_counts_map, qbits_meas, acc_outputs_qbit0_left_);
+        results_changed();
 
         // If requested, save the results to the all_bitstring_counts for computing gradients
-        if (calc_all_bitstring_counts) {
-          for (const auto &[bitvec, count] : results_) all_bitstring_counts_[bitstring_index(bitvec)] = count;
+        if (calc_all_bitstring_counts and sparse_outputs) {
+          populate_sparse_counts();
+        } else if (calc_all_bitstring_counts) {
+          for (size_t i = 0; i < results_.size(); i++) all_bitstring_counts_[bitstring_index(results_.outcome_at(i))] = results_.counts()[i];
         }
       }
 
@@ -771,6 +1104,7 @@ namespace qristal
   CHECK_SESSION_RESULT_TYPE(session::ResultsMapQubitsType, mpi::Qubits);
   CHECK_SESSION_RESULT_TYPE(session::ResultsMapCountType, mpi::Count);
   CHECK_SESSION_RESULT_TYPE(session::ResultsMapType, mpi::ResultsMap);
+  CHECK_SESSION_RESULT_TYPE(session::PackedResultsType, mpi::Results);
   CHECK_SESSION_RESULT_TYPE(session::NativeResultsMapType, mpi::ResultsMap);
 
   CHECK_SESSION_RESULT_TYPE(session::CountType, mpi::Count);
@@ -782,6 +1116,9 @@ namespace qristal
   CHECK_SESSION_RESULT_TYPE(session::OutProbabilityGradientsType,
                             mpi::OutProbabilityGradients);
 
+  CHECK_SESSION_RESULT_TYPE(session::BitstringIndexType, mpi::BitstringIndex);
+  CHECK_SESSION_RESULT_TYPE(session::SparseIndicesType, mpi::SparseIndices);
+
   // // Also ensure the count type used in the results map is the same used in
   // all_bitstring_counts
   CHECK_SESSION_RESULT_TYPE(session::ResultsMapCountType, session::CountType);
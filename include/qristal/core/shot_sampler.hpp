@@ -0,0 +1,66 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+#pragma once
+
+// STL
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace qristal
+{
+
+  /**
+   * @brief Draws shots at random, without replacement, from a set of measurement counts.
+   *
+   * @details The remaining counts of the distinct outcomes are kept in a Fenwick (binary indexed) tree, so that
+   * drawing a shot and removing it from the counts both take O(log K) time for K distinct outcomes, rather than
+   * the O(K) of walking the counts. Each sampler has its own random number generator, so separate samplers can be
+   * used concurrently, and a sampler created with the same counts and seed always draws the same shots.
+   */
+  class shot_sampler
+  {
+
+    public:
+
+      /// A single measurement outcome, as stored in session results
+      using outcome = std::vector<bool>;
+
+      /// Constructor for an empty sampler
+      shot_sampler() = default;
+
+      /// Constructor taking measurement counts and a seed for the random number generator
+      shot_sampler(const std::map<outcome, int>& counts, uint64_t seed);
+
+      /// Number of shots remaining to be drawn
+      size_t remaining() const;
+
+      /// Randomly draw (and remove) a single shot. Throws std::out_of_range if no shots remain.
+      const outcome& draw();
+
+      /// Randomly draw (and remove) @p n shots. Throws std::out_of_range (and draws nothing) if fewer than @p n remain.
+      std::vector<outcome> draw(size_t n);
+
+    private:
+
+      /// Draw the index of an outcome, and remove one shot of it from the tree
+      size_t draw_index();
+
+      /// Distinct outcomes, in the order of the counts that the sampler was created with
+      std::vector<outcome> outcomes;
+
+      /// Fenwick tree over the remaining counts of the outcomes (1-based)
+      std::vector<size_t> tree;
+
+      /// Highest power of two not greater than the number of outcomes
+      size_t top_step = 0;
+
+      /// Number of shots remaining to be drawn
+      size_t shots_remaining = 0;
+
+      /// Random number generator
+      std::mt19937_64 rng;
+
+  };
+
+}
@@ -2,18 +2,33 @@
 #pragma once
 
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
 #include <thread>
 #include <future>
 #include <atomic>
+#include <memory>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <functional>
 #include <type_traits>
+#include <exception>
+#include <algorithm>
 
 namespace qristal
 {
 
-  /// A threadsafe singleton thread pool class based on std::thread
+  class task_group;
+
+  /**
+   * @brief A threadsafe singleton thread pool class based on std::thread
+   *
+   * @details Each worker owns a double-ended queue of tasks. Workers take tasks from the back of their own queue,
+   * and when that runs dry, steal from the front of the other workers' queues. Tasks submitted from outside the
+   * pool are dealt out to the workers' queues in round-robin order; tasks submitted from within a running task go
+   * to the back of the submitting worker's own queue. Workers with nothing to do sleep on a condition variable
+   * rather than polling, so an idle pool uses no CPU time.
+   */
   class thread_pool
   {
 
@@ -59,15 +74,15 @@ namespace qristal
         // Define a future from the result promise
         std::future<result_type> result_future = promise_ptr->get_future();
 
-        // Make a void() lambda out of the submitted function, returning the result to the promise
-        auto func = [=] { promise_ptr->set_value(std::invoke(f, args...)); };
-
-        // Threadlocked block for updating the queue
+        // Make a void() lambda out of the submitted function, returning the result (or any exception) to the promise
+        auto func = [=]
         {
-          std::scoped_lock<std::mutex> lock(queue_m);
-          // Put the function in the queue
-          queue.push(func);
-        }
+          try { promise_ptr->set_value(std::invoke(f, args...)); }
+          catch (...) { promise_ptr->set_exception(std::current_exception()); }
+        };
+
+        // Put the function in a queue
+        enqueue(std::move(func));
 
         // Return the future obtained from the result promise
         return result_future;
@@ -80,14 +95,26 @@ namespace qristal
       {
         // Make a void() lambda out of the submitted function
         auto func = [=] { std::invoke(f, args...); };
-        // Threadlocked block for updating the queue
-        {
-          std::scoped_lock<std::mutex> lock(queue_m);
-          // Put the function in the queue
-          queue.push(func);
-        }
+        // Put the function in a queue
+        enqueue(std::move(func));
       }
 
+      /**
+       * @brief Call a function for every index in [begin, end) using the thread pool, and wait for all calls to finish.
+       *
+       * @details The range is divided into chunks of @p grain consecutive indices. Rather than submitting one task
+       * per chunk, one task is submitted per worker and the workers claim chunks from a shared counter until none are
+       * left, so scheduling costs a handful of allocations no matter how large the range is. If any call throws, the
+       * remaining chunks are skipped and the first exception is rethrown here.
+       *
+       * @param begin First index in the range
+       * @param end One past the last index in the range
+       * @param grain Number of consecutive indices handled by each chunk. Zero chooses a grain automatically.
+       * @param f Function to call with each index; must be callable as f(size_t).
+       */
+      template <class Function>
+      static void parallel_for(size_t begin, size_t end, size_t grain, Function&& f);
+
       /// Uncopyable
       thread_pool(const thread_pool&) = delete;
 
@@ -98,6 +125,24 @@ namespace qristal
 
     private:
 
+      friend class task_group;
+
+      /// A worker thread and the queue of tasks that it owns
+      struct worker
+      {
+        /// The thread running thread_pool::loop for this worker
+        std::thread thread;
+
+        /// Tasks waiting to be run. The owner works from the back; thieves take from the front.
+        std::deque<std::function<void()>> tasks;
+
+        /// Thread locker for the task queue
+        std::mutex tasks_m;
+
+        /// Flag indicating that the worker has exited its loop and can be joined
+        bool done = false;
+      };
+
       /// Getter for the instance; makes this class a threadsafe singleton
       static thread_pool& get_instance();
 
@@ -107,30 +152,181 @@ namespace qristal
       /// Destructor
       ~thread_pool();
 
-      /// Initialise a thread-future pair
-      std::pair<std::thread, std::shared_ptr<bool>> initialise_thread();
+      /// Start a worker thread at a given position in the pool
+      void initialise_thread(size_t);
+
+      /// Work collector.  Each thread runs this until the pool is destroyed or shrunk below its position.
+      void loop(size_t);
+
+      /// Place a task in a worker's queue and wake a sleeping worker to run it
+      void enqueue(std::function<void()>&&);
 
-      /// Work collector.  Each thread runs this indefinitely until the pool is destroyed.
-      void loop(std::shared_ptr<bool>);
+      /// Take a task from the back of a worker's own queue, or else steal one from the front of another worker's queue
+      bool try_take(size_t, std::function<void()>&);
+
+      /// Move any tasks left in the queue of a retiring worker into the queues of the remaining workers
+      void redistribute(size_t);
+
+      /// If the calling thread is one of the pool's workers, take a queued task and run it. Returns true if a task was run.
+      bool help();
 
       /// Number of threads to be maintained in the pool
-      int num_threads;
+      std::atomic<int> num_threads;
 
-      /// Number of active threads in the pool
-      int num_active_threads;
+      /// The workers. Entries at positions >= num_threads are retiring, and are cleaned up lazily.
+      std::vector<std::unique_ptr<worker>> workers;
 
-      /// A vector of threads for running tasks, paired with flags indicating if they have exited their loop.
-      std::vector<std::pair<std::thread, std::shared_ptr<bool>>> threads;
+      /// Thread locker for the workers vector. Held shared to access the queues, and exclusively to add or remove workers.
+      std::shared_mutex workers_m;
 
-      /// A queue of tasks waiting to be run by threads
-      std::queue<std::function<void()>> queue;
+      /// Number of tasks sitting in queues, waiting to be taken by a worker
+      std::atomic<size_t> pending_tasks;
 
-      /// Thread lockers for the queue and the shutdown flag
-      std::mutex queue_m, threads_m;
+      /// Counter used to deal out tasks submitted from outside the pool to the workers in round-robin order
+      std::atomic<size_t> next_worker;
+
+      /// Thread locker and condition variable used to put idle workers to sleep and wake them up again
+      std::mutex sleep_m;
+      std::condition_variable wake_up;
 
       /// Flag indicating that the pool is being destroyed
       std::atomic<bool> shutting_down;
 
   };
 
+
+  /**
+   * @brief A group of tasks run on the thread pool that can be waited on, and cancelled, as a whole.
+   *
+   * @details Tasks added to the group with run() or parallel_for() share a single completion counter, so there is
+   * one handle to wait on however many tasks are in the group, rather than one std::future per task. The first
+   * exception thrown by any task in the group cancels the rest of the group, and is rethrown by wait(). Calling
+   * cancel() causes tasks that have not yet started to be skipped. A group can be reused once wait() has returned.
+   *
+   * wait() may safely be called from within a task running on the pool: rather than blocking a worker, the waiting
+   * thread runs queued tasks itself until the group is finished. The destructor waits for any outstanding tasks, but
+   * discards any exception that they threw.
+   */
+  class task_group
+  {
+
+    public:
+
+      /// Constructor
+      task_group();
+
+      /// Destructor. Waits for all tasks in the group to finish.
+      ~task_group();
+
+      /// Uncopyable
+      task_group(const task_group&) = delete;
+
+      /// Unassignable
+      task_group& operator=(const task_group&) = delete;
+
+      /// Add a task to the group and send it to the thread pool for execution
+      template <class Function>
+      void run(Function&& f)
+      {
+        add(1);
+        thread_pool::get_instance().enqueue([st = st, f = std::forward<Function>(f)]() mutable
+        {
+          if (not st->cancelled)
+          {
+            try { f(); }
+            catch (...) { st->fail(std::current_exception()); }
+          }
+          st->finish();
+        });
+      }
+
+      /**
+       * @brief Add calls of a function for every index in [begin, end) to the group, without waiting for them.
+       *
+       * @details See thread_pool::parallel_for. Cancellation is checked between chunks, so a chunk that has already
+       * started always runs to completion.
+       */
+      template <class Function>
+      void parallel_for(size_t begin, size_t end, size_t grain, Function&& f)
+      {
+        if (end <= begin) return;
+        const size_t n = end - begin;
+        const size_t threads = std::max(1, thread_pool::get_num_threads());
+        // By default aim for several chunks per thread, so that uneven work still balances out across the workers.
+        if (grain == 0) grain = std::max<size_t>(1, n / (4 * threads));
+        const size_t num_chunks = (n + grain - 1) / grain;
+
+        // The function and the chunk counter are shared by all the tasks that work through this range.
+        auto fn = std::make_shared<std::decay_t<Function>>(std::forward<Function>(f));
+        auto next_chunk = std::make_shared<std::atomic<size_t>>(0);
+        const size_t num_tasks = std::min(num_chunks, threads);
+        add(num_tasks);
+        for (size_t t = 0; t < num_tasks; t++)
+        {
+          thread_pool::get_instance().enqueue([=, st = st]
+          {
+            try
+            {
+              for (size_t c = (*next_chunk)++; c < num_chunks and not st->cancelled; c = (*next_chunk)++)
+              {
+                const size_t chunk_end = std::min(end, begin + (c + 1) * grain);
+                for (size_t i = begin + c * grain; i < chunk_end; i++) (*fn)(i);
+              }
+            }
+            catch (...) { st->fail(std::current_exception()); }
+            st->finish();
+          });
+        }
+      }
+
+      /// Wait for all tasks in the group to finish, and rethrow the first exception thrown by any of them
+      void wait();
+
+      /// Skip all tasks in the group that have not started yet. Tasks that are already running are not interrupted.
+      void cancel();
+
+      /// Check whether the group has been cancelled, either explicitly or because one of its tasks threw
+      bool is_cancelled() const;
+
+    private:
+
+      /// Completion state shared between the group and its tasks
+      struct state
+      {
+        /// Thread locker and condition variable used to wait for the group to finish
+        std::mutex m;
+        std::condition_variable done;
+
+        /// Number of tasks in the group that have not finished yet
+        size_t outstanding = 0;
+
+        /// First exception thrown by a task in the group
+        std::exception_ptr error;
+
+        /// Flag indicating that tasks that have not started yet should be skipped
+        std::atomic<bool> cancelled = false;
+
+        /// Record an exception thrown by a task, and cancel the rest of the group
+        void fail(std::exception_ptr);
+
+        /// Mark one task as finished
+        void finish();
+      };
+
+      /// Register tasks that are about to be added to the group
+      void add(size_t);
+
+      /// Completion state of this group
+      std::shared_ptr<state> st;
+
+  };
+
+  template <class Function>
+  void thread_pool::parallel_for(size_t begin, size_t end, size_t grain, Function&& f)
+  {
+    task_group group;
+    group.parallel_for(begin, end, grain, std::forward<Function>(f));
+    group.wait();
+  }
+
 }
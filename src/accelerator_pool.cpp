@@ -0,0 +1,126 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/accelerator_pool.hpp>
+
+// XACC
+#include <Accelerator.hpp>
+
+// STL
+#include <functional>
+
+namespace qristal
+{
+
+  /// Getter for the instance; makes this class a threadsafe singleton
+  accelerator_pool& accelerator_pool::get_instance()
+  {
+    // This is guaranteed to be threadsafe by C++11
+    static accelerator_pool pool;
+    return pool;
+  }
+
+  /// Hash function for pool keys
+  size_t accelerator_pool::key_hash::operator()(const key& k) const
+  {
+    size_t h = std::hash<std::string>{}(k.backend);
+    h ^= k.options_hash + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+  }
+
+  /// Take an idle accelerator set up under a given key out of the pool, or return nullptr if there is none
+  std::shared_ptr<xacc::Accelerator> accelerator_pool::acquire(const key& k)
+  {
+    std::scoped_lock lock(m);
+    if (capacity == 0) return nullptr;
+    auto it = idle.find(k);
+    if (it == idle.end() or it->second.empty())
+    {
+      miss_count++;
+      return nullptr;
+    }
+    auto acc = std::move(it->second.back());
+    it->second.pop_back();
+    hit_count++;
+    return acc;
+  }
+
+  /// Give an accelerator back to the pool, once the caller has completely finished with it
+  void accelerator_pool::release(const key& k, std::shared_ptr<xacc::Accelerator> acc)
+  {
+    if (not acc) return;
+    std::scoped_lock lock(m);
+    auto& accs = idle[k];
+    if (accs.size() < capacity) accs.push_back(std::move(acc));
+  }
+
+  /// Set the maximum number of idle accelerators to keep for each key. Zero disables the pool.
+  void accelerator_pool::set_capacity(size_t n)
+  {
+    std::scoped_lock lock(m);
+    capacity = n;
+    for (auto& [k, accs] : idle) if (accs.size() > capacity) accs.resize(capacity);
+  }
+
+  /// Get the maximum number of idle accelerators to keep for each key
+  size_t accelerator_pool::get_capacity() const
+  {
+    std::scoped_lock lock(m);
+    return capacity;
+  }
+
+  /// Get the total number of idle accelerators currently in the pool
+  size_t accelerator_pool::size() const
+  {
+    std::scoped_lock lock(m);
+    size_t n = 0;
+    for (const auto& [k, accs] : idle) n += accs.size();
+    return n;
+  }
+
+  /// Remove all idle accelerators from the pool
+  void accelerator_pool::clear()
+  {
+    std::scoped_lock lock(m);
+    idle.clear();
+  }
+
+  /// Number of lookups that found an idle accelerator
+  size_t accelerator_pool::hits() const
+  {
+    return hit_count;
+  }
+
+  /// Number of lookups that did not find an idle accelerator
+  size_t accelerator_pool::misses() const
+  {
+    return miss_count;
+  }
+
+  /// Record the time spent setting up an accelerator for a run, in ms
+  void accelerator_pool::record_setup_time(bool reused, double ms)
+  {
+    (reused ? reused_setup_ns : new_setup_ns) += static_cast<size_t>(ms * 1.0e6);
+  }
+
+  /// Total time spent setting up accelerators taken from the pool, in ms
+  double accelerator_pool::reused_setup_time_ms() const
+  {
+    return reused_setup_ns * 1.0e-6;
+  }
+
+  /// Total time spent setting up new accelerators, in ms
+  double accelerator_pool::new_setup_time_ms() const
+  {
+    return new_setup_ns * 1.0e-6;
+  }
+
+  /// Set the hit and miss counters and the setup timers back to zero
+  void accelerator_pool::reset_counters()
+  {
+    hit_count = 0;
+    miss_count = 0;
+    reused_setup_ns = 0;
+    new_setup_ns = 0;
+  }
+
+}
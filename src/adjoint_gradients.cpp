@@ -0,0 +1,374 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/adjoint_gradients.hpp>
+#include <qristal/core/thread_pool.hpp>
+
+// XACC
+#include <AllGateVisitor.hpp>
+#include <CompositeInstruction.hpp>
+#include <InstructionIterator.hpp>
+#include <PauliOperator.hpp>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <set>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace
+{
+  using namespace std::complex_literals;
+
+  /// 1/sqrt(2)
+  constexpr double r2 = 1.0 / std::numbers::sqrt2;
+
+  /// Gates that the adjoint method knows how to simulate
+  const std::unordered_set<std::string> supported_gates = {
+    "H", "X", "Y", "Z", "S", "Sdg", "T", "Tdg", "I", "Rx", "Ry", "Rz", "U1", "U",
+    "CNOT", "CY", "CZ", "CH", "CRZ", "CPhase", "Swap", "Measure"
+  };
+}
+
+namespace qristal
+{
+  using namespace xacc::quantum;
+
+  /// Builds the list of gates for the adjoint method from a circuit
+  class adjoint_circuit_visitor : public AllGateVisitor
+  {
+
+    public:
+
+      using op = adjoint_gradients::op;
+      using matrix = adjoint_gradients::matrix;
+
+      /// Constructor
+      adjoint_circuit_visitor(const std::vector<std::string>& variables, const std::vector<double>& parameters)
+       : variables(variables), parameters(parameters) {}
+
+      /// Gates of the circuit, in order
+      std::vector<op> ops;
+
+      /// Qubits that have been measured
+      std::set<size_t> measured;
+
+      void visit(Hadamard& h) override { fixed(h.bits()[0], {r2, r2, r2, -r2}); }
+      void visit(X& x) override { fixed(x.bits()[0], {0, 1, 1, 0}); }
+      void visit(Y& y) override { fixed(y.bits()[0], {0, -1i, 1i, 0}); }
+      void visit(Z& z) override { fixed(z.bits()[0], {1, 0, 0, -1}); }
+      void visit(S& s) override { fixed(s.bits()[0], {1, 0, 0, 1i}); }
+      void visit(Sdg& sdg) override { fixed(sdg.bits()[0], {1, 0, 0, -1i}); }
+      void visit(T& t) override { fixed(t.bits()[0], {1, 0, 0, std::polar(1.0, std::numbers::pi/4)}); }
+      void visit(Tdg& tdg) override { fixed(tdg.bits()[0], {1, 0, 0, std::polar(1.0, -std::numbers::pi/4)}); }
+      void visit(Identity&) override {}
+      void visit(Measure& m) override { measured.insert(m.bits()[0]); }
+
+      void visit(Rx& rx) override { rotation_x(rx.bits()[0], rx.getParameter(0)); }
+      void visit(Ry& ry) override { rotation_y(ry.bits()[0], ry.getParameter(0)); }
+      void visit(Rz& rz) override { rotation_z(rz.bits()[0], -1, rz.getParameter(0)); }
+      void visit(U1& u1) override { phase(u1.bits()[0], -1, u1.getParameter(0)); }
+
+      void visit(U& u) override
+      {
+        // U(theta, phi, lambda) = Rz(phi) Ry(theta) Rz(lambda), up to a global phase
+        rotation_z(u.bits()[0], -1, u.getParameter(2));
+        rotation_y(u.bits()[0], u.getParameter(0));
+        rotation_z(u.bits()[0], -1, u.getParameter(1));
+      }
+
+      void visit(CNOT& cx) override { fixed(cx.bits()[1], {0, 1, 1, 0}, cx.bits()[0]); }
+      void visit(CY& cy) override { fixed(cy.bits()[1], {0, -1i, 1i, 0}, cy.bits()[0]); }
+      void visit(CZ& cz) override { fixed(cz.bits()[1], {1, 0, 0, -1}, cz.bits()[0]); }
+      void visit(CH& ch) override { fixed(ch.bits()[1], {r2, r2, r2, -r2}, ch.bits()[0]); }
+      void visit(CRZ& crz) override { rotation_z(crz.bits()[1], crz.bits()[0], crz.getParameter(0)); }
+      void visit(CPhase& cp) override { phase(cp.bits()[1], cp.bits()[0], cp.getParameter(0)); }
+
+      void visit(Swap& s) override
+      {
+        op o{};
+        o.target = s.bits()[0];
+        o.control = s.bits()[1];
+        o.swap = true;
+        ops.push_back(o);
+      }
+
+    private:
+
+      /// Names of the free parameters of the circuit
+      const std::vector<std::string>& variables;
+
+      /// Values of the free parameters of the circuit
+      const std::vector<double>& parameters;
+
+      /// Get the value of a gate parameter, and the index of the free parameter that it refers to (if any)
+      double angle(const xacc::InstructionParameter& p, long& param)
+      {
+        param = -1;
+        if (p.which() != 2) return InstructionParameterToDouble(p);
+        const auto var = std::find(variables.begin(), variables.end(), p.toString());
+        if (var == variables.end())
+        {
+          throw std::invalid_argument("Gate parameter " + p.toString() + " is not a free parameter of the circuit. "
+                                      "Adjoint gradients need free parameters to be passed to gates directly.");
+        }
+        param = var - variables.begin();
+        return parameters[param];
+      }
+
+      /// Add a gate without parameters
+      void fixed(size_t target, const matrix& m, long control = -1)
+      {
+        op o{};
+        o.m = m;
+        o.target = target;
+        o.control = control;
+        ops.push_back(o);
+      }
+
+      /// Add a gate with a parameter
+      void parametrised(size_t target, long control, const matrix& m, long param, const matrix& generator)
+      {
+        op o{};
+        o.m = m;
+        o.target = target;
+        o.control = control;
+        o.param = param;
+        o.generator = generator;
+        ops.push_back(o);
+      }
+
+      void rotation_x(size_t target, const xacc::InstructionParameter& p)
+      {
+        long param;
+        const double theta = angle(p, param);
+        const double c = std::cos(theta/2), s = std::sin(theta/2);
+        parametrised(target, -1, {c, -1i*s, -1i*s, c}, param, {0, 0.5, 0.5, 0});
+      }
+
+      void rotation_y(size_t target, const xacc::InstructionParameter& p)
+      {
+        long param;
+        const double theta = angle(p, param);
+        const double c = std::cos(theta/2), s = std::sin(theta/2);
+        parametrised(target, -1, {c, -s, s, c}, param, {0, -0.5i, 0.5i, 0});
+      }
+
+      void rotation_z(size_t target, long control, const xacc::InstructionParameter& p)
+      {
+        long param;
+        const double theta = angle(p, param);
+        parametrised(target, control, {std::polar(1.0, -theta/2), 0, 0, std::polar(1.0, theta/2)}, param, {0.5, 0, 0, -0.5});
+      }
+
+      void phase(size_t target, long control, const xacc::InstructionParameter& p)
+      {
+        long param;
+        const double theta = angle(p, param);
+        parametrised(target, control, {1, 0, 0, std::polar(1.0, theta)}, param, {0, 0, 0, -1});
+      }
+
+  };
+
+
+  /// Parse a Pauli observable from a string
+  std::vector<adjoint_gradients::pauli_term> adjoint_gradients::parse_observable(const std::string& observable)
+  {
+    std::vector<pauli_term> terms;
+    PauliOperator op(observable);
+    for (const auto& [name, term] : op.getTerms())
+    {
+      pauli_term t{term.coeff(), {}};
+      for (const auto& [qubit, pauli] : std::get<2>(term))
+      {
+        if (pauli.empty() or pauli == "I") continue;
+        t.paulis[qubit] = pauli[0];
+      }
+      terms.push_back(t);
+    }
+    return terms;
+  }
+
+  /// Constructor. Runs the forward pass.
+  adjoint_gradients::adjoint_gradients(std::shared_ptr<xacc::CompositeInstruction> circuit,
+                                       const std::vector<double>& parameters, size_t n_qubits)
+   : n_qubits(n_qubits), n_params(parameters.size())
+  {
+    const std::vector<std::string> variables = circuit->getVariables();
+    if (variables.size() != parameters.size())
+    {
+      throw std::invalid_argument("The number of circuit parameters (" + std::to_string(parameters.size()) + ") does not "
+                                  "match the number of free parameters in the circuit (" + std::to_string(variables.size()) + ").");
+    }
+
+    // Convert the circuit to a list of gates
+    adjoint_circuit_visitor visitor(variables, parameters);
+    xacc::InstructionIterator it(circuit);
+    while (it.hasNext())
+    {
+      auto inst = it.next();
+      if (not inst->isEnabled() or inst->isComposite()) continue;
+      if (not supported_gates.contains(inst->name()))
+      {
+        throw std::invalid_argument("Gate " + inst->name() + " is not supported by the adjoint gradient method.");
+      }
+      for (size_t q : inst->bits())
+      {
+        if (q >= n_qubits) throw std::invalid_argument("Gate " + inst->name() + " acts on qubit " + std::to_string(q) +
+                                                       ", but the circuit only has " + std::to_string(n_qubits) + ".");
+      }
+      inst->accept(&visitor);
+    }
+    if (visitor.measured.size() != n_qubits)
+    {
+      throw std::invalid_argument("Adjoint gradients need every qubit to be measured.");
+    }
+    ops = std::move(visitor.ops);
+
+    // Forward pass
+    final_state.assign(size_t(1) << n_qubits, 0);
+    final_state[0] = 1;
+    for (const op& o : ops) apply(o, final_state);
+  }
+
+  /// Probabilities of all bitstrings
+  std::vector<double> adjoint_gradients::probabilities() const
+  {
+    std::vector<double> probs(final_state.size());
+    for (size_t k = 0; k < final_state.size(); k++) probs[k] = std::norm(final_state[k]);
+    return probs;
+  }
+
+  /// Gradients of the probabilities of all bitstrings
+  std::vector<std::vector<double>> adjoint_gradients::probability_gradients() const
+  {
+    std::vector<std::vector<double>> jacobian(n_params, std::vector<double>(final_state.size(), 0.0));
+
+    // Push the derivative of the state with respect to each parameter through the circuit alongside the state itself,
+    // one parameter per task.
+    thread_pool::parallel_for(0, n_params, 1, [&](size_t p) {
+      state psi(final_state.size(), 0);
+      psi[0] = 1;
+      state tangent(final_state.size(), 0);
+      bool started = false;
+      for (const op& o : ops)
+      {
+        apply(o, psi);
+        if (started) apply(o, tangent);
+        if (o.param == long(p))
+        {
+          // d(U psi)/dp = -i G U psi
+          state g = psi;
+          apply_generator(o, g);
+          for (size_t k = 0; k < g.size(); k++) tangent[k] -= 1i * g[k];
+          started = true;
+        }
+      }
+      for (size_t k = 0; k < psi.size(); k++) jacobian[p][k] = 2 * std::real(std::conj(psi[k]) * tangent[k]);
+    });
+
+    return jacobian;
+  }
+
+  /// Expectation value of an observable, and its gradient with respect to every parameter
+  std::pair<double, std::vector<double>> adjoint_gradients::expectation_gradients(
+   const std::vector<pauli_term>& observable) const
+  {
+    state phi = final_state;
+    state lambda = apply_observable(observable, phi);
+    double expectation = 0;
+    for (size_t k = 0; k < phi.size(); k++) expectation += std::real(std::conj(phi[k]) * lambda[k]);
+
+    // Backward pass: undo the gates one at a time, picking up the contribution of each parametrised gate on the way
+    std::vector<double> gradients(n_params, 0.0);
+    for (auto o = ops.rbegin(); o != ops.rend(); ++o)
+    {
+      if (o->param >= 0)
+      {
+        // Contribution 2 Re <lambda| -i G |phi>, where phi is the state just after the gate
+        state mu = phi;
+        apply_generator(*o, mu);
+        std::complex<double> overlap = 0;
+        for (size_t k = 0; k < mu.size(); k++) overlap += std::conj(lambda[k]) * mu[k];
+        gradients[o->param] += 2 * std::imag(overlap);
+      }
+      apply_inverse(*o, phi);
+      apply_inverse(*o, lambda);
+    }
+
+    return {expectation, gradients};
+  }
+
+  /// Apply a gate to a state
+  void adjoint_gradients::apply(const op& o, state& psi) const
+  {
+    if (o.swap)
+    {
+      const size_t a = size_t(1) << o.target, b = size_t(1) << o.control;
+      for (size_t i = 0; i < psi.size(); i++) if ((i & a) and not (i & b)) std::swap(psi[i], psi[i ^ a ^ b]);
+      return;
+    }
+    apply_matrix(o.m, o.target, o.control, false, psi);
+  }
+
+  /// Apply the inverse of a gate to a state
+  void adjoint_gradients::apply_inverse(const op& o, state& psi) const
+  {
+    if (o.swap) return apply(o, psi);
+    const matrix dagger = {std::conj(o.m[0]), std::conj(o.m[2]), std::conj(o.m[1]), std::conj(o.m[3])};
+    apply_matrix(dagger, o.target, o.control, false, psi);
+  }
+
+  /// Apply the generator of a gate to a state
+  void adjoint_gradients::apply_generator(const op& o, state& psi) const
+  {
+    apply_matrix(o.generator, o.target, o.control, true, psi);
+  }
+
+  /// Apply a 2x2 matrix to a state
+  void adjoint_gradients::apply_matrix(const matrix& m, size_t target, long control, bool project_control,
+                                       state& psi) const
+  {
+    const size_t t = size_t(1) << target;
+    for (size_t i = 0; i < psi.size(); i++)
+    {
+      if (i & t) continue;
+      const size_t j = i | t;
+      if (control >= 0 and not ((i >> control) & 1))
+      {
+        if (project_control) psi[i] = psi[j] = 0;
+        continue;
+      }
+      const std::complex<double> a = psi[i], b = psi[j];
+      psi[i] = m[0]*a + m[1]*b;
+      psi[j] = m[2]*a + m[3]*b;
+    }
+  }
+
+  /// Apply an observable to a state
+  adjoint_gradients::state adjoint_gradients::apply_observable(const std::vector<pauli_term>& observable,
+                                                               const state& psi) const
+  {
+    state result(psi.size(), 0);
+    for (const auto& term : observable)
+    {
+      state tmp = psi;
+      for (const auto& [qubit, pauli] : term.paulis)
+      {
+        if (qubit >= n_qubits) throw std::invalid_argument("Observable acts on qubit " + std::to_string(qubit) +
+                                                           ", but the circuit only has " + std::to_string(n_qubits) + ".");
+        switch (pauli)
+        {
+          case 'X': apply_matrix({0, 1, 1, 0}, qubit, -1, false, tmp); break;
+          case 'Y': apply_matrix({0, -1i, 1i, 0}, qubit, -1, false, tmp); break;
+          case 'Z': apply_matrix({1, 0, 0, -1}, qubit, -1, false, tmp); break;
+          default: throw std::invalid_argument(std::string("Unknown Pauli operator ") + pauli + ".");
+        }
+      }
+      for (size_t k = 0; k < psi.size(); k++) result[k] += term.coefficient * tmp[k];
+    }
+    return result;
+  }
+
+}
@@ -0,0 +1,107 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/artifact_writer.hpp>
+
+// STL
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+// POSIX
+#include <unistd.h>
+
+namespace qristal
+{
+
+  /// Getter for the instance; makes this class a threadsafe singleton
+  artifact_writer& artifact_writer::get_instance()
+  {
+    // This is guaranteed to be threadsafe by C++11
+    static artifact_writer writer;
+    return writer;
+  }
+
+  /// Get a new file path in a directory that no other call (in this process or any other) will return
+  std::filesystem::path artifact_writer::unique_path(const std::filesystem::path& dir, const std::string& stem,
+                                                     const std::string& extension)
+  {
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    std::stringstream name;
+    name << stem << "_" << std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() << "_"
+         << getpid() << "_" << counter++ << extension;
+    return dir / name.str();
+  }
+
+  /// Queue a file to be written in the background
+  std::shared_future<void> artifact_writer::write(const std::filesystem::path& path,
+                                                  std::function<std::string()> contents)
+  {
+    std::promise<void> done;
+    std::shared_future<void> result = done.get_future().share();
+    {
+      std::scoped_lock lock(m);
+      if (stopping) throw std::logic_error("Files cannot be queued while the artifact writer is shutting down.");
+      if (not worker.joinable()) worker = std::thread(&artifact_writer::work, this);
+      jobs.push_back({path, std::move(contents), std::move(done)});
+      pending++;
+    }
+    job_added.notify_one();
+    return result;
+  }
+
+  /// Wait until all files queued so far have been written
+  void artifact_writer::flush()
+  {
+    std::unique_lock lock(m);
+    job_finished.wait(lock, [this]{ return pending == 0; });
+  }
+
+  /// Destructor; writes any files still queued
+  artifact_writer::~artifact_writer()
+  {
+    {
+      std::scoped_lock lock(m);
+      stopping = true;
+    }
+    job_added.notify_all();
+    if (worker.joinable()) worker.join();
+  }
+
+  /// Write queued files until told to stop
+  void artifact_writer::work()
+  {
+    while (true)
+    {
+      job j;
+      {
+        std::unique_lock lock(m);
+        job_added.wait(lock, [this]{ return stopping or not jobs.empty(); });
+        if (jobs.empty()) return;
+        j = std::move(jobs.front());
+        jobs.pop_front();
+      }
+
+      try
+      {
+        const std::string contents = j.contents();
+        if (j.path.has_parent_path()) std::filesystem::create_directories(j.path.parent_path());
+        std::ofstream of(j.path);
+        if (not of.is_open()) throw std::runtime_error("Unable to open " + j.path.string() + " for writing.");
+        of << contents << std::endl;
+        j.done.set_value();
+      }
+      catch (...)
+      {
+        j.done.set_exception(std::current_exception());
+      }
+
+      {
+        std::scoped_lock lock(m);
+        pending--;
+      }
+      job_finished.notify_all();
+    }
+  }
+
+}
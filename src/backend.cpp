@@ -2,6 +2,7 @@
 
 // Qristal
 #include <qristal/core/backend.hpp>
+#include <qristal/core/service_locks.hpp>
 
 // XACC
 #include <InstructionIterator.hpp>
@@ -31,7 +32,8 @@ namespace qristal
       "shots",
       "n_qubits",
       "m_connectivity",
-      "output_oqm_enabled"
+      "output_oqm_enabled",
+      "output_oqm_in_memory"
     };
   }
 
@@ -54,6 +56,9 @@ namespace qristal
     if (config.keyExists<bool>("output_oqm_enabled")) {
       output_oqm_enabled_ = config.get<bool>("output_oqm_enabled");
     }
+    if (config.keyExists<bool>("output_oqm_in_memory")) {
+      output_oqm_in_memory_ = config.get<bool>("output_oqm_in_memory");
+    }
   }
 
   void backend::initialize(
@@ -70,6 +75,7 @@ namespace qristal
     m.insert("output_oqm", output_oqm);
     m.insert("m_connectivity", m_connectivity);
     m.insert("output_oqm_enabled", output_oqm_enabled_);
+    m.insert("output_oqm_in_memory", output_oqm_in_memory_);
     return m;
   }
 
@@ -90,15 +96,28 @@ namespace qristal
       std::shared_ptr<xacc::AcceleratorBuffer> buffer,
       const std::vector<std::shared_ptr<xacc::CompositeInstruction>> functions)
   {
-    auto staq = xacc::getCompiler("staq");
-    auto qb_transpiler = xacc::getIRTransformation("qb-gateset-transpiler");
+    std::shared_ptr<xacc::Compiler> staq;
+    std::shared_ptr<xacc::IRTransformation> qb_transpiler;
+    {
+      auto registry_guard = service_locks::lock_registry();
+      staq = xacc::getCompiler("staq");
+      qb_transpiler = xacc::getIRTransformation("qb-gateset-transpiler");
+    }
     for (auto& kernel : functions)
     {
       auto transpiled_ir = xacc::ir::asComposite(kernel->clone());
-      qb_transpiler->apply(transpiled_ir, xacc::as_shared_ptr(this));
-      qpuQasmStr_ = staq->translate(transpiled_ir);
+      {
+        auto transpiler_guard = service_locks::lock_if_shared(qb_transpiler);
+        qb_transpiler->apply(transpiled_ir, xacc::as_shared_ptr(this));
+      }
+      {
+        auto staq_guard = service_locks::lock_if_shared(staq);
+        qpuQasmStr_ = staq->translate(transpiled_ir);
+      }
+      transpiledIR_ = transpiled_ir;
 
-      if (output_oqm_enabled_)
+      // In in-memory mode, the transpiled circuit is only kept for getTranspiledResult and getTranspiledIR.
+      if (output_oqm_enabled_ and not output_oqm_in_memory_)
       {
         std::ofstream of(output_oqm);
         if (of.is_open())
@@ -123,4 +142,9 @@ namespace qristal
     return qpuQasmStr_;
   }
 
+  std::shared_ptr<xacc::CompositeInstruction> backend::getTranspiledIR() const
+  {
+    return transpiledIR_;
+  }
+
 }
@@ -3,6 +3,9 @@
 // Qristal
 #include <qristal/core/backends/sims/microsoft/sparse-sim/SparseSimulator.h>
 #include <qristal/core/backends/sims/microsoft/sparse-sim/types.h>
+#include <qristal/core/noise_model/compiled_noise_model.hpp>
+#include <qristal/core/service_locks.hpp>
+#include <qristal/core/thread_pool.hpp>
 
 // XACC
 #include <Accelerator.hpp>
@@ -13,17 +16,31 @@
 #include <xacc.hpp>
 #include <xacc_plugin.hpp>
 
+// JSON
+#include <nlohmann/json.hpp>
+
 // STL
+#include <algorithm>
 #include <cassert>
+#include <map>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <vector>
 
 namespace xacc {
-namespace quantum {
 using namespace Microsoft::Quantum::SPARSESIMULATOR;
+namespace quantum {
 
 class SparseSimVisitor : public AllGateVisitor,
                          public InstructionVisitor<Circuit> {
 public:
-  SparseSimVisitor(size_t nbQubits) : m_sim(nbQubits) {}
+  SparseSimVisitor(size_t nbQubits, size_t nbThreads = 1,
+                   std::optional<double> denseThreshold = std::nullopt)
+      : m_sim(nbQubits) {
+    m_sim.set_num_threads(nbThreads);
+    if (denseThreshold) m_sim.set_dense_threshold(*denseThreshold);
+  }
 
   void visit(Hadamard &h) override { m_sim.H(h.bits()[0]); }
 
@@ -87,27 +104,17 @@ public:
   void visit(Identity &i) override {}
 
   void visit(U &u) override {
-    const auto theta = InstructionParameterToDouble(u.getParameter(0));
-    const auto phi = InstructionParameterToDouble(u.getParameter(1));
-    const auto lambda = InstructionParameterToDouble(u.getParameter(2));
-
-    // rz(lmda)
-    m_sim.R(Gates::Basis::PauliZ, lambda, u.bits()[0]);
-
-    // ry(theta)
-
-    m_sim.R(Gates::Basis::PauliY, theta, u.bits()[0]);
-    // rz(phi)
-
-    m_sim.R(Gates::Basis::PauliZ, phi, u.bits()[0]);
+    // Applied as one gate so that it can be fused with its neighbours
+    m_sim.Unitary(*gateMatrix("U", u), u.bits()[0]);
   }
 
   void visit(iSwap &in_iSwapGate) override {
-    xacc::error("Sparse simulator doesn't support iSwap.");
+    m_sim.Unitary(iSwapMatrix(), in_iSwapGate.bits()[0], in_iSwapGate.bits()[1]);
   }
 
   void visit(fSim &in_fsimGate) override {
-    xacc::error("Sparse simulator doesn't support fSim.");
+    m_sim.Unitary(fSimMatrix(in_fsimGate), in_fsimGate.bits()[0],
+                  in_fsimGate.bits()[1]);
   }
 
   void visit(IfStmt &ifStmt) override {
@@ -115,109 +122,228 @@ public:
   }
   void visit(Measure &measure) override {}
   void visit(Circuit &in_circuit) override {
-    // std::cout << "HOWDY: Visit quantum circuit: " << in_circuit.name() <<
-    // "\n";
-    if (in_circuit.name() == "C-U" &&
-        dynamic_cast<xacc::quantum::ControlModifier *>(&in_circuit)) {
-      auto *asControlledBlock =
-          dynamic_cast<xacc::quantum::ControlModifier *>(&in_circuit);
-      assert(asControlledBlock);
-      // Controlled circuit
-      const auto controlQubits = asControlledBlock->getControlQubits();
-      auto baseCircuit = asControlledBlock->getBaseInstruction();
-      assert(baseCircuit->isComposite());
-      auto asComp = xacc::ir::asComposite(baseCircuit);
-      assert(!controlQubits.empty());
-      const bool should_perform_mcu_sim = [&]() {
-        if (asComp->getInstructions().size() == 1) {
-          // Only support these instructions for the moment
-          if (asComp->getInstruction(0)->name() == "X" ||
-              asComp->getInstruction(0)->name() == "Y" ||
-              asComp->getInstruction(0)->name() == "Z" ||
-              asComp->getInstruction(0)->name() == "H" ||
-              asComp->getInstruction(0)->name() == "Rx" ||
-              asComp->getInstruction(0)->name() == "Ry" ||
-              asComp->getInstruction(0)->name() == "Rz") {
-            return true;
-          }
-        }
+    if (!applyControlledBlock(in_circuit)) {
+      return;
+    }
+    // No need to handle this sub-circuit anymore.
+    in_circuit.disable();
+    m_controlledBlocks.emplace_back(in_circuit);
+  }
 
-        return false;
-      }();
-
-      if (should_perform_mcu_sim) {
-        std::vector<logical_qubit_id> ctrlIdx;
-        const std::string regName = controlQubits[0].first;
-        for (const auto &[reg, idx] : controlQubits) {
-          if (reg != regName) {
-            xacc::error("Multiple qubit registers are not supported!");
+  // Whether a block is a controlled block that applyControlledBlock can apply
+  bool isNativeControlledBlock(Circuit &in_circuit) {
+    auto *asControlledBlock =
+        dynamic_cast<xacc::quantum::ControlModifier *>(&in_circuit);
+    if (in_circuit.name() != "C-U" || !asControlledBlock) {
+      return false;
+    }
+    // This needs every gate in the block, including any nested controlled
+    // blocks, to have a native controlled version.
+    auto baseCircuit = asControlledBlock->getBaseInstruction();
+    assert(baseCircuit->isComposite());
+    return canControl(baseCircuit, controlIndices(*asControlledBlock));
+  }
+
+  // A controlled block is applied gate by gate, with its controls added to
+  // each gate, rather than through its decomposition. Returns whether the block
+  // could be applied this way, leaving the block itself untouched.
+  bool applyControlledBlock(Circuit &in_circuit) {
+    if (!isNativeControlledBlock(in_circuit)) {
+      return false;
+    }
+    auto &block = dynamic_cast<xacc::quantum::ControlModifier &>(in_circuit);
+    applyControlled(block.getBaseInstruction(), controlIndices(block));
+    return true;
+  }
+
+  // Kraus operator of a noise channel, prepared for quantum trajectories
+  struct Kraus {
+    // Qubits acted on, the first being the most significant bit of the matrix
+    std::vector<logical_qubit_id> qubits;
+    // Matrix, in row-major order
+    std::vector<amplitude> matrix;
+    // Tr(K^dagger K P) for each Pauli string P on the qubits, from which the
+    // probability of the operator follows from the expectation values of P
+    std::vector<double> pauliTraces;
+    // Probability of the operator, if it is the same in every state, i.e. if
+    // K^dagger K is proportional to the identity
+    std::optional<double> probability;
+    // Whether the operator is proportional to the identity, so that the state
+    // is left as it is
+    bool isIdentity = false;
+  };
+  using Channel = std::vector<Kraus>;
+
+  // Prepare a noise channel for trajectories on the given qubits, where the
+  // first operand of the gate is the most significant bit of its matrices
+  static Channel prepareChannel(const qristal::NoiseChannel &channel,
+                                const std::vector<size_t> &qubits) {
+    Channel prepared;
+    for (const auto &op : channel) {
+      const size_t k = qubits.size();
+      const size_t dim = size_t(1) << k;
+      if ((k != 1 && k != 2) || op.matrix.size() != dim) {
+        throw std::invalid_argument(
+            "The sparse simulator only supports noise channels of one or two "
+            "qubits.");
+      }
+      Kraus kraus;
+      kraus.qubits.assign(qubits.begin(), qubits.end());
+      // Kraus matrices are stored contiguously in row-major order, as here
+      kraus.matrix.assign(op.matrix.data(), op.matrix.data() + dim * dim);
+      // K^dagger K
+      std::vector<amplitude> effect(dim * dim, 0.0);
+      for (size_t r = 0; r < dim; ++r) {
+        for (size_t c = 0; c < dim; ++c) {
+          for (size_t j = 0; j < dim; ++j) {
+            effect[r * dim + c] +=
+                std::conj(kraus.matrix[j * dim + r]) * kraus.matrix[j * dim + c];
           }
-          ctrlIdx.emplace_back(idx);
         }
-        assert(ctrlIdx.size() == controlQubits.size());
-
-        auto baseGate = asComp->getInstruction(0);
-        const logical_qubit_id targetIdx = baseGate->bits()[0];
-        if (xacc::container::contains(
-                std::vector<std::string>{"X", "Y", "Z", "H"},
-                baseGate->name())) {
-          if (baseGate->name() == "X") {
-            m_sim.MCX(ctrlIdx, targetIdx);
-          } else if (baseGate->name() == "Y") {
-            m_sim.MCY(ctrlIdx, targetIdx);
-
-          } else if (baseGate->name() == "Z") {
-            m_sim.MCZ(ctrlIdx, targetIdx);
-
-          } else {
-            assert(baseGate->name() == "H");
-            m_sim.MCH(ctrlIdx, targetIdx);
+      }
+      for (size_t pauli = 0; pauli < dim * dim; ++pauli) {
+        amplitude trace = 0.0;
+        for (size_t r = 0; r < dim; ++r) {
+          for (size_t c = 0; c < dim; ++c) {
+            trace += effect[r * dim + c] * pauliElement(pauli, k, c, r);
           }
+        }
+        kraus.pauliTraces.push_back(trace.real());
+      }
+      if (isScaledIdentity(effect, dim)) {
+        kraus.probability = effect[0].real();
+      }
+      kraus.isIdentity = isScaledIdentity(kraus.matrix, dim);
+      prepared.push_back(std::move(kraus));
+    }
+    return prepared;
+  }
 
-        } else {
-          assert(xacc::container::contains(
-              std::vector<std::string>{"Rx", "Ry", "Rz"}, baseGate->name()));
-          const double angle =
-              InstructionParameterToDouble(baseGate->getParameter(0));
-          const Gates::Basis basis = [&baseGate]() {
-            if (baseGate->name() == "Rx") {
-              return Gates::Basis::PauliX;
-            } else if (baseGate->name() == "Ry") {
-              return Gates::Basis::PauliY;
-            } else {
-              assert(baseGate->name() == "Rz");
-              return Gates::Basis::PauliZ;
+  // Apply noise channels after a gate: one Kraus operator of each channel is
+  // drawn, with the probability of it occurring in the current state, and
+  // applied to the state, which is then renormalised
+  void applyNoise(const std::vector<Channel> &channels, std::mt19937_64 &rng) {
+    for (const Channel &channel : channels) {
+      if (channel.empty()) {
+        continue;
+      }
+      const auto &qubits = channel[0].qubits;
+      const size_t k = qubits.size();
+      const size_t dim = size_t(1) << k;
+      // Expectation values of the Pauli strings on the qubits, only needed if
+      // the probabilities depend on the state
+      std::vector<double> expectationValues;
+      for (const Kraus &kraus : channel) {
+        if (!kraus.probability) {
+          std::vector<pauli_term> terms;
+          for (size_t pauli = 1; pauli < dim * dim; ++pauli) {
+            pauli_term term{1.0, {}, {}};
+            for (size_t q = 0; q < k; ++q) {
+              const size_t digit = (pauli >> (2 * (k - 1 - q))) & 3;
+              if (digit == 0) continue;
+              term.axes.push_back(digit == 1   ? Gates::Basis::PauliX
+                                  : digit == 2 ? Gates::Basis::PauliY
+                                               : Gates::Basis::PauliZ);
+              term.qubits.push_back(qubits[q]);
             }
-          }();
-          m_sim.MCR(ctrlIdx, basis, angle, targetIdx);
+            terms.push_back(term);
+          }
+          expectationValues = m_sim.PauliExpectations(terms);
+          expectationValues.insert(expectationValues.begin(), 1.0);
+          break;
         }
-
-        // No need to handle this sub-circuit anymore.
-        in_circuit.disable();
-        m_controlledBlocks.emplace_back(in_circuit);
+      }
+      std::vector<double> probabilities;
+      for (const Kraus &kraus : channel) {
+        double p = 0.0;
+        if (kraus.probability) {
+          p = *kraus.probability;
+        } else {
+          for (size_t pauli = 0; pauli < dim * dim; ++pauli) {
+            p += expectationValues[pauli] * kraus.pauliTraces[pauli];
+          }
+          p /= dim;
+        }
+        probabilities.push_back(std::max(0.0, p));
+      }
+      std::discrete_distribution<size_t> draw(probabilities.begin(),
+                                              probabilities.end());
+      const size_t chosen = draw(rng);
+      const Kraus &kraus = channel[chosen];
+      if (kraus.isIdentity) {
+        continue;
+      }
+      const double norm = 1.0 / std::sqrt(probabilities[chosen]);
+      if (k == 1) {
+        single_qubit_unitary matrix;
+        for (size_t i = 0; i < 4; ++i) matrix[i] = kraus.matrix[i] * norm;
+        m_sim.Operator(matrix, qubits[0]);
+      } else {
+        two_qubit_unitary matrix;
+        for (size_t i = 0; i < 16; ++i) matrix[i] = kraus.matrix[i] * norm;
+        m_sim.Unitary(matrix, qubits[0], qubits[1]);
       }
     }
   }
 
-  std::map<std::string, int> sample(const std::vector<size_t> &bits,
-                                    size_t shots) {
+  // Seed the random numbers used to draw shots
+  void seed(std::mt19937::result_type seed) { m_sim.set_random_seed(seed); }
+
+  // Draw shots of the measured bits. With readout errors, each bit of each
+  // shot is then flipped with the probability of misreading its value.
+  std::map<std::string, int> sample(
+      const std::vector<size_t> &bits, size_t shots,
+      const qristal::CompiledNoiseModel *noise = nullptr,
+      std::mt19937_64 *rng = nullptr) {
     if (shots == 0) {
       return {};
     }
+    // Probabilities of misreading 1 as 0, and 0 as 1, for each measured bit
+    std::vector<std::pair<double, double>> misread;
+    const qristal::ReadoutError none{0.0, 0.0};
+    for (const size_t bit : bits) {
+      const auto &error = noise ? noise->readout_error(bit) : none;
+      misread.emplace_back(error.p_01, error.p_10);
+    }
+    const bool noisy =
+        rng && std::any_of(misread.begin(), misread.end(), [](auto p) {
+          return p.first > 0 || p.second > 0;
+        });
+    // Draw all the shots at once, and only build a bitstring for each distinct outcome
+    const std::vector<logical_qubit_id> qubits(bits.begin(), bits.end());
     std::map<std::string, int> resultMap;
-    const auto rawSamples = m_sim.Sample(shots);
-    const auto length = rawSamples.front().size();
-    for (const auto &rawSample : rawSamples) {
-      std::string result;
-      for (const auto &bit : bits) {
-        assert(bit < length);
-        result.push_back(rawSample[length - bit - 1]);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (const auto &[outcome, count] : m_sim.SampleCounts(shots, qubits)) {
+      std::string result(bits.size(), '0');
+      for (size_t i = 0; i < bits.size(); ++i) {
+        if ((outcome[i / 64] >> (i % 64)) & 1) {
+          result[i] = '1';
+        }
+      }
+      if (!noisy) {
+        resultMap[result] += count;
+        continue;
+      }
+      for (size_t shot = 0; shot < count; ++shot) {
+        std::string read = result;
+        for (size_t i = 0; i < bits.size(); ++i) {
+          const double p = (read[i] == '1' ? misread[i].first : misread[i].second);
+          if (p > 0 && uniform(*rng) < p) {
+            read[i] = (read[i] == '1' ? '0' : '1');
+          }
+        }
+        resultMap[read]++;
       }
-      resultMap[result]++;
     }
     return resultMap;
   }
 
+  // Expectation value of each term of a weighted sum of Pauli strings, times
+  // its coefficient, computed directly from the amplitudes
+  std::vector<double> expectations(const std::vector<pauli_term> &terms) {
+    return m_sim.PauliExpectations(terms);
+  }
+
   ~SparseSimVisitor() {
     for (auto &block : m_controlledBlocks) {
       // We temporarily disabled these blocks while handling the simulation,
@@ -228,6 +354,219 @@ public:
   }
 
 private:
+  // Element (row, col) of the Pauli string with index pauli on k qubits, whose
+  // base-4 digits, most significant first, are I, X, Y or Z on each qubit
+  static amplitude pauliElement(size_t pauli, size_t k, size_t row,
+                                size_t col) {
+    static const amplitude paulis[4][4] = {
+        {1, 0, 0, 1}, {0, 1, 1, 0}, {0, {0, -1}, {0, 1}, 0}, {1, 0, 0, -1}};
+    amplitude element = 1.0;
+    for (size_t q = 0; q < k; ++q) {
+      const size_t digit = (pauli >> (2 * (k - 1 - q))) & 3;
+      const size_t r = (row >> (k - 1 - q)) & 1;
+      const size_t c = (col >> (k - 1 - q)) & 1;
+      element *= paulis[digit][2 * r + c];
+    }
+    return element;
+  }
+
+  // Whether a row-major matrix is proportional to the identity
+  static bool isScaledIdentity(const std::vector<amplitude> &matrix,
+                               size_t dim) {
+    for (size_t r = 0; r < dim; ++r) {
+      for (size_t c = 0; c < dim; ++c) {
+        const amplitude expected = (r == c ? matrix[0] : 0.0);
+        if (std::abs(matrix[r * dim + c] - expected) > 1e-12) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // Matrix of a single-qubit gate, or of the target part of a controlled gate,
+  // given the name of the gate without the control, or nothing if the gate is
+  // not supported
+  static std::optional<single_qubit_unitary> gateMatrix(const std::string &name,
+                                                        Instruction &gate) {
+    const double r = 1.0 / std::sqrt(2.0);
+    if (name == "I") return single_qubit_unitary{1, 0, 0, 1};
+    if (name == "X") return single_qubit_unitary{0, 1, 1, 0};
+    if (name == "Y") return single_qubit_unitary{0, -1i, 1i, 0};
+    if (name == "Z") return single_qubit_unitary{1, 0, 0, -1};
+    if (name == "H") return single_qubit_unitary{r, r, r, -r};
+    if (name == "S") return single_qubit_unitary{1, 0, 0, 1i};
+    if (name == "Sdg") return single_qubit_unitary{1, 0, 0, -1i};
+    if (name == "T") return single_qubit_unitary{1, 0, 0, amplitude(r, r)};
+    if (name == "Tdg") return single_qubit_unitary{1, 0, 0, amplitude(r, -r)};
+    if (name == "Rx" || name == "Ry" || name == "Rz" || name == "U1") {
+      const double angle = InstructionParameterToDouble(gate.getParameter(0));
+      const double c = std::cos(angle / 2.0);
+      const double s = std::sin(angle / 2.0);
+      if (name == "Rx") return single_qubit_unitary{c, -1i * s, -1i * s, c};
+      if (name == "Ry") return single_qubit_unitary{c, -s, s, c};
+      if (name == "Rz") {
+        return single_qubit_unitary{std::polar(1.0, -angle / 2.0), 0, 0,
+                                    std::polar(1.0, angle / 2.0)};
+      }
+      return single_qubit_unitary{1, 0, 0, std::polar(1.0, angle)};
+    }
+    if (name == "U") {
+      // U(theta, phi, lambda) = Rz(phi) Ry(theta) Rz(lambda), up to a global phase
+      const double theta = InstructionParameterToDouble(gate.getParameter(0));
+      const double phi = InstructionParameterToDouble(gate.getParameter(1));
+      const double lambda = InstructionParameterToDouble(gate.getParameter(2));
+      const double c = std::cos(theta / 2.0);
+      const double s = std::sin(theta / 2.0);
+      return single_qubit_unitary{c, -s * std::exp(1i * lambda),
+                                  s * std::exp(1i * phi),
+                                  c * std::exp(1i * (phi + lambda))};
+    }
+    return std::nullopt;
+  }
+
+  // Name of the gate applied to the target of a singly-controlled gate, or
+  // nothing if the gate is not one
+  static std::optional<std::string> controlledBase(const std::string &name) {
+    static const std::map<std::string, std::string> bases{
+        {"CNOT", "X"}, {"CY", "Y"},   {"CZ", "Z"},
+        {"CH", "H"},   {"CRZ", "Rz"}, {"CPhase", "U1"}};
+    const auto it = bases.find(name);
+    if (it == bases.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+
+  static two_qubit_unitary iSwapMatrix() {
+    return {1, 0,  0,  0,
+            0, 0,  1i, 0,
+            0, 1i, 0,  0,
+            0, 0,  0,  1};
+  }
+
+  static two_qubit_unitary fSimMatrix(Instruction &gate) {
+    const double theta = InstructionParameterToDouble(gate.getParameter(0));
+    const double phi = InstructionParameterToDouble(gate.getParameter(1));
+    const double c = std::cos(theta);
+    const double s = std::sin(theta);
+    return {1, 0,       0,       0,
+            0, c,       -1i * s, 0,
+            0, -1i * s, c,       0,
+            0, 0,       0,       std::exp(-1i * phi)};
+  }
+
+  // Qubit indices of the controls of a controlled block
+  static std::vector<logical_qubit_id>
+  controlIndices(xacc::quantum::ControlModifier &block) {
+    const auto controlQubits = block.getControlQubits();
+    assert(!controlQubits.empty());
+    std::vector<logical_qubit_id> ctrlIdx;
+    const std::string regName = controlQubits[0].first;
+    for (const auto &[reg, idx] : controlQubits) {
+      if (reg != regName) {
+        xacc::error("Multiple qubit registers are not supported!");
+      }
+      ctrlIdx.emplace_back(idx);
+    }
+    return ctrlIdx;
+  }
+
+  static std::vector<logical_qubit_id>
+  withControls(std::vector<logical_qubit_id> controls,
+               const std::vector<logical_qubit_id> &extra) {
+    controls.insert(controls.end(), extra.begin(), extra.end());
+    return controls;
+  }
+
+  // Whether an instruction can be applied natively with the given controls
+  bool canControl(const std::shared_ptr<Instruction> &inst,
+                  const std::vector<logical_qubit_id> &controls) {
+    if (inst->isComposite()) {
+      if (auto *block =
+              dynamic_cast<xacc::quantum::ControlModifier *>(inst.get())) {
+        return canControl(block->getBaseInstruction(),
+                          withControls(controls, controlIndices(*block)));
+      }
+      for (const auto &sub : xacc::ir::asComposite(inst)->getInstructions()) {
+        if (!canControl(sub, controls)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    // A gate cannot act on its own controls
+    for (const auto bit : inst->bits()) {
+      if (xacc::container::contains(controls,
+                                    static_cast<logical_qubit_id>(bit))) {
+        return false;
+      }
+    }
+    const std::string name = inst->name();
+    return name == "Swap" || name == "iSwap" || name == "fSim" ||
+           controlledBase(name) || gateMatrix(name, *inst);
+  }
+
+  // Applies an instruction with the given controls added to each of its gates
+  void applyControlled(const std::shared_ptr<Instruction> &inst,
+                       const std::vector<logical_qubit_id> &controls) {
+    if (inst->isComposite()) {
+      if (auto *block =
+              dynamic_cast<xacc::quantum::ControlModifier *>(inst.get())) {
+        applyControlled(block->getBaseInstruction(),
+                        withControls(controls, controlIndices(*block)));
+        return;
+      }
+      for (const auto &sub : xacc::ir::asComposite(inst)->getInstructions()) {
+        applyControlled(sub, controls);
+      }
+      return;
+    }
+    const std::string name = inst->name();
+    const auto bits = inst->bits();
+    if (name == "Swap") {
+      m_sim.CSWAP(controls, bits[0], bits[1]);
+    } else if (name == "iSwap") {
+      m_sim.MCUnitary(controls, iSwapMatrix(), bits[0], bits[1]);
+    } else if (name == "fSim") {
+      m_sim.MCUnitary(controls, fSimMatrix(*inst), bits[0], bits[1]);
+    } else if (const auto base = controlledBase(name)) {
+      const logical_qubit_id control = bits[0];
+      applyControlledGate(*base, *inst, withControls(controls, {control}),
+                          bits[1]);
+    } else {
+      applyControlledGate(name, *inst, controls, bits[0]);
+    }
+  }
+
+  // Applies a single-qubit gate, or the target part of a controlled gate, with
+  // the given controls, using the simulator's dedicated multi-controlled gates
+  // where there are any
+  void applyControlledGate(const std::string &name, Instruction &gate,
+                           const std::vector<logical_qubit_id> &controls,
+                           logical_qubit_id target) {
+    if (name == "X") {
+      m_sim.MCX(controls, target);
+    } else if (name == "Y") {
+      m_sim.MCY(controls, target);
+    } else if (name == "Z") {
+      m_sim.MCZ(controls, target);
+    } else if (name == "H") {
+      m_sim.MCH(controls, target);
+    } else if (name == "Rx" || name == "Ry" || name == "Rz") {
+      const double angle = InstructionParameterToDouble(gate.getParameter(0));
+      const Gates::Basis basis = name == "Rx"   ? Gates::Basis::PauliX
+                                 : name == "Ry" ? Gates::Basis::PauliY
+                                                : Gates::Basis::PauliZ;
+      m_sim.MCR(controls, basis, angle, target);
+    } else if (name == "U1") {
+      const double angle = InstructionParameterToDouble(gate.getParameter(0));
+      m_sim.MCR1(controls, angle, target);
+    } else if (name != "I") {
+      m_sim.MCUnitary(controls, *gateMatrix(name, gate), target);
+    }
+  }
+
   SparseSimulator m_sim;
   std::vector<std::reference_wrapper<xacc::quantum::Circuit>>
       m_controlledBlocks;
@@ -238,6 +577,248 @@ class SparseSimAccelerator : public xacc::Accelerator,
                              public xacc::Cloneable<xacc::Accelerator> {
 private:
   size_t m_shots = 0;
+  // Number of threads that gates on large wavefunctions are split between
+  size_t m_threads = 1;
+  // Fraction of nonzero amplitudes above which wavefunctions are stored as
+  // dense arrays, if not the simulator's default
+  std::optional<double> m_denseThreshold;
+  // Whether to compute the expectation values of observables exactly
+  bool m_vqeMode = false;
+  // Noise model for quantum trajectory simulation, compiled when it is set, if
+  // noise is enabled
+  std::shared_ptr<const qristal::CompiledNoiseModel> m_noise;
+  // Compiler that transpiles noisy circuits to the QObj basis gates of the
+  // noise model
+  std::string m_qobjCompiler = "xacc-qobj";
+  // Number of noisy trajectories, each giving an equal share of the shots, or
+  // 0 for one trajectory per shot
+  size_t m_trajectories = 0;
+  // Seed of the random numbers of noisy trajectories, if any
+  std::optional<int> m_seed;
+
+  // A gate of a noisy circuit, with the noise channels that follow it
+  struct NoisyStep {
+    std::shared_ptr<Instruction> inst;
+    const std::vector<xacc::quantum::SparseSimVisitor::Channel> *channels;
+  };
+
+  // Noise channels of each gate of the noise model and its operands, prepared
+  // for trajectories
+  using ChannelCache =
+      std::map<std::pair<std::string, std::vector<size_t>>,
+               std::vector<xacc::quantum::SparseSimVisitor::Channel>>;
+
+  // Channels that follow a gate of the noise model, prepared once per gate and
+  // operands. Returns nullptr if the gate is noiseless.
+  const std::vector<xacc::quantum::SparseSimVisitor::Channel> *
+  prepareChannels(const std::string &name, const std::vector<size_t> &bits,
+                  ChannelCache &channels) const {
+    auto key = std::make_pair(name, bits);
+    auto prepared = channels.find(key);
+    if (prepared == channels.end()) {
+      std::vector<xacc::quantum::SparseSimVisitor::Channel> gateChannels;
+      const size_t gate = m_noise->gate_index(name);
+      // Channels for these operands, or else for any operands
+      const auto *noiseChannels = m_noise->channels(gate, bits);
+      if (noiseChannels) {
+        const bool uniform = noiseChannels == m_noise->channels(gate, {});
+        for (const auto &channel : *noiseChannels) {
+          if (channel.empty()) continue;
+          // Channels given for any operands act on the gate's operands
+          const std::vector<size_t> &qubits =
+              uniform && channel[0].qubits.size() == bits.size()
+                  ? bits
+                  : channel[0].qubits;
+          gateChannels.push_back(
+              xacc::quantum::SparseSimVisitor::prepareChannel(channel, qubits));
+        }
+      }
+      prepared = channels.emplace(key, std::move(gateChannels)).first;
+    }
+    return prepared->second.empty() ? nullptr : &prepared->second;
+  }
+
+  // Transpile a circuit to the QObj basis gates of the noise model, with the
+  // noise model's QObj compiler as for the AER simulator, and flatten it into
+  // the gates applied by a trajectory, each with its noise channels.
+  void transpile(const std::shared_ptr<CompositeInstruction> &circuit,
+                 std::vector<NoisyStep> &steps,
+                 std::vector<size_t> &measureBitIdxs, ChannelCache &channels) {
+    std::shared_ptr<xacc::Compiler> compiler;
+    {
+      auto registry = qristal::service_locks::lock_registry();
+      compiler = xacc::getCompiler(m_qobjCompiler);
+    }
+    std::string qobj;
+    {
+      auto lock = qristal::service_locks::lock_if_shared(compiler);
+      qobj = compiler->translate(circuit);
+    }
+    const auto instructions = nlohmann::json::parse(
+        qobj)["qObject"]["experiments"][0]["instructions"];
+    for (const auto &op : instructions) {
+      const std::string name = op["name"];
+      const auto bits = op.value("qubits", std::vector<size_t>{});
+      const auto params = op.value("params", std::vector<double>{});
+      using namespace xacc::quantum;
+      std::shared_ptr<Instruction> inst;
+      if (name == "measure") {
+        measureBitIdxs.insert(measureBitIdxs.end(), bits.begin(), bits.end());
+        continue;
+      } else if (name == "barrier") {
+        continue;
+      } else if (name == "u1") {
+        inst = std::make_shared<U>(bits[0], 0.0, 0.0, params[0]);
+      } else if (name == "u2") {
+        inst = std::make_shared<U>(bits[0], M_PI / 2, params[0], params[1]);
+      } else if (name == "u3") {
+        inst = std::make_shared<U>(bits[0], params[0], params[1], params[2]);
+      } else if (name == "rx") {
+        inst = std::make_shared<Rx>(bits[0], params[0]);
+      } else if (name == "ry") {
+        inst = std::make_shared<Ry>(bits[0], params[0]);
+      } else if (name == "cx") {
+        inst = std::make_shared<CNOT>(bits[0], bits[1]);
+      } else if (name == "cz") {
+        inst = std::make_shared<CZ>(bits[0], bits[1]);
+      } else if (name == "id") {
+        inst = std::make_shared<Identity>(bits[0]);
+      } else {
+        throw std::runtime_error("Sparse simulator cannot apply the QObj "
+                                 "instruction '" + name + "' from the " +
+                                 m_qobjCompiler + " compiler.");
+      }
+      steps.push_back({inst, prepareChannels(name, bits, channels)});
+    }
+  }
+
+  // Sample a circuit with noise, from quantum trajectories run in parallel on
+  // the Qristal thread pool. Each trajectory draws its Kraus operators
+  // independently, and gives its share of the shots, with readout errors.
+  std::map<std::string, int>
+  sampleTrajectories(size_t nbQubits,
+                     const std::shared_ptr<CompositeInstruction> &circuit) {
+    if (m_shots == 0) {
+      return {};
+    }
+    std::vector<NoisyStep> steps;
+    std::vector<size_t> measureBitIdxs;
+    ChannelCache channels;
+    transpile(circuit, steps, measureBitIdxs, channels);
+
+    const size_t nbTrajectories =
+        m_trajectories ? std::min(m_trajectories, m_shots) : m_shots;
+    const uint64_t seed = m_seed ? *m_seed : std::random_device{}();
+    std::vector<std::map<std::string, int>> counts(nbTrajectories);
+    qristal::thread_pool::parallel_for(0, nbTrajectories, 1, [&](size_t t) {
+      std::seed_seq seq{seed, uint64_t(t)};
+      std::mt19937_64 rng(seq);
+      xacc::quantum::SparseSimVisitor visitor(nbQubits, 1, m_denseThreshold);
+      visitor.seed(rng());
+      for (const auto &step : steps) {
+        step.inst->accept(&visitor);
+        if (step.channels) {
+          visitor.applyNoise(*step.channels, rng);
+        }
+      }
+      const size_t shots =
+          m_shots * (t + 1) / nbTrajectories - m_shots * t / nbTrajectories;
+      counts[t] = visitor.sample(measureBitIdxs, shots,
+                                 m_noise.get(), &rng);
+    });
+    std::map<std::string, int> measurements;
+    for (const auto &trajectoryCounts : counts) {
+      for (const auto &[bitstring, count] : trajectoryCounts) {
+        measurements[bitstring] += count;
+      }
+    }
+    return measurements;
+  }
+
+  // Simulate the gates of a circuit, returning the qubits that it measures
+  static std::vector<size_t>
+  simulate(xacc::quantum::SparseSimVisitor &visitor,
+           std::shared_ptr<CompositeInstruction> circuit) {
+    std::vector<size_t> measureBitIdxs;
+    // Walk the IR tree, and visit each node
+    InstructionIterator it(circuit);
+    while (it.hasNext()) {
+      auto nextInst = it.next();
+      if (nextInst->isEnabled()) {
+        if (nextInst->name() != "Measure") {
+          nextInst->accept(&visitor);
+        } else {
+          measureBitIdxs.emplace_back(nextInst->bits()[0]);
+        }
+      }
+    }
+    return measureBitIdxs;
+  }
+
+  // Product of Z on each of a list of qubits
+  static pauli_term parityTerm(const std::vector<size_t> &bits) {
+    pauli_term term{1.0, {}, {}};
+    for (size_t bit : bits) {
+      term.axes.push_back(Gates::Basis::PauliZ);
+      term.qubits.push_back(bit);
+    }
+    return term;
+  }
+
+  // Pauli strings measured by circuits built by Observable::observe, each of
+  // them a kernel shared by all the circuits followed by basis changes (H for
+  // X, Rx(pi/2) for Y) and measurements. Returns nothing if any circuit is not
+  // of this form.
+  static std::optional<
+      std::pair<std::shared_ptr<CompositeInstruction>, std::vector<pauli_term>>>
+  observedTerms(
+      const std::vector<std::shared_ptr<CompositeInstruction>> &circuits) {
+    if (circuits.empty() || circuits[0]->nInstructions() == 0) {
+      return std::nullopt;
+    }
+    const auto kernel = std::dynamic_pointer_cast<CompositeInstruction>(
+        circuits[0]->getInstruction(0));
+    if (!kernel) {
+      return std::nullopt;
+    }
+    std::vector<pauli_term> terms;
+    for (const auto &circuit : circuits) {
+      if (circuit->nInstructions() == 0 ||
+          circuit->getInstruction(0) != kernel) {
+        return std::nullopt;
+      }
+      std::map<size_t, Gates::Basis> bases;
+      pauli_term term{1.0, {}, {}};
+      for (size_t i = 1; i < circuit->nInstructions(); ++i) {
+        auto inst = circuit->getInstruction(i);
+        if (!inst->isEnabled()) {
+          continue;
+        }
+        const size_t bit = inst->bits()[0];
+        if (inst->name() == "H" && !bases.count(bit)) {
+          bases[bit] = Gates::Basis::PauliX;
+        } else if (inst->name() == "Rx" && !bases.count(bit) &&
+                   inst->getParameter(0).isNumeric() &&
+                   std::abs(InstructionParameterToDouble(
+                                inst->getParameter(0)) -
+                            M_PI / 2) < 1e-12) {
+          bases[bit] = Gates::Basis::PauliY;
+        } else if (inst->name() == "Measure") {
+          term.axes.push_back(bases.count(bit) ? bases[bit]
+                                               : Gates::Basis::PauliZ);
+          term.qubits.push_back(bit);
+        } else {
+          return std::nullopt;
+        }
+      }
+      // Basis changes must be followed by measurements
+      if (bases.size() > term.qubits.size()) {
+        return std::nullopt;
+      }
+      terms.push_back(term);
+    }
+    return std::make_pair(kernel, terms);
+  }
 
 public:
   virtual const std::string name() const override { return "sparse-sim"; }
@@ -246,19 +827,64 @@ public:
            "representation.";
   }
   virtual void initialize(const xacc::HeterogeneousMap &params = {}) override {
+    // Noise is only enabled for runs that ask for it
+    m_noise = nullptr;
     if (params.keyExists<int>("shots")) {
       m_shots = params.get<int>("shots");
     }
+    if (params.keyExists<int>("threads")) {
+      m_threads = std::max(1, params.get<int>("threads"));
+    }
+    if (params.keyExists<double>("dense-threshold")) {
+      m_denseThreshold = std::max(0.0, params.get<double>("dense-threshold"));
+    }
+    if (params.keyExists<bool>("vqe-mode")) {
+      m_vqeMode = params.get<bool>("vqe-mode");
+    }
+    if (params.keyExists<std::shared_ptr<qristal::NoiseModel>>("noise-model")) {
+      const auto model =
+          params.get<std::shared_ptr<qristal::NoiseModel>>("noise-model");
+      m_noise = std::make_shared<const qristal::CompiledNoiseModel>(*model);
+      m_qobjCompiler = model->get_qobj_compiler();
+    }
+    if (params.keyExists<int>("trajectories")) {
+      m_trajectories = std::max(0, params.get<int>("trajectories"));
+    }
+    if (params.keyExists<int>("seed")) {
+      m_seed = params.get<int>("seed");
+    }
   }
   virtual void
   updateConfiguration(const xacc::HeterogeneousMap &params) override {
     if (params.keyExists<int>("shots")) {
       m_shots = params.get<int>("shots");
     }
+    if (params.keyExists<int>("threads")) {
+      m_threads = std::max(1, params.get<int>("threads"));
+    }
+    if (params.keyExists<double>("dense-threshold")) {
+      m_denseThreshold = std::max(0.0, params.get<double>("dense-threshold"));
+    }
+    if (params.keyExists<bool>("vqe-mode")) {
+      m_vqeMode = params.get<bool>("vqe-mode");
+    }
+    if (params.keyExists<std::shared_ptr<qristal::NoiseModel>>("noise-model")) {
+      const auto model =
+          params.get<std::shared_ptr<qristal::NoiseModel>>("noise-model");
+      m_noise = std::make_shared<const qristal::CompiledNoiseModel>(*model);
+      m_qobjCompiler = model->get_qobj_compiler();
+    }
+    if (params.keyExists<int>("trajectories")) {
+      m_trajectories = std::max(0, params.get<int>("trajectories"));
+    }
+    if (params.keyExists<int>("seed")) {
+      m_seed = params.get<int>("seed");
+    }
   }
 
   virtual const std::vector<std::string> configurationKeys() override {
-    return {};
+    return {"shots",       "threads",      "dense-threshold", "vqe-mode",
+            "noise-model", "trajectories", "seed"};
   }
 
   virtual xacc::HeterogeneousMap getProperties() override { return {}; }
@@ -266,19 +892,18 @@ public:
   virtual void execute(std::shared_ptr<xacc::AcceleratorBuffer> buffer,
                        const std::shared_ptr<xacc::CompositeInstruction>
                            compositeInstruction) override {
-    xacc::quantum::SparseSimVisitor visitor(buffer->size());
-    std::vector<size_t> measureBitIdxs;
-    // Walk the IR tree, and visit each node
-    InstructionIterator it(compositeInstruction);
-    while (it.hasNext()) {
-      auto nextInst = it.next();
-      if (nextInst->isEnabled()) {
-        if (nextInst->name() != "Measure") {
-          nextInst->accept(&visitor);
-        } else {
-          measureBitIdxs.emplace_back(nextInst->bits()[0]);
-        }
-      }
+    if (m_noise) {
+      buffer->setMeasurements(
+          sampleTrajectories(buffer->size(), compositeInstruction));
+      return;
+    }
+    xacc::quantum::SparseSimVisitor visitor(buffer->size(), m_threads,
+                                           m_denseThreshold);
+    const std::vector<size_t> measureBitIdxs =
+        simulate(visitor, compositeInstruction);
+    if (m_vqeMode) {
+      buffer->addExtraInfo(
+          "exp-val-z", visitor.expectations({parityTerm(measureBitIdxs)})[0]);
     }
     const auto measurements = visitor.sample(measureBitIdxs, m_shots);
     //   std::cout << "Measure: " << bitstring << "\n";
@@ -289,6 +914,26 @@ public:
   execute(std::shared_ptr<xacc::AcceleratorBuffer> buffer,
           const std::vector<std::shared_ptr<xacc::CompositeInstruction>>
               CompositeInstructions) override {
+    // In VQE mode, the circuits measuring the terms of an observable share a
+    // single simulation of their kernel, and the expectation value of each term
+    // is computed directly from the state, without the basis changes
+    if (m_vqeMode && !m_noise) {
+      if (const auto observed = observedTerms(CompositeInstructions)) {
+        xacc::quantum::SparseSimVisitor visitor(buffer->size(), m_threads,
+                                               m_denseThreshold);
+        simulate(visitor, observed->first);
+        const std::vector<double> values =
+            visitor.expectations(observed->second);
+        for (size_t i = 0; i < CompositeInstructions.size(); ++i) {
+          const auto &f = CompositeInstructions[i];
+          auto tmpBuffer = std::make_shared<xacc::AcceleratorBuffer>(
+              f->name(), buffer->size());
+          tmpBuffer->addExtraInfo("exp-val-z", values[i]);
+          buffer->appendChild(f->name(), tmpBuffer);
+        }
+        return;
+      }
+    }
     for (auto &f : CompositeInstructions) {
       auto tmpBuffer =
           std::make_shared<xacc::AcceleratorBuffer>(f->name(), buffer->size());
@@ -0,0 +1,110 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/bit_reversal.hpp>
+#include <qristal/core/thread_pool.hpp>
+
+// STL
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace qristal
+{
+
+  namespace
+  {
+
+    /// Bits in the lowest and highest parts of each index, chosen so that a run of 2^b elements fills 128 bytes
+    template <typename T>
+    constexpr size_t tile_bits = std::countr_zero(std::max<size_t>(1, 128 / sizeof(T)));
+
+    /// Vectors of fewer than this many elements are permuted serially
+    constexpr size_t min_parallel_size = size_t(1) << 14;
+
+    /// Number of tiles handled by each task on the thread pool
+    constexpr size_t tiles_per_task = 64;
+
+    template <typename T>
+    void permute(std::vector<T>& v)
+    {
+      const size_t size = v.size();
+      if (not std::has_single_bit(size))
+      {
+        throw std::invalid_argument("Unable to reverse the bits of the indices of a vector of " +
+                                    std::to_string(size) + " elements, as this is not a power of two.");
+      }
+      const size_t n = std::countr_zero(size);
+      constexpr size_t b = tile_bits<T>;
+
+      // Vectors too small to tile are permuted one pair of elements at a time
+      if (n < 2 * b + 1)
+      {
+        for (size_t i = 0; i < size; i++)
+        {
+          const size_t j = reverse_bits(i, n);
+          if (i < j) std::swap(v[i], v[j]);
+        }
+        return;
+      }
+
+      // Index = high * 2^(m + b) + middle * 2^b + low, which is reversed to rev(low) * 2^(m + b) + rev(middle) * 2^b +
+      // rev(high).
+      constexpr size_t run = size_t(1) << b;
+      const size_t m = n - 2 * b;
+      const size_t stride = size_t(1) << (m + b);
+      std::array<size_t, run> rev{};
+      for (size_t i = 0; i < run; i++) rev[i] = reverse_bits(i, b);
+
+      auto swap_tiles = [&](size_t middle)
+      {
+        const size_t rev_middle = reverse_bits(middle, m);
+        if (rev_middle < middle) return;
+        T* const tile = v.data() + middle * run;
+        T* const rev_tile = v.data() + rev_middle * run;
+        for (size_t high = 0; high < run; high++)
+        {
+          T* const row = tile + high * stride;
+          for (size_t low = 0; low < run; low++)
+          {
+            // A tile that is its own reverse swaps elements within itself, so each pair is only swapped once
+            if (rev_middle == middle and rev[low] * run + rev[high] <= high * run + low) continue;
+            std::swap(row[low], rev_tile[rev[low] * stride + rev[high]]);
+          }
+        }
+      };
+
+      const size_t n_tiles = size_t(1) << m;
+      if (size < min_parallel_size)
+      {
+        for (size_t middle = 0; middle < n_tiles; middle++) swap_tiles(middle);
+      }
+      else
+      {
+        thread_pool::parallel_for(0, n_tiles, tiles_per_task, swap_tiles);
+      }
+    }
+
+  }
+
+  /// Reverse the order of the lowest n_bits bits of an index
+  size_t reverse_bits(size_t index, size_t n_bits)
+  {
+    size_t result = 0;
+    for (size_t i = 0; i < n_bits; i++)
+    {
+      result = (result << 1) | (index & 1);
+      index >>= 1;
+    }
+    return result;
+  }
+
+  /// Permute a vector in place, moving the element at every index to the index with its bits reversed
+  void bit_reverse_permute(std::vector<std::complex<double>>& v) { permute(v); }
+
+  /// Permute a vector in place, moving the element at every index to the index with its bits reversed
+  void bit_reverse_permute(std::vector<double>& v) { permute(v); }
+
+}
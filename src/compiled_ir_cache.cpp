@@ -0,0 +1,136 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/compiled_ir_cache.hpp>
+
+// XACC
+#include <CompositeInstruction.hpp>
+#include <xacc.hpp>
+
+// STL
+#include <functional>
+
+namespace qristal
+{
+
+  /// Getter for the instance; makes this class a threadsafe singleton
+  compiled_ir_cache& compiled_ir_cache::get_instance()
+  {
+    // This is guaranteed to be threadsafe by C++11
+    static compiled_ir_cache cache;
+    return cache;
+  }
+
+  /// Hash function for cache keys
+  size_t compiled_ir_cache::key_hash::operator()(const key& k) const
+  {
+    size_t h = std::hash<std::string>{}(k.source);
+    const auto combine = [&h](size_t v) { h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2); };
+    combine(std::hash<size_t>{}(k.num_qubits));
+    combine(std::hash<int>{}(static_cast<int>(k.language)));
+    combine(std::hash<std::string>{}(k.include_qb));
+    combine(std::hash<std::string>{}(k.includes));
+    combine(std::hash<bool>{}(k.aer_pretranspile));
+    return h;
+  }
+
+  /// Return a clone of the circuit cached under a given key, or nullptr if there is none
+  std::shared_ptr<xacc::CompositeInstruction> compiled_ir_cache::get(const key& k)
+  {
+    std::shared_ptr<xacc::CompositeInstruction> cached;
+    {
+      std::scoped_lock lock(m);
+      if (capacity == 0) return nullptr;
+      auto it = index.find(k);
+      if (it == index.end())
+      {
+        miss_count++;
+        return nullptr;
+      }
+      // Move the entry to the front of the list, as it is now the most recently used
+      entries.splice(entries.begin(), entries, it->second);
+      cached = it->second->second;
+      hit_count++;
+    }
+    // Clone outside the lock; the cached circuit itself is never modified, so this is safe.
+    return xacc::ir::asComposite(cached->clone());
+  }
+
+  /// Store a clone of a circuit under a given key, evicting the least recently used circuit if the cache is full
+  void compiled_ir_cache::put(const key& k, const std::shared_ptr<xacc::CompositeInstruction>& circuit)
+  {
+    if (get_capacity() == 0) return;
+    auto copy = xacc::ir::asComposite(circuit->clone());
+    std::scoped_lock lock(m);
+    auto it = index.find(k);
+    if (it != index.end())
+    {
+      // Another thread got there first; just refresh the entry
+      it->second->second = std::move(copy);
+      entries.splice(entries.begin(), entries, it->second);
+      return;
+    }
+    entries.emplace_front(k, std::move(copy));
+    index.emplace(k, entries.begin());
+    trim();
+  }
+
+  /// Set the maximum number of circuits to keep in the cache. Zero disables the cache.
+  void compiled_ir_cache::set_capacity(size_t n)
+  {
+    std::scoped_lock lock(m);
+    capacity = n;
+    trim();
+  }
+
+  /// Get the maximum number of circuits to keep in the cache
+  size_t compiled_ir_cache::get_capacity() const
+  {
+    std::scoped_lock lock(m);
+    return capacity;
+  }
+
+  /// Get the number of circuits currently in the cache
+  size_t compiled_ir_cache::size() const
+  {
+    std::scoped_lock lock(m);
+    return entries.size();
+  }
+
+  /// Remove all circuits from the cache
+  void compiled_ir_cache::clear()
+  {
+    std::scoped_lock lock(m);
+    index.clear();
+    entries.clear();
+  }
+
+  /// Number of lookups that found a cached circuit
+  size_t compiled_ir_cache::hits() const
+  {
+    return hit_count;
+  }
+
+  /// Number of lookups that did not find a cached circuit
+  size_t compiled_ir_cache::misses() const
+  {
+    return miss_count;
+  }
+
+  /// Set the hit and miss counters back to zero
+  void compiled_ir_cache::reset_counters()
+  {
+    hit_count = 0;
+    miss_count = 0;
+  }
+
+  /// Drop least recently used circuits until the cache fits within its capacity. The caller must hold m.
+  void compiled_ir_cache::trim()
+  {
+    while (entries.size() > capacity)
+    {
+      index.erase(entries.back().first);
+      entries.pop_back();
+    }
+  }
+
+}
@@ -55,9 +55,10 @@ namespace qristal {
     // CUDAQ reports bitstrings in LSB
     acc_outputs_qbit0_left_ = true;
 
-    // Z expectation value
-    z_op_expectation_ = cudaq_counts.exp_val_z();
-    if (debug) std::cout << "* Z-operator expectation value: " << z_op_expectation_ << std::endl;
+    // Z expectation value. CUDAQ works this out anyway, so there is no point in deferring it.
+    deferred_outputs_ = std::make_shared<deferred_outputs>();
+    std::call_once(deferred_outputs_->z_op_calculated, [&] { deferred_outputs_->z_op_expectation = cudaq_counts.exp_val_z(); });
+    if (debug) std::cout << "* Z-operator expectation value: " << deferred_outputs_->z_op_expectation << std::endl;
 
     // Save the counts
     populate_measure_counts_data(cudaq_counts.to_map());
@@ -1,5 +1,6 @@
 #include <qristal/core/mpi/results_serialisation.hpp>
 
+#include <algorithm>
 #include <iterator>
 #include <numeric>
 #include <ranges>
@@ -75,6 +76,38 @@ std::vector<ResultsType> pack_results_map(const ResultsMap &results_map) {
          ::ranges::to<std::vector<ResultsType>>;
 }
 
+std::vector<ResultsType> pack_results(const Results &results) {
+  if (results.empty()) {
+    return {};
+  }
+
+  const size_t num_bits = results.bits();
+  const size_t num_elements =
+      (num_bits + MPI_ARRAY_ELEMENT_BITS - 1) / MPI_ARRAY_ELEMENT_BITS;
+  std::vector<ResultsType> packed_data;
+  packed_data.reserve(1 + results.size() * (num_elements + 2));
+  packed_data.push_back(static_cast<ResultsType>(num_bits));
+
+  for (const auto &[words, count] : results) {
+    packed_data.push_back(static_cast<ResultsType>(num_elements));
+    for (size_t i = 0; i < num_elements; i++) {
+      // Each 64-bit word holds two elements, starting from its most
+      // significant bit. A partial last element has its bits moved down to the
+      // least significant end, as in pack_results_map().
+      const uint64_t word = words[i / 2];
+      const auto element =
+          static_cast<ResultsType>(i % 2 == 0 ? word >> 32 : word);
+      const size_t bits_in_element =
+          std::min(MPI_ARRAY_ELEMENT_BITS, num_bits - i * MPI_ARRAY_ELEMENT_BITS);
+      packed_data.push_back(element >>
+                            (MPI_ARRAY_ELEMENT_BITS - bits_in_element));
+    }
+    packed_data.push_back(static_cast<ResultsType>(count));
+  }
+
+  return packed_data;
+}
+
 std::vector<GradientsType> pack_gradients(OutProbabilityGradients &gradients) {
   if (gradients.size() == 0) {
     return {};
@@ -29,7 +29,7 @@ int32_t shots_for_mpi_process(int32_t total_processes, int32_t total_shots,
 }
 
 void send_results_to_supervisor(
-    MpiManager &mpi_manager, ResultsMap &results,
+    MpiManager &mpi_manager, Results &results,
     std::optional<std::reference_wrapper<ResultsMap>> results_native,
     std::optional<std::span<Count>> out_counts,
     std::optional<std::span<Probability>> out_probs,
@@ -40,16 +40,14 @@ void send_results_to_supervisor(
   // combine the results. Because all backends may not guarantee that all of the
   // configured shots will be run, it must be sent here. This is calculated
   // by summing the counts of each qubit result in the map.
-  auto map_values = results | std::views::values;
-  int32_t num_shots =
-      std::reduce(map_values.begin(), map_values.end(), INT32_C(0));
+  int32_t num_shots = static_cast<int32_t>(results.total());
   mpi_manager.send_to_supervisor(
       std::span<serialisation::ShotCountType>{&num_shots, 1},
       MessageTags::SHOT_COUNT);
 
-  // Results map
+  // Results
   std::vector<serialisation::ResultsType> packed_results =
-      serialisation::pack_results_map(results);
+      serialisation::pack_results(results);
   mpi_manager.send_to_supervisor(
       std::span<serialisation::ResultsType>{packed_results},
       MessageTags::RESULTS_MAP);
@@ -83,9 +81,9 @@ void send_results_to_supervisor(
   }
 }
 
-void collect_results_from_mpi_processes(
+std::vector<int32_t> collect_results_from_mpi_processes(
     MpiManager &mpi_manager, int32_t total_shots_requested,
-    int32_t supervisor_shot_count, ResultsMap &results,
+    int32_t supervisor_shot_count, Results &results,
     std::optional<std::reference_wrapper<ResultsMap>> results_native,
     std::optional<std::span<Count>> out_counts,
     std::optional<std::span<Probability>> out_probs,
@@ -107,16 +105,19 @@ void collect_results_from_mpi_processes(
         shot_counts[id] = shot_count.front();
       });
 
-  // Results map
+  // Results
   mpi_manager.receive_from_others<serialisation::ResultsType>(
       MessageTags::RESULTS_MAP,
       [&results](int32_t id, std::span<serialisation::ResultsType> buffer) {
+        // Each process sends its outcomes in order, so they can be added to
+        // the end of the process's results and then merged in linear time
+        Results process_results;
         serialisation::unpack_results_map(
-            buffer,
-            [&results](std::vector<bool> key, serialisation::CountsType value) {
-              // Add the value to the map
-              results[key] += value;
+            buffer, [&process_results](std::vector<bool> key,
+                                       serialisation::CountsType value) {
+              process_results.add(key, value);
             });
+        results.merge(process_results);
       });
 
   // Native results map
@@ -218,6 +219,145 @@ void collect_results_from_mpi_processes(
               });
         });
   }
+
+  return shot_counts;
+}
+
+void send_sparse_outputs_to_supervisor(
+    MpiManager &mpi_manager, SparseIndices &indices, std::span<Count> out_counts,
+    std::optional<std::span<Probability>> out_probs,
+    std::optional<std::reference_wrapper<OutProbabilityGradients>>
+        out_prob_gradients) {
+  // Indices of the bitstrings that the other outputs are given for
+  mpi_manager.send_to_supervisor(std::span<BitstringIndex>{indices},
+                                 MessageTags::SPARSE_INDICES);
+
+  // Out counts
+  mpi_manager.send_to_supervisor(out_counts, MessageTags::COUNTS);
+
+  // Out probs
+  if (out_probs) {
+    mpi_manager.send_to_supervisor(*out_probs, MessageTags::PROBABILITIES);
+  }
+
+  // Out gradients
+  if (out_prob_gradients) {
+    std::vector<serialisation::GradientsType> packed_gradients =
+        serialisation::pack_gradients(*out_prob_gradients);
+    mpi_manager.send_to_supervisor(
+        std::span<serialisation::GradientsType>{packed_gradients},
+        MessageTags::PROBABILITY_GRADIENTS);
+  }
+}
+
+void collect_sparse_outputs_from_mpi_processes(
+    MpiManager &mpi_manager, int32_t total_shots_requested,
+    std::span<const int32_t> shot_counts, SparseIndices &indices,
+    OutCounts &out_counts,
+    std::optional<std::reference_wrapper<OutProbabilities>> out_probs,
+    std::optional<std::reference_wrapper<OutProbabilityGradients>>
+        out_prob_gradients) {
+  // Bitstring indices of each process, indexed by MPI process ID
+  const int32_t this_process = mpi_manager.get_process_id();
+  std::vector<SparseIndices> process_indices(mpi_manager.get_total_processes());
+  process_indices[this_process] = indices;
+  mpi_manager.receive_from_others<BitstringIndex>(
+      MessageTags::SPARSE_INDICES,
+      [&process_indices](int32_t id, std::span<BitstringIndex> buffer) {
+        process_indices[id].assign(buffer.begin(), buffer.end());
+      });
+
+  // The merged indices are the sorted union of the indices of all processes
+  SparseIndices merged_indices;
+  for (const auto &i : process_indices) {
+    merged_indices.insert(merged_indices.end(), i.begin(), i.end());
+  }
+  std::ranges::sort(merged_indices);
+  const auto duplicates = std::ranges::unique(merged_indices);
+  merged_indices.erase(duplicates.begin(), duplicates.end());
+
+  // Position in the merged indices of each bitstring of each process
+  std::vector<std::vector<size_t>> positions(process_indices.size());
+  for (size_t id = 0; id < process_indices.size(); id++) {
+    positions[id].reserve(process_indices[id].size());
+    for (BitstringIndex i : process_indices[id]) {
+      positions[id].push_back(std::ranges::lower_bound(merged_indices, i) -
+                              merged_indices.begin());
+    }
+  }
+  auto shot_scaling_factor = [&shot_counts, total_shots_requested](int32_t id) {
+    return static_cast<Probability>(shot_counts[id]) / total_shots_requested;
+  };
+
+  // Out counts are summed over all processes
+  OutCounts merged_counts(merged_indices.size(), 0);
+  for (size_t j = 0; j < out_counts.size(); j++) {
+    merged_counts[positions[this_process][j]] += out_counts[j];
+  }
+  mpi_manager.receive_from_others<serialisation::CountsType>(
+      MessageTags::COUNTS,
+      [&merged_counts, &positions](int32_t id,
+                                   std::span<serialisation::CountsType> buffer) {
+        for (size_t j = 0; j < buffer.size(); j++) {
+          merged_counts[positions[id][j]] += buffer[j];
+        }
+      });
+  out_counts = std::move(merged_counts);
+
+  // Out probs are rescaled by the number of shots each process ran vs the total
+  // number of configured shots, and then summed
+  if (out_probs) {
+    OutProbabilities merged_probs(merged_indices.size(), 0);
+    const Probability scale = shot_scaling_factor(this_process);
+    for (size_t j = 0; j < out_probs->get().size(); j++) {
+      merged_probs[positions[this_process][j]] += out_probs->get()[j] * scale;
+    }
+    mpi_manager.receive_from_others<serialisation::ProbabilitiesType>(
+        MessageTags::PROBABILITIES,
+        [&merged_probs, &positions, &shot_scaling_factor](
+            int32_t id, std::span<serialisation::ProbabilitiesType> buffer) {
+          const Probability scale = shot_scaling_factor(id);
+          for (size_t j = 0; j < buffer.size(); j++) {
+            merged_probs[positions[id][j]] += buffer[j] * scale;
+          }
+        });
+    out_probs->get() = std::move(merged_probs);
+  }
+
+  // Out gradients are rescaled and summed in the same way as the out probs
+  if (out_prob_gradients) {
+    OutProbabilityGradients &gradients = out_prob_gradients->get();
+    OutProbabilityGradients merged_gradients(
+        gradients.size(), std::vector<Probability>(merged_indices.size(), 0));
+    const Probability scale = shot_scaling_factor(this_process);
+    for (size_t p = 0; p < gradients.size(); p++) {
+      for (size_t j = 0; j < gradients[p].size(); j++) {
+        merged_gradients[p][positions[this_process][j]] +=
+            gradients[p][j] * scale;
+      }
+    }
+    mpi_manager.receive_from_others<serialisation::GradientsType>(
+        MessageTags::PROBABILITY_GRADIENTS,
+        [&merged_gradients, &positions, &shot_scaling_factor](
+            int32_t id, std::span<serialisation::GradientsType> buffer) {
+          // A process that measured nothing has no gradients to unpack
+          if (positions[id].empty()) {
+            return;
+          }
+          const Probability scale = shot_scaling_factor(id);
+          size_t p = 0;
+          for (const auto &row : serialisation::unpack_gradients(buffer)) {
+            size_t j = 0;
+            for (auto g : row) {
+              merged_gradients[p][positions[id][j++]] += g * scale;
+            }
+            p++;
+          }
+        });
+    gradients = std::move(merged_gradients);
+  }
+
+  indices = std::move(merged_indices);
 }
 
 } // namespace qristal::mpi
@@ -0,0 +1,132 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/noise_model/compiled_noise_model.hpp>
+#include <algorithm>
+#include <array>
+
+namespace {
+// Names of the gates with fixed indices, in the order of CompiledNoiseModel::Gate
+constexpr std::array<std::string_view, static_cast<size_t>(qristal::CompiledNoiseModel::Gate::count)> fixed_gate_names{
+    "id", "u1", "u2", "u3", "rx", "ry", "rz", "x", "y", "z", "h", "s", "sdg", "t", "tdg", "cx", "cz", "cp", "swap"};
+}
+
+namespace qristal
+{
+    CompiledNoiseModel::CompiledNoiseModel(const NoiseModel &noise_model)
+    {
+        for (size_t gate = 0; gate < fixed_gate_names.size(); ++gate)
+        {
+            m_gate_indices.emplace(fixed_gate_names[gate], gate);
+        }
+        m_gates.resize(fixed_gate_names.size());
+
+        // The tables span every qubit that the model mentions
+        const auto &noise_channels = noise_model.get_noise_channels();
+        const auto &readout_errors = noise_model.get_readout_errors();
+        const auto extend = [this](size_t qubit) { m_nb_qubits = std::max(m_nb_qubits, qubit + 1); };
+        for (const auto &[gate_name, operands_to_noise_channels] : noise_channels)
+        {
+            for (const auto &[qubits, channels] : operands_to_noise_channels)
+            {
+                std::for_each(qubits.begin(), qubits.end(), extend);
+            }
+        }
+        for (const auto &[qubit, readout_error] : readout_errors)
+        {
+            extend(qubit);
+        }
+
+        for (const auto &[gate_name, operands_to_noise_channels] : noise_channels)
+        {
+            const auto [iter, inserted] = m_gate_indices.emplace(gate_name, m_gates.size());
+            if (inserted)
+            {
+                m_gates.emplace_back();
+            }
+            GateTable &table = m_gates[iter->second];
+            for (const auto &[qubits, channels] : operands_to_noise_channels)
+            {
+                const int32_t index = static_cast<int32_t>(m_channels.size());
+                m_channels.emplace_back(channels);
+                if (qubits.empty())
+                {
+                    table.uniform = index;
+                    continue;
+                }
+                // The first operands of one or two qubits decide the arity of the flat table
+                if (table.arity == 0 && qubits.size() <= 2)
+                {
+                    table.arity = qubits.size();
+                    table.offset = m_index.size();
+                    m_index.resize(m_index.size() + (table.arity == 1 ? m_nb_qubits : m_nb_qubits * m_nb_qubits), -1);
+                }
+                if (table.arity != 0 && qubits.size() == table.arity)
+                {
+                    size_t flat = 0;
+                    for (const size_t qubit : qubits)
+                    {
+                        flat = flat * m_nb_qubits + qubit;
+                    }
+                    m_index[table.offset + flat] = index;
+                }
+                else
+                {
+                    table.others.emplace(qubits, index);
+                }
+            }
+        }
+
+        if (!readout_errors.empty())
+        {
+            m_readout_errors.assign(m_nb_qubits, ReadoutError{0.0, 0.0});
+            for (const auto &[qubit, readout_error] : readout_errors)
+            {
+                m_readout_errors[qubit] = readout_error;
+            }
+        }
+    }
+
+    size_t CompiledNoiseModel::gate_index(std::string_view gate_name) const
+    {
+        const auto iter = m_gate_indices.find(std::string(gate_name));
+        return iter == m_gate_indices.end() ? no_gate : iter->second;
+    }
+
+    const std::vector<NoiseChannel>* CompiledNoiseModel::channels(size_t gate, std::span<const size_t> qubits) const
+    {
+        if (gate >= m_gates.size())
+        {
+            return nullptr;
+        }
+        const GateTable &table = m_gates[gate];
+        if (table.arity != 0 && qubits.size() == table.arity)
+        {
+            size_t flat = 0;
+            bool spanned = true;
+            for (const size_t qubit : qubits)
+            {
+                spanned = spanned && qubit < m_nb_qubits;
+                flat = flat * m_nb_qubits + qubit;
+            }
+            if (spanned && m_index[table.offset + flat] >= 0)
+            {
+                return &m_channels[m_index[table.offset + flat]];
+            }
+        }
+        else if (!table.others.empty())
+        {
+            const auto iter = table.others.find(std::vector<size_t>(qubits.begin(), qubits.end()));
+            if (iter != table.others.end())
+            {
+                return &m_channels[iter->second];
+            }
+        }
+        return table.uniform >= 0 ? &m_channels[table.uniform] : nullptr;
+    }
+
+    const ReadoutError& CompiledNoiseModel::readout_error(size_t qubit) const
+    {
+        static const ReadoutError none{0.0, 0.0};
+        return qubit < m_readout_errors.size() ? m_readout_errors[qubit] : none;
+    }
+}
@@ -0,0 +1,53 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/noise_model/kraus_matrix.hpp>
+#include <qristal/core/noise_model/json_complex_convert.hpp>
+#include <algorithm>
+
+namespace qristal
+{
+    KrausMatrix::KrausMatrix(std::initializer_list<std::initializer_list<Scalar>> rows) : KrausMatrix(rows.size())
+    {
+        size_t row = 0;
+        for (const auto &elements : rows)
+        {
+            if (elements.size() != m_dim) throw std::invalid_argument("Kraus matrices must be square.");
+            std::copy(elements.begin(), elements.end(), data() + row++ * m_dim);
+        }
+    }
+
+    KrausMatrix::KrausMatrix(const std::vector<std::vector<Scalar>> &rows) : KrausMatrix(rows.size())
+    {
+        for (size_t row = 0; row < m_dim; ++row)
+        {
+            if (rows[row].size() != m_dim) throw std::invalid_argument("Kraus matrices must be square.");
+            std::copy(rows[row].begin(), rows[row].end(), data() + row * m_dim);
+        }
+    }
+
+    std::vector<std::vector<KrausMatrix::Scalar>> KrausMatrix::to_nested() const
+    {
+        std::vector<std::vector<Scalar>> rows;
+        rows.reserve(m_dim);
+        for (size_t row = 0; row < m_dim; ++row)
+        {
+            rows.emplace_back(data() + row * m_dim, data() + (row + 1) * m_dim);
+        }
+        return rows;
+    }
+
+    bool KrausMatrix::operator==(const KrausMatrix &other) const
+    {
+        return m_dim == other.m_dim && std::equal(data(), data() + m_dim * m_dim, other.data());
+    }
+
+    void to_json(nlohmann::json &js, const KrausMatrix &mat)
+    {
+        js = mat.to_nested();
+    }
+
+    void from_json(const nlohmann::json &js, KrausMatrix &mat)
+    {
+        mat = KrausMatrix(js.get<std::vector<std::vector<std::complex<double>>>>());
+    }
+}
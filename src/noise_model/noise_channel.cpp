@@ -15,30 +15,16 @@
 namespace
 {
     using eigen_cmat = Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>;
-    using eigen_cvec = Eigen::Vector<std::complex<double>, Eigen::Dynamic>;
 
-    /// Convert an STL-based matrix to an eigen matrix
+    /// Convert a Kraus matrix to an eigen matrix, in one copy from its Eigen view
     eigen_cmat matrix_to_eigen(const qristal::KrausOperator::Matrix &mat) {
       assert(!mat.empty());
-      const size_t rows = mat.size();
-      const size_t cols = mat.at(0).size();
-      eigen_cmat eigen_mat(rows, cols);
-      for (size_t i = 0; i < rows; ++i) {
-        eigen_mat.row(i) = eigen_cvec::Map(&mat[i][0], mat[i].size());
-      }
-      return eigen_mat;
+      return mat.eigen();
     }
 
-    /// Convert an eigen matrix to an STL-based matrix
+    /// Convert an eigen matrix to a Kraus matrix
     qristal::KrausOperator::Matrix eigen_to_matrix(const eigen_cmat &eigen_mat) {
-      qristal::KrausOperator::Matrix mat;
-      for (Eigen::Index i = 0; i < eigen_mat.rows(); ++i) {
-        eigen_cvec eigen_row = eigen_mat.row(i);
-        std::vector<std::complex<double>> row(
-            eigen_row.data(), eigen_row.data() + eigen_row.size());
-        mat.emplace_back(row);
-      }
-      return mat;
+      return qristal::KrausOperator::Matrix(eigen_mat);
     }
 }
 
@@ -104,19 +90,9 @@ namespace qristal
             Eigen::MatrixXcd kron_mat = coeff * Eigen::kroneckerProduct(first_mat, second_mat);
             assert(kron_mat.rows() == 4);
             assert(kron_mat.cols() == 4);
-            KrausOperator::Matrix mat(kron_mat.rows());
-            for (int row = 0; row < kron_mat.rows(); ++row)
-            {
-                std::vector<std::complex<double>> row_vec(kron_mat.cols());
-                for (int col = 0; col < kron_mat.cols(); ++col)
-                {
-                    row_vec[col] = kron_mat(row, col);
-                }
-                mat[row] = row_vec;
-            }
 
             qristal::KrausOperator kraus_op;
-            kraus_op.matrix = mat;
+            kraus_op.matrix = KrausOperator::Matrix(kron_mat);
             kraus_op.qubits = {q1, q2};
             kraus_op.prob = std::pow(coeff, 2);
             return kraus_op;
@@ -174,17 +150,9 @@ namespace qristal
         const auto is_non_zero = [](const KrausOperator::Matrix &mat)
         {
             constexpr double tol = 1e-12;
-            for (const auto &row : mat)
-            {
-                for (const auto &el : row)
-                {
-                    if (std::abs(el) > tol)
-                    {
-                        return true;
-                    }
-                }
-            }
-            return false;
+            // maxCoeff() is undefined on an empty matrix
+            if (mat.empty()) return false;
+            return mat.eigen().cwiseAbs().maxCoeff() > tol;
         };
 
         std::vector<KrausOperator::Matrix> non_zero_ops;
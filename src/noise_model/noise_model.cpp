@@ -11,30 +11,6 @@ namespace {
 qristal::NoiseChannel noise_channel_expand(const qristal::NoiseChannel& noise_channel_1,
                                       const qristal::NoiseChannel& noise_channel_2) {
   qristal::NoiseChannel combined_channel;
-  const auto mat_to_eigen =
-      [](const qristal::KrausOperator::Matrix& mat) -> Eigen::MatrixXcd {
-    Eigen::MatrixXcd eigen_mat(mat.size(), mat[0].size());
-    for (int row = 0; row < eigen_mat.rows(); ++row) {
-      for (int col = 0; col < eigen_mat.cols(); ++col) {
-        eigen_mat(row, col) = mat[row][col];
-      }
-    }
-    return eigen_mat;
-  };
-
-  const auto eigen_to_mat =
-      [](const Eigen::MatrixXcd& eigen_mat) -> qristal::KrausOperator::Matrix {
-    qristal::KrausOperator::Matrix mat(eigen_mat.rows());
-    for (int row = 0; row < eigen_mat.rows(); ++row) {
-      std::vector<std::complex<double>> row_data(eigen_mat.cols());
-      for (int col = 0; col < eigen_mat.cols(); ++col) {
-        row_data[col] = eigen_mat(row, col);
-      }
-      mat[row] = row_data;
-    }
-    return mat;
-  };
-
   for (const auto& kraus1 : noise_channel_1) {
     for (const auto& kraus2 : noise_channel_2) {
       auto qubits = kraus1.qubits;
@@ -45,11 +21,12 @@ qristal::NoiseChannel noise_channel_expand(const qristal::NoiseChannel& noise_ch
             "Cannot Kronecker combine two Kraus operators operating on the "
             "same qubit.");
       }
+      // Kronecker product of the Eigen views of the two matrices
       Eigen::MatrixXcd expanded_mat = Eigen::kroneckerProduct(
-          mat_to_eigen(kraus1.matrix), mat_to_eigen(kraus2.matrix));
+          kraus1.matrix.eigen(), kraus2.matrix.eigen());
       qristal::KrausOperator expanded_kraus_op;
       expanded_kraus_op.qubits = qubits;
-      expanded_kraus_op.matrix = eigen_to_mat(expanded_mat);
+      expanded_kraus_op.matrix = qristal::KrausOperator::Matrix(expanded_mat);
       combined_channel.emplace_back(expanded_kraus_op);
     }
   }
@@ -0,0 +1,206 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/packed_results.hpp>
+
+// STL
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace qristal
+{
+
+  /// Unpack the outcome
+  packed_results::outcome packed_results::entry::bits(size_t n_bits) const
+  {
+    outcome o(n_bits);
+    for (size_t i = 0; i < n_bits; i++) o[i] = (words[i / 64] >> (63 - i % 64)) & 1;
+    return o;
+  }
+
+  /// Constructor for empty results with outcomes of n_bits bits
+  packed_results::packed_results(size_t n_bits) : n_bits(n_bits), n_words((n_bits + 63) / 64) {}
+
+  /// Constructor converting from a map of counts
+  packed_results::packed_results(const std::map<outcome, int>& counts)
+  {
+    if (counts.empty()) return;
+    *this = packed_results(counts.begin()->first.size());
+    keys.reserve(counts.size() * n_words);
+    counts_.reserve(counts.size());
+    // The map is already in order
+    for (const auto& [o, count] : counts)
+    {
+      check_bits(o.size());
+      const std::vector<uint64_t> key = pack(o);
+      keys.insert(keys.end(), key.begin(), key.end());
+      counts_.push_back(count);
+    }
+  }
+
+  /// Remove all outcomes, keeping the number of bits
+  void packed_results::clear()
+  {
+    keys.clear();
+    counts_.clear();
+  }
+
+  /// Count of an outcome, or zero if it was not measured
+  int packed_results::count(const outcome& o) const
+  {
+    if (o.size() != n_bits) return 0;
+    const std::vector<uint64_t> key = pack(o);
+    const size_t i = lower_bound(key);
+    return (i < size() and std::ranges::equal(words(i), key)) ? counts_[i] : 0;
+  }
+
+  /// Total count of all outcomes
+  long long packed_results::total() const
+  {
+    return std::accumulate(counts_.begin(), counts_.end(), 0LL);
+  }
+
+  /// Add count to the count of an outcome
+  void packed_results::add(const outcome& o, int count)
+  {
+    check_bits(o.size());
+    const std::vector<uint64_t> key = pack(o);
+    // Fast path for outcomes added in order
+    if (empty() or std::ranges::lexicographical_compare(words(size() - 1), key))
+    {
+      keys.insert(keys.end(), key.begin(), key.end());
+      counts_.push_back(count);
+      return;
+    }
+    const size_t i = lower_bound(key);
+    if (std::ranges::equal(words(i), key))
+    {
+      counts_[i] += count;
+      return;
+    }
+    keys.insert(keys.begin() + i * n_words, key.begin(), key.end());
+    counts_.insert(counts_.begin() + i, count);
+  }
+
+  /// Add the counts of other results to these, in linear time
+  void packed_results::merge(const packed_results& other)
+  {
+    if (other.empty()) return;
+    check_bits(other.n_bits);
+    std::vector<uint64_t> merged_keys;
+    std::vector<int> merged_counts;
+    merged_keys.reserve(keys.size() + other.keys.size());
+    merged_counts.reserve(size() + other.size());
+    size_t i = 0, j = 0;
+    auto take = [&](const packed_results& from, size_t k, int count)
+    {
+      const auto key = from.words(k);
+      merged_keys.insert(merged_keys.end(), key.begin(), key.end());
+      merged_counts.push_back(count);
+    };
+    while (i < size() and j < other.size())
+    {
+      const auto a = words(i), b = other.words(j);
+      if (std::ranges::lexicographical_compare(a, b)) { take(*this, i, counts_[i]); i++; }
+      else if (std::ranges::lexicographical_compare(b, a)) { take(other, j, other.counts_[j]); j++; }
+      else { take(*this, i, counts_[i] + other.counts_[j]); i++; j++; }
+    }
+    for (; i < size(); i++) take(*this, i, counts_[i]);
+    for (; j < other.size(); j++) take(other, j, other.counts_[j]);
+    keys = std::move(merged_keys);
+    counts_ = std::move(merged_counts);
+  }
+
+  /// Convert to a map of counts
+  std::map<packed_results::outcome, int> packed_results::to_map() const
+  {
+    std::map<outcome, int> map;
+    // Outcomes are already in the order of the map, so each one goes at the end
+    for (size_t i = 0; i < size(); i++) map.emplace_hint(map.end(), outcome_at(i), counts_[i]);
+    return map;
+  }
+
+  /// Pack an outcome into words
+  std::vector<uint64_t> packed_results::pack(const outcome& o) const
+  {
+    std::vector<uint64_t> key(n_words, 0);
+    for (size_t i = 0; i < o.size(); i++) if (o[i]) key[i / 64] |= uint64_t(1) << (63 - i % 64);
+    return key;
+  }
+
+  /// Sort the outcomes, and combine the counts of any repeated outcomes
+  void packed_results::sort_and_combine()
+  {
+    // Outcomes of up to 64 bits are sorted in place, together with their counts
+    if (n_words == 1)
+    {
+      std::vector<std::pair<uint64_t, int>> entries(size());
+      for (size_t k = 0; k < size(); k++) entries[k] = {keys[k], counts_[k]};
+      std::ranges::sort(entries, {}, &std::pair<uint64_t, int>::first);
+      keys.clear();
+      counts_.clear();
+      for (const auto& [key, count] : entries)
+      {
+        if (not keys.empty() and keys.back() == key) counts_.back() += count;
+        else
+        {
+          keys.push_back(key);
+          counts_.push_back(count);
+        }
+      }
+      return;
+    }
+
+    // Longer outcomes are sorted by index
+    std::vector<size_t> order(size());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::sort(order, [this](size_t a, size_t b) {
+      return std::ranges::lexicographical_compare(words(a), words(b));
+    });
+
+    std::vector<uint64_t> sorted_keys;
+    std::vector<int> sorted_counts;
+    sorted_keys.reserve(keys.size());
+    sorted_counts.reserve(size());
+    for (size_t k : order)
+    {
+      const auto key = words(k);
+      if (not sorted_counts.empty() and std::equal(key.begin(), key.end(), sorted_keys.end() - n_words))
+      {
+        sorted_counts.back() += counts_[k];
+        continue;
+      }
+      sorted_keys.insert(sorted_keys.end(), key.begin(), key.end());
+      sorted_counts.push_back(counts_[k]);
+    }
+    keys = std::move(sorted_keys);
+    counts_ = std::move(sorted_counts);
+  }
+
+  /// Index of the first outcome not less than the given packed outcome
+  size_t packed_results::lower_bound(std::span<const uint64_t> key) const
+  {
+    size_t lo = 0, hi = size();
+    while (lo < hi)
+    {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (std::ranges::lexicographical_compare(words(mid), key)) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+
+  /// Set the number of bits of empty results, or check it against that of non-empty results
+  void packed_results::check_bits(size_t bits)
+  {
+    if (bits == n_bits) return;
+    if (not empty())
+    {
+      throw std::invalid_argument("Unable to combine " + std::to_string(bits) + "-bit outcomes with results of " +
+                                  std::to_string(n_bits) + "-bit outcomes.");
+    }
+    n_bits = bits;
+    n_words = (bits + 63) / 64;
+  }
+
+}
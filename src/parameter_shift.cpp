@@ -0,0 +1,104 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/parameter_shift.hpp>
+
+// XACC
+#include <CompositeInstruction.hpp>
+#include <GateModifier.hpp>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+namespace
+{
+  /// Parametrised gates whose outputs have the frequencies 1/2 and 1 in their parameter
+  const std::unordered_set<std::string> half_frequency_gates = {"CRZ"};
+
+  /// Number of gates of each kind that each parameter appears in
+  struct gate_counts
+  {
+    std::vector<size_t> full_frequency;
+    std::vector<size_t> half_and_full_frequency;
+  };
+
+  /// Count up the gates of each kind that each parameter appears in within an instruction. Gates inside a
+  /// controlled-unitary (C-U) block are counted from the block's base circuit rather than its decomposition, and,
+  /// being controlled, give the frequencies 1/2 and 1 like a controlled rotation.
+  void count_gates(const std::shared_ptr<xacc::Instruction>& inst, bool controlled,
+                   const std::vector<std::string>& variables, gate_counts& counts)
+  {
+    if (not inst->isEnabled()) return;
+    if (auto block = std::dynamic_pointer_cast<xacc::quantum::ControlModifier>(inst))
+    {
+      count_gates(block->getBaseInstruction(), true, variables, counts);
+      return;
+    }
+    if (inst->isComposite())
+    {
+      for (const auto& sub : xacc::ir::asComposite(inst)->getInstructions()) count_gates(sub, controlled, variables, counts);
+      return;
+    }
+    if (not inst->isParameterized()) return;
+    const bool half = controlled or half_frequency_gates.contains(inst->name());
+    for (const auto& param : inst->getParameters())
+    {
+      if (param.which() != 2) continue; // Not a named (string) parameter
+      const auto var = std::find(variables.begin(), variables.end(), param.toString());
+      if (var == variables.end())
+      {
+        throw std::invalid_argument("Gate parameter " + param.toString() + " is not a free parameter of the circuit. "
+                                    "Parameter-shift gradients need free parameters to be passed to gates directly.");
+      }
+      const size_t i = var - variables.begin();
+      (half ? counts.half_and_full_frequency : counts.full_frequency)[i]++;
+    }
+  }
+}
+
+namespace qristal::parameter_shift
+{
+
+  /// Get the shift rule for a parameter with the given spectrum
+  std::vector<term> rule(const spectrum& s)
+  {
+    using std::numbers::pi;
+    const size_t R = s.max_multiple;
+    const double omega = s.base_frequency;
+    std::vector<term> terms;
+    terms.reserve(2*R);
+    for (size_t mu = 1; mu <= 2*R; mu++)
+    {
+      const double x = (2.0*mu - 1) * pi / (2.0 * R);
+      // Outputs are periodic with period 2pi/omega, so keep shifts in (-pi/omega, pi/omega]
+      const double shift = (x > pi ? x - 2*pi : x) / omega;
+      const double sine = std::sin(x / 2);
+      const double coefficient = (mu % 2 == 1 ? 1.0 : -1.0) * omega / (4.0 * R * sine * sine);
+      terms.push_back({shift, coefficient});
+    }
+    return terms;
+  }
+
+  /// Work out the spectrum of each free parameter of a parametrised circuit, in the order of its variables
+  std::vector<spectrum> spectra(std::shared_ptr<xacc::CompositeInstruction> circuit)
+  {
+    const std::vector<std::string> variables = circuit->getVariables();
+    gate_counts counts{std::vector<size_t>(variables.size(), 0), std::vector<size_t>(variables.size(), 0)};
+    count_gates(circuit, false, variables, counts);
+
+    // With only full-frequency gates, the frequencies are the integers up to the number of gates. Otherwise, they are
+    // the multiples of 1/2 up to the number of gates.
+    std::vector<spectrum> result(variables.size());
+    for (size_t i = 0; i < variables.size(); i++)
+    {
+      if (counts.half_and_full_frequency[i] == 0) result[i] = {1.0, counts.full_frequency[i]};
+      else result[i] = {0.5, 2 * (counts.full_frequency[i] + counts.half_and_full_frequency[i])};
+    }
+    return result;
+  }
+
+}
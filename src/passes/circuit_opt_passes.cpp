@@ -1,6 +1,7 @@
 // Copyright (c) Quantum Brilliance Pty Ltd
 #include <qristal/core/passes/circuit_opt_passes.hpp>
 #include <qristal/core/circuit_builder.hpp>
+#include <qristal/core/service_locks.hpp>
 #include <xacc.hpp>
 
 namespace qristal {
@@ -26,7 +27,12 @@ std::string optimization_pass::get_description() const {
 
 /// Runs the pass over the circuit IR node
 void optimization_pass::apply(CircuitBuilder &circuit) {
-    xacc::getIRTransformation(m_plugin_name)->apply(circuit.get(), nullptr); 
+    auto pass = [&] {
+      auto registry_guard = service_locks::lock_registry();
+      return xacc::getIRTransformation(m_plugin_name);
+    }();
+    auto pass_guard = service_locks::lock_if_shared(pass);
+    pass->apply(circuit.get(), nullptr);
 }
 
 /// sequence_pass class
@@ -43,7 +49,12 @@ std::string sequence_pass::get_description() const {
 /// Runs the pass over the circuit IR node
 void sequence_pass::apply(CircuitBuilder &circuit) {
   for (const auto& s : m_pass_list) {
-    xacc::getIRTransformation(s)->apply(circuit.get(), nullptr);
+    auto pass = [&] {
+      auto registry_guard = service_locks::lock_registry();
+      return xacc::getIRTransformation(s);
+    }();
+    auto pass_guard = service_locks::lock_if_shared(pass);
+    pass->apply(circuit.get(), nullptr);
   }
 }
 }
@@ -6,6 +6,7 @@
 #include <CompositeInstruction.hpp>
 #include <xacc.hpp>
 
+#include <algorithm>
 #include <cassert>
 
 
@@ -20,6 +21,9 @@ namespace qristal {
     3.0 With an InstructionIterator, iterate through the circuit and count two-qubit gates
     4.0 With an InstructionIterator, iterate through the circuit and tally the number of gates (single-qubit + two-qubit)
         that apply to each qubit.  From there, find the qubit that sets the max-depth of the circuit.
+    5.0 In the same pass, link each gate to the previous gate on each of its qubits (building the dependency DAG) and
+        schedule it as soon as possible.  Then walk the DAG backwards from the end of the critical path to schedule
+        each gate as late as possible.
 */
 Profiler::Profiler(std::string target_circuit, const int n_qubits,
                    const double gate_1q_time_ms,
@@ -28,7 +32,7 @@ Profiler::Profiler(std::string target_circuit, const int n_qubits,
                    const double q_readout_time_ms,
                    const double pc_send_to_control_time_ms,
                    const bool debug)
-    : largestdepth_q_(-1), n_qubits_(n_qubits),
+    : n_qubits_(n_qubits),
       gate_1q_time_ms_(gate_1q_time_ms), gate_2q_time_ms_(gate_2q_time_ms),
       q_initialisation_time_ms_(q_initialisation_time_ms),
       q_readout_time_ms_(q_readout_time_ms),
@@ -59,7 +63,7 @@ Profiler::Profiler(std::shared_ptr<xacc::CompositeInstruction> &f,
                    const double q_readout_time_ms,
                    const double pc_send_to_control_time_ms,
                    const bool debug)
-    : placed_circuit_(f), largestdepth_q_(-1), n_qubits_(n_qubits),
+    : placed_circuit_(f), n_qubits_(n_qubits),
       gate_1q_time_ms_(gate_1q_time_ms), gate_2q_time_ms_(gate_2q_time_ms),
       q_initialisation_time_ms_(q_initialisation_time_ms),
       q_readout_time_ms_(q_readout_time_ms),
@@ -80,17 +84,11 @@ std::map<int,double> Profiler::get_total_initialisation_maxgate_readout_time_ms(
   double t_readout_ms = n_qubits_ * q_readout_time_ms_;
   ret_nd.insert(std::make_pair(KEY_READOUT_TIME, shots * t_readout_ms));
   //
-  // Max-depth gate time
-  double t_max_depth_gate_ms = 0;
-  if (largestdepth_q_ < 0) {
-    throw std::invalid_argument("session: no gates found in circuit");
-  } else {
-    t_max_depth_gate_ms =
-        (count_1q_gates_on_q_[largestdepth_q_] * gate_1q_time_ms_) +
-        (count_2q_gates_on_q_[largestdepth_q_] * gate_2q_time_ms_);
-    ret_nd.insert(
-        std::make_pair(KEY_MAX_DEPTH_GATE_TIME, shots * t_max_depth_gate_ms));
-  }
+  // Gate time along the critical path. This is at least the total gate time on the qubit with the most gates, and
+  // more whenever that qubit has to wait for gates on other qubits.
+  double t_max_depth_gate_ms = critical_path_time_ms_;
+  ret_nd.insert(
+      std::make_pair(KEY_MAX_DEPTH_GATE_TIME, shots * t_max_depth_gate_ms));
   //
   // Total time
   ret_nd.insert(std::make_pair(
@@ -135,24 +133,108 @@ int Profiler::get_count_2q_gates_on_q(const int iq) {
   return count_2q_gates_on_q_[iq];
 }
 
-int Profiler::get_largestdepth_q() { return largestdepth_q_; }
+int Profiler::get_largestdepth_q() {
+  int largestdepth_q = 0;
+  double max_busy_time = 0;
+  for (const auto &[qId, busy] : busy_time_on_q_) {
+    if (busy > max_busy_time) {
+      max_busy_time = busy;
+      largestdepth_q = qId;
+    }
+  }
+  return largestdepth_q;
+}
+
+const std::vector<Profiler::scheduled_gate>& Profiler::get_schedule() const { return schedule_; }
+
+const std::vector<size_t>& Profiler::get_critical_path() const { return critical_path_; }
+
+double Profiler::get_critical_path_time_ms() const { return critical_path_time_ms_; }
+
+std::map<int,double> Profiler::get_idle_time_on_q() const {
+  std::map<int,double> idle;
+  for (const auto &[qId, busy] : busy_time_on_q_) idle[qId] = critical_path_time_ms_ - busy;
+  return idle;
+}
 
 void Profiler::run() {
-  // Walk the circuit and count gates on each qubit line
-  std::set<int> qubitIds;
+  // Walk the circuit, count gates on each qubit line, and schedule each gate as soon as possible
+  // Index of the last gate on each qubit line so far
+  std::unordered_map<size_t, size_t> last_gate_on_q;
+  // For each gate, the predecessor that finishes last, and so sets the gate's ASAP start time
+  std::vector<size_t> latest_predecessor;
+  size_t last_to_finish = 0;
   xacc::InstructionIterator countq(placed_circuit_);
   while (countq.hasNext()) {
     auto nextI = countq.next();
     // Don't count Measure since we have a separate readout time for it.
     if (nextI->isEnabled() && nextI->name() != "Measure") {
       // Which map we need to update?
-      auto &map_to_update = nextI->bits().size() == 1 ? count_1q_gates_on_q_
-                                                      : count_2q_gates_on_q_;
+      const bool is_1q = nextI->bits().size() == 1;
+      auto &map_to_update = is_1q ? count_1q_gates_on_q_ : count_2q_gates_on_q_;
       // Update gate count on qubit line(s)
       for (const auto &qId : nextI->bits()) {
         map_to_update[qId]++;
-        qubitIds.emplace(qId);
       }
+
+      // Link the gate into the DAG and schedule it as soon as its predecessors have all finished
+      const size_t index = schedule_.size();
+      scheduled_gate gate{nextI->name(), nextI->bits()};
+      gate.duration_ms = is_1q ? gate_1q_time_ms_ : gate_2q_time_ms_;
+      size_t critical_predecessor = index;
+      for (size_t qId : gate.qubits) {
+        auto last = last_gate_on_q.find(qId);
+        if (last != last_gate_on_q.end()) {
+          const scheduled_gate &pred = schedule_[last->second];
+          if (std::find(gate.predecessors.begin(), gate.predecessors.end(), last->second) == gate.predecessors.end()) {
+            gate.predecessors.push_back(last->second);
+          }
+          const double pred_end = pred.asap_start_ms + pred.duration_ms;
+          if (critical_predecessor == index or pred_end > gate.asap_start_ms) {
+            gate.asap_start_ms = pred_end;
+            critical_predecessor = last->second;
+          }
+        }
+        last_gate_on_q[qId] = index;
+        busy_time_on_q_[qId] += gate.duration_ms;
+      }
+      const double end = gate.asap_start_ms + gate.duration_ms;
+      if (end > critical_path_time_ms_) {
+        critical_path_time_ms_ = end;
+        last_to_finish = index;
+      }
+      latest_predecessor.push_back(critical_predecessor);
+      schedule_.push_back(std::move(gate));
+    }
+  }
+
+  // Walk back from the gate that finishes last to find the critical path
+  if (not schedule_.empty()) {
+    for (size_t i = last_to_finish; ; i = latest_predecessor[i]) {
+      critical_path_.push_back(i);
+      if (latest_predecessor[i] == i) break;
+    }
+    std::reverse(critical_path_.begin(), critical_path_.end());
+  }
+
+  // Schedule each gate as late as possible without delaying the end of the critical path, starting from the end
+  std::unordered_map<size_t, double> latest_end_on_q;
+  for (size_t i = schedule_.size(); i-- > 0;) {
+    scheduled_gate &gate = schedule_[i];
+    double end = critical_path_time_ms_;
+    for (size_t qId : gate.qubits) {
+      auto latest = latest_end_on_q.find(qId);
+      if (latest != latest_end_on_q.end()) end = std::min(end, latest->second);
+    }
+    gate.alap_start_ms = end - gate.duration_ms;
+    for (size_t qId : gate.qubits) latest_end_on_q[qId] = gate.alap_start_ms;
+  }
+
+  if (debug_) {
+    std::cout << "[debug]: critical path: " << critical_path_.size() << " gates, "
+              << critical_path_time_ms_ << " ms" << std::endl;
+    for (const auto &[qId, idle] : get_idle_time_on_q()) {
+      std::cout << "[debug]: q" << qId << ": idle time: " << idle << " ms\n";
     }
   }
 
@@ -166,25 +248,5 @@ void Profiler::run() {
                 << '\n';
     }
   }
-
-  // Find out which qubit line has the most gates (1 qubit- + 2 qubit- gates)
-  // TODO: this works for our case since 1-q gate time == 2-q gate time.
-  // Generally, we need to find the most-critical path by translating the gate count -> circuit runtime.
-  // i.e., multiply the runtime/gate for each gate type (1q- or 2q- gates).
-  int max_gate_count = 0;
-  largestdepth_q_ = 0;
-  for (const auto &qId : qubitIds) {
-    const auto total_gates_on_q = count_1q_gates_on_q_[qId] + count_2q_gates_on_q_[qId];
-    // This qubit line has more gates, update the current max target.
-    if (total_gates_on_q > max_gate_count) {
-      max_gate_count = total_gates_on_q;
-      largestdepth_q_ = qId;
-    }
-  }
-
-  if (debug_) {
-    std::cout << "[debug]: largest depth set by q" << get_largestdepth_q()
-              << std::endl;
-  }
 }
 }
@@ -10,7 +10,13 @@ void bind_noise_model(pybind11::module &m) {
   namespace py = pybind11;
   py::class_<qristal::KrausOperator>(m, "KrausOperator")
       .def(py::init<>())
-      .def_readwrite("matrix", &qristal::KrausOperator::matrix, R"(Kraus matrix)")
+      .def_property(
+          "matrix",
+          [](const qristal::KrausOperator &op) { return op.matrix.to_nested(); },
+          [](qristal::KrausOperator &op, const std::vector<std::vector<std::complex<double>>> &rows) {
+            op.matrix = rows;
+          },
+          R"(Kraus matrix)")
       .def_readwrite("qubits", &qristal::KrausOperator::qubits,
                      R"(Qubits that this Kraus operator acts on.)");
 
@@ -33,6 +33,9 @@ namespace qristal {
               .def_readwrite("include_qb", &session::include_qb)
               .def_readwrite("circuit_parameters", &session::circuit_parameters)
               .def_readwrite("calc_gradients", &session::calc_gradients)
+              .def_readwrite("gradient_method", &session::gradient_method)
+              .def_readwrite("sparse_outputs", &session::sparse_outputs)
+              .def_readwrite("gradient_observable", &session::gradient_observable)
               .def_readwrite("calc_all_bitstring_counts", &session::calc_all_bitstring_counts)
               .def_readwrite("remote_backend_database_path", &session::remote_backend_database_path)
               .def_readwrite("acc", &session::acc)
@@ -47,6 +50,7 @@ namespace qristal {
               .def_readwrite("noise", &session::noise)
               .def_readwrite("calc_state_vec", &session::calc_state_vec)
               .def_readwrite("output_oqm_enabled", &session::output_oqm_enabled)
+              .def_readwrite("output_oqm_dir", &session::output_oqm_dir)
               .def_readwrite("notiming", &session::notiming)
               .def_readwrite("qn", &session::qn)
               .def_readwrite("sn", &session::sn)
@@ -71,7 +75,14 @@ namespace qristal {
               .def_property_readonly("all_bitstring_probabilities", &session::all_bitstring_probabilities, help::all_bitstring_probabilities)
               .def_property_readonly("all_bitstring_counts", &session::all_bitstring_counts, help::all_bitstring_counts)
               .def_property_readonly("all_bitstring_probability_gradients", &session::all_bitstring_probability_gradients, help::all_bitstring_probability_gradients)
+              .def_property_readonly("sparse_bitstring_indices", &session::sparse_bitstring_indices, help::sparse_bitstring_indices)
+              .def_property_readonly("sparse_bitstring_counts", &session::sparse_bitstring_counts, help::sparse_bitstring_counts)
+              .def_property_readonly("sparse_bitstring_probabilities", &session::sparse_bitstring_probabilities, help::sparse_bitstring_probabilities)
+              .def_property_readonly("sparse_bitstring_probability_gradients", &session::sparse_bitstring_probability_gradients, help::sparse_bitstring_probability_gradients)
+              .def_property_readonly("observable_expectation", &session::observable_expectation, help::observable_expectation)
+              .def_property_readonly("observable_gradients", &session::observable_gradients, help::observable_gradients)
               .def_property_readonly("transpiled_circuit", &session::transpiled_circuit, help::transpiled_circuit)
+              .def_property_readonly("output_oqm_file", &session::output_oqm_file, help::output_oqm_file)
               .def_property_readonly("qobj", &session::qobj, help::qobj)
               .def_property_readonly("qbjson", &session::qbjson, help::qbjson)
               .def_property_readonly("one_qubit_gate_depths", &session::one_qubit_gate_depths, help::one_qubit_gate_depths)
@@ -114,6 +125,8 @@ namespace qristal {
                    help::bitstring_index)
               .def("draw_shot", py::overload_cast<>(&session::draw_shot),
                    "draw_shot : Draw a single shot from the saved results of circuit i, condition j.")
+              .def("draw_shots", &session::draw_shots, py::arg("n"),
+                   "draw_shots : Draw n shots from the saved results, without replacement.")
               .def("run",
                   [&](session &s) {
                     std::shared_ptr<async_job_handle> handle = s.run();
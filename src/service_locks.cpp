@@ -0,0 +1,74 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/service_locks.hpp>
+
+// XACC
+#include <Accelerator.hpp>
+
+// STL
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+  /// Backends that keep process-wide state, so that even separate instances of them cannot execute concurrently
+  const std::unordered_set<std::string> serial_backends = {"tnqvm"};
+
+  /// Thread locker for an accelerator backend, and whether the backend is known to hand out private instances
+  struct backend_lock
+  {
+    std::mutex m;
+    std::atomic<bool> private_instances = false;
+  };
+
+  /// Get the thread locker for an accelerator backend
+  backend_lock& get_backend_lock(const std::string& backend)
+  {
+    static std::mutex backend_locks_m;
+    static std::unordered_map<std::string, backend_lock> backend_locks;
+    std::scoped_lock lock(backend_locks_m);
+    // Elements of an unordered_map never move, so the reference stays valid after the lock is released.
+    return backend_locks[backend];
+  }
+}
+
+namespace qristal::service_locks
+{
+
+  /// Get the thread locker dedicated to a shared service instance
+  std::mutex& get_instance_mutex(const void* instance)
+  {
+    static std::mutex instance_mutexes_m;
+    static std::unordered_map<const void*, std::mutex> instance_mutexes;
+    std::scoped_lock lock(instance_mutexes_m);
+    // Shared service instances live as long as the service registry, so their addresses are never reused.
+    return instance_mutexes[instance];
+  }
+
+  /// Lock the thread locker of an accelerator backend, unless the backend is known to hand out private instances
+  std::unique_lock<std::mutex> lock_backend(const std::string& backend)
+  {
+    backend_lock& bl = get_backend_lock(backend);
+    if (bl.private_instances) return {};
+    return std::unique_lock(bl.m);
+  }
+
+  /// Check an accelerator instance retrieved from XACC, and remember if its backend hands out private instances
+  bool register_backend_instance(const std::string& backend, const std::shared_ptr<xacc::Accelerator>& instance,
+                                 bool constructed)
+  {
+    if (serial_backends.contains(backend)) return false;
+    if (not constructed and not std::dynamic_pointer_cast<xacc::Cloneable<xacc::Accelerator>>(instance)) return false;
+    get_backend_lock(backend).private_instances = true;
+    return true;
+  }
+
+  /// Lock the XACC service registry, for looking up and initialising services
+  std::unique_lock<std::mutex> lock_registry()
+  {
+    static std::mutex registry_m;
+    return std::unique_lock(registry_m);
+  }
+
+}
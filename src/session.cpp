@@ -1,17 +1,25 @@
 // Copyright (c) Quantum Brilliance Pty Ltd
 
 // Qristal
+#include <qristal/core/accelerator_pool.hpp>
+#include <qristal/core/adjoint_gradients.hpp>
+#include <qristal/core/artifact_writer.hpp>
 #include <qristal/core/backend.hpp>
 #include <qristal/core/backend_utils.hpp>
 #include <qristal/core/backends/hardware/qb/qdk.hpp>
 #include <qristal/core/benchmark/metrics/ConfusionMatrix.hpp>
 #include <qristal/core/benchmark/workflows/SPAMBenchmark.hpp>
+#include <qristal/core/bit_reversal.hpp>
 #include <qristal/core/circuit_builder.hpp>
+#include <qristal/core/compiled_ir_cache.hpp>
 #include <qristal/core/passes/circuit_opt_passes.hpp>
 #include <qristal/core/extension_loader.hpp>
+#include <qristal/core/parameter_shift.hpp>
 #include <qristal/core/pretranspiler.hpp>
 #include <qristal/core/profiler.hpp>
+#include <qristal/core/service_locks.hpp>
 #include <qristal/core/session.hpp>
+#include <qristal/core/thread_pool.hpp>
 
 // MPI
 #ifdef USE_MPI
@@ -27,13 +35,17 @@
 
 // STL
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdlib>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <numeric>
 #include <optional>
 #include <random>
 #include <regex>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <thread>
@@ -46,12 +58,6 @@
 #include <CompositeInstruction.hpp>
 #include <xacc.hpp>
 
-// Boost
-#include <boost/dynamic_bitset.hpp>
-
-// range v3
-#include <range/v3/view/zip.hpp>
-
 
 // Helper functions
 namespace
@@ -71,6 +77,21 @@ namespace
     return s.starts_with(sub);
   }
 
+  // Append the names and contents of the files included by an OpenQASM source (other than qelib1.inc, which the
+  // compiler provides itself), and of the files that they include in turn, to a string.
+  void append_included_files(const std::string& source, std::string& includes, std::set<std::string>& seen) {
+    static const std::regex include_regex(R"(include\s*\"([^\"]+)\"\s*;)");
+    for (std::sregex_iterator it(source.begin(), source.end(), include_regex), end; it != end; ++it) {
+      const std::string file = (*it)[1].str();
+      if (file == "qelib1.inc" or not seen.insert(file).second) continue;
+      std::ifstream ifs(file);
+      std::string contents;
+      if (ifs.is_open()) contents.assign(std::istreambuf_iterator<char>(ifs), {});
+      includes += file + '\0' + contents + '\0';
+      append_included_files(contents, includes, seen);
+    }
+  }
+
   double getExpectationValueZ(std::shared_ptr<xacc::AcceleratorBuffer> buffer) {
     double aver = 0.0;
     auto has_even_parity = [](const std::string &x) -> bool {
@@ -105,9 +126,6 @@ namespace
 namespace qristal
 {
 
-  /// Static class member. A mutex to lock access to non-threadsafe operations.
-  std::mutex session::shared_mutex;
-
   /// Default session constructor
   session::session() {
     xacc::Initialize();
@@ -256,15 +274,21 @@ namespace qristal
   }
 
   /// Retrieve the target circuit string
-  std::string session::get_target_circuit_qasm_string(circuit_origin input_origin) {
+  std::string session::get_target_circuit_qasm_string(circuit_origin input_origin,
+                                                      const std::optional<compiled_ir_cache::key>& cache_key) {
     std::string target_circuit;
     if (input_origin == circuit_origin::infile) {
-        // File input: load from file
-        std::ifstream tifs(infile);
-        if (tifs.is_open()) {
-          std::string outbuf(std::istreambuf_iterator<char>(tifs), {});
+        // File input: load from file, unless it has already been read into the cache key
+        std::optional<std::string> outbuf;
+        if (cache_key) {
+          outbuf = cache_key->source;
+        } else {
+          std::ifstream tifs(infile);
+          if (tifs.is_open()) outbuf.emplace(std::istreambuf_iterator<char>(tifs), std::istreambuf_iterator<char>());
+        }
+        if (outbuf) {
           // Check for raw OpenQASM string: starts with "OPENQASM" (not already wrapped in __qpu__)
-          target_circuit = starts_with_ex_whitespace("OPENQASM", outbuf) ? convertRawOpenQasmToQBKernel(outbuf) : outbuf;
+          target_circuit = starts_with_ex_whitespace("OPENQASM", *outbuf) ? convertRawOpenQasmToQBKernel(*outbuf) : *outbuf;
         }
     } else if (input_origin == circuit_origin::instring) {
       // String input
@@ -301,13 +325,18 @@ namespace qristal
       qbgpre.add_n_control_gates(target_circuit);
       if (debug) std::cout << "[debug]: Circuit after inserting QB specific gates:" << std::endl << target_circuit << std::endl;
 
-      // Insert include file for QB: include_qb
+      // Insert include file for QB: include_qb, unless it has already been read into the cache key
       if (debug) std::cout << "[debug]: Include file for QB: " << include_qb << std::endl;
-      std::ifstream tifs(include_qb);
-      if (tifs.is_open()) {
-        std::string target_includeqb(std::istreambuf_iterator<char>(tifs), {});
+      std::optional<std::string> target_includeqb;
+      if (cache_key) {
+        if (not cache_key->include_qb.empty()) target_includeqb = cache_key->include_qb;
+      } else {
+        std::ifstream tifs(include_qb);
+        if (tifs.is_open()) target_includeqb.emplace(std::istreambuf_iterator<char>(tifs), std::istreambuf_iterator<char>());
+      }
+      if (target_includeqb) {
         std::stringstream anchor_second;
-        anchor_second << "include \"qelib1.inc\";" << std::endl << target_includeqb;
+        anchor_second << "include \"qelib1.inc\";" << std::endl << *target_includeqb;
         target_circuit = std::regex_replace(target_circuit, std::regex("include \"qelib1.inc\";"), anchor_second.str());
         if (debug) std::cout << "[debug]: Circuit after custom include file for QB:" << std::endl << target_circuit << std::endl;
       } else if (debug) std::cout << "[debug]: Could not find the QB custom include file named: " << include_qb << std::endl;
@@ -316,6 +345,33 @@ namespace qristal
     return target_circuit;
   }
 
+  /// Work out the key under which the IR compiled from the target circuit string is stored in the compiled IR cache
+  std::optional<compiled_ir_cache::key> session::get_compiled_ir_cache_key(circuit_origin input_origin) {
+    compiled_ir_cache::key key{.num_qubits = qn, .language = input_language, .aer_pretranspile = false};
+    if (input_origin == circuit_origin::instring) {
+      key.source = instring;
+    } else if (input_origin == circuit_origin::infile) {
+      std::ifstream tifs(infile);
+      // Leave missing files for get_target_circuit_qasm_string to deal with
+      if (not tifs.is_open()) return std::nullopt;
+      key.source.assign(std::istreambuf_iterator<char>(tifs), {});
+    } else {
+      // Random circuits are different every time, so there is no point caching them
+      return std::nullopt;
+    }
+    // Only OpenQASM sources are pre-transpiled (see get_target_circuit_qasm_string)
+    if (input_language == circuit_language::OpenQASM) {
+      key.aer_pretranspile = (acc == "aer");
+      std::ifstream tifs(include_qb);
+      if (tifs.is_open()) key.include_qb.assign(std::istreambuf_iterator<char>(tifs), {});
+      // The compiler reads the files included by the source and by include_qb, so their contents matter too
+      std::set<std::string> seen;
+      append_included_files(key.source, key.includes, seen);
+      append_included_files(key.include_qb, key.includes, seen);
+    }
+    return key;
+  }
+
   void session::execute_on_simulator(
       std::shared_ptr<xacc::Accelerator> qpu,
       std::shared_ptr<xacc::AcceleratorBuffer> buffer_b,
@@ -325,6 +381,7 @@ namespace qristal
       if (!noise_mitigation.empty()) {
         if (noise) {
           auto noise_mitigated_acc = [&]() {
+            auto registry_guard = service_locks::lock_registry();
             if (noise_mitigation == "rich-extrap") {
               // Noise scaling factors that we use
               const std::vector<int> noise_scalings{1, 3, 5};
@@ -356,46 +413,83 @@ namespace qristal
     }
   }
 
-  /// Get the simulator
+  /// Get the simulator, from the accelerator pool if an idle one with the same settings is available
   std::shared_ptr<xacc::Accelerator> session::get_sim_qpu(bool execute_on_hardware)
   {
     // If a hardware accelerator was selected, we select "tnqvm" as the sim acc
     std::string sim_acc = (execute_on_hardware ? "tnqvm" : acc);
 
+    // Time the setup of the accelerator, for the accelerator pool statistics
+    const auto setup_start = std::chrono::steady_clock::now();
+    auto& pool = accelerator_pool::get_instance();
+    qpu_pool_key_.reset();
+
+    // Set up the options for the accelerator, keeping track of them in a fingerprint for the accelerator pool key.
+    // The seed is left out of the fingerprint, as pooled accelerators are re-initialised before each run anyway.
+    xacc::HeterogeneousMap qpu_options;
+    std::ostringstream fingerprint;
+    fingerprint.precision(17);
+    const auto set_option = [&](const std::string& key, const auto& value) {
+      qpu_options.insert(key, value);
+      fingerprint << key << "=";
+      using T = std::decay_t<decltype(value)>;
+      if constexpr (std::is_same_v<T, std::vector<size_t>>) for (size_t v : value) fingerprint << v << ",";
+      else if constexpr (requires { value->to_json(); }) fingerprint << value->to_json();
+      else fingerprint << value;
+      fingerprint << ";";
+    };
+
+    // Take an idle accelerator from the pool, or retrieve a new one, and record the time it took
+    const auto get_qpu = [&](auto&& make_qpu) {
+      accelerator_pool::key k{sim_acc, std::hash<std::string>{}(fingerprint.str())};
+      std::shared_ptr<xacc::Accelerator> qpu = pool.acquire(k);
+      const bool reused = (qpu != nullptr);
+      if (reused) {
+        qpu->initialize(qpu_options);
+        qpu_pool_key_ = k;
+      } else {
+        bool constructed = false;
+        std::tie(qpu, constructed) = make_qpu();
+        if (service_locks::register_backend_instance(sim_acc, qpu, constructed)) qpu_pool_key_ = k;
+      }
+      pool.record_setup_time(reused, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setup_start).count());
+      if (debug) std::cout << "# " << (reused ? "Reusing pooled" : "Using new") << " accelerator instance." << std::endl;
+      return qpu;
+    };
+
     #ifdef WITH_CUDAQ
       // If a CUDAQ backend sim was requested, returns its xacc::Accelerator wrapper.
       if (xacc::container::contains(cudaq_sim_pool::get_instance().available_simulators(), sim_acc)) {
 
         if (debug) std::cout << "# Using CUDA Quantum Simulator backend: " << sim_acc << std::endl;
 
-        xacc::HeterogeneousMap qpu_options {
-          {"shots", static_cast<int>(sn_this_process)},
-          {"initial-bond-dim", initial_bond_dimension},
-          {"max-bond-dim", max_bond_dimension},
-          {"abs-truncation-threshold", svd_cutoff},
-          {"rel-truncation-threshold", rel_svd_cutoff},
-          {"measurement-sampling-method", measure_sample_method},
-          {"gpu-device-ids", gpu_device_ids},
-          {"svd-type", svd_type},
-          {"svdj-tol", svdj_tol},
-          {"svdj-max-sweeps", svdj_max_sweeps}
-        };
+        set_option("shots", static_cast<int>(sn_this_process));
+        set_option("initial-bond-dim", initial_bond_dimension);
+        set_option("max-bond-dim", max_bond_dimension);
+        set_option("abs-truncation-threshold", svd_cutoff);
+        set_option("rel-truncation-threshold", rel_svd_cutoff);
+        set_option("measurement-sampling-method", measure_sample_method);
+        set_option("gpu-device-ids", gpu_device_ids);
+        set_option("svd-type", svd_type);
+        set_option("svdj-tol", svdj_tol);
+        set_option("svdj-max-sweeps", svdj_max_sweeps);
 
         // Additional options for qb-purification
         if (sim_acc == "cudaq:qb_purification") {
-          qpu_options.insert("initial-kraus-dim", initial_kraus_dimension);
-          qpu_options.insert("max-kraus-dim", max_kraus_dimension);
+          set_option("initial-kraus-dim", initial_kraus_dimension);
+          set_option("max-kraus-dim", max_kraus_dimension);
         }
 
         if (noise) {
           if (debug) std::cout << "# Noise model for " << sim_acc << " (from emulator package): enabled" << std::endl;
-          qpu_options.insert("noise-model", noise_model.get());
+          set_option("noise-model", noise_model.get());
         }
 
-        auto cudaq_accelerator = std::make_shared<qristal::cudaq_acc>(sim_acc);
-        cudaq_accelerator->initialize(qpu_options);
-
-        return cudaq_accelerator;
+        return get_qpu([&] {
+          auto cudaq_accelerator = std::make_shared<qristal::cudaq_acc>(sim_acc);
+          cudaq_accelerator->initialize(qpu_options);
+          return std::pair<std::shared_ptr<xacc::Accelerator>, bool>(cudaq_accelerator, true);
+        });
       }
     #endif
 
@@ -404,14 +498,14 @@ namespace qristal
     if (debug) std::cout << "# Qristal emulator" << (emulator ? "" : " NOT") << " found and loaded.\n";
 
     // Set up the options for the accelerator
-    xacc::HeterogeneousMap qpu_options {{"seed", static_cast<int>(seed)}};
+    qpu_options.insert("seed", static_cast<int>(seed));
 
     // Additional settings for TNQVM
     if (sim_acc == "tnqvm") {
       xacc::set_verbose(false);
-      qpu_options.insert("tnqvm-visitor", "exatn-mps");
-      qpu_options.insert("max-bond-dim", max_bond_dimension);
-      qpu_options.insert("svd-cutoff", svd_cutoff);
+      set_option("tnqvm-visitor", "exatn-mps");
+      set_option("max-bond-dim", max_bond_dimension);
+      set_option("svd-cutoff", svd_cutoff);
     }
 
     // Additional settings for AER
@@ -420,7 +514,7 @@ namespace qristal
       // the statevector simulation type instead of qasm simulation type. The former
       // then populates its ExecutionInfo::WaveFuncKey.
       if (not calc_state_vec) {
-        qpu_options.insert("shots", static_cast<int>(sn_this_process));
+        set_option("shots", static_cast<int>(sn_this_process));
       } else if (sn_this_process > 0) {
         std::cout << "Warning: Requesting AER state vector will ignore shot sampling!\n";
       }
@@ -431,7 +525,7 @@ namespace qristal
       }
 
       if (!aer_sim_type.empty()) {
-        qpu_options.insert("sim-type", aer_sim_type);
+        set_option("sim-type", aer_sim_type);
         if (debug)
           std::cout << "# Using AER simulation method: " << aer_sim_type
                     << std::endl;
@@ -446,42 +540,73 @@ namespace qristal
         else if (debug) std::cout << "# AER will determine how many threads to use for itself." << std::endl;
       }
       if (aer_omp_threads != 0) {
-        qpu_options.insert("max_parallel_threads", aer_omp_threads);
+        set_option("max_parallel_threads", aer_omp_threads);
         if (debug)std::cout << "# Allowing AER simulator to use up to " << aer_omp_threads
                              << " OpenMP threads." << std::endl;
       }
 
       if (noise) {
-        qpu_options.insert("noise-model", noise_model->to_json());
-        qpu_options.insert("qobj-compiler", noise_model->get_qobj_compiler());
+        set_option("noise-model", noise_model->to_json());
+        set_option("qobj-compiler", noise_model->get_qobj_compiler());
       }
     }
 
+    // Additional settings for the sparse simulator
+    if (sim_acc == "sparse-sim" and noise) set_option("noise-model", noise_model);
+
     // Additional settings for emulator backends
     if (EMULATOR_BACKENDS.count(sim_acc) != 0) {
       // Tensor network settings
       if (sim_acc != "qb-statevector-cpu" && sim_acc != "qb-statevector-gpu") {
-        qpu_options.insert("initial-bond-dim", initial_bond_dimension);
-        qpu_options.insert("max-bond-dim", max_bond_dimension);
-        qpu_options.insert("abs-truncation-threshold", svd_cutoff);
-        qpu_options.insert("rel-truncation-threshold", rel_svd_cutoff);
-        qpu_options.insert("measurement-sampling-method", measure_sample_method);
-        qpu_options.insert("svd-type", svd_type);
-        qpu_options.insert("svdj-tol", svdj_tol);
-        qpu_options.insert("svdj-max-sweeps", svdj_max_sweeps);
+        set_option("initial-bond-dim", initial_bond_dimension);
+        set_option("max-bond-dim", max_bond_dimension);
+        set_option("abs-truncation-threshold", svd_cutoff);
+        set_option("rel-truncation-threshold", rel_svd_cutoff);
+        set_option("measurement-sampling-method", measure_sample_method);
+        set_option("svd-type", svd_type);
+        set_option("svdj-tol", svdj_tol);
+        set_option("svdj-max-sweeps", svdj_max_sweeps);
 
         if (sim_acc == "qb-purification") { // Additional options for qb-purification
-          qpu_options.insert("initial-kraus-dim", initial_kraus_dimension);
-          qpu_options.insert("max-kraus-dim", max_kraus_dimension);
+          set_option("initial-kraus-dim", initial_kraus_dimension);
+          set_option("max-kraus-dim", max_kraus_dimension);
         }
       }
 
-      if (!gpu_device_ids.empty()) qpu_options.insert("gpu-device-ids", gpu_device_ids);
+      if (!gpu_device_ids.empty()) set_option("gpu-device-ids", gpu_device_ids);
 
-      if (noise) qpu_options.insert("noise-model", noise_model);
+      if (noise) set_option("noise-model", noise_model);
     }
 
-    return xacc::getAccelerator(sim_acc, qpu_options);
+    return get_qpu([&] {
+      auto registry_guard = service_locks::lock_registry();
+      return std::pair(xacc::getAccelerator(sim_acc, qpu_options), false);
+    });
+  }
+
+  /// Retrieve and configure the accelerator for this run, storing it in qpu_
+  std::unique_lock<std::mutex> session::acquire_sim_qpu(bool execute_on_hardware, const xacc::HeterogeneousMap& mqbacc)
+  {
+    // Lock up the backend unless it is known to hand out private accelerator instances. XACC initialises a shared
+    // instance while retrieving it, so this has to be done before get_sim_qpu.
+    const std::string sim_acc = (execute_on_hardware ? "tnqvm" : acc);
+    std::unique_lock backend_guard = service_locks::lock_backend(sim_acc);
+    qpu_ = get_sim_qpu(execute_on_hardware);
+    qpu_->updateConfiguration(mqbacc);
+    // Once the backend has been shown to hand out private instances, there is no need to hold onto the lock.
+    if (qpu_pool_key_ and backend_guard.owns_lock()) backend_guard.unlock();
+    return backend_guard;
+  }
+
+  /// Give qpu_ back to the accelerator pool for reuse, if it is private to this session
+  void session::release_sim_qpu()
+  {
+    // The state vector may point into memory owned by the accelerator, so hang onto the accelerator in that case.
+    if (qpu_ and qpu_pool_key_ and not calc_state_vec) {
+      accelerator_pool::get_instance().release(*qpu_pool_key_, std::move(qpu_));
+      qpu_ = nullptr;
+    }
+    qpu_pool_key_.reset();
   }
 
   /// Helper function to check that a setting is in a set of allowed values
@@ -598,6 +723,22 @@ namespace qristal
     check_allowed(VALID_MEASURE_SAMPLING_OPTIONS, measure_sample_method, "measure_sample_method");
     check_allowed(VALID_SVD_TYPE_OPTIONS, svd_type, "svd_type");
     check_allowed(VALID_NOISE_MITIGATIONS, noise_mitigation, "noise_mitigation");
+    check_allowed(VALID_GRADIENT_METHODS, gradient_method, "gradient_method");
+
+    // Check that the chosen gradient method can be used with the chosen backend
+    if (gradient_method == "adjoint") {
+      if (calc_gradients and (noise or remote_backends.contains(acc) or acc == "aws-braket")) throw std::invalid_argument(
+       "Adjoint gradients require a local simulator without noise. Please set noise = false, or gradient_method = \"parameter-shift\".");
+    } else if (not gradient_observable.empty()) {
+      throw std::invalid_argument("Gradients of gradient_observable can only be calculated with gradient_method = \"adjoint\".");
+    }
+
+    // Check that the outputs indexed by bitstring can be stored in the chosen representation
+    if (sparse_outputs and calc_all_bitstring_counts) {
+      if (qn > 64) throw std::invalid_argument("Sparse outputs index bitstrings with 64-bit integers, so are limited to 64 qubits.");
+      if (calc_gradients and gradient_method == "adjoint" and gradient_observable.empty()) throw std::invalid_argument(
+       "Adjoint gradients of all bitstring probabilities are dense. Please set sparse_outputs = false, or set gradient_observable.");
+    }
 
     // Check that the chosen placement options are allowed
     if (not noplacement) {
@@ -605,7 +746,11 @@ namespace qristal
       if (not noise) throw std::invalid_argument("Placement requires connectivity map, which can only be obtained if noise=true.");
       // Make sure the chosen placement transformation is allowed, and can be loaded
       check_allowed(VALID_HARDWARE_PLACEMENTS, placement, "placement");
-      if (not xacc::getIRTransformation(placement)) {
+      const bool placement_found = [&] {
+        auto registry_guard = service_locks::lock_registry();
+        return bool(xacc::getIRTransformation(placement));
+      }();
+      if (not placement_found) {
         std::cout << "Placement module '" << placement << "' cannot be located. Please check your installation." << std::endl;
       }
     }
@@ -729,26 +874,31 @@ namespace qristal
 
     // Clear all non-optional outputs
     results_.clear();
-    transpiled_circuit_.clear();
+    results_changed();
+    shot_sampler_.reset();
     qobj_.clear();
     qbjson_.clear();
-    one_qubit_gate_depths_.clear();
-    two_qubit_gate_depths_.clear();
-    timing_estimates_.clear();
+    deferred_outputs_.reset();
 
-    // Clear and size the optional outputs
-    const long long int num_outputs = ipow(2, qn);
+    // Clear and size the optional outputs. Sparse outputs are sized once the results are in.
+    const double num_outputs = std::ldexp(1.0, qn);
     const size_t num_params = circuit_parameters.size();
-
-    if (calc_all_bitstring_counts) {
+    sparse_bitstring_indices_.clear();
+    sparse_bitstring_counts_.clear();
+    sparse_bitstring_probabilities_.clear();
+    sparse_bitstring_probability_gradients_.clear();
+    observable_expectation_ = 0;
+    observable_gradients_.clear();
+
+    if (calc_all_bitstring_counts and not sparse_outputs) {
       all_bitstring_counts_.clear();
       constexpr double size_ratio_dbl_to_int = double(sizeof(double(0)))/sizeof(int(0));
       // We need 2^nq ints for all_bitstring_counts plus (potentially) num_params * 2^nq doubles for jacobians + 2^nq doubles for probs
       double scalefactor = 1 + (calc_gradients ? size_ratio_dbl_to_int * (num_params + 1): 0);
       // Check that there is enough free memory to store everything
-      if (all_bitstring_counts_.max_size() > scalefactor*double(num_outputs))
+      if (all_bitstring_counts_.max_size() > scalefactor*num_outputs)
       {
-        try { all_bitstring_counts_.resize(num_outputs); }
+        try { all_bitstring_counts_.resize(static_cast<size_t>(num_outputs)); }
         catch(std::exception& e) {
           std::string err = "Your RAM use is too fragmented to allocate a large enough "
            "std::vector<int> to hold integer bitstring representations.\nPlease free up more memory, use calc_all_bitstring_counts = false,";
@@ -769,12 +919,13 @@ namespace qristal
       }
     }
 
-    if (calc_gradients) {
+    if (calc_gradients and not sparse_outputs) {
       all_bitstring_probabilities_.clear();
       all_bitstring_probability_gradients_.clear();
       try {
-        all_bitstring_probabilities_.resize(num_outputs);
-        all_bitstring_probability_gradients_.resize(num_params,std::vector<double>(num_outputs));
+        all_bitstring_probabilities_.resize(static_cast<size_t>(num_outputs));
+        // Gradients of an observable replace the gradients of the probabilities
+        if (gradient_observable.empty()) all_bitstring_probability_gradients_.resize(num_params,std::vector<double>(static_cast<size_t>(num_outputs)));
       }
       catch (std::exception& e) {
         throw std::logic_error("Your RAM use is too fragmented to allocate a large enough std::vector<double> to hold all relevant gradients.\n"
@@ -872,53 +1023,169 @@ namespace qristal
   void session::run_gradients() {
 
     // Skip gradients if no counts have been returned by the backend
-    if (all_bitstring_counts_.empty()) return;
-
-    // Initialize
-    std::shared_ptr<xacc::CompositeInstruction> target_circuit = irtarget;
-    std::vector<std::shared_ptr<xacc::CompositeInstruction>> gradient_circs;
+    if (sparse_outputs ? sparse_bitstring_counts_.empty() : all_bitstring_counts_.empty()) return;
+    if (not irtarget) throw std::invalid_argument("Gradients can only be calculated for parametrised circuits given as IR.");
+    if (gradient_method == "adjoint") return run_adjoint_gradients();
+
+    // Work out the general parameter-shift rule for each parameter from the gates that it appears in, and bind every
+    // shifted set of parameter values to the same compiled circuit.
+    struct shifted_run {
+      size_t param;
+      double coefficient;
+      std::shared_ptr<xacc::CompositeInstruction> circuit;
+      std::vector<int> counts;
+      std::vector<uint64_t> indices;
+    };
+    std::vector<shifted_run> shifted_runs;
+    const std::vector<parameter_shift::spectrum> spectra = parameter_shift::spectra(irtarget);
     const size_t num_params = circuit_parameters.size();
+    if (spectra.size() != num_params) {
+      throw std::invalid_argument("The number of circuit parameters (" + std::to_string(num_params) + ") does not match "
+                                  "the number of free parameters in the circuit (" + std::to_string(spectra.size()) + ").");
+    }
+    for (size_t p = 0; p < num_params; p++) {
+      for (const auto& [shift, coefficient] : parameter_shift::rule(spectra[p])) {
+        std::vector<double> vals(circuit_parameters);
+        vals[p] += shift;
+        shifted_runs.push_back({p, coefficient, (*irtarget)(vals), {}, {}});
+      }
+    }
 
-    // Calculate param-shift gradient
-    for (size_t i = 0; i < 2*num_params; i+=2) {
-      std::vector<double> vals(circuit_parameters);
-      vals[i/2] += M_PI_2; // Increase by pi/2
-      auto evaled_circ_plus = (*target_circuit)(vals);
-      vals[i/2] -= M_PI; // Reduce by pi to get -pi/2 overall
-      auto evaled_circ_minus = (*target_circuit)(vals);
-      gradient_circs.push_back(evaled_circ_plus);
-      gradient_circs.push_back(evaled_circ_minus);
-    }
-
-    // Create new session objects to run shifted gradient circuits.
-    std::vector<session> gradient_sessions(gradient_circs.size(), *this);
-    for (auto [s, circ] : ::ranges::views::zip(gradient_sessions, gradient_circs)) {
-      s.calc_all_bitstring_counts = true;
-      s.irtarget = circ;
-      s.calc_gradients = false;
-      #ifdef USE_MPI
-        s.mpi_acceleration_enabled = false;
-      #endif
-      s.run();
+    // The shifted runs need this session's settings, but none of its outputs
+    const size_t num_outputs = sparse_outputs ? 0 : size_t(1) << qn;
+    session worker_settings = *this;
+    worker_settings.calc_gradients = false;
+    worker_settings.calc_state_vec = false;
+    worker_settings.calc_all_bitstring_counts = true;
+    worker_settings.irtarget.reset();
+    worker_settings.circuit_parameters.clear();
+    worker_settings.all_bitstring_counts_.clear();
+    worker_settings.all_bitstring_probabilities_.clear();
+    worker_settings.all_bitstring_probability_gradients_.clear();
+    worker_settings.sparse_bitstring_indices_.clear();
+    worker_settings.sparse_bitstring_counts_.clear();
+    worker_settings.sparse_bitstring_probabilities_.clear();
+    worker_settings.sparse_bitstring_probability_gradients_.clear();
+    worker_settings.results_.clear();
+    worker_settings.results_changed();
+    worker_settings.results_native_.clear();
+    worker_settings.deferred_outputs_.reset();
+    worker_settings.state_vec_.reset();
+    worker_settings.qpu_.reset();
+    #ifdef USE_MPI
+      worker_settings.mpi_acceleration_enabled = false;
+    #endif
+
+    // Hardware and remote backends go through a full run for each shifted circuit, one after the other.
+    if (is_hardware_accelerator(acc, remote_backend_database_) or acc == "aws-braket") {
+      for (auto& r : shifted_runs) {
+        session worker = worker_settings;
+        worker.irtarget = r.circuit;
+        worker.run();
+        if (sparse_outputs) {
+          r.indices = worker.sparse_bitstring_indices();
+          r.counts = worker.sparse_bitstring_counts();
+        } else {
+          r.counts = worker.all_bitstring_counts();
+        }
+      }
+    } else {
+      // Local simulators place, optimise and execute the shifted circuits concurrently on the thread pool, taking
+      // accelerators from the accelerator pool. There is no need to transpile or profile them.
+      const xacc::HeterogeneousMap mqbacc = configure_backend(remote_backend_database_);
+      task_group tasks;
+      tasks.parallel_for(0, shifted_runs.size(), 1, [&](size_t i) {
+        shifted_run& r = shifted_runs[i];
+        session worker = worker_settings;
+        auto backend_instance = std::make_shared<qristal::backend>();
+        backend_instance->updateConfiguration(mqbacc);
+        worker.place_and_optimise(r.circuit, backend_instance);
+        auto buffer_b = std::make_shared<xacc::AcceleratorBuffer>(qn);
+        {
+          std::unique_lock backend_guard = worker.acquire_sim_qpu(false, mqbacc);
+          worker.execute_on_simulator(worker.qpu_, buffer_b, r.circuit);
+        }
+        worker.release_sim_qpu();
+        if (not sparse_outputs) worker.all_bitstring_counts_.assign(num_outputs, 0);
+        worker.populate_measure_counts_data(buffer_b->getMeasurementCounts());
+        r.indices = std::move(worker.sparse_bitstring_indices_);
+        r.counts = std::move(sparse_outputs ? worker.sparse_bitstring_counts_ : worker.all_bitstring_counts_);
+      });
+      tasks.wait();
+    }
+
+    if (sparse_outputs) {
+      // Bitstrings measured in any of the shifted runs have gradients too, so add them to the sparse outputs
+      std::vector<uint64_t> indices = sparse_bitstring_indices_;
+      for (const auto& r : shifted_runs) indices.insert(indices.end(), r.indices.begin(), r.indices.end());
+      std::ranges::sort(indices);
+      indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+      auto position = [&indices](uint64_t index) { return std::ranges::lower_bound(indices, index) - indices.begin(); };
+
+      std::vector<int> counts(indices.size(), 0);
+      for (size_t j = 0; j < sparse_bitstring_indices_.size(); j++) {
+        counts[position(sparse_bitstring_indices_[j])] = sparse_bitstring_counts_[j];
+      }
+      sparse_bitstring_probabilities_.resize(indices.size());
+      for (size_t j = 0; j < indices.size(); j++) sparse_bitstring_probabilities_[j] = counts[j] / (1.0 * sn_this_process);
+
+      sparse_bitstring_probability_gradients_.assign(num_params, std::vector<double>(indices.size(), 0.0));
+      for (const auto& r : shifted_runs) {
+        const double weight = r.coefficient / sn_this_process;
+        for (size_t j = 0; j < r.indices.size(); j++) {
+          sparse_bitstring_probability_gradients_[r.param][position(r.indices[j])] += weight * r.counts[j];
+        }
+      }
+      sparse_bitstring_indices_ = std::move(indices);
+      sparse_bitstring_counts_ = std::move(counts);
+      return;
     }
 
     // Construct the probabilities
-    const size_t num_outputs = ipow(2, qn);
     for (size_t i = 0; i < num_outputs; i++) {
       all_bitstring_probabilities_.at(i) = all_bitstring_counts_.at(i) / (1.0 * sn_this_process);
     }
 
-    // Construct the Jacobian
+    // Construct the Jacobian from the weighted sums of the shifted counts
     std::vector<std::vector<double>>& jacobian = all_bitstring_probability_gradients_;
-    for (size_t i = 0; i < 2*num_params; i += 2) {
-      // Get the counts for the shifted values of the parameter
-      const std::vector<int>& counts_plus = gradient_sessions.at(i).all_bitstring_counts();
-      const std::vector<int>& counts_minus = gradient_sessions.at(i+1).all_bitstring_counts();
-      // Compute the entry in the Jacobian
-      for (size_t j = 0; j < num_outputs; j++) {
-        jacobian[i/2][j] = 0.5 * (counts_plus[j] - counts_minus[j]) / (1.0 * sn_this_process);
+    for (auto& row : jacobian) std::fill(row.begin(), row.end(), 0.0);
+    for (const auto& r : shifted_runs) {
+      const double weight = r.coefficient / sn_this_process;
+      for (size_t j = 0; j < num_outputs; j++) jacobian[r.param][j] += weight * r.counts.at(j);
+    }
+  }
+
+  void session::run_adjoint_gradients() {
+
+    // Construct the probabilities from the counts, as for the other gradient methods
+    const size_t num_outputs = sparse_outputs ? 0 : size_t(1) << qn;
+    if (sparse_outputs) {
+      sparse_bitstring_probabilities_.resize(sparse_bitstring_counts_.size());
+      for (size_t i = 0; i < sparse_bitstring_counts_.size(); i++) {
+        sparse_bitstring_probabilities_[i] = sparse_bitstring_counts_[i] / (1.0 * sn_this_process);
       }
     }
+    for (size_t i = 0; i < num_outputs; i++) {
+      all_bitstring_probabilities_.at(i) = all_bitstring_counts_.at(i) / (1.0 * sn_this_process);
+    }
+
+    // Simulate the state vector of the unbound circuit at the current parameter values
+    const adjoint_gradients adjoint(irtarget, circuit_parameters, qn);
+
+    // Gradients of the expectation value of an observable take a single backward pass
+    if (not gradient_observable.empty()) {
+      std::tie(observable_expectation_, observable_gradients_) =
+       adjoint.expectation_gradients(adjoint_gradients::parse_observable(gradient_observable));
+      return;
+    }
+
+    // Gradients of the probabilities come out with qubit 0 as the least significant bit, so reverse the bits of each
+    // index if the outputs are ordered by MSB.
+    std::vector<std::vector<double>> jacobian = adjoint.probability_gradients();
+    if (all_bitstring_counts_ordered_by_MSB_) {
+      for (auto& gradients : jacobian) bit_reverse_permute(gradients);
+    }
+    all_bitstring_probability_gradients_ = std::move(jacobian);
   }
 
   /// Util method to compile input source string into IR
@@ -929,6 +1196,7 @@ namespace qristal
     // Retrieve the compiler instance for the QASM dialect
     auto compiler = [&]() -> std::shared_ptr<xacc::Compiler>
     {
+      auto registry_guard = service_locks::lock_registry();
       switch (in_source_type)
       {
         case circuit_language::OpenQASM:
@@ -981,12 +1249,107 @@ namespace qristal
       src_str = tmp;
     }
 
-    // Compile source string to IR
+    // Compile source string to IR. Non-cloneable compilers (e.g. staq) are shared by all threads, so take turns.
+    auto compiler_guard = service_locks::lock_if_shared(compiler);
     auto irtarget = compiler->compile(src_str);
+    compiler_guard = {};
     // Get the kernel composite instruction (quantum circuit)
     return irtarget->getComposites().front();
   }
 
+  /// Compile (if necessary), place and optimise the input circuit, ready for execution
+  std::shared_ptr<xacc::CompositeInstruction> session::prepare_circuit(circuit_origin input_origin,
+                                                                       std::shared_ptr<qristal::backend> backend_instance) {
+    std::shared_ptr<xacc::CompositeInstruction> citarget;
+
+    // ==============================================
+    // ----------------- Compilation ----------------
+    // ==============================================
+    if (input_origin == circuit_origin::IR) {
+      // Direct IR input (e.g., circuit builder)
+      std::shared_ptr<xacc::CompositeInstruction> in_circ = irtarget;
+      if (in_circ->nVariables() > 0) {
+        in_circ = in_circ->operator()(circuit_parameters);
+      }
+      citarget = in_circ;
+    } else {
+      // String input -> take a copy of the IR from the cache if exactly the same source has been compiled before
+      const std::optional<compiled_ir_cache::key> cache_key = get_compiled_ir_cache_key(input_origin);
+      if (cache_key) citarget = compiled_ir_cache::get_instance().get(*cache_key);
+      if (citarget) {
+        if (debug) std::cout << "[debug]: Reusing compiled circuit from the cache" << std::endl;
+      } else {
+        // Not cached -> compile
+        const std::string target_circuit = get_target_circuit_qasm_string(input_origin, cache_key);
+        // Note: compile_input may not be thread-safe, e.g., XACC's staq
+        // compiler plugin was not defined as Clonable, hence only one instance
+        // is available from the service registry.
+        citarget = compile_input(target_circuit, qn, input_language);
+        if (cache_key) compiled_ir_cache::get_instance().put(*cache_key, citarget);
+      }
+    }
+
+    place_and_optimise(citarget, backend_instance);
+    return citarget;
+  }
+
+  /// Place and optimise a circuit that has already been compiled and had its parameters bound
+  void session::place_and_optimise(std::shared_ptr<xacc::CompositeInstruction> citarget,
+                                   std::shared_ptr<qristal::backend> backend_instance) {
+    // ==============================================
+    // -----------------  Placement  ----------------
+    // ==============================================
+    // Transform the target to account for QB topology: XACC
+    if (!noplacement) {
+      if (debug) std::cout << "# Quantum Brilliance topological placement: enabled" << std::endl;
+      xacc::HeterogeneousMap m;
+      if (acc == "aws-braket") m.merge(qpu_->getProperties());
+      // Disable QASM inlining during placement.
+      // e.g., we don't want to map gates to the IBM gateset (defined in
+      // qelib1.inc) during placement.
+      m.insert("no-inline", true);
+      auto A = [&] {
+        auto registry_guard = service_locks::lock_registry();
+        return xacc::getIRTransformation(placement);
+      }();
+      auto placement_guard = service_locks::lock_if_shared(A);
+      A->apply(citarget, backend_instance, m);
+    }
+
+    // ==============================================
+    // ----------  Circuit Optimization  ------------
+    // ==============================================
+    // Perform circuit optimisation: XACC "circuit-optimizer"
+    if (!nooptimise) {
+      std::stringstream debug_msg;
+      if (debug) std::cout << "# Quantum Brilliance circuit optimiser: enabled" << std::endl;
+      for (const auto &pass : circuit_opts) {
+        if (debug) std::cout << "# Apply optimization pass: " << pass->get_name() << std::endl;
+
+        // Wrap the composite IR (citarget) as a CircuitBuilder to send on
+        // to the optimization pass. Set copy_nodes to false to keep the root
+        // node (citarget) intact.
+        CircuitBuilder ir_as_circuit(citarget, /*copy_nodes*/ false);
+
+        // Check if the circuit contains control-unitary (C-U) gates, which
+        // XACC's CircuitOptimizer is not able to correctly optimise.
+        std::shared_ptr<xacc::CompositeInstruction> circ = ir_as_circuit.get();
+        xacc::InstructionIterator iter(circ);
+        while (iter.hasNext()) {
+          xacc::InstPtr next = iter.next();
+          if (next->name() == "C-U") {
+            std::cout << "This circuit contains a control-unitary gate or a gate constructed from a control-unitary gate, " <<
+                         "e.g. a multi-control or generalised multi-control gate. " <<
+                         "Such a gate cannot be optimised by the circuit optimiser.\n";
+            throw std::runtime_error("Gate error");
+          }
+        }
+
+        pass->apply(ir_as_circuit);
+      }
+    }
+  }
+
   // Terminate the job if still running.
   void session::cancel_run() {
     if (qpu_) qpu_->cancel();
@@ -1003,9 +1366,6 @@ namespace qristal
     // Determine input circuit providence
     auto input_origin = deduce_circuit_origin();
 
-    // Set the number of shots available to be drawn after the run completes
-    shots_remaining_ = sn;
-
     // Work out how many shots this process should actually run
     #ifdef USE_MPI
       int32_t num_mpi_processes = mpi_manager_.get_total_processes();
@@ -1064,84 +1424,22 @@ namespace qristal
     auto backend_instance = std::make_shared<qristal::backend>();
     backend_instance->updateConfiguration(mqbacc);
 
-    {
-      // Lock up during compilation, placement, optimization and execution if using aer or qpp, in order to avoid thread clashes.
-      std::unique_lock guard(shared_mutex, std::defer_lock);
-      if (acc == "aer" or acc == "qpp" or acc == "tnqvm") guard.lock();
+    // AWS Braket placement needs the properties of the accelerator, so in that case retrieve the accelerator first.
+    std::unique_lock<std::mutex> backend_guard;
+    const bool placement_needs_qpu = (acc == "aws-braket" and not noplacement);
+    if (placement_needs_qpu) backend_guard = acquire_sim_qpu(exec_on_hardware, mqbacc);
 
-      // ==============================================
-      // Construct/initialize the Accelerator instance
-      // ==============================================
-      qpu_ = get_sim_qpu(exec_on_hardware);
-      qpu_->updateConfiguration(mqbacc);
-
-      // ==============================================
-      // ----------------- Compilation ----------------
-      // ==============================================
-      if (input_origin == circuit_origin::IR) {
-        // Direct IR input (e.g., circuit builder)
-        std::shared_ptr<xacc::CompositeInstruction> in_circ = irtarget;
-        if (in_circ->nVariables() > 0) {
-          in_circ = in_circ->operator()(circuit_parameters);
-        }
-        citarget = in_circ;
-      } else {
-        // String input -> compile
-        const std::string target_circuit = get_target_circuit_qasm_string(input_origin);
-        // Note: compile_input may not be thread-safe, e.g., XACC's staq
-        // compiler plugin was not defined as Clonable, hence only one instance
-        // is available from the service registry.
-        citarget = compile_input(target_circuit, qn, input_language);
-      }
-
-      // ==============================================
-      // -----------------  Placement  ----------------
-      // ==============================================
-      // Transform the target to account for QB topology: XACC
-      if (!noplacement) {
-        if (debug) std::cout << "# Quantum Brilliance topological placement: enabled" << std::endl;
-        xacc::HeterogeneousMap m;
-        if (acc == "aws-braket") m.merge(qpu_->getProperties());
-        // Disable QASM inlining during placement.
-        // e.g., we don't want to map gates to the IBM gateset (defined in
-        // qelib1.inc) during placement.
-        m.insert("no-inline", true);
-        auto A = xacc::getIRTransformation(placement);
-        A->apply(citarget, backend_instance, m);
-      }
+    // Compile, place and optimise the circuit. Any shared XACC services used along the way are locked individually,
+    // so this can go ahead concurrently with other sessions.
+    citarget = prepare_circuit(input_origin, backend_instance);
 
+    {
       // ==============================================
-      // ----------  Circuit Optimization  ------------
+      // Construct/initialize the Accelerator instance
       // ==============================================
-      // Perform circuit optimisation: XACC "circuit-optimizer"
-      if (!nooptimise) {
-        std::stringstream debug_msg;
-        if (debug) std::cout << "# Quantum Brilliance circuit optimiser: enabled" << std::endl;
-        for (const auto &pass : circuit_opts) {
-          if (debug) std::cout << "# Apply optimization pass: " << pass->get_name() << std::endl;
-
-          // Wrap the composite IR (citarget) as a CircuitBuilder to send on
-          // to the optimization pass. Set copy_nodes to false to keep the root
-          // node (citarget) intact.
-          CircuitBuilder ir_as_circuit(citarget, /*copy_nodes*/ false);
-
-          // Check if the circuit contains control-unitary (C-U) gates, which
-          // XACC's CircuitOptimizer is not able to correctly optimise.
-          std::shared_ptr<xacc::CompositeInstruction> circ = ir_as_circuit.get();
-          xacc::InstructionIterator iter(circ);
-          while (iter.hasNext()) {
-            xacc::InstPtr next = iter.next();
-            if (next->name() == "C-U") {
-              std::cout << "This circuit contains a control-unitary gate or a gate constructed from a control-unitary gate, " <<
-                           "e.g. a multi-control or generalised multi-control gate. " <<
-                           "Such a gate cannot be optimised by the circuit optimiser.\n";
-              throw std::runtime_error("Gate error");
-            }
-          }
-
-          pass->apply(ir_as_circuit);
-        }
-      }
+      // If the accelerator instance is shared with other sessions, the returned lock is held until execution and
+      // post-processing are finished with it.
+      if (not placement_needs_qpu) backend_guard = acquire_sim_qpu(exec_on_hardware, mqbacc);
 
       // ==============================================
       // ----------  Execution  ------------
@@ -1171,7 +1469,9 @@ namespace qristal
               auto buffer_temp = std::make_shared<xacc::AcceleratorBuffer>(buffer_b->size());
               handle.load_result(buffer_temp);
               auto qb_transpiler = std::make_shared<qristal::backend>();
+              qb_transpiler->updateConfiguration(mqbacc);
               this->process_run_result(citarget, qpu_, mqbacc, buffer_temp, timer_for_qpu.getDurationMs(), qb_transpiler);
+              this->finish_run_result();
             });
             return aws_job_handle;
           } catch (std::exception& e) {
@@ -1184,6 +1484,10 @@ namespace qristal
       }
     }
 
+    // Post-processing only reads from the accelerator to get the state vector or the AER qobj. Otherwise, other
+    // sessions can start using a shared accelerator instance now.
+    if (backend_guard.owns_lock() and not calc_state_vec and qpu_->name() != "aer") backend_guard.unlock();
+
     // Return identity gate if the circuit is empty
     if (citarget->nInstructions()==0){
       for (int i = 0; i < qn; ++i){
@@ -1205,9 +1509,140 @@ namespace qristal
     /// Post-processing results with local backend, i.e., execution occurs on this thread.
     process_run_result(citarget, qpu_, mqbacc, buffer_b, timer_for_qpu.getDurationMs(), backend_instance);
 
+    // Let other sessions reuse the accelerator, now that this one is finished with it
+    backend_guard = {};
+    release_sim_qpu();
+    finish_run_result();
+
     return nullptr;
   }
 
+  std::vector<session> session::run_batch(const std::vector<CircuitBuilder>& circuits) {
+    return run_batch(circuits.size(), [&](session& s, size_t i) { s.irtarget = circuits[i].get(); });
+  }
+
+  std::vector<session> session::run_batch(const std::vector<std::string>& sources) {
+    return run_batch(sources.size(), [&](session& s, size_t i) { s.instring = sources[i]; });
+  }
+
+  std::vector<session> session::run_batch(size_t n_circuits, const std::function<void(session&, size_t)>& set_input) {
+
+    // Validate the run configuration and work out the shot counts once for the whole batch
+    validate();
+    xacc::set_verbose(debug);
+    #ifdef USE_MPI
+      sn_this_process = mpi::shots_for_mpi_process(mpi_manager_.get_total_processes(), sn, mpi_manager_.get_process_id());
+    #else
+      sn_this_process = sn;
+    #endif
+
+    // One session per circuit, each a copy of this one with just the input circuit swapped out
+    std::vector<session> batch(n_circuits, *this);
+    for (size_t i = 0; i < n_circuits; i++) {
+      batch[i].instring.clear();
+      batch[i].infile.clear();
+      batch[i].irtarget.reset();
+      batch[i].random_circuit_depth = 0;
+      set_input(batch[i], i);
+    }
+
+    // Hardware, remote and MPI-distributed runs can't share accelerator instances between circuits, so just run
+    // them one after the other.
+    const bool exec_on_hardware = is_hardware_accelerator(acc, remote_backend_database_);
+    bool sequential = exec_on_hardware or acc == "aws-braket";
+    #ifdef USE_MPI
+      sequential = sequential or (mpi_acceleration_enabled and mpi_manager_.get_total_processes() > 1);
+    #endif
+    if (sequential) {
+      for (auto& s : batch) s.run();
+      return batch;
+    }
+
+    // Collect all the simulator options once
+    const xacc::HeterogeneousMap mqbacc = configure_backend(remote_backend_database_);
+
+    // Compile, place, optimise, execute and post-process each circuit on the thread pool. Accelerator instances are
+    // handed from one circuit to the next through the accelerator pool.
+    thread_pool::parallel_for(0, n_circuits, 1, [&](size_t i) {
+      session& s = batch[i];
+      const circuit_origin input_origin = s.deduce_circuit_origin();
+      if (input_origin == circuit_origin::CUDAQ) throw std::invalid_argument("CUDAQ kernels cannot be run with run_batch.");
+
+      auto backend_instance = std::make_shared<qristal::backend>();
+      backend_instance->updateConfiguration(mqbacc);
+      auto buffer_b = std::make_shared<xacc::AcceleratorBuffer>(qn);
+      xacc::ScopeTimer timer_for_qpu("Walltime, in ms, for simulator to execute quantum circuit", false);
+
+      // Compile, place and optimise the circuit
+      std::shared_ptr<xacc::CompositeInstruction> citarget = s.prepare_circuit(input_origin, backend_instance);
+
+      // Get an accelerator, locking up the backend if the accelerator is shared with other sessions
+      std::unique_lock backend_guard = s.acquire_sim_qpu(false, mqbacc);
+
+      buffer_b->resetBuffer();
+      if (execute_circuit) s.execute_on_simulator(s.qpu_, buffer_b, citarget);
+
+      // As in run(), keep any lock on a shared accelerator only if post-processing needs to read from it.
+      if (backend_guard.owns_lock() and not calc_state_vec and s.qpu_->name() != "aer") backend_guard.unlock();
+
+      // Return identity gate if the circuit is empty
+      if (citarget->nInstructions() == 0) {
+        for (size_t q = 0; q < qn; ++q) citarget->addInstruction(std::make_shared<xacc::quantum::Identity>(q));
+      }
+
+      // Post-processing reads execution info (e.g. the state vector) back out of the accelerator, so only hand the
+      // accelerator back for reuse once that is done.
+      s.process_run_result(citarget, s.qpu_, mqbacc, buffer_b, timer_for_qpu.getDurationMs(), backend_instance);
+      backend_guard = {};
+      s.release_sim_qpu();
+      s.finish_run_result();
+    });
+
+    return batch;
+  }
+
+  /// Transpile the circuit to QB native gates and profile it
+  void session::deferred_outputs::profile() {
+    if (not transpiler) return;
+
+    auto buffer_qb = std::make_shared<xacc::AcceleratorBuffer>(num_qubits);
+    try {
+      transpiler->execute(buffer_qb, circuit);
+    } catch (...) {
+      throw std::invalid_argument(
+          "Transpiling to QB native gates for your input circuit failed");
+    }
+
+    // Save the transpiled circuit string
+    transpiled_circuit = transpiler->getTranspiledResult();
+
+    // Invoke the Profiler directly on the transpiled IR
+    auto transpiled_ir = transpiler->getTranspiledIR();
+    Profiler timing_profile(transpiled_ir, num_qubits, debug);
+
+    // Save single qubit gate qtys to std::map<int,int>
+    one_qubit_gate_depths = timing_profile.get_count_1q_gates_on_q();
+
+    // Save two-qubit gate qtys to std::map<int,int>
+    two_qubit_gate_depths = timing_profile.get_count_2q_gates_on_q();
+
+    // Save timing results to std::map<int,double>
+    timing_estimates = timing_profile.get_total_initialisation_maxgate_readout_time_ms(simulator_time_ms, shots);
+  }
+
+  /// Calculate the Z-operator expectation value
+  void session::deferred_outputs::calculate_z_op_expectation() {
+    if (not buffer) return;
+    if (buffer->hasExtraInfoKey("ro-fixed-exp-val-z") ||
+        buffer->hasExtraInfoKey("exp-val-z") ||
+        (!buffer->getMeasurementCounts().empty())) {
+      z_op_expectation = getExpectationValueZ(buffer);
+      if (debug) std::cout << "* Z-operator expectation value: " << z_op_expectation << std::endl;
+    } else {
+      xacc::warning("No Z operator expectation available");
+    }
+  }
+
   void session::process_run_result(
       std::shared_ptr<xacc::CompositeInstruction> ir_target,
       std::shared_ptr<xacc::Accelerator> sim_qpu,
@@ -1233,16 +1668,30 @@ namespace qristal
     // Keep the qobj so that a user can call Aer standalone later.
     if (sim_qpu->name() == "aer") qobj_ = sim_qpu->getNativeCode(ir_target, sim_qpu_config);
 
-    // Get Z operator expectation:
-    if (execute_circuit) {
-      if (buffer_b->hasExtraInfoKey("ro-fixed-exp-val-z") ||
-          buffer_b->hasExtraInfoKey("exp-val-z") ||
-          (!buffer_b->getMeasurementCounts().empty())) {
-        z_op_expectation_ = getExpectationValueZ(buffer_b);
-        if (debug) std::cout << "* Z-operator expectation value: " << z_op_expectation_ << std::endl;
-      } else {
-        xacc::warning("No Z operator expectation available");
-      }
+    // Keep hold of what is needed to work out the transpiled circuit, resource estimates and Z operator expectation
+    // value if and when they are asked for.
+    deferred_outputs_ = std::make_shared<deferred_outputs>();
+    if (output_oqm_enabled) {
+      // The executed circuit can be the caller's own irtarget, so transpile a snapshot of it; otherwise changes made
+      // to irtarget after this run would show up in its transpiled circuit and resource estimates.
+      deferred_outputs_->circuit = xacc::ir::asComposite(ir_target->clone());
+      deferred_outputs_->transpiler = qb_transpiler;
+    }
+    if (execute_circuit) deferred_outputs_->buffer = buffer_b;
+    deferred_outputs_->num_qubits = qn;
+    deferred_outputs_->shots = sn;
+    deferred_outputs_->simulator_time_ms = xacc_scope_timer_qpu_ms;
+    deferred_outputs_->debug = debug;
+
+    // Save the transpiled circuit to a file of its own in the background, if requested.
+    if (output_oqm_enabled and not output_oqm_dir.empty()) {
+      auto& writer = artifact_writer::get_instance();
+      deferred_outputs_->output_oqm_file = writer.unique_path(output_oqm_dir, "qristal_circuit", ".inc").string();
+      deferred_outputs_->output_oqm_written = writer.write(deferred_outputs_->output_oqm_file,
+        [outputs = deferred_outputs_] {
+          std::call_once(outputs->profiled, &deferred_outputs::profile, outputs.get());
+          return outputs->transpiled_circuit;
+        });
     }
 
     // Get the state vector from qpp or AER
@@ -1251,20 +1700,9 @@ namespace qristal
       state_vec_ = sim_qpu->getExecutionInfo<xacc::ExecutionInfo::WaveFuncPtrType>(
                         xacc::ExecutionInfo::WaveFuncKey);
 
-      if (all_bitstring_counts_ordered_by_MSB_) {
-        std::vector<std::complex<double>> state_vec_tmp = *state_vec_;
-        // Generate bitstring configurations
-        const size_t num_qubits = std::log2(state_vec_->size());
-        for (size_t i = 0; i < state_vec_->size(); i++) {
-          auto bitstring = boost::dynamic_bitset<>(num_qubits, i);
-          std::vector<bool> vb;
-          for (size_t j = 0; j < bitstring.size(); j++) {
-            vb.emplace_back(bitstring[j]);
-          }
-          state_vec_tmp[bitstring_index(vb)] = state_vec_->at(i);
-        }
-        *state_vec_ = state_vec_tmp;
-      }
+      // The state vector comes out with qubit 0 as the least significant bit, so reverse the bits of each index if
+      // the outputs are ordered by MSB.
+      if (all_bitstring_counts_ordered_by_MSB_) bit_reverse_permute(*state_vec_);
     }
 
     // Get counts
@@ -1272,35 +1710,12 @@ namespace qristal
     if (execute_circuit) {
       // Save the counts to results_
       populate_measure_counts_data(counts_map);
-      // If required to calculate gradients, do it now
-      if (calc_gradients) run_gradients();
     }
+  }
 
-    // Transpile to QB native gates (acc)
-    if (output_oqm_enabled) {
-      auto buffer_qb = std::make_shared<xacc::AcceleratorBuffer>(qn);
-      try {
-        qb_transpiler->execute(buffer_qb, ir_target);
-      } catch (...) {
-        throw std::invalid_argument(
-            "Transpiling to QB native gates for your input circuit failed");
-      }
-
-      // Save the transpiled circuit string
-      transpiled_circuit_ = qb_transpiler->getTranspiledResult();
-
-      // Invoke the Profiler
-      Profiler timing_profile(qb_transpiler->getTranspiledResult(), qn, debug);
-
-      // Save single qubit gate qtys to std::map<int,int>
-      one_qubit_gate_depths_ = timing_profile.get_count_1q_gates_on_q();
-
-      // Save two-qubit gate qtys to std::map<int,int>
-      two_qubit_gate_depths_ = timing_profile.get_count_2q_gates_on_q();
-
-      // Save timing results to std::map<int,double>
-      timing_estimates_ = timing_profile.get_total_initialisation_maxgate_readout_time_ms(xacc_scope_timer_qpu_ms, sn);
-    }
+  void session::finish_run_result() {
+    // If required to calculate gradients, do it now
+    if (execute_circuit and calc_gradients) run_gradients();
 
     // Perform SPAM correction (if set) and store corrected results separately
     if (perform_SPAM_correction_) {
@@ -1309,9 +1724,10 @@ namespace qristal
       std::cerr << "│ `results` will be overwritten by SPAM-corrected counts │" << std::endl;
       std::cerr << "│  Native results can be retrieved from `results_native` │" << std::endl;
       std::cerr << "╰────────────────────────────────────────────────────────╯" << std::endl;
-      results_native_ = results_;
+      results_native_ = results();
       //overwrite results_ with SPAM-corrected counts
-      results_ = apply_SPAM_correction(results_, SPAM_correction_matrix);
+      results_ = packed_results(apply_SPAM_correction(results_native_, SPAM_correction_matrix));
+      results_changed();
     }
 
     #ifdef USE_MPI
@@ -1323,11 +1739,23 @@ namespace qristal
         std::optional<std::span<mpi::Probability>> all_bitstring_probabilities_local;
         std::optional<std::reference_wrapper<mpi::OutProbabilityGradients>> all_bitstring_probability_gradients_local;
 
+        std::optional<std::reference_wrapper<mpi::OutProbabilities>> sparse_bitstring_probabilities_local;
+        std::optional<std::reference_wrapper<mpi::OutProbabilityGradients>> sparse_bitstring_probability_gradients_local;
+        const bool sync_sparse_outputs = sparse_outputs and calc_all_bitstring_counts;
+
         if (perform_SPAM_correction_) results_native_local = results_native_;
-        if (calc_all_bitstring_counts) all_bitstring_counts_local = all_bitstring_counts_;
-        if (calc_gradients) {
-          all_bitstring_probabilities_local = all_bitstring_probabilities_;
-          all_bitstring_probability_gradients_local = all_bitstring_probability_gradients_;
+        if (sync_sparse_outputs) {
+          // Sparse outputs are merged by bitstring index separately
+          if (calc_gradients) {
+            sparse_bitstring_probabilities_local = sparse_bitstring_probabilities_;
+            sparse_bitstring_probability_gradients_local = sparse_bitstring_probability_gradients_;
+          }
+        } else {
+          if (calc_all_bitstring_counts) all_bitstring_counts_local = all_bitstring_counts_;
+          if (calc_gradients) {
+            all_bitstring_probabilities_local = all_bitstring_probabilities_;
+            all_bitstring_probability_gradients_local = all_bitstring_probability_gradients_;
+          }
         }
 
         auto current_process_mpi_id = mpi_manager_.get_process_id();
@@ -1335,14 +1763,25 @@ namespace qristal
           // This is the supervisor process. Receive, unpack and combine
           // the results from the other worker processes with the results
           // from this process
-          mpi::collect_results_from_mpi_processes(
+          const std::vector<int32_t> shot_counts = mpi::collect_results_from_mpi_processes(
               mpi_manager_, sn, sn_this_process, results_, results_native_local, all_bitstring_counts_local,
               all_bitstring_probabilities_local, all_bitstring_probability_gradients_local);
+          results_changed();
+          if (sync_sparse_outputs) {
+            mpi::collect_sparse_outputs_from_mpi_processes(mpi_manager_, sn, shot_counts, sparse_bitstring_indices_,
+                sparse_bitstring_counts_, sparse_bitstring_probabilities_local, sparse_bitstring_probability_gradients_local);
+          }
         } else {
           // This is a worker process. Pack the results and send to the
           // supervisor process
           mpi::send_results_to_supervisor(mpi_manager_, results_, results_native_local, all_bitstring_counts_local,
               all_bitstring_probabilities_local, all_bitstring_probability_gradients_local);
+          if (sync_sparse_outputs) {
+            std::optional<std::span<mpi::Probability>> sparse_bitstring_probabilities_span;
+            if (sparse_bitstring_probabilities_local) sparse_bitstring_probabilities_span = sparse_bitstring_probabilities_;
+            mpi::send_sparse_outputs_to_supervisor(mpi_manager_, sparse_bitstring_indices_, sparse_bitstring_counts_,
+                sparse_bitstring_probabilities_span, sparse_bitstring_probability_gradients_local);
+          }
         }
       }
     #endif
@@ -1388,45 +1827,44 @@ namespace qristal
 
   // Convert a bit vector to an integer assuming either LSB or MSB encoding
   size_t session::bitstring_index(const std::vector<bool>& bitvec) {
+    if (bitvec.size() > std::numeric_limits<size_t>::digits) {
+      throw std::out_of_range("Unable to index a " + std::to_string(bitvec.size()) + "-bit bitstring with a " +
+                              std::to_string(std::numeric_limits<size_t>::digits) + "-bit integer.");
+    }
     size_t result = 0;
     if (all_bitstring_counts_ordered_by_MSB_) {
-      for (uint i = 0; i < bitvec.size(); i++) if (bitvec[i]) result += 1<<(bitvec.size()-i-1);
+      for (size_t i = 0; i < bitvec.size(); i++) if (bitvec[i]) result |= size_t(1) << (bitvec.size()-i-1);
     } else {
-      for (uint i = 0; i < bitvec.size(); i++) if (bitvec[i]) result += 1<<i;
+      for (size_t i = 0; i < bitvec.size(); i++) if (bitvec[i]) result |= size_t(1) << i;
     }
     return result;
   }
 
-  // Randomly draw (and remove) a single shot from the results map
-  std::vector<bool> session::draw_shot() {
+  // Save the results to the sparse bitstring counts, sorted by bitstring index
+  void session::populate_sparse_counts() {
+    std::vector<std::pair<uint64_t, int>> entries;
+    entries.reserve(results_.size());
+    for (size_t i = 0; i < results_.size(); i++) entries.emplace_back(bitstring_index(results_.outcome_at(i)), results_.counts()[i]);
+    std::ranges::sort(entries);
+    sparse_bitstring_indices_.resize(entries.size());
+    sparse_bitstring_counts_.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) std::tie(sparse_bitstring_indices_[i], sparse_bitstring_counts_[i]) = entries[i];
+  }
 
-    if (shots_remaining_ == 0) throw std::out_of_range("Unable to draw shot as no shots remain.");
-
-    // RNG
-    static std::random_device rd;
-    static std::mt19937 rng(rd());
-    std::uniform_int_distribution<> gen_shot_index(0, shots_remaining_-1);
-
-    // Randomly generate an integer representing the index of the shot to draw
-    const size_t shot_index = gen_shot_index(rng);
-
-    // Iterate through the results map entries until the drawn shot has been reached
-    size_t sum = 0;
-    std::vector<bool> bitvec;
-    for (auto entry = results_.begin(); entry != results_.end(); ++entry) {
-      assert(entry->second > 0);
-      sum += entry->second;
-      // If the drawn shot has been reached, save the bitvector and break the loop
-      if (sum >= shot_index) {
-        bitvec = entry->first;
-        // If this was the last shot for this bitvector, remove it
-        if (--(entry->second) == 0) results_.erase(entry);
-        break;
-      }
-    }
+  // Set up the sampler for drawing shots from the results map, if not already done since the last run
+  shot_sampler& session::get_shot_sampler() {
+    if (not shot_sampler_) shot_sampler_.emplace(results(), seed);
+    return *shot_sampler_;
+  }
+
+  // Randomly draw a single shot from the results map, without replacement
+  std::vector<bool> session::draw_shot() {
+    return get_shot_sampler().draw();
+  }
 
-    shots_remaining_--;
-    return bitvec;
+  // Randomly draw n shots from the results map, without replacement
+  std::vector<std::vector<bool>> session::draw_shots(size_t n) {
+    return get_shot_sampler().draw(n);
   }
 
 
@@ -1444,6 +1882,8 @@ namespace qristal
     // Generic options. XACC backends need qn and sn as ints, not size_ts.
     m.insert("n_qubits", static_cast<int>(qn));
     m.insert("output_oqm_enabled", output_oqm_enabled);
+    // Sessions keep the transpiled circuit in memory, and save it to output_oqm_dir (if set) in the background.
+    m.insert("output_oqm_in_memory", true);
     if (noise) {
       m.insert("noise-model", noise_model->to_json());
       m.insert("noise-model-name", noise_model->name);
@@ -12,38 +12,97 @@ namespace qristal {
   }
 
   const std::vector<int>& session::all_bitstring_counts() const {
-    return get_conditional(all_bitstring_counts_, calc_all_bitstring_counts, "all_bitstring_counts() requires calc_all_bitstring_counts = true.");
+    return get_conditional(all_bitstring_counts_, calc_all_bitstring_counts and not sparse_outputs,
+     "all_bitstring_counts() requires calc_all_bitstring_counts = true and sparse_outputs = false.");
   }
 
   const std::vector<double>& session::all_bitstring_probabilities() const {
-    return get_conditional(all_bitstring_probabilities_, calc_gradients, "all_bitstring_probabilities() requires calc_gradients = true.");
+    return get_conditional(all_bitstring_probabilities_, calc_gradients and not sparse_outputs,
+     "all_bitstring_probabilities() requires calc_gradients = true and sparse_outputs = false.");
   }
 
   const std::vector<std::vector<double>>& session::all_bitstring_probability_gradients() const {
-    return get_conditional(all_bitstring_probability_gradients_, calc_gradients, "all_bitstring_probability_gradients() requires calc_gradients = true.");
+    return get_conditional(all_bitstring_probability_gradients_, calc_gradients and not sparse_outputs,
+     "all_bitstring_probability_gradients() requires calc_gradients = true and sparse_outputs = false.");
+  }
+
+  const std::vector<uint64_t>& session::sparse_bitstring_indices() const {
+    return get_conditional(sparse_bitstring_indices_, calc_all_bitstring_counts and sparse_outputs,
+     "sparse_bitstring_indices() requires calc_all_bitstring_counts = true and sparse_outputs = true.");
+  }
+
+  const std::vector<int>& session::sparse_bitstring_counts() const {
+    return get_conditional(sparse_bitstring_counts_, calc_all_bitstring_counts and sparse_outputs,
+     "sparse_bitstring_counts() requires calc_all_bitstring_counts = true and sparse_outputs = true.");
+  }
+
+  const std::vector<double>& session::sparse_bitstring_probabilities() const {
+    return get_conditional(sparse_bitstring_probabilities_, calc_gradients and sparse_outputs,
+     "sparse_bitstring_probabilities() requires calc_gradients = true and sparse_outputs = true.");
+  }
+
+  const std::vector<std::vector<double>>& session::sparse_bitstring_probability_gradients() const {
+    return get_conditional(sparse_bitstring_probability_gradients_, calc_gradients and sparse_outputs,
+     "sparse_bitstring_probability_gradients() requires calc_gradients = true and sparse_outputs = true.");
+  }
+
+  double session::observable_expectation() const {
+    return get_conditional(observable_expectation_, calc_gradients and not gradient_observable.empty(),
+     "observable_expectation() requires calc_gradients = true and gradient_observable to be set.");
+  }
+
+  const std::vector<double>& session::observable_gradients() const {
+    return get_conditional(observable_gradients_, calc_gradients and not gradient_observable.empty(),
+     "observable_gradients() requires calc_gradients = true and gradient_observable to be set.");
   }
 
   const std::vector<std::complex<double>>& session::state_vec() const {
     return get_conditional(*state_vec_, calc_state_vec, "state_vec() requires calc_state_vec = true.");
   }
 
-  const std::map<std::vector<bool>,int>& session::results() const { return results_; }
+  const std::map<std::vector<bool>,int>& session::results() const {
+    std::lock_guard lock(results_map_.m);
+    if (results_map_.stale) {
+      results_map_.map = results_.to_map();
+      results_map_.stale = false;
+    }
+    return results_map_.map;
+  }
+
+  const packed_results& session::results_packed() const { return results_; }
 
   const std::map<std::vector<bool>,int>& session::results_native() const { return results_native_; }
 
-  std::string session::transpiled_circuit() const { return transpiled_circuit_; }
+  std::string session::transpiled_circuit() const { return profiled_outputs().transpiled_circuit; }
+
+  std::string session::output_oqm_file() const {
+    if (not deferred_outputs_ or deferred_outputs_->output_oqm_file.empty()) return "";
+    deferred_outputs_->output_oqm_written.get();
+    return deferred_outputs_->output_oqm_file;
+  }
 
   std::string session::qobj() const { return qobj_; }
 
   std::string session::qbjson() const { return qbjson_; }
 
-  std::map<int,int> session::one_qubit_gate_depths() const { return one_qubit_gate_depths_; }
+  std::map<int,int> session::one_qubit_gate_depths() const { return profiled_outputs().one_qubit_gate_depths; }
+
+  std::map<int,int> session::two_qubit_gate_depths() const { return profiled_outputs().two_qubit_gate_depths; }
 
-  std::map<int,int> session::two_qubit_gate_depths() const { return two_qubit_gate_depths_; }
+  std::map<int,double> session::timing_estimates() const { return profiled_outputs().timing_estimates; }
 
-  std::map<int,double> session::timing_estimates() const { return timing_estimates_; }
+  double session::z_op_expectation() const {
+    if (not deferred_outputs_) return 0;
+    std::call_once(deferred_outputs_->z_op_calculated, &deferred_outputs::calculate_z_op_expectation, deferred_outputs_.get());
+    return deferred_outputs_->z_op_expectation;
+  }
 
-  double session::z_op_expectation() const { return z_op_expectation_; }
+  const session::deferred_outputs& session::profiled_outputs() const {
+    static const deferred_outputs none;
+    if (not deferred_outputs_) return none;
+    std::call_once(deferred_outputs_->profiled, &deferred_outputs::profile, deferred_outputs_.get());
+    return *deferred_outputs_;
+  }
 
   void session::set_SPAM_confusion_matrix(Eigen::MatrixXd mat) { SPAM_correction_matrix = mat.inverse(); };
 
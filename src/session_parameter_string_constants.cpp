@@ -44,7 +44,8 @@ namespace qristal {
     "cudaq:qb_mps",
     "cudaq:qb_purification",
     "cudaq:qb_mpdo",
-    "aws-braket"
+    "aws-braket",
+    "sparse-sim"
   };
 
   /// Backends that *only* support noise, i.e. will not run with noise = false
@@ -106,5 +107,12 @@ namespace qristal {
     "QR",
     "Jacobian"
   };
+
+  const std::unordered_set<std::string_view> session::VALID_GRADIENT_METHODS = {
+    // Shifted runs of the circuit on the chosen backend
+    "parameter-shift",
+    // Exact, from the noiseless state vector
+    "adjoint"
+  };
 }
 
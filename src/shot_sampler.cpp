@@ -0,0 +1,87 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+#include <qristal/core/shot_sampler.hpp>
+
+// STL
+#include <stdexcept>
+#include <string>
+
+namespace qristal
+{
+
+  /// Constructor taking measurement counts and a seed for the random number generator
+  shot_sampler::shot_sampler(const std::map<outcome, int>& counts, uint64_t seed)
+  {
+    outcomes.reserve(counts.size());
+    tree.assign(counts.size() + 1, 0);
+
+    // Build the tree in linear time, by passing each node's partial sum on to its parent
+    size_t i = 1;
+    for (const auto& [bitvec, count] : counts)
+    {
+      if (count < 0) throw std::invalid_argument("Unable to draw shots from negative counts.");
+      outcomes.push_back(bitvec);
+      tree[i] += count;
+      shots_remaining += count;
+      const size_t parent = i + (i & -i);
+      if (parent < tree.size()) tree[parent] += tree[i];
+      i++;
+    }
+    while (top_step * 2 <= outcomes.size()) top_step = top_step ? top_step * 2 : 1;
+
+    // Mix a constant into the seed, so that the shots drawn are not correlated with a simulator seeded with the same value
+    std::seed_seq seq{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32), 0x73686f74u};
+    rng.seed(seq);
+  }
+
+  /// Number of shots remaining to be drawn
+  size_t shot_sampler::remaining() const
+  {
+    return shots_remaining;
+  }
+
+  /// Randomly draw (and remove) a single shot
+  const shot_sampler::outcome& shot_sampler::draw()
+  {
+    if (shots_remaining == 0) throw std::out_of_range("Unable to draw shot as no shots remain.");
+    return outcomes[draw_index()];
+  }
+
+  /// Randomly draw (and remove) n shots
+  std::vector<shot_sampler::outcome> shot_sampler::draw(size_t n)
+  {
+    if (n > shots_remaining)
+    {
+      throw std::out_of_range("Unable to draw " + std::to_string(n) + " shots as only " +
+                              std::to_string(shots_remaining) + " remain.");
+    }
+    std::vector<outcome> shots;
+    shots.reserve(n);
+    for (size_t i = 0; i < n; i++) shots.push_back(outcomes[draw_index()]);
+    return shots;
+  }
+
+  /// Draw the index of an outcome, and remove one shot of it from the tree
+  size_t shot_sampler::draw_index()
+  {
+    // Pick one of the remaining shots uniformly at random
+    size_t target = std::uniform_int_distribution<size_t>(0, shots_remaining - 1)(rng);
+
+    // Descend the tree to find the outcome that the shot belongs to
+    size_t pos = 0;
+    for (size_t step = top_step; step != 0; step >>= 1)
+    {
+      if (pos + step < tree.size() and tree[pos + step] <= target)
+      {
+        pos += step;
+        target -= tree[pos];
+      }
+    }
+
+    // Remove the shot
+    for (size_t i = pos + 1; i < tree.size(); i += (i & -i)) tree[i]--;
+    shots_remaining--;
+    return pos;
+  }
+
+}
@@ -2,7 +2,16 @@
 #include <qristal/core/thread_pool.hpp>
 
 #include <algorithm>
-#include <iostream>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+  /// The pool that the current thread works for (if any), and its position in that pool
+  thread_local const qristal::thread_pool* current_pool = nullptr;
+  thread_local size_t current_position = 0;
+}
 
 namespace qristal
 {
@@ -22,34 +31,55 @@ namespace qristal
   /// Set the number of threads to be maintained in the pool
   void thread_pool::set_num_threads_internal(const int n)
   {
-    // Do some housekeeping to clean out std::thread objects leftover from previously shrinking the pool
+    if (n < 1) throw std::invalid_argument("The thread pool must contain at least one thread.");
+
     {
-      std::scoped_lock<std::mutex> lock(threads_m);
-      // Erase any threads that have exited the loop() function already
-      threads.erase(std::remove_if(threads.begin(), threads.end(),
-       [](std::pair<std::thread, std::shared_ptr<bool>>& t)
-       {
-         // If the thread has finished running loop(), tell it to join in preparation for destruction
-         if (*t.second) t.first.join();
-         // Erase the thread if and only if it is done
-         return *t.second;
-       }),
-       threads.end());
+      std::unique_lock lock(workers_m);
 
       // Nothing else to do if num_threads is already equal to the value requested.
       if (num_threads == n) return;
 
       // More threads requested
-      if (n > num_active_threads)
+      if (n > num_threads)
       {
-        // Grow the thread vector
-        threads.resize(n);
-        // Create the new threads and set them to run thread_pool::loop
-        for (int i = num_active_threads; i < n; i++) threads.at(i) = initialise_thread();
+        for (size_t i = num_threads; i < size_t(n); i++)
+        {
+          if (i < workers.size())
+          {
+            // A worker left over from previously shrinking the pool. If it has already exited, start it again.
+            // Otherwise it is still finishing its last task, and will simply stay on once num_threads is raised.
+            if (workers[i]->done)
+            {
+              workers[i]->thread.join();
+              workers[i]->done = false;
+              initialise_thread(i);
+            }
+          }
+          else
+          {
+            // Create a new worker and set it running thread_pool::loop
+            workers.push_back(std::make_unique<worker>());
+            initialise_thread(i);
+          }
+        }
       }
-      // Update the overall number of threads
+
+      // Update the overall number of threads. Any workers at positions >= n will drain off when they next look for work.
       num_threads = n;
+
+      // Do some housekeeping to clean out workers that have already drained off after previously shrinking the pool
+      while (workers.size() > size_t(n) and workers.back()->done)
+      {
+        workers.back()->thread.join();
+        workers.pop_back();
+      }
     }
+
+    // Wake up any sleeping workers that are now surplus, so that they can drain off.
+    {
+      std::scoped_lock lock(sleep_m);
+    }
+    wake_up.notify_all();
   }
 
   /// Retrieve the number of threads to be maintained in the pool
@@ -68,74 +98,249 @@ namespace qristal
 
   /// Constructor
   thread_pool::thread_pool()
-   : num_threads(std::thread::hardware_concurrency()),
+   : num_threads(std::max(1u, std::thread::hardware_concurrency())),
+     pending_tasks(0),
+     next_worker(0),
      shutting_down(false)
   {
-    // Create all threads and set them to run thread_pool::loop
-    threads.resize(num_threads);
-    for (auto& t : threads) t = initialise_thread();
+    // Create all workers and set them to run thread_pool::loop
+    std::unique_lock lock(workers_m);
+    for (int i = 0; i < num_threads; i++)
+    {
+      workers.push_back(std::make_unique<worker>());
+      initialise_thread(i);
+    }
   }
 
   /// Destructor
   thread_pool::~thread_pool()
   {
     // Tell all threads to finish their current tasks and return from the loop
-    shutting_down = true;
+    {
+      std::scoped_lock lock(sleep_m);
+      shutting_down = true;
+    }
+    wake_up.notify_all();
     // Wait for them all to finish before finally destroying the assets of the pool.
-    for (auto& t : threads) t.first.join();
+    for (auto& w : workers) if (w->thread.joinable()) w->thread.join();
+  }
+
+  /// Start a worker thread at a given position in the pool. The caller must hold an exclusive lock on workers_m.
+  void thread_pool::initialise_thread(size_t position)
+  {
+    workers[position]->thread = std::thread(&thread_pool::loop, this, position);
+  }
+
+  /// Place a task in a worker's queue and wake a sleeping worker to run it
+  void thread_pool::enqueue(std::function<void()>&& task)
+  {
+    {
+      std::shared_lock lock(workers_m);
+      // Tasks submitted by a task already running in the pool go to the back of that worker's own queue, where
+      // the same worker is likely to pick them up next. Anything else is dealt out round-robin.
+      const size_t n = num_threads;
+      const size_t target = (current_pool == this and current_position < n) ? current_position : next_worker++ % n;
+      std::scoped_lock task_lock(workers[target]->tasks_m);
+      workers[target]->tasks.push_back(std::move(task));
+      pending_tasks++;
+    }
+
+    // Wake up a sleeping worker. Taking the lock here guarantees that the wake-up cannot be missed by a worker that
+    // has just checked pending_tasks and is about to go to sleep.
+    {
+      std::scoped_lock lock(sleep_m);
+    }
+    wake_up.notify_one();
   }
 
-  /// Initialise a thread-future pair
-  std::pair<std::thread, std::shared_ptr<bool>> thread_pool::initialise_thread()
+  /// Take a task from the back of a worker's own queue, or else steal one from the front of another worker's queue.
+  /// The caller must hold a shared lock on workers_m.
+  bool thread_pool::try_take(size_t position, std::function<void()>& task)
   {
-    // Define a flag used to indicate if the loop() member function is finished
-    std::shared_ptr<bool> done = std::make_shared<bool>(false);
-    // Define a thread that runs the loop() member function, passing the flag as input
-    std::thread thread(&thread_pool::loop, this, done);
-    // Increment the number of active threads
-    num_active_threads += 1;
-    // Return a pair of the thread and flag
-    return {std::move(thread), done};
+    // Look in this worker's own queue first
+    {
+      worker& self = *workers[position];
+      std::scoped_lock lock(self.tasks_m);
+      if (not self.tasks.empty())
+      {
+        task = std::move(self.tasks.back());
+        self.tasks.pop_back();
+        pending_tasks--;
+        return true;
+      }
+    }
+
+    // Steal from the other workers, starting with the next one along
+    const size_t n = workers.size();
+    for (size_t offset = 1; offset < n; offset++)
+    {
+      worker& victim = *workers[(position + offset) % n];
+      std::scoped_lock lock(victim.tasks_m);
+      if (not victim.tasks.empty())
+      {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        pending_tasks--;
+        return true;
+      }
+    }
+
+    return false;
   }
 
-  /// Work collector.  Each thread runs this indefinitely until the pool is destroyed.
-  void thread_pool::loop(std::shared_ptr<bool> done)
+  /// Move any tasks left in the queue of a retiring worker into the queues of the remaining workers.
+  /// The caller must hold an exclusive lock on workers_m, so the queues can be modified without their own locks.
+  void thread_pool::redistribute(size_t position)
   {
+    auto& leftovers = workers[position]->tasks;
+    const size_t n = num_threads;
+    while (not leftovers.empty())
+    {
+      workers[next_worker++ % n]->tasks.push_back(std::move(leftovers.front()));
+      leftovers.pop_front();
+    }
+  }
+
+  /// If the calling thread is one of the pool's workers, take a queued task and run it. Returns true if a task was run.
+  bool thread_pool::help()
+  {
+    if (current_pool != this) return false;
     std::function<void()> task;
-    bool work_pending = false;
+    {
+      std::shared_lock lock(workers_m);
+      if (not try_take(current_position, task)) return false;
+    }
+    task();
+    return true;
+  }
+
+  /// Work collector.  Each thread runs this until the pool is destroyed or shrunk below its position.
+  void thread_pool::loop(size_t position)
+  {
+    current_pool = this;
+    current_position = position;
 
     // Keep looking for tasks until the thread should drain off. When the
     // destructor starts, the shutting_down flag is set true and no more
-    // tasks are allocated to threads, even if the queue is not empty yet.
-    while (not shutting_down and not *done)
+    // tasks are allocated to threads, even if the queues are not empty yet.
+    while (not shutting_down)
     {
-      // Threadlocked block for updating the queue
+      // Determine if this thread should drain out because the pool got shrunk.
+      if (position >= size_t(num_threads))
       {
-        std::scoped_lock<std::mutex> lock(queue_m);
-        // Determine if there is work pending or not
-        work_pending = not queue.empty();
-        if (work_pending)
+        bool retired = false, leftovers = false;
         {
-          // There's work to do! Get the next task from the front of the queue.
-          task = queue.front();
-          queue.pop();
+          std::unique_lock lock(workers_m);
+          // Check again now that the pool cannot be resized underneath us
+          if (position >= size_t(num_threads))
+          {
+            leftovers = not workers[position]->tasks.empty();
+            redistribute(position);
+            workers[position]->done = retired = true;
+          }
+        }
+        if (retired)
+        {
+          // Make sure the tasks handed on from this worker get picked up
+          if (leftovers)
+          {
+            { std::scoped_lock lock(sleep_m); }
+            wake_up.notify_all();
+          }
+          return;
         }
       }
 
-      // Run the task just taken from the front of the queue.
-      if (work_pending) task();
+      // Look for a task
+      std::function<void()> task;
+      bool work_pending;
+      {
+        std::shared_lock lock(workers_m);
+        work_pending = try_take(position, task);
+      }
 
-      // Threadlocked block for reading and updating num_active_threads
+      // There's work to do! Run the task just taken from a queue.
+      if (work_pending)
       {
-        std::scoped_lock<std::mutex> lock(threads_m);
-        // Determine if this thread should drain out because the pool got shrunk.
-        if (num_active_threads > num_threads)
-        {
-          *done = true;
-          num_active_threads -= 1;
-        }
+        task();
+        continue;
       }
+
+      // Nothing to do; sleep until a task is submitted, the pool gets shrunk or the pool is destroyed.
+      std::unique_lock lock(sleep_m);
+      wake_up.wait(lock, [&]
+      {
+        return pending_tasks > 0 or shutting_down or position >= size_t(num_threads);
+      });
     }
   }
 
+
+  /// Constructor
+  task_group::task_group() : st(std::make_shared<state>()) {}
+
+  /// Destructor. Waits for all tasks in the group to finish.
+  task_group::~task_group()
+  {
+    try { wait(); }
+    catch (...) {}
+  }
+
+  /// Register tasks that are about to be added to the group
+  void task_group::add(size_t n)
+  {
+    std::scoped_lock lock(st->m);
+    st->outstanding += n;
+  }
+
+  /// Wait for all tasks in the group to finish, and rethrow the first exception thrown by any of them
+  void task_group::wait()
+  {
+    thread_pool& pool = thread_pool::get_instance();
+    std::unique_lock lock(st->m);
+    while (st->outstanding > 0)
+    {
+      // A worker that blocked here could end up waiting on tasks sitting in its own queue, so workers run queued
+      // tasks instead of sleeping. Only when there is nothing left to take do they wait for the group's tasks to
+      // finish on the other workers, checking back regularly in case those tasks submit more work.
+      lock.unlock();
+      const bool helped = pool.help();
+      lock.lock();
+      if (helped) continue;
+      if (current_pool == &pool) st->done.wait_for(lock, std::chrono::microseconds(100), [&]{ return st->outstanding == 0; });
+      else st->done.wait(lock, [&]{ return st->outstanding == 0; });
+    }
+
+    // Reset the group so that it can be reused, and pass on any exception
+    st->cancelled = false;
+    if (st->error) std::rethrow_exception(std::exchange(st->error, nullptr));
+  }
+
+  /// Skip all tasks in the group that have not started yet
+  void task_group::cancel()
+  {
+    st->cancelled = true;
+  }
+
+  /// Check whether the group has been cancelled, either explicitly or because one of its tasks threw
+  bool task_group::is_cancelled() const
+  {
+    return st->cancelled;
+  }
+
+  /// Record an exception thrown by a task, and cancel the rest of the group
+  void task_group::state::fail(std::exception_ptr e)
+  {
+    std::scoped_lock lock(m);
+    if (not error) error = e;
+    cancelled = true;
+  }
+
+  /// Mark one task as finished
+  void task_group::state::finish()
+  {
+    std::scoped_lock lock(m);
+    if (--outstanding == 0) done.notify_all();
+  }
+
 }
@@ -0,0 +1,58 @@
+// Copyright (c) Quantum Brilliance Pty Ltd
+
+// Gtest
+#include <gtest/gtest.h>
+
+// Qristal
+#include <qristal/core/profiler.hpp>
+
+// XACC
+#include <CommonGates.hpp>
+#include <xacc.hpp>
+
+TEST(ProfilerTester, criticalPathAndIdleTime) {
+  // q0: H ─■─ H
+  // q1: H ─X─
+  // q2: H ────────
+  constexpr double t1 = 1.0;
+  constexpr double t2 = 5.0;
+  auto provider = xacc::getIRProvider("quantum");
+  auto circuit = provider->createComposite("circuit");
+  circuit->addInstruction(std::make_shared<xacc::quantum::Hadamard>(0));
+  circuit->addInstruction(std::make_shared<xacc::quantum::Hadamard>(1));
+  circuit->addInstruction(std::make_shared<xacc::quantum::Hadamard>(2));
+  circuit->addInstruction(std::make_shared<xacc::quantum::CNOT>(0, 1));
+  circuit->addInstruction(std::make_shared<xacc::quantum::Hadamard>(0));
+  for (size_t q = 0; q < 3; q++) circuit->addInstruction(std::make_shared<xacc::quantum::Measure>(q));
+
+  qristal::Profiler profiler(circuit, 3, t1, t2);
+
+  // Measurements are left out of the schedule, as readout is timed separately.
+  const auto& schedule = profiler.get_schedule();
+  ASSERT_EQ(schedule.size(), 5);
+
+  // The CNOT depends on the first two Hadamards, and the last Hadamard on the CNOT.
+  EXPECT_EQ(schedule[3].predecessors, std::vector<size_t>({0, 1}));
+  EXPECT_EQ(schedule[4].predecessors, std::vector<size_t>({3}));
+
+  // ASAP and ALAP start times. Only the Hadamard on q2 has any slack.
+  EXPECT_DOUBLE_EQ(schedule[3].asap_start_ms, t1);
+  EXPECT_DOUBLE_EQ(schedule[4].asap_start_ms, t1 + t2);
+  EXPECT_DOUBLE_EQ(schedule[2].asap_start_ms, 0);
+  EXPECT_DOUBLE_EQ(schedule[2].alap_start_ms, 2*t1 + t2 - t1);
+  for (size_t i : {0, 1, 3, 4}) EXPECT_DOUBLE_EQ(schedule[i].slack_ms(), 0);
+
+  // Critical path: H(0) -> CNOT -> H(0)
+  EXPECT_EQ(profiler.get_critical_path(), std::vector<size_t>({0, 3, 4}));
+  EXPECT_DOUBLE_EQ(profiler.get_critical_path_time_ms(), 2*t1 + t2);
+
+  // Idle time on each qubit, up to the end of the critical path
+  const auto idle = profiler.get_idle_time_on_q();
+  EXPECT_DOUBLE_EQ(idle.at(0), 0);
+  EXPECT_DOUBLE_EQ(idle.at(1), t1);
+  EXPECT_DOUBLE_EQ(idle.at(2), t1 + t2);
+
+  // The gate part of the timing estimate follows the critical path.
+  const auto timing = profiler.get_total_initialisation_maxgate_readout_time_ms(0.0, 10);
+  EXPECT_DOUBLE_EQ(timing.at(profiler.KEY_MAX_DEPTH_GATE_TIME), 10 * (2*t1 + t2));
+}
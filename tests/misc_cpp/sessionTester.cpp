@@ -1,8 +1,17 @@
 // Copyright (c) Quantum Brilliance Pty Ltd
+#include <qristal/core/accelerator_pool.hpp>
+#include <qristal/core/bit_reversal.hpp>
 #include <qristal/core/circuit_builder.hpp>
+#include <qristal/core/compiled_ir_cache.hpp>
+#include <qristal/core/packed_results.hpp>
+#include <qristal/core/parameter_shift.hpp>
 #include <qristal/core/session.hpp>
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 #include <random>
+#include <sstream>
 
 TEST(sessionTester, test_small_angles_xasm_compilation) {
   auto my_sim = qristal::session();
@@ -383,4 +392,652 @@ TEST(sessionTester, test_infinite_shots) {
 
       check_identity_state_vector(stateVec, qn);
   }
-}
\ No newline at end of file
+}
+
+TEST(sessionTester, test_compiled_ir_cache) {
+  auto& cache = qristal::compiled_ir_cache::get_instance();
+  cache.clear();
+  cache.reset_counters();
+
+  qristal::session my_sim;
+  my_sim.acc = "qpp";
+  my_sim.qn = 2;
+  my_sim.sn = 1000;
+  my_sim.seed = 42;
+  my_sim.instring = R"(
+    __qpu__ void qristal_circuit(qreg q)
+    {
+      OPENQASM 2.0;
+      include "qelib1.inc";
+      creg c[2];
+      x q[0];
+      cx q[0],q[1];
+      measure q[0] -> c[0];
+      measure q[1] -> c[1];
+    }
+    )";
+
+  // The first run compiles the circuit; subsequent runs with different shot counts reuse it.
+  my_sim.run();
+  EXPECT_EQ(cache.misses(), 1);
+  EXPECT_EQ(cache.hits(), 0);
+  for (int shots : {1000, 500}) {
+    my_sim.sn = shots;
+    my_sim.run();
+    EXPECT_EQ(my_sim.results().at({1,1}), shots);
+  }
+  EXPECT_EQ(cache.misses(), 1);
+  EXPECT_EQ(cache.hits(), 2);
+  EXPECT_EQ(cache.size(), 1);
+
+  // Changing the number of qubits means a different compiled circuit.
+  my_sim.qn = 3;
+  my_sim.run();
+  EXPECT_EQ(cache.misses(), 2);
+  EXPECT_EQ(cache.size(), 2);
+
+  // The least recently used circuit is evicted when the cache shrinks, and a capacity of zero disables the cache.
+  cache.set_capacity(1);
+  EXPECT_EQ(cache.size(), 1);
+  cache.set_capacity(0);
+  my_sim.run();
+  EXPECT_EQ(cache.misses(), 2);
+  EXPECT_EQ(cache.hits(), 2);
+  EXPECT_EQ(cache.size(), 0);
+  cache.set_capacity(256);
+}
+
+TEST(sessionTester, test_compiled_ir_cache_includes) {
+  // Editing a file included by a circuit must not return the circuit compiled from its old contents.
+  auto& cache = qristal::compiled_ir_cache::get_instance();
+  cache.clear();
+  cache.reset_counters();
+
+  const std::string include_file = "compiled_ir_cache_test.inc";
+  auto write_include = [&](const std::string& gate_body) {
+    std::ofstream ofs(include_file);
+    ofs << "gate flip a { " << gate_body << " }" << std::endl;
+  };
+
+  qristal::session my_sim;
+  my_sim.acc = "qpp";
+  my_sim.qn = 1;
+  my_sim.sn = 100;
+  my_sim.instring = R"(
+    __qpu__ void qristal_circuit(qreg q)
+    {
+      OPENQASM 2.0;
+      include "compiled_ir_cache_test.inc";
+      creg c[1];
+      flip q[0];
+      measure q[0] -> c[0];
+    }
+    )";
+
+  write_include("U(pi,0,pi) a;");
+  my_sim.run();
+  EXPECT_EQ(my_sim.results().at({1}), 100);
+  my_sim.run();
+  EXPECT_EQ(cache.hits(), 1);
+
+  write_include("U(0,0,0) a;");
+  my_sim.run();
+  EXPECT_EQ(cache.misses(), 2);
+  EXPECT_EQ(my_sim.results().at({0}), 100);
+
+  std::filesystem::remove(include_file);
+}
+
+TEST(sessionTester, test_run_batch) {
+  constexpr size_t num_qubits = 5;
+  constexpr size_t num_circuits = 40;
+
+  // Circuit i flips the qubits corresponding to the set bits of i, so every circuit has a different deterministic result.
+  std::vector<qristal::CircuitBuilder> circuits(num_circuits);
+  std::vector<std::string> sources(num_circuits);
+  for (size_t i = 0; i < num_circuits; i++) {
+    std::ostringstream src;
+    src << "OPENQASM 2.0;\ninclude \"qelib1.inc\";\nqreg q[" << num_qubits << "];\ncreg c[" << num_qubits << "];\n";
+    for (size_t q = 0; q < num_qubits; q++) {
+      if ((i >> q) & 1) {
+        circuits[i].X(q);
+        src << "x q[" << q << "];\n";
+      }
+    }
+    circuits[i].MeasureAll(num_qubits);
+    src << "measure q -> c;\n";
+    sources[i] = src.str();
+  }
+
+  qristal::session my_sim;
+  my_sim.acc = "qpp";
+  my_sim.qn = num_qubits;
+  my_sim.sn = 100;
+
+  const auto check = [&](const std::vector<qristal::session>& batch) {
+    ASSERT_EQ(batch.size(), num_circuits);
+    for (size_t i = 0; i < num_circuits; i++) {
+      std::vector<bool> expected(num_qubits);
+      for (size_t q = 0; q < num_qubits; q++) expected[q] = (i >> q) & 1;
+      const auto& results = batch[i].results();
+      ASSERT_EQ(results.size(), 1);
+      EXPECT_EQ(results.begin()->first, expected);
+      EXPECT_EQ(results.begin()->second, my_sim.sn);
+    }
+  };
+
+  check(my_sim.run_batch(circuits));
+  check(my_sim.run_batch(sources));
+
+  // Errors in any one circuit are passed on to the caller.
+  sources.back() = "OPENQASM 2.0;\ninclude \"qelib1.inc\";\nqreg q[5];\nnot_a_gate q[0];\n";
+  EXPECT_ANY_THROW(my_sim.run_batch(sources));
+}
+
+TEST(sessionTester, test_accelerator_pool) {
+  auto& pool = qristal::accelerator_pool::get_instance();
+  pool.clear();
+  pool.reset_counters();
+
+  qristal::session my_sim;
+  my_sim.acc = "sparse-sim";
+  my_sim.qn = 2;
+  my_sim.sn = 100;
+  qristal::CircuitBuilder circuit;
+  circuit.X(0);
+  circuit.CNOT(0, 1);
+  circuit.MeasureAll(2);
+  my_sim.irtarget = circuit.get();
+
+  // The first run sets up a new accelerator and hands it to the pool afterwards; later runs take it back out.
+  for (int i = 0; i < 3; i++) {
+    my_sim.run();
+    EXPECT_EQ(my_sim.results().at({1,1}), my_sim.sn);
+    EXPECT_EQ(pool.size(), 1);
+  }
+  EXPECT_EQ(pool.misses(), 1);
+  EXPECT_EQ(pool.hits(), 2);
+
+  // Settings passed on to the accelerator before every run (e.g. the shot count) don't need a new accelerator.
+  my_sim.sn = 50;
+  my_sim.run();
+  EXPECT_EQ(my_sim.results().at({1,1}), 50);
+  EXPECT_EQ(pool.hits(), 3);
+  EXPECT_EQ(pool.size(), 1);
+
+  // Accelerators shared by the XACC service registry (e.g. qpp) never go into the pool.
+  my_sim.acc = "qpp";
+  my_sim.run();
+  EXPECT_EQ(my_sim.results().at({1,1}), 50);
+  EXPECT_EQ(pool.size(), 1);
+
+  // A capacity of zero disables the pool.
+  pool.set_capacity(0);
+  EXPECT_EQ(pool.size(), 0);
+  my_sim.acc = "sparse-sim";
+  my_sim.run();
+  EXPECT_EQ(pool.size(), 0);
+  EXPECT_EQ(pool.hits(), 3);
+  pool.set_capacity(16);
+}
+
+TEST(sessionTester, test_sparse_sim_default_noise) {
+  // The default noise model defines depolarizing noise on the QObj basis gates (u1, u2, u3 and cx), so a long chain
+  // of H or X gates flips many more shots than the 1% readout error alone, once transpiled to those gates.
+  const size_t nb_gates = 200;
+  qristal::CircuitBuilder circuit;
+  for (size_t i = 0; i < nb_gates; i++) {
+    circuit.H(0);
+    circuit.X(1);
+  }
+  circuit.MeasureAll(2);
+
+  qristal::session my_sim;
+  my_sim.acc = "sparse-sim";
+  my_sim.qn = 2;
+  my_sim.sn = 4000;
+  my_sim.noise = true;
+  my_sim.irtarget = circuit.get();
+  my_sim.run();
+
+  int total = 0;
+  std::vector<int> ones(2, 0);
+  for (const auto& [bits, count] : my_sim.results()) {
+    total += count;
+    for (size_t q = 0; q < 2; q++) ones[q] += bits[q] * count;
+  }
+  EXPECT_EQ(total, my_sim.sn);
+  for (size_t q = 0; q < 2; q++) {
+    EXPECT_GT(double(ones[q]) / total, 0.05);
+    EXPECT_LT(double(ones[q]) / total, 0.2);
+  }
+}
+
+TEST(sessionTester, test_deferred_outputs) {
+  qristal::session my_sim;
+  my_sim.acc = "qpp";
+  my_sim.qn = 2;
+  my_sim.sn = 100;
+  qristal::CircuitBuilder circuit;
+  circuit.X(0);
+  circuit.CNOT(0, 1);
+  circuit.MeasureAll(2);
+  my_sim.irtarget = circuit.get();
+
+  // Nothing has been run yet, so there is nothing to report.
+  EXPECT_TRUE(my_sim.transpiled_circuit().empty());
+  EXPECT_TRUE(my_sim.timing_estimates().empty());
+
+  // The outputs are worked out on first access after a run, and are the same on every later access.
+  my_sim.run();
+  const std::string transpiled = my_sim.transpiled_circuit();
+  EXPECT_FALSE(transpiled.empty());
+  EXPECT_EQ(my_sim.transpiled_circuit(), transpiled);
+  EXPECT_FALSE(my_sim.one_qubit_gate_depths().empty());
+  EXPECT_EQ(my_sim.timing_estimates().size(), 6);
+  EXPECT_DOUBLE_EQ(my_sim.z_op_expectation(), 1.0);
+
+  // Copies share the outputs of the run.
+  const qristal::session copy = my_sim;
+  EXPECT_EQ(copy.transpiled_circuit(), transpiled);
+
+  // A new run replaces them.
+  qristal::CircuitBuilder circuit2;
+  circuit2.X(0);
+  circuit2.MeasureAll(2);
+  my_sim.irtarget = circuit2.get();
+  my_sim.run();
+  EXPECT_NE(my_sim.transpiled_circuit(), transpiled);
+  EXPECT_DOUBLE_EQ(my_sim.z_op_expectation(), -1.0);
+  EXPECT_EQ(copy.transpiled_circuit(), transpiled);
+
+  // Changes made to the circuit after a run do not show up in the outputs of that run.
+  qristal::CircuitBuilder circuit3;
+  circuit3.X(0);
+  circuit3.MeasureAll(2);
+  my_sim.irtarget = circuit3.get();
+  my_sim.run();
+  qristal::session unmodified = my_sim;
+  unmodified.irtarget = circuit2.get();
+  unmodified.run();
+  circuit3.H(1);
+  circuit3.CNOT(0, 1);
+  EXPECT_EQ(my_sim.transpiled_circuit(), unmodified.transpiled_circuit());
+  EXPECT_EQ(my_sim.two_qubit_gate_depths(), unmodified.two_qubit_gate_depths());
+  EXPECT_TRUE(my_sim.two_qubit_gate_depths().empty());
+
+  // Transpilation and resource estimation can still be switched off altogether.
+  my_sim.output_oqm_enabled = false;
+  my_sim.run();
+  EXPECT_TRUE(my_sim.transpiled_circuit().empty());
+  EXPECT_TRUE(my_sim.timing_estimates().empty());
+}
+
+TEST(sessionTester, test_output_oqm_dir) {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "qristal_test_output_oqm_dir";
+  std::filesystem::remove_all(dir);
+
+  qristal::session my_sim;
+  my_sim.acc = "qpp";
+  my_sim.qn = 2;
+  my_sim.sn = 100;
+  qristal::CircuitBuilder circuit;
+  circuit.X(0);
+  circuit.CNOT(0, 1);
+  circuit.MeasureAll(2);
+  my_sim.irtarget = circuit.get();
+
+  // By default, the transpiled circuit is only kept in memory.
+  my_sim.run();
+  EXPECT_FALSE(my_sim.transpiled_circuit().empty());
+  EXPECT_TRUE(my_sim.output_oqm_file().empty());
+
+  // If a directory is given, each run saves the transpiled circuit to a file of its own.
+  my_sim.output_oqm_dir = dir.string();
+  my_sim.run();
+  const std::string first = my_sim.output_oqm_file();
+  my_sim.run();
+  const std::string second = my_sim.output_oqm_file();
+  EXPECT_NE(first, second);
+  for (const auto& file : {first, second}) {
+    EXPECT_EQ(std::filesystem::path(file).parent_path(), dir);
+    std::ifstream in(file);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    EXPECT_EQ(contents.str(), my_sim.transpiled_circuit() + "\n");
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST(sessionTester, test_draw_shots) {
+  qristal::session my_sim;
+  my_sim.acc = "qpp";
+  my_sim.qn = 3;
+  my_sim.sn = 1000;
+  my_sim.seed = 17;
+  qristal::CircuitBuilder circuit;
+  for (size_t q = 0; q < 3; q++) circuit.H(q);
+  circuit.MeasureAll(3);
+  my_sim.irtarget = circuit.get();
+  my_sim.run();
+
+  // Draws in bulk and one at a time come from the same stream, and together give back all the shots.
+  std::map<std::vector<bool>, int> my_results;
+  const auto first = my_sim.draw_shots(400);
+  EXPECT_EQ(first.size(), 400);
+  for (const auto& shot : first) my_results[shot]++;
+  for (int i = 0; i < 100; i++) my_results[my_sim.draw_shot()]++;
+  EXPECT_THROW(my_sim.draw_shots(501), std::out_of_range);
+  for (const auto& shot : my_sim.draw_shots(500)) my_results[shot]++;
+  EXPECT_EQ(my_results, my_sim.results());
+  EXPECT_THROW(my_sim.draw_shot(), std::out_of_range);
+
+  // Draws from the same results with the same seed are reproducible.
+  qristal::session copy = my_sim;
+  my_sim.run();
+  copy.run();
+  EXPECT_EQ(my_sim.results(), copy.results());
+  EXPECT_EQ(my_sim.draw_shots(1000), copy.draw_shots(1000));
+}
+
+TEST(sessionTester, test_multi_frequency_gradients) {
+  /***
+  Tests gradients with respect to parameters whose circuit outputs have several frequencies,
+  which the two-term parameter-shift rule gets wrong.
+
+  Circuit 1: H on both qubits, CRZ(theta) from qubit 0 to qubit 1, then H on qubit 1.
+  P(q0=1,q1=1) = sin^2(theta/2)/2, so dP/dtheta = sin(theta)/4, and P(q0=1,q1=0) has the opposite gradient.
+
+  Circuit 2: the same parameter in two RX gates on qubit 0, i.e. RX(2*alpha).
+  P(q0=1) = sin^2(alpha), so dP/dalpha = sin(2*alpha).
+  ***/
+  const double theta = M_PI / 3;
+  qristal::CircuitBuilder crz;
+  crz.H(0);
+  crz.H(1);
+  crz.CRZ(0, 1, "theta");
+  crz.H(1);
+  crz.MeasureAll(2);
+
+  qristal::session my_sim;
+  my_sim.qn = 2;
+  my_sim.sn = 100000;
+  my_sim.acc = "qpp";
+  my_sim.seed = 1000;
+  my_sim.calc_gradients = true;
+  my_sim.irtarget = crz.get();
+  my_sim.circuit_parameters = {theta};
+  my_sim.run();
+  auto gradients = my_sim.all_bitstring_probability_gradients();
+  ASSERT_EQ(gradients.size(), 1);
+  EXPECT_NEAR(gradients[0][my_sim.bitstring_index({1,1})], std::sin(theta) / 4, 0.01);
+  EXPECT_NEAR(gradients[0][my_sim.bitstring_index({1,0})], -std::sin(theta) / 4, 0.01);
+  EXPECT_NEAR(gradients[0][my_sim.bitstring_index({0,0})], 0.0, 0.01);
+
+  const double alpha = 0.3;
+  qristal::CircuitBuilder repeated;
+  repeated.RX(0, "alpha");
+  repeated.RX(0, "alpha");
+  repeated.MeasureAll(2);
+  my_sim.irtarget = repeated.get();
+  my_sim.circuit_parameters = {alpha};
+  my_sim.run();
+  gradients = my_sim.all_bitstring_probability_gradients();
+  EXPECT_NEAR(gradients[0][my_sim.bitstring_index({1,0})], std::sin(2 * alpha), 0.01);
+  EXPECT_NEAR(gradients[0][my_sim.bitstring_index({0,0})], -std::sin(2 * alpha), 0.01);
+}
+
+TEST(sessionTester, test_controlled_block_spectra) {
+  /***
+  Tests that parameters inside controlled-unitary blocks get the frequencies 1/2 and 1, like controlled rotations,
+  rather than being treated as bare rotation parameters.
+  ***/
+  qristal::CircuitBuilder base;
+  base.RY(1, "theta");
+  qristal::CircuitBuilder circuit;
+  circuit.H(0);
+  circuit.RY(1, "theta");
+  circuit.RY(1, "phi");
+  circuit.CU(base, {0});
+
+  const auto variables = circuit.get()->getVariables();
+  ASSERT_EQ(variables, (std::vector<std::string>{"theta", "phi"}));
+  const auto spectra = qristal::parameter_shift::spectra(circuit.get());
+  ASSERT_EQ(spectra.size(), 2);
+  // theta: one bare rotation and one controlled rotation, so the multiples of 1/2 up to 2
+  EXPECT_EQ(spectra[0].base_frequency, 0.5);
+  EXPECT_EQ(spectra[0].max_multiple, 4);
+  // phi: a single bare rotation
+  EXPECT_EQ(spectra[1].base_frequency, 1.0);
+  EXPECT_EQ(spectra[1].max_multiple, 1);
+  EXPECT_EQ(qristal::parameter_shift::rule(spectra[0]).size(), 8);
+
+  // A gate parameter that is not a free parameter of the circuit cannot be differentiated, so it is rejected rather
+  // than given a gradient of zero.
+  qristal::CircuitBuilder hidden;
+  hidden.RY(0, "phi");
+  hidden.CU(base, {0});
+  EXPECT_THROW(qristal::parameter_shift::spectra(hidden.get()), std::invalid_argument);
+}
+
+TEST(sessionTester, test_sparse_outputs) {
+  /***
+  Tests sparse outputs indexed by bitstring, on a 40-qubit GHZ state (too large for dense outputs, and for 32-bit
+  indices), and for gradients on the CRZ circuit of test_multi_frequency_gradients.
+  ***/
+  constexpr size_t n = 40;
+  qristal::CircuitBuilder ghz;
+  ghz.H(0);
+  for (size_t q = 0; q + 1 < n; q++) ghz.CNOT(q, q + 1);
+  ghz.MeasureAll(n);
+
+  qristal::session my_sim;
+  my_sim.qn = n;
+  my_sim.sn = 1000;
+  my_sim.acc = "sparse-sim";
+  my_sim.calc_all_bitstring_counts = true;
+  my_sim.sparse_outputs = true;
+  my_sim.irtarget = ghz.get();
+  my_sim.run();
+  const uint64_t all_ones = (uint64_t(1) << n) - 1;
+  EXPECT_EQ(my_sim.bitstring_index(std::vector<bool>(n, true)), all_ones);
+  ASSERT_EQ(my_sim.sparse_bitstring_indices().size(), 2);
+  EXPECT_EQ(my_sim.sparse_bitstring_indices()[0], 0);
+  EXPECT_EQ(my_sim.sparse_bitstring_indices()[1], all_ones);
+  const auto& counts = my_sim.sparse_bitstring_counts();
+  EXPECT_EQ(counts[0] + counts[1], 1000);
+  EXPECT_THROW(my_sim.all_bitstring_counts(), std::logic_error);
+
+  const double theta = M_PI / 3;
+  qristal::CircuitBuilder crz;
+  crz.H(0);
+  crz.H(1);
+  crz.CRZ(0, 1, "theta");
+  crz.H(1);
+  crz.MeasureAll(2);
+  my_sim.qn = 2;
+  my_sim.sn = 100000;
+  my_sim.acc = "qpp";
+  my_sim.seed = 1000;
+  my_sim.calc_gradients = true;
+  my_sim.irtarget = crz.get();
+  my_sim.circuit_parameters = {theta};
+  my_sim.run();
+  const auto& indices = my_sim.sparse_bitstring_indices();
+  const auto& gradients = my_sim.sparse_bitstring_probability_gradients();
+  ASSERT_EQ(gradients.size(), 1);
+  ASSERT_EQ(gradients[0].size(), indices.size());
+  ASSERT_EQ(my_sim.sparse_bitstring_probabilities().size(), indices.size());
+  const size_t i11 = std::ranges::find(indices, my_sim.bitstring_index({1,1})) - indices.begin();
+  ASSERT_LT(i11, indices.size());
+  EXPECT_NEAR(gradients[0][i11], std::sin(theta) / 4, 0.01);
+}
+
+TEST(sessionTester, test_adjoint_gradients) {
+  /***
+  Tests exact adjoint gradients, on the same circuits as test_multi_frequency_gradients.
+
+  Circuit 1: dP(q0=1,q1=1)/dtheta = sin(theta)/4, with the bitstring indices reversed when ordered by MSB.
+  Circuit 2: <Z0> = cos(2*alpha), so d<Z0>/dalpha = -2*sin(2*alpha).
+  ***/
+  const double theta = M_PI / 3;
+  qristal::CircuitBuilder crz;
+  crz.H(0);
+  crz.H(1);
+  crz.CRZ(0, 1, "theta");
+  crz.H(1);
+  crz.MeasureAll(2);
+
+  for (bool msb : {false, true}) {
+    qristal::session my_sim(msb);
+    my_sim.qn = 2;
+    my_sim.sn = 1000;
+    my_sim.acc = "qpp";
+    my_sim.calc_gradients = true;
+    my_sim.gradient_method = "adjoint";
+    my_sim.irtarget = crz.get();
+    my_sim.circuit_parameters = {theta};
+    my_sim.run();
+    auto gradients = my_sim.all_bitstring_probability_gradients();
+    ASSERT_EQ(gradients.size(), 1);
+    EXPECT_NEAR(gradients[0][my_sim.bitstring_index({1,1})], std::sin(theta) / 4, 1e-10);
+    EXPECT_NEAR(gradients[0][my_sim.bitstring_index({1,0})], -std::sin(theta) / 4, 1e-10);
+    EXPECT_NEAR(gradients[0][my_sim.bitstring_index({0,0})], 0.0, 1e-10);
+    EXPECT_NEAR(gradients[0][my_sim.bitstring_index({0,1})], 0.0, 1e-10);
+  }
+
+  const double alpha = 0.3;
+  qristal::CircuitBuilder repeated;
+  repeated.RX(0, "alpha");
+  repeated.RX(0, "alpha");
+  repeated.MeasureAll(2);
+
+  qristal::session my_sim;
+  my_sim.qn = 2;
+  my_sim.sn = 1000;
+  my_sim.acc = "qpp";
+  my_sim.calc_gradients = true;
+  my_sim.gradient_method = "adjoint";
+  my_sim.gradient_observable = "1.0 Z0";
+  my_sim.irtarget = repeated.get();
+  my_sim.circuit_parameters = {alpha};
+  my_sim.run();
+  EXPECT_NEAR(my_sim.observable_expectation(), std::cos(2 * alpha), 1e-10);
+  ASSERT_EQ(my_sim.observable_gradients().size(), 1);
+  EXPECT_NEAR(my_sim.observable_gradients()[0], -2 * std::sin(2 * alpha), 1e-10);
+
+  // Adjoint gradients are only available without noise
+  my_sim.noise = true;
+  EXPECT_THROW(my_sim.run(), std::invalid_argument);
+}
+
+TEST(sessionTester, test_packed_results) {
+  /***
+  Tests the packed results container: conversion from backend bitstrings in both qubit orders, lookup, merging and
+  conversion to a map, including outcomes that span more than one 64-bit word, and that the results of a session
+  match their packed form.
+  ***/
+  constexpr size_t n = 70;
+  std::string a(n, '0'), b(n, '0');
+  a[0] = '1';
+  b[n - 1] = '1';
+  b[64] = '1';
+  const std::map<std::string, int> counts{{a, 3}, {b, 5}};
+
+  for (bool qubit0_left : {false, true}) {
+    auto packed = qristal::packed_results::from_bitstrings(counts, n, qubit0_left);
+    ASSERT_EQ(packed.size(), 2);
+    EXPECT_EQ(packed.bits(), n);
+    EXPECT_EQ(packed.words_per_outcome(), 2);
+    EXPECT_EQ(packed.total(), 8);
+    std::vector<bool> bits_a(n, false);
+    bits_a[qubit0_left ? 0 : n - 1] = true;
+    EXPECT_EQ(packed.count(bits_a), 3);
+    EXPECT_EQ(packed.count(std::vector<bool>(n, false)), 0);
+
+    // Converting to a map and back is lossless, and keeps the map order
+    const auto map = packed.to_map();
+    EXPECT_EQ(qristal::packed_results(map), packed);
+    std::vector<std::vector<bool>> outcomes;
+    for (const auto& [words, count] : packed) outcomes.push_back(qristal::packed_results::entry{words, count}.bits(n));
+    std::vector<std::vector<bool>> map_outcomes;
+    for (const auto& [outcome, count] : map) map_outcomes.push_back(outcome);
+    EXPECT_EQ(outcomes, map_outcomes);
+
+    // Merging adds the counts of shared outcomes and keeps the others
+    qristal::packed_results other(n);
+    other.add(bits_a, 2);
+    other.add(std::vector<bool>(n, true), 1);
+    packed.merge(other);
+    EXPECT_EQ(packed.size(), 3);
+    EXPECT_EQ(packed.count(bits_a), 5);
+    EXPECT_EQ(packed.count(std::vector<bool>(n, true)), 1);
+    EXPECT_EQ(packed.total(), 11);
+    EXPECT_THROW(packed.merge(qristal::packed_results::from_bitstrings(counts, n - 1, qubit0_left)), std::invalid_argument);
+    EXPECT_THROW(qristal::packed_results::from_bitstrings(counts, n + 1, qubit0_left), std::out_of_range);
+  }
+
+  qristal::CircuitBuilder circuit;
+  for (size_t q = 0; q < 4; q++) circuit.H(q);
+  circuit.MeasureAll(4);
+  qristal::session my_sim;
+  my_sim.qn = 4;
+  my_sim.sn = 1000;
+  my_sim.acc = "qpp";
+  my_sim.irtarget = circuit.get();
+  my_sim.run();
+  EXPECT_EQ(my_sim.results_packed().to_map(), my_sim.results());
+  EXPECT_EQ(my_sim.results_packed().total(), 1000);
+
+  // A reference to the results map stays valid across runs, and shows the new results once they are asked for again
+  const auto& results = my_sim.results();
+  my_sim.sn = 500;
+  my_sim.run();
+  EXPECT_EQ(&my_sim.results(), &results);
+  EXPECT_EQ(my_sim.results_packed().to_map(), results);
+  EXPECT_EQ(my_sim.results_packed().total(), 500);
+}
+
+TEST(sessionTester, test_bit_reversal) {
+  /***
+  Tests the in-place bit-reversal permutation, on vectors small enough to be permuted serially, large enough to be
+  tiled and large enough to be tiled on the thread pool, and on the state vector of a session ordered by MSB.
+  ***/
+  for (size_t n : {0, 1, 5, 9, 16}) {
+    const size_t size = size_t(1) << n;
+    std::vector<std::complex<double>> amplitudes(size);
+    std::vector<double> probabilities(size);
+    for (size_t i = 0; i < size; i++) {
+      amplitudes[i] = {double(i), -double(i)};
+      probabilities[i] = i;
+    }
+    qristal::bit_reverse_permute(amplitudes);
+    qristal::bit_reverse_permute(probabilities);
+    for (size_t i = 0; i < size; i++) {
+      const size_t j = qristal::reverse_bits(i, n);
+      EXPECT_EQ(amplitudes[j], std::complex<double>(double(i), -double(i)));
+      EXPECT_EQ(probabilities[j], double(i));
+    }
+  }
+  std::vector<double> not_power_of_two(3);
+  EXPECT_THROW(qristal::bit_reverse_permute(not_power_of_two), std::invalid_argument);
+
+  constexpr size_t n = 16;
+  qristal::CircuitBuilder circuit;
+  circuit.X(0);
+  circuit.X(3);
+  circuit.MeasureAll(n);
+  for (bool MSB : {true, false}) {
+    qristal::session my_sim(MSB);
+    my_sim.qn = n;
+    my_sim.sn = 100;
+    my_sim.acc = "qpp";
+    my_sim.irtarget = circuit.get();
+    my_sim.calc_state_vec = true;
+    my_sim.run();
+    const size_t index = my_sim.bitstring_index({1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0});
+    EXPECT_EQ(index, MSB ? (size_t(1) << 15) + (size_t(1) << 12) : 9);
+    EXPECT_NEAR(std::abs(my_sim.state_vec().at(index)), 1.0, 1e-12);
+  }
+}
@@ -7,6 +7,7 @@
 #include <Eigen/Dense>
 #include <unsupported/Eigen/KroneckerProduct>
 
+#include <qristal/core/noise_model/compiled_noise_model.hpp>
 #include <qristal/core/noise_model/noise_model.hpp>
 #include <qristal/core/primitives.hpp>
 
@@ -309,6 +310,109 @@ TEST(NoiseModelTester, checkJsonNoiseModel) {
   }
 }
 
+TEST(NoiseModelTester, checkCompiledNoiseModel) {
+  // Every channel of the default noise model is found in its compiled form
+  size_t nb_qubits = 3;
+  qristal::NoiseModel noise_model("default", nb_qubits);
+  // Add noise for any operands of one gate, overridden on one qubit, and noise on three qubits of another gate
+  noise_model.add_gate_error(qristal::DepolarizingChannel::Create(0, 0.01), "h", {});
+  noise_model.add_gate_error(qristal::AmplitudeDampingChannel::Create(1, 0.1), "h", {1});
+  noise_model.add_gate_error(qristal::AmplitudeDampingChannel::Create(2, 0.1), "ccx", {0, 1, 2});
+  const qristal::CompiledNoiseModel compiled(noise_model);
+  EXPECT_EQ(compiled.nb_qubits(), nb_qubits);
+
+  const auto same = [](const std::vector<qristal::NoiseChannel> &channels1,
+                       const std::vector<qristal::NoiseChannel> &channels2) {
+    if (channels1.size() != channels2.size()) return false;
+    for (size_t i = 0; i < channels1.size(); i++) {
+      if (channels1[i].size() != channels2[i].size()) return false;
+      for (size_t j = 0; j < channels1[i].size(); j++) {
+        if (channels1[i][j].matrix != channels2[i][j].matrix or
+            channels1[i][j].qubits != channels2[i][j].qubits) return false;
+      }
+    }
+    return true;
+  };
+  for (const auto &[gate_name, operands_to_noise_channels] : noise_model.get_noise_channels()) {
+    const size_t gate = compiled.gate_index(gate_name);
+    ASSERT_NE(gate, qristal::CompiledNoiseModel::no_gate);
+    for (const auto &[qubits, channels] : operands_to_noise_channels) {
+      const auto *compiled_channels = compiled.channels(gate, qubits);
+      ASSERT_NE(compiled_channels, nullptr);
+      EXPECT_TRUE(same(*compiled_channels, channels));
+    }
+  }
+
+  // Basis gates have fixed indices
+  EXPECT_EQ(compiled.gate_index("cx"), static_cast<size_t>(qristal::CompiledNoiseModel::Gate::cx));
+  EXPECT_EQ(compiled.channels(qristal::CompiledNoiseModel::Gate::cx, std::vector<size_t>{0, 1}),
+            compiled.channels(compiled.gate_index("cx"), std::vector<size_t>{0, 1}));
+  // Operands without their own noise fall back to the noise for any operands, if there is any
+  const size_t h = compiled.gate_index("h");
+  EXPECT_EQ(compiled.channels(h, std::vector<size_t>{0}), compiled.channels(h, std::vector<size_t>{}));
+  EXPECT_EQ(compiled.channels(h, std::vector<size_t>{7}), compiled.channels(h, std::vector<size_t>{}));
+  EXPECT_NE(compiled.channels(h, std::vector<size_t>{1}), compiled.channels(h, std::vector<size_t>{}));
+  EXPECT_EQ(compiled.channels(compiled.gate_index("ccx"), std::vector<size_t>{1, 0, 2}), nullptr);
+  EXPECT_EQ(compiled.channels(qristal::CompiledNoiseModel::Gate::swap, std::vector<size_t>{0, 1}), nullptr);
+  EXPECT_EQ(compiled.gate_index("not_a_gate"), qristal::CompiledNoiseModel::no_gate);
+  EXPECT_EQ(compiled.channels(qristal::CompiledNoiseModel::no_gate, std::vector<size_t>{0}), nullptr);
+
+  // Readout errors are looked up by qubit, and are zero for qubits without them
+  for (const auto &[qubit, readout_error] : noise_model.get_readout_errors()) {
+    EXPECT_EQ(compiled.readout_error(qubit).p_01, readout_error.p_01);
+    EXPECT_EQ(compiled.readout_error(qubit).p_10, readout_error.p_10);
+  }
+  EXPECT_EQ(compiled.readout_error(nb_qubits).p_01, 0.0);
+  EXPECT_EQ(compiled.readout_error(nb_qubits).p_10, 0.0);
+}
+
+TEST(NoiseModelTester, checkKrausMatrix) {
+  using Matrix = qristal::KrausOperator::Matrix;
+  const std::complex<double> i(0.0, 1.0);
+  const std::vector<std::vector<std::complex<double>>> rows{{0.0, -i}, {i, 0.5}};
+
+  // Matrices built from rows, nested vectors and Eigen matrices agree, and index as the nested vectors did
+  const Matrix mat{{0.0, -i}, {i, 0.5}};
+  EXPECT_EQ(mat, Matrix(rows));
+  EXPECT_EQ(mat.to_nested(), rows);
+  EXPECT_EQ(mat.size(), 2);
+  EXPECT_EQ(mat[1][0], i);
+  EXPECT_EQ(mat(0, 1), -i);
+  Eigen::MatrixXcd eigen_mat(2, 2);
+  eigen_mat << 0.0, -i, i, 0.5;
+  EXPECT_EQ(Matrix(eigen_mat), mat);
+  EXPECT_THROW(Matrix({{1.0, 0.0}}), std::invalid_argument);
+  EXPECT_THROW(mat.fixed<4>(), std::invalid_argument);
+
+  // Eigen views share the elements of the matrix
+  Matrix view_mat = mat;
+  EXPECT_EQ(view_mat.eigen(), eigen_mat);
+  EXPECT_EQ(view_mat.fixed<2>().data(), view_mat.data());
+  view_mat.fixed<2>() *= 2.0;
+  EXPECT_EQ(view_mat[1][1], 1.0);
+  EXPECT_EQ(mat[1][1], 0.5);
+
+  // Larger matrices are stored the same way
+  const Eigen::MatrixXcd big = Eigen::MatrixXcd::Random(16, 16);
+  const Matrix big_mat(big);
+  EXPECT_EQ(big_mat.eigen(), big);
+  EXPECT_EQ(big_mat[3][7], big(3, 7));
+
+  // JSON is unchanged from that of the nested vectors, and reads back
+  const nlohmann::json js = mat;
+  EXPECT_EQ(js, nlohmann::json(rows));
+  EXPECT_EQ(js.get<Matrix>(), mat);
+
+  // Factories and conversions produce the same channels as before
+  const auto channel = qristal::DepolarizingChannel::Create(0, 1, 0.1);
+  EXPECT_EQ(channel.size(), 16);
+  EXPECT_EQ(channel[0].matrix.dim(), 4);
+  EXPECT_TRUE(channel[0].matrix.fixed<4>().isApprox(std::sqrt(1.0 - 0.1 * 15.0 / 16.0) * Eigen::Matrix4cd::Identity()));
+  const auto choi = qristal::kraus_to_choi(channel);
+  EXPECT_EQ(choi.dim(), 16);
+  EXPECT_NEAR(choi.eigen().trace().real(), 4.0, 1e-12);
+}
+
 Eigen::MatrixXcd evolve_density_process(const Eigen::MatrixXcd& process_matrix, const Eigen::MatrixXcd& density) {
   size_t n_qubits = std::log2(density.rows());
   Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic> result = Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>::Zero(density.rows(), density.cols());
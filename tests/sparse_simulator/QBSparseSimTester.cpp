@@ -1,4 +1,8 @@
 // Copyright (c) Quantum Brilliance Pty Ltd
+#include <qristal/core/backends/sims/microsoft/sparse-sim/SparseSimulator.h>
+#include <qristal/core/backends/sims/microsoft/sparse-sim/flat_wavefunction.hpp>
+#include <qristal/core/backends/sims/microsoft/sparse-sim/types.h>
+#include <qristal/core/noise_model/noise_model.hpp>
 #include <CommonGates.hpp>
 #include <Optimizer.hpp>
 #include <xacc.hpp>
@@ -222,3 +226,467 @@ TEST(QBSparseSimTester, testDeuteronVqeH3Shots) {
   // EXPECT_NEAR((*buffer)["opt-val"].as<double>(), -2.04482, 0.25);
 }
 
+TEST(QBSparseSimTester, testDeuteronVqeH3ExactExpectations) {
+  // In VQE mode, the expectation value of each term is computed from the
+  // amplitudes of a single simulation of the ansatz, so the energy is exact.
+  auto accelerator = xacc::getAccelerator("sparse-sim", {{"vqe-mode", true}});
+  auto H_N_3 = xacc::quantum::getObservable(
+      "pauli",
+      std::string("5.907 - 2.1433 X0X1 - 2.1433 Y0Y1 + .21829 Z0 - 6.125 Z1 + "
+                  "9.625 - 9.625 Z2 - 3.91 X1 X2 - 3.91 Y1 Y2"));
+  auto optimizer = xacc::getOptimizer("nlopt", {{"nlopt-maxeval", 100}});
+  xacc::qasm(R"(
+        .compiler xasm
+        .circuit deuteron_ansatz_h3_exact
+        .parameters t0, t1
+        .qbit q
+        X(q[0]);
+        exp_i_theta(q, t0, {{"pauli", "X0 Y1 - Y0 X1"}});
+        exp_i_theta(q, t1, {{"pauli", "X0 Z1 Y2 - X2 Z1 Y0"}});
+    )");
+  auto ansatz = xacc::getCompiled("deuteron_ansatz_h3_exact");
+  auto vqe = xacc::getAlgorithm("vqe");
+  vqe->initialize({{"ansatz", ansatz},
+                   {"observable", H_N_3},
+                   {"accelerator", accelerator},
+                   {"optimizer", optimizer}});
+  auto buffer = xacc::qalloc(3);
+  vqe->execute(buffer);
+  EXPECT_NEAR((*buffer)["opt-val"].as<double>(), -2.04482, 1e-3);
+
+  // A single circuit gets the exact expectation value of the parity of its
+  // measured qubits
+  auto xasmCompiler = xacc::getCompiler("xasm");
+  auto ir = xasmCompiler->compile(R"(__qpu__ void ansatz_exact(qbit q, double t) {
+      X(q[0]);
+      Ry(q[1], t);
+      CX(q[1], q[0]);
+      H(q[0]);
+      H(q[1]);
+      Measure(q[0]);
+      Measure(q[1]);
+    })",
+                                  accelerator);
+  auto program = ir->getComposite("ansatz_exact");
+  for (const double angle : {-0.5, 0.3, 1.2}) {
+    auto xBuffer = xacc::qalloc(2);
+    accelerator->execute(xBuffer, program->operator()({angle}));
+    // <X0 X1> = sin(t) for this ansatz
+    EXPECT_NEAR(xBuffer->getExpectationValueZ(), std::sin(angle), 1e-9);
+  }
+}
+
+
+TEST(QBSparseSimTester, testBatchedSampling) {
+  // Shots are drawn all at once; check their total and distribution when only
+  // some qubits are measured, and in an order other than that of the qubits.
+  const int nbShots = 200000;
+  auto accelerator = xacc::getAccelerator("sparse-sim", {{"shots", nbShots}});
+  auto xasmCompiler = xacc::getCompiler("xasm");
+  auto ir = xasmCompiler->compile(R"(__qpu__ void partial(qbit q) {
+      Ry(q[0], 0.6);
+      X(q[2]);
+      H(q[3]);
+      Measure(q[2]);
+      Measure(q[0]);
+    })",
+                                  accelerator);
+
+  auto program = ir->getComposite("partial");
+  auto buffer = xacc::qalloc(4);
+  accelerator->execute(buffer, program);
+  const auto counts = buffer->getMeasurementCounts();
+  EXPECT_EQ(counts.size(), 2);
+  int total = 0;
+  for (const auto &[bitstring, count] : counts) {
+    total += count;
+  }
+  EXPECT_EQ(total, nbShots);
+  EXPECT_NEAR(buffer->computeMeasurementProbability("11"),
+              std::pow(std::sin(0.3), 2), 0.005);
+  EXPECT_NEAR(buffer->computeMeasurementProbability("10"),
+              std::pow(std::cos(0.3), 2), 0.005);
+}
+
+TEST(QBSparseSimTester, testFlatWavefunction) {
+  // The flat hash table must behave like the std::unordered_map operations
+  // used by the simulator, including keys that differ only in their high bits.
+  using namespace Microsoft::Quantum::SPARSESIMULATOR;
+  using label = std::bitset<128>;
+  flat_wavefunction<label, amplitude> wfn(4);
+  std::unordered_map<label, amplitude> reference;
+  std::mt19937 rng(7);
+  for (int i = 0; i < 20000; ++i) {
+    label key;
+    key.set(rng() % 128);
+    key.set(64 + rng() % 64);
+    const amplitude value(i, -i);
+    const bool inserted = wfn.emplace(key, value).second;
+    EXPECT_EQ(inserted, reference.emplace(key, value).second);
+  }
+  EXPECT_EQ(wfn.size(), reference.size());
+  for (const auto &[key, value] : reference) {
+    auto found = wfn.find(key);
+    ASSERT_NE(found, wfn.end());
+    EXPECT_EQ(found->second, value);
+  }
+  EXPECT_EQ(wfn.find(label()), wfn.end());
+  wfn[label()] += 2.0;
+  EXPECT_EQ(wfn.find(label())->second, amplitude(2.0));
+  size_t count = 0;
+  for (auto state = wfn.begin(); state != wfn.end(); ++state) {
+    count++;
+  }
+  EXPECT_EQ(count, reference.size() + 1);
+}
+
+TEST(QBSparseSimTester, testMultithreadedGates) {
+  // Gates on wavefunctions large enough to be split between threads must give
+  // the same amplitudes as on a single thread, whether stored sparsely or densely.
+  using namespace Microsoft::Quantum::SPARSESIMULATOR;
+  const logical_qubit_id nbQubits = 18;
+  auto run = [&](size_t nbThreads, double denseThreshold) {
+    SparseSimulator sim(nbQubits);
+    sim.set_num_threads(nbThreads);
+    sim.set_dense_threshold(denseThreshold);
+    EXPECT_EQ(sim.get_num_threads(), nbThreads);
+    std::mt19937 rng(11);
+    for (logical_qubit_id q = 0; q < nbQubits; ++q) {
+      sim.H(q);
+    }
+    for (int i = 0; i < 40; ++i) {
+      const logical_qubit_id a = rng() % nbQubits;
+      const logical_qubit_id b = (a + 1 + rng() % (nbQubits - 1)) % nbQubits;
+      switch (i % 5) {
+        case 0: sim.H(a); break;
+        case 1: sim.R(Gates::Basis::PauliY, 0.1 * i, a); break;
+        case 2: sim.MCX({a}, b); break;
+        case 3: sim.MCR({a}, Gates::Basis::PauliX, 0.2 * i, b); break;
+        case 4: sim.R(Gates::Basis::PauliZ, 0.3 * i, a); break;
+      }
+    }
+    std::map<std::string, amplitude> amplitudes;
+    sim.dump_all([&](const char *label, double re, double im) {
+      amplitudes[label] = amplitude(re, im);
+      return true;
+    });
+    return amplitudes;
+  };
+  for (const double denseThreshold : {0.0, 0.125}) {
+    const auto serial = run(1, denseThreshold);
+    const auto parallel = run(4, denseThreshold);
+    EXPECT_GT(serial.size(), size_t(1) << 14);
+    ASSERT_EQ(serial.size(), parallel.size());
+    for (const auto &[label, value] : serial) {
+      auto found = parallel.find(label);
+      ASSERT_NE(found, parallel.end());
+      EXPECT_NEAR(std::abs(found->second - value), 0.0, 1e-12);
+    }
+  }
+}
+
+TEST(QBSparseSimTester, testSingleQubitGateFusion) {
+  // Runs of single-qubit gates are fused into one gate; compare with applying
+  // every gate as soon as it is queued, up to a global phase.
+  using namespace Microsoft::Quantum::SPARSESIMULATOR;
+  const logical_qubit_id nbQubits = 4;
+  SparseSimulator fused(nbQubits), unfused(nbQubits);
+  std::mt19937 rng(5);
+  for (int i = 0; i < 400; ++i) {
+    const logical_qubit_id q = rng() % nbQubits;
+    const logical_qubit_id c = (q + 1 + rng() % (nbQubits - 1)) % nbQubits;
+    const double angle = 0.01 * (rng() % 700);
+    const bool entangle = rng() % 3 == 0;
+    for (SparseSimulator *sim : {&fused, &unfused}) {
+      switch (i % 9) {
+        case 0: sim->H(q); break;
+        case 1: sim->T(q); break;
+        case 2: sim->R(Gates::Basis::PauliX, angle, q); break;
+        case 3: sim->R(Gates::Basis::PauliY, angle, q); break;
+        case 4: sim->R(Gates::Basis::PauliZ, angle, q); break;
+        case 5: sim->Unitary({std::cos(angle), -std::sin(angle) * std::exp(0.3i),
+                              std::sin(angle), std::cos(angle) * std::exp(0.3i)}, q); break;
+        case 6: sim->S(q); break;
+        case 7: sim->X(q); break;
+        case 8: if (entangle) sim->MCX({c}, q); break;
+      }
+    }
+    unfused.update_state();
+  }
+  std::map<std::string, amplitude> expected;
+  unfused.dump_all([&](const char *label, double re, double im) {
+    expected[label] = amplitude(re, im);
+    return true;
+  });
+  amplitude overlap = 0;
+  fused.dump_all([&](const char *label, double re, double im) {
+    overlap += std::conj(expected[label]) * amplitude(re, im);
+    return true;
+  });
+  EXPECT_NEAR(std::abs(overlap), 1.0, 1e-9);
+}
+
+TEST(QBSparseSimTester, testControlledUnitaries) {
+  // Arbitrary 2x2 and 4x4 unitaries, with and without controls, compared with
+  // the equivalent native gates, including the global phase.
+  using namespace Microsoft::Quantum::SPARSESIMULATOR;
+  const logical_qubit_id nbQubits = 6;
+  const double r = 1.0 / std::sqrt(2.0);
+  const std::vector<logical_qubit_id> controls{0, 4};
+  SparseSimulator unitaries(nbQubits), gates(nbQubits);
+  for (SparseSimulator *sim : {&unitaries, &gates}) {
+    for (logical_qubit_id q = 0; q < nbQubits; ++q) {
+      sim->R(Gates::Basis::PauliY, 0.3 + 0.4 * q, q);
+      sim->T(q);
+    }
+    sim->MCX({0}, 3);
+  }
+  unitaries.MCUnitary(controls, {r, r, r, -r}, 2);
+  gates.MCH(controls, 2);
+  unitaries.MCUnitary(controls, {0, 1i, 1i, 0}, 5);
+  gates.MCR(controls, Gates::Basis::PauliX, -M_PI, 5);
+  unitaries.MCUnitary(controls, {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0}, 1, 3);
+  gates.MCX({0, 4, 1}, 3);
+  // iSwap
+  unitaries.Unitary({1, 0, 0, 0, 0, 0, 1i, 0, 0, 1i, 0, 0, 0, 0, 0, 1}, 2, 5);
+  gates.S(2);
+  gates.S(5);
+  gates.H(2);
+  gates.MCX({2}, 5);
+  gates.MCX({5}, 2);
+  gates.H(5);
+
+  std::map<std::string, amplitude> expected;
+  gates.dump_all([&](const char *label, double re, double im) {
+    expected[label] = amplitude(re, im);
+    return true;
+  });
+  amplitude overlap = 0;
+  unitaries.dump_all([&](const char *label, double re, double im) {
+    overlap += std::conj(expected[label]) * amplitude(re, im);
+    return true;
+  });
+  EXPECT_NEAR(overlap.real(), 1.0, 1e-9);
+  EXPECT_NEAR(overlap.imag(), 0.0, 1e-9);
+}
+
+TEST(QBSparseSimTester, testControlledCompositeNativeSim) {
+  // A controlled block with several gates, including a nested controlled block
+  // and an iSwap, is simulated natively rather than through its decomposition.
+  auto gateRegistry = xacc::getService<xacc::IRProvider>("quantum");
+  auto inner = gateRegistry->createComposite("__COMPOSITE__INNER_X");
+  inner->addInstruction(gateRegistry->createInstruction("X", {2}));
+  auto innerControlled = std::dynamic_pointer_cast<xacc::CompositeInstruction>(
+      xacc::getService<xacc::Instruction>("C-U"));
+  innerControlled->expand({{"U", inner}, {"control-idx", std::vector<int>{1}}});
+
+  auto body = gateRegistry->createComposite("__COMPOSITE__BODY");
+  body->addInstruction(gateRegistry->createInstruction("X", {0}));
+  body->addInstruction(gateRegistry->createInstruction("CNOT", {0, 1}));
+  body->addInstruction(innerControlled);
+  body->addInstruction(gateRegistry->createInstruction("iSwap", {2, 3}));
+  auto controlled = std::dynamic_pointer_cast<xacc::CompositeInstruction>(
+      xacc::getService<xacc::Instruction>("C-U"));
+  const std::vector<int> ctrl_idxs{4, 5, 6, 7, 8, 9, 10, 11};
+  const size_t nQubits = 12;
+  controlled->expand({{"U", body}, {"control-idx", ctrl_idxs}});
+
+  auto acc = xacc::getAccelerator("sparse-sim", {{"shots", 100}});
+  for (const bool controlsSet : {true, false}) {
+    auto composite = gateRegistry->createComposite(
+        "__TEMP_COMPOSITE__CONTROLLED_BODY_" + std::to_string(controlsSet));
+    for (const int idx : ctrl_idxs) {
+      if (controlsSet || idx != ctrl_idxs.back()) {
+        composite->addInstruction(gateRegistry->createInstruction("X", {size_t(idx)}));
+      }
+    }
+    composite->addInstruction(controlled);
+    for (size_t i = 0; i < nQubits; ++i) {
+      composite->addInstruction(gateRegistry->createInstruction("Measure", {i}));
+    }
+    auto buffer = xacc::qalloc(nQubits);
+    acc->execute(buffer, composite);
+    // X sets q0, the CNOT then sets q1, the nested block sets q2, and the
+    // iSwap moves it to q3
+    const std::string expected = controlsSet ? "110111111111" : "000011111110";
+    EXPECT_NEAR(buffer->computeMeasurementProbability(expected), 1.0, 1e-9);
+  }
+}
+
+TEST(QBSparseSimTester, testHybridDenseStorage) {
+  // A wavefunction that fills up is moved to a dense array, and back to a hash
+  // map once it is uncomputed, giving the same amplitudes as if it had stayed
+  // sparse throughout.
+  using namespace Microsoft::Quantum::SPARSESIMULATOR;
+  const logical_qubit_id nbQubits = 14;
+  SparseSimulator hybrid(nbQubits), sparse(nbQubits);
+  sparse.set_dense_threshold(0);
+  for (SparseSimulator *sim : {&hybrid, &sparse}) {
+    for (logical_qubit_id q = 0; q < nbQubits; ++q) {
+      sim->H(q);
+    }
+    sim->update_state();
+  }
+  EXPECT_TRUE(hybrid.is_dense());
+  EXPECT_FALSE(sparse.is_dense());
+  EXPECT_EQ(hybrid.get_dense_conversions(), 1);
+
+  std::mt19937 rng(3);
+  for (int i = 0; i < 60; ++i) {
+    const logical_qubit_id a = rng() % nbQubits;
+    const logical_qubit_id b = (a + 1 + rng() % (nbQubits - 1)) % nbQubits;
+    const double angle = 0.01 * (rng() % 700);
+    for (SparseSimulator *sim : {&hybrid, &sparse}) {
+      switch (i % 6) {
+        case 0: sim->R(Gates::Basis::PauliY, angle, a); break;
+        case 1: sim->MCX({a}, b); break;
+        case 2: sim->T(a); break;
+        case 3: sim->MCR({a}, Gates::Basis::PauliX, angle, b); break;
+        case 4: sim->Unitary({1, 0, 0, 0, 0, 0, 1i, 0, 0, 1i, 0, 0, 0, 0, 0, 1}, a, b); break;
+        case 5: sim->SWAP(a, b); break;
+      }
+    }
+  }
+  std::map<std::string, amplitude> expected;
+  sparse.dump_all([&](const char *label, double re, double im) {
+    expected[label] = amplitude(re, im);
+    return true;
+  });
+  amplitude overlap = 0;
+  hybrid.dump_all([&](const char *label, double re, double im) {
+    overlap += std::conj(expected[label]) * amplitude(re, im);
+    return true;
+  });
+  EXPECT_NEAR(std::abs(overlap - 1.0), 0.0, 1e-6);
+
+  // Uncompute the Hadamards on a fresh dense state
+  SparseSimulator uncompute(nbQubits);
+  for (int layer = 0; layer < 2; ++layer) {
+    for (logical_qubit_id q = 0; q < nbQubits; ++q) {
+      uncompute.H(q);
+    }
+    uncompute.update_state();
+  }
+  EXPECT_FALSE(uncompute.is_dense());
+  EXPECT_EQ(uncompute.get_dense_conversions(), 1);
+  EXPECT_EQ(uncompute.get_sparse_conversions(), 1);
+  EXPECT_NEAR(std::abs(uncompute.probe(std::string(nbQubits, '0'))), 1.0, 1e-9);
+
+  // Sampling a dense state draws from its amplitudes without converting it
+  SparseSimulator sampled(nbQubits);
+  for (logical_qubit_id q = 0; q < nbQubits; ++q) {
+    sampled.H(q);
+  }
+  sampled.X(nbQubits - 1);
+  sampled.update_state();
+  ASSERT_TRUE(sampled.is_dense());
+  const size_t nbSamples = 40000;
+  const auto counts = sampled.SampleCounts(nbSamples, {0, 1});
+  EXPECT_TRUE(sampled.is_dense());
+  EXPECT_EQ(sampled.get_sparse_conversions(), 0);
+  EXPECT_EQ(counts.size(), 4);
+  size_t total = 0;
+  for (const auto &[outcome, count] : counts) {
+    total += count;
+    EXPECT_NEAR(double(count) / nbSamples, 0.25, 0.02);
+  }
+  EXPECT_EQ(total, nbSamples);
+}
+
+TEST(QBSparseSimTester, testPauliExpectations) {
+  // Expectation values of Pauli strings computed directly from the amplitudes
+  // match those from the probability of measuring them, for sparse and dense
+  // states alike.
+  using namespace Microsoft::Quantum::SPARSESIMULATOR;
+  const logical_qubit_id nbQubits = 14;
+  const Gates::Basis paulis[3] = {Gates::Basis::PauliX, Gates::Basis::PauliY,
+                                  Gates::Basis::PauliZ};
+  std::mt19937 rng(5);
+  for (const double denseThreshold : {0.0, 0.125}) {
+    SparseSimulator sim(nbQubits);
+    sim.set_dense_threshold(denseThreshold);
+    sim.X(nbQubits - 1);
+    for (logical_qubit_id q = 0; q < nbQubits - 2; ++q) {
+      sim.H(q);
+    }
+    for (int i = 0; i < 40; ++i) {
+      const logical_qubit_id a = rng() % (nbQubits - 2);
+      const logical_qubit_id b = (a + 1) % (nbQubits - 2);
+      sim.R(Gates::Basis::PauliY, 0.01 * (rng() % 700), a);
+      sim.MCX({a}, b);
+      sim.T(b);
+    }
+    sim.update_state();
+    EXPECT_EQ(sim.is_dense(), denseThreshold > 0);
+
+    std::vector<pauli_term> terms;
+    for (int t = 0; t < 30; ++t) {
+      pauli_term term{0.1 * (t + 1), {}, {}};
+      for (logical_qubit_id q = 0; q < nbQubits; ++q) {
+        if (rng() % 4 == 0) {
+          // Every third term is made only of Zs
+          term.axes.push_back(t % 3 ? paulis[rng() % 3] : Gates::Basis::PauliZ);
+          term.qubits.push_back(q);
+        }
+      }
+      terms.push_back(term);
+    }
+    const std::vector<double> values = sim.PauliExpectations(terms);
+    const double sum = sim.PauliExpectation(terms);
+    ASSERT_EQ(values.size(), terms.size());
+    double expectedSum = 0.0;
+    for (size_t t = 0; t < terms.size(); ++t) {
+      const double expected =
+          terms[t].coefficient *
+          (1.0 - 2.0 * sim.MeasurementProbability(terms[t].axes, terms[t].qubits));
+      EXPECT_NEAR(values[t], expected, 1e-6);
+      expectedSum += expected;
+    }
+    EXPECT_NEAR(sum, expectedSum, 1e-6);
+  }
+}
+
+TEST(QBSparseSimTester, testNoisyTrajectories) {
+  // Amplitude damping after X on q[0], which the noise model's QObj compiler
+  // transpiles to u3, leaves it in |1> with probability 1 - gamma, and a
+  // readout error reads q[1] as 1 with probability p_10.
+  // The same seed gives the same counts, however the trajectories are run.
+  const int nbShots = 20000;
+  const double gamma = 0.3;
+  auto noiseModel = std::make_shared<qristal::NoiseModel>();
+  noiseModel->add_gate_error(qristal::AmplitudeDampingChannel::Create(0, gamma),
+                             "u3", {0});
+  noiseModel->set_qubit_readout_error(1, {0.0, 0.1});
+  auto xasmCompiler = xacc::getCompiler("xasm");
+  auto ir = xasmCompiler->compile(R"(__qpu__ void damped(qbit q) {
+      X(q[0]);
+      Measure(q[0]);
+      Measure(q[1]);
+    })");
+  auto program = ir->getComposite("damped");
+
+  for (const int trajectories : {0, 500}) {
+    auto accelerator = xacc::getAccelerator(
+        "sparse-sim", {{"shots", nbShots},
+                       {"noise-model", noiseModel},
+                       {"trajectories", trajectories},
+                       {"seed", 7}});
+    auto buffer = xacc::qalloc(2);
+    accelerator->execute(buffer, program);
+    const auto counts = buffer->getMeasurementCounts();
+    int total = 0;
+    double q0 = 0.0, q1 = 0.0;
+    for (const auto &[bitstring, count] : counts) {
+      total += count;
+      q0 += (bitstring[0] == '1') * count;
+      q1 += (bitstring[1] == '1') * count;
+    }
+    EXPECT_EQ(total, nbShots);
+    EXPECT_NEAR(q0 / nbShots, 1.0 - gamma, 0.02);
+    EXPECT_NEAR(q1 / nbShots, 0.1, 0.01);
+
+    auto repeat = xacc::qalloc(2);
+    accelerator->execute(repeat, program);
+    EXPECT_EQ(repeat->getMeasurementCounts(), counts);
+  }
+}
@@ -9,6 +9,11 @@
 #include <future>
 #include <chrono>
 #include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 // range v3
 #include <range/v3/view/zip.hpp>
@@ -107,3 +112,147 @@ TEST(TestAsyncCircuitExecution, HundredSessionsTenThreads) {
   std::cout << "\nEnd! " << std::endl;
   ASSERT_TRUE(std::all_of(results.cbegin(), results.cend(), [](std::string r){ return not r.empty(); }));
 }
+
+
+TEST(TestAsyncCircuitExecution, ThreadPoolResizeAndNestedSubmit) {
+
+  // Resize the pool up and down while tasks are in flight, and make sure that every task still gets run.
+  constexpr size_t n_tasks = 2000;
+  std::atomic<size_t> ran{0};
+  std::vector<std::future<size_t>> futures;
+  for (int threads : {2, 7, 1, 4}) {
+    qristal::thread_pool::set_num_threads(threads);
+    EXPECT_EQ(qristal::thread_pool::get_num_threads(), threads);
+    for (size_t i = 0; i < n_tasks/4; i++) {
+      // Each task also submits a child task from inside the pool. The child's future is not waited on, as blocking
+      // a worker on another task is only safe if there is a spare worker to run it.
+      futures.push_back(qristal::thread_pool::submit([&ran, i] {
+        qristal::thread_pool::submit([&ran] { ran++; return true; });
+        return i;
+      }));
+    }
+  }
+  size_t sum = 0;
+  for (auto& f : futures) sum += f.get();
+  EXPECT_EQ(sum, 4 * (n_tasks/4) * (n_tasks/4 - 1) / 2);
+
+  // Wait for the child tasks to finish too.
+  while (ran < n_tasks) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_EQ(ran, n_tasks);
+}
+
+
+TEST(TestAsyncCircuitExecution, ThreadPoolExceptionPropagation) {
+
+  // An exception thrown by a task must reach the caller through the future, and must not take down the worker.
+  auto f = qristal::thread_pool::submit([]() -> int { throw std::runtime_error("task failed"); });
+  EXPECT_THROW(f.get(), std::runtime_error);
+  EXPECT_EQ(qristal::thread_pool::submit([] { return 42; }).get(), 42);
+  EXPECT_THROW(qristal::thread_pool::set_num_threads(0), std::invalid_argument);
+}
+
+
+TEST(TestAsyncCircuitExecution, ThreadPoolParallelFor) {
+
+  qristal::thread_pool::set_num_threads(4);
+
+  // Every index must be visited exactly once, whatever the grain.
+  for (size_t grain : {0, 1, 7, 1000, 100000}) {
+    constexpr size_t n = 10000;
+    std::vector<std::atomic<int>> visits(n);
+    qristal::thread_pool::parallel_for(0, n, grain, [&](size_t i) { visits[i]++; });
+    EXPECT_TRUE(std::all_of(visits.begin(), visits.end(), [](const auto& v) { return v == 1; }));
+  }
+
+  // Empty ranges are fine.
+  qristal::thread_pool::parallel_for(5, 5, 0, [](size_t) { FAIL(); });
+
+  // Nested parallel_for calls from inside the pool must not deadlock, even with more outer tasks than threads.
+  std::atomic<size_t> total{0};
+  qristal::thread_pool::parallel_for(0, 16, 1, [&](size_t) {
+    qristal::thread_pool::parallel_for(0, 100, 10, [&](size_t i) { total += i; });
+  });
+  EXPECT_EQ(total, 16 * 4950);
+}
+
+
+TEST(TestAsyncCircuitExecution, ThreadPoolTaskGroup) {
+
+  qristal::thread_pool::set_num_threads(4);
+
+  // One handle for many tasks
+  std::atomic<int> count{0};
+  qristal::task_group group;
+  for (int i = 0; i < 1000; i++) group.run([&] { count++; });
+  group.parallel_for(0, 1000, 0, [&](size_t) { count++; });
+  group.wait();
+  EXPECT_EQ(count, 2000);
+
+  // The first exception is rethrown by wait(), and cancels the chunks that have not started yet.
+  std::atomic<size_t> visited{0};
+  group.parallel_for(0, 100000, 1, [&](size_t i) {
+    visited++;
+    if (i == 10) throw std::runtime_error("chunk failed");
+  });
+  EXPECT_THROW(group.wait(), std::runtime_error);
+  EXPECT_LT(visited, 100000);
+
+  // After wait() the group can be reused; cancelled tasks are skipped.
+  count = 0;
+  std::promise<void> gate;
+  std::shared_future<void> opened = gate.get_future().share();
+  group.run([opened] { opened.wait(); });
+  group.cancel();
+  for (int i = 0; i < 100; i++) group.run([&] { count++; });
+  EXPECT_TRUE(group.is_cancelled());
+  gate.set_value();
+  group.wait();
+  EXPECT_EQ(count, 0);
+  EXPECT_FALSE(group.is_cancelled());
+}
+
+
+TEST(TestAsyncCircuitExecution, IndependentSessionThroughput) {
+
+  // Independent sessions on a backend that hands out private accelerator instances must not wait for each other, so
+  // running them on several threads should be close to proportionally faster than running them on one. The speedup
+  // depends on the load of the test machine, so it is only reported; the runs themselves must all succeed.
+  const size_t threads = std::min<size_t>(4, std::thread::hardware_concurrency());
+  if (threads < 2) GTEST_SKIP() << "Throughput scaling needs at least two hardware threads.";
+  constexpr size_t n_jobs = 48;
+  constexpr size_t n_qubits = 14;
+
+  std::ostringstream circuit;
+  circuit << "OPENQASM 2.0;\ninclude \"qelib1.inc\";\nqreg q[" << n_qubits << "];\ncreg c[" << n_qubits << "];\n";
+  for (size_t layer = 0; layer < 6; layer++) {
+    for (size_t q = 0; q < n_qubits; q++) circuit << "ry(" << 0.1 * (layer + q + 1) << ") q[" << q << "];\n";
+    for (size_t q = 0; q + 1 < n_qubits; q++) circuit << "cx q[" << q << "],q[" << q + 1 << "];\n";
+  }
+  circuit << "measure q -> c;\n";
+
+  auto time_jobs = [&](size_t n_threads) {
+    qristal::thread_pool::set_num_threads(n_threads);
+    std::vector<qristal::session> sims(n_jobs);
+    for (auto& s : sims) {
+      s.acc = "sparse-sim";
+      s.qn = n_qubits;
+      s.sn = 1000;
+      s.noplacement = true;
+      s.instring = circuit.str();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<std::string>> futures;
+    for (auto& s : sims) futures.push_back(qristal::thread_pool::submit(run_async_internal, std::ref(s)));
+    for (auto& f : futures) EXPECT_FALSE(f.get().empty());
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (const auto& s : sims) EXPECT_EQ(s.results_packed().total(), 1000);
+    return elapsed;
+  };
+
+  // Warm up the service registry and the compiled IR cache before timing anything.
+  time_jobs(threads);
+  const double serial_s = time_jobs(1);
+  const double parallel_s = time_jobs(threads);
+  const double speedup = serial_s / parallel_s;
+  std::cout << "Speedup of " << n_jobs << " independent runs on " << threads << " threads: " << speedup << "x" << std::endl;
+}